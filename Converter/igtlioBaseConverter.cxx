@@ -1,5 +1,34 @@
 #include "igtlioBaseConverter.h"
 
+#include <igtl_util.h>
+
+namespace // unnamed namespace
+{
+
+// Offsets in igtl_header
+const int VersionOffset = 0;
+const int CRCOffset = 50;
+const int ExtendedHeaderMinimumSize = 12;
+
+//---------------------------------------------------------------------------
+// Network byte order accessors
+igtlUint16 Get16(const unsigned char* p)
+{
+  return static_cast<igtlUint16>((p[0] << 8) | p[1]);
+}
+
+igtlUint32 Get32(const unsigned char* p)
+{
+  return (static_cast<igtlUint32>(p[0]) << 24) | (static_cast<igtlUint32>(p[1]) << 16)
+    | (static_cast<igtlUint32>(p[2]) << 8) | p[3];
+}
+
+igtlUint64 Get64(const unsigned char* p)
+{
+  return (static_cast<igtlUint64>(Get32(p)) << 32) | Get32(p + 4);
+}
+
+} // unnamed namespace
 
 namespace igtlio
 {
@@ -22,11 +51,45 @@ int BaseConverter::HeadertoIGTL(const BaseConverter::HeaderData &header, igtl::M
 
   int BaseConverter::IGTLToTimestamp(igtl::MessageBase::Pointer msg, HeaderData *dest)
 {
-  // Save OpenIGTLink time stamp
-  igtl::TimeStamp::Pointer ts = igtl::TimeStamp::New();
-  msg->GetTimeStamp(ts);
-  dest->timestamp = ts->GetTimeStamp();
+  // Save OpenIGTLink time stamp, as igtl::TimeStamp::GetTimeStamp() would
+  // give it, without allocating one for each message.
+  unsigned int sec = 0;
+  unsigned int frac = 0;
+  msg->GetTimeStamp(&sec, &frac);
+  dest->timestamp = sec + igtl_frac_to_nanosec(frac) / 1e9;
   return 1;
 }
 
+//---------------------------------------------------------------------------
+const unsigned char* BaseConverter::GetPackContent(igtl::MessageBase* source, bool checkCRC, igtlUint64* contentSize)
+{
+  const unsigned char* pack = static_cast<const unsigned char*>(source->GetPackPointer());
+  const unsigned char* body = static_cast<const unsigned char*>(source->GetPackBodyPointer());
+  igtlUint64 bodySize = source->GetPackBodySize();
+  if (!pack || !body)
+    {
+    return NULL;
+    }
+
+  if (checkCRC && crc64(const_cast<unsigned char*>(body), bodySize, crc64(0, 0, 0)) != Get64(pack + CRCOffset))
+    {
+    return NULL;
+    }
+
+  // Version 2 headers: extended header, content, then meta data.
+  *contentSize = bodySize;
+  if (Get16(pack + VersionOffset) < 2)
+    {
+    return body;
+    }
+  if (bodySize < ExtendedHeaderMinimumSize)
+    return NULL;
+  igtlUint64 extendedHeaderSize = Get16(body);
+  igtlUint64 metaDataSize = Get16(body + 2) + static_cast<igtlUint64>(Get32(body + 4));
+  if (extendedHeaderSize < ExtendedHeaderMinimumSize || extendedHeaderSize + metaDataSize > bodySize)
+    return NULL;
+  *contentSize = bodySize - extendedHeaderSize - metaDataSize;
+  return body + extendedHeaderSize;
+}
+
 } // namespace igtlio
@@ -45,6 +45,12 @@ public:
 
   static int IGTLToTimestamp(igtl::MessageBase::Pointer msg, HeaderData *dest);
 
+protected:
+  /// Content of the body of a message as received, whatever its class:
+  /// after the extended header and before the meta data of version 2
+  /// messages. NULL if the body is missing, fails the CRC check if asked,
+  /// or is malformed.
+  static const unsigned char* GetPackContent(igtl::MessageBase* source, bool checkCRC, igtlUint64* contentSize);
 };
 
 } // namespace igtlio
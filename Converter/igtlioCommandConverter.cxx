@@ -20,10 +20,14 @@ int CommandConverter::fromIGTL(igtl::MessageBase::Pointer source,
                              ContentData* dest,
                              bool checkCRC)
 {
-  // Create a message buffer to receive  data
-  igtl::CommandMessage::Pointer msg;
-  msg = igtl::CommandMessage::New();
-  msg->Copy(source); // !! TODO: copy makes performance issue.
+  // Unpack in place if the message was received as the concrete type,
+  // otherwise copy into a new message buffer.
+  igtl::CommandMessage::Pointer msg = dynamic_pointer_cast<igtl::CommandMessage>(source);
+  if (msg.IsNull())
+    {
+    msg = igtl::CommandMessage::New();
+    msg->Copy(source);
+    }
 
   // Deserialize the data
   // If CheckCRC==0, CRC check is skipped.
@@ -53,10 +57,14 @@ int CommandConverter::fromIGTLResponse(igtl::MessageBase::Pointer source,
 {
   //TODO: merge this method with fromIGTL(),
 
-  // Create a message buffer to receive  data
-  igtl::RTSCommandMessage::Pointer msg;
-  msg = igtl::RTSCommandMessage::New();
-  msg->Copy(source); // !! TODO: copy makes performance issue.
+  // Unpack in place if the message was received as the concrete type,
+  // otherwise copy into a new message buffer.
+  igtl::RTSCommandMessage::Pointer msg = dynamic_pointer_cast<igtl::RTSCommandMessage>(source);
+  if (msg.IsNull())
+    {
+    msg = igtl::RTSCommandMessage::New();
+    msg->Copy(source);
+    }
 
   // Deserialize the data
   // If CheckCRC==0, CRC check is skipped.
@@ -0,0 +1,474 @@
+#include "igtlioImageCompressor.h"
+
+#include <igtl_header.h>
+#include <igtl_util.h>
+
+#include <vtkDataCompressor.h>
+#include <vtkMultiThreader.h>
+#include <vtkSmartPointer.h>
+#include <vtkVersion.h>
+#include <vtkZLibDataCompressor.h>
+#if VTK_MAJOR_VERSION > 8 || (VTK_MAJOR_VERSION == 8 && VTK_MINOR_VERSION >= 1)
+#define IGTLIO_IMAGECOMPRESSOR_LZ4
+#include <vtkLZ4DataCompressor.h>
+#endif
+
+#include <algorithm>
+#include <string.h>
+
+namespace // unnamed namespace
+{
+
+const igtlUint16 FormatVersion = 1;
+const igtlUint64 FormatHeaderSize = 32;
+const igtlUint32 StoredBlock = 0x80000000u;
+
+// Offsets in igtl_header
+const int TypeOffset = 2;
+const int BodySizeOffset = 42;
+const int CRCOffset = 50;
+
+unsigned int BlockSize = 1024*1024;
+
+//---------------------------------------------------------------------------
+// Network byte order accessors
+//---------------------------------------------------------------------------
+void Put16(unsigned char* p, igtlUint16 v)
+{
+  p[0] = static_cast<unsigned char>(v >> 8);
+  p[1] = static_cast<unsigned char>(v);
+}
+
+void Put32(unsigned char* p, igtlUint32 v)
+{
+  for (int i=3; i>=0; --i, v >>= 8)
+    p[i] = static_cast<unsigned char>(v);
+}
+
+void Put64(unsigned char* p, igtlUint64 v)
+{
+  for (int i=7; i>=0; --i, v >>= 8)
+    p[i] = static_cast<unsigned char>(v);
+}
+
+igtlUint16 Get16(const unsigned char* p)
+{
+  return static_cast<igtlUint16>((p[0] << 8) | p[1]);
+}
+
+igtlUint32 Get32(const unsigned char* p)
+{
+  igtlUint32 v = 0;
+  for (int i=0; i<4; ++i)
+    v = (v << 8) | p[i];
+  return v;
+}
+
+igtlUint64 Get64(const unsigned char* p)
+{
+  igtlUint64 v = 0;
+  for (int i=0; i<8; ++i)
+    v = (v << 8) | p[i];
+  return v;
+}
+
+//---------------------------------------------------------------------------
+void SetType(unsigned char* header, const char* type)
+{
+  memset(header + TypeOffset, 0, IGTL_HEADER_TYPE_SIZE);
+  strncpy(reinterpret_cast<char*>(header) + TypeOffset, type, IGTL_HEADER_TYPE_SIZE);
+}
+
+//---------------------------------------------------------------------------
+vtkSmartPointer<vtkDataCompressor> CreateCompressor(int codec)
+{
+  vtkSmartPointer<vtkDataCompressor> compressor;
+  if (codec == igtlio::ImageCompressor::CODEC_ZLIB)
+    {
+    vtkSmartPointer<vtkZLibDataCompressor> zlib = vtkSmartPointer<vtkZLibDataCompressor>::New();
+    // Higher levels gain little on images, for several times the time.
+    zlib->SetCompressionLevel(1);
+    compressor = zlib;
+    }
+#ifdef IGTLIO_IMAGECOMPRESSOR_LZ4
+  else if (codec == igtlio::ImageCompressor::CODEC_LZ4)
+    {
+    compressor = vtkSmartPointer<vtkLZ4DataCompressor>::New();
+    }
+#endif
+  return compressor;
+}
+
+//---------------------------------------------------------------------------
+// Blocks are processed in parallel, thread i taking blocks i, i+n, ...
+//---------------------------------------------------------------------------
+struct BlockJob
+{
+  int Codec;
+  bool Decompress;
+  igtlUint64 Size;      // uncompressed
+  igtlUint64 BlockSize;
+  int NumberOfBlocks;
+  int NumberOfThreads;
+
+  // Compression input: the body of the pack, then the pixels.
+  const unsigned char* Segments[2];
+  igtlUint64 SegmentSizes[2];
+  // Compression output, decompression input
+  std::vector< std::vector<unsigned char> > Blocks;
+  std::vector<igtlUint32> BlockSizes;
+  const unsigned char* Compressed;
+  std::vector<igtlUint64> Offsets;
+  // Decompression output
+  unsigned char* Body;
+
+  std::vector<char> Failed; // per thread
+};
+
+//---------------------------------------------------------------------------
+// Uncompressed bytes of the block, gathered in scratch if they straddle
+// the pack and the pixels.
+const unsigned char* GetBlockInput(const BlockJob* job, igtlUint64 begin, igtlUint64 size,
+                                   std::vector<unsigned char>& scratch)
+{
+  if (begin + size <= job->SegmentSizes[0])
+    {
+    return job->Segments[0] + begin;
+    }
+  if (begin >= job->SegmentSizes[0])
+    {
+    return job->Segments[1] + (begin - job->SegmentSizes[0]);
+    }
+  igtlUint64 first = job->SegmentSizes[0] - begin;
+  scratch.resize(size);
+  memcpy(&scratch[0], job->Segments[0] + begin, first);
+  memcpy(&scratch[first], job->Segments[1], size - first);
+  return &scratch[0];
+}
+
+//---------------------------------------------------------------------------
+bool CompressBlock(BlockJob* job, vtkDataCompressor* compressor, int block, std::vector<unsigned char>& scratch)
+{
+  igtlUint64 begin = static_cast<igtlUint64>(block)*job->BlockSize;
+  igtlUint64 size = std::min(job->BlockSize, job->Size - begin);
+  const unsigned char* input = GetBlockInput(job, begin, size, scratch);
+
+  std::vector<unsigned char>& output = job->Blocks[block];
+  size_t space = compressor->GetMaximumCompressionSpace(size);
+  output.resize(space);
+  size_t compressedSize = compressor->Compress(input, size, &output[0], space);
+  if (compressedSize == 0 || compressedSize >= size)
+    {
+    // Incompressible, noise for instance
+    output.assign(input, input + size);
+    job->BlockSizes[block] = static_cast<igtlUint32>(size) | StoredBlock;
+    return true;
+    }
+  output.resize(compressedSize);
+  job->BlockSizes[block] = static_cast<igtlUint32>(compressedSize);
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool DecompressBlock(BlockJob* job, vtkDataCompressor* compressor, int block)
+{
+  igtlUint64 begin = static_cast<igtlUint64>(block)*job->BlockSize;
+  igtlUint64 size = std::min(job->BlockSize, job->Size - begin);
+  const unsigned char* input = job->Compressed + job->Offsets[block];
+  igtlUint32 compressedSize = job->BlockSizes[block] & ~StoredBlock;
+
+  if (job->BlockSizes[block] & StoredBlock)
+    {
+    if (compressedSize != size)
+      return false;
+    memcpy(job->Body + begin, input, size);
+    return true;
+    }
+  return compressor->Uncompress(input, compressedSize, job->Body + begin, size) == size;
+}
+
+//---------------------------------------------------------------------------
+void ProcessBlocks(BlockJob* job, int thread)
+{
+  vtkSmartPointer<vtkDataCompressor> compressor = CreateCompressor(job->Codec);
+  std::vector<unsigned char> scratch;
+  for (int block=thread; block<job->NumberOfBlocks; block+=job->NumberOfThreads)
+    {
+    bool ok = job->Decompress ? DecompressBlock(job, compressor, block)
+                              : CompressBlock(job, compressor, block, scratch);
+    if (!ok)
+      {
+      job->Failed[thread] = 1;
+      return;
+      }
+    }
+}
+
+void* BlockThread(void* ptr)
+{
+  vtkMultiThreader::ThreadInfo* info = static_cast<vtkMultiThreader::ThreadInfo*>(ptr);
+  ProcessBlocks(static_cast<BlockJob*>(info->UserData), info->ThreadID);
+  return NULL;
+}
+
+//---------------------------------------------------------------------------
+bool Execute(BlockJob* job, int numberOfThreads)
+{
+  if (numberOfThreads <= 0)
+    {
+    numberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+    }
+  // vtkMultiThreader runs at most VTK_MAX_THREADS: the blocks must match.
+  numberOfThreads = std::min(numberOfThreads, static_cast<int>(VTK_MAX_THREADS));
+  numberOfThreads = std::max(1, std::min(numberOfThreads, job->NumberOfBlocks));
+  job->NumberOfThreads = numberOfThreads;
+  job->Failed.assign(numberOfThreads, 0);
+
+  if (numberOfThreads == 1)
+    {
+    ProcessBlocks(job, 0);
+    }
+  else
+    {
+    vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+    threader->SetNumberOfThreads(numberOfThreads);
+    threader->SetSingleMethod((vtkThreadFunctionType)&BlockThread, job);
+    threader->SingleMethodExecute();
+    }
+
+  for (int i=0; i<numberOfThreads; ++i)
+    {
+    if (job->Failed[i])
+      return false;
+    }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+// Parse the ZIMAGE body into job, false if it is not valid.
+bool ReadFormat(igtl::MessageBase* compressed, BlockJob* job, igtlUint64* crc)
+{
+  igtlUint64 bodySize = compressed->GetPackBodySize();
+  const unsigned char* body = static_cast<const unsigned char*>(compressed->GetPackBodyPointer());
+  if (bodySize < FormatHeaderSize || Get16(body) != FormatVersion)
+    return false;
+
+  job->Codec = Get16(body + 2);
+  job->BlockSize = Get32(body + 4);
+  job->Size = Get64(body + 8);
+  *crc = Get64(body + 16);
+  igtlUint32 numberOfBlocks = Get32(body + 24);
+  if (job->Codec == igtlio::ImageCompressor::CODEC_NONE || job->Codec == igtlio::ImageCompressor::CODEC_AUTO
+      || !igtlio::ImageCompressor::IsCodecSupported(job->Codec) || job->BlockSize == 0
+      || numberOfBlocks != (job->Size + job->BlockSize - 1) / job->BlockSize
+      || (bodySize - FormatHeaderSize) / 4 < numberOfBlocks)
+    return false;
+  job->NumberOfBlocks = static_cast<int>(numberOfBlocks);
+
+  const unsigned char* table = body + FormatHeaderSize;
+  igtlUint64 offset = 0;
+  job->BlockSizes.resize(numberOfBlocks);
+  job->Offsets.resize(numberOfBlocks);
+  igtlUint64 available = bodySize - FormatHeaderSize - 4*static_cast<igtlUint64>(numberOfBlocks);
+  for (igtlUint32 i=0; i<numberOfBlocks; ++i)
+    {
+    // Stored blocks hold the block as is, compressed ones are smaller than
+    // it, and all of them must lie within the body.
+    igtlUint64 size = std::min(job->BlockSize, job->Size - i*job->BlockSize);
+    job->BlockSizes[i] = Get32(table + 4*i);
+    igtlUint64 blockSize = job->BlockSizes[i] & ~StoredBlock;
+    bool stored = (job->BlockSizes[i] & StoredBlock) != 0;
+    if (stored ? blockSize != size : (blockSize == 0 || blockSize >= size))
+      return false;
+    if (blockSize > available - offset)
+      return false;
+    job->Offsets[i] = offset;
+    offset += blockSize;
+    }
+  job->Compressed = table + 4*static_cast<igtlUint64>(numberOfBlocks);
+  return offset == available;
+}
+
+} // unnamed namespace
+
+namespace igtlio
+{
+
+//---------------------------------------------------------------------------
+const char* ImageCompressor::GetCodecName(int codec)
+{
+  switch (codec)
+    {
+    case CODEC_NONE: return "NONE";
+    case CODEC_ZLIB: return "ZLIB";
+    case CODEC_LZ4: return "LZ4";
+    case CODEC_AUTO: return "AUTO";
+    default: return "UNKNOWN";
+    }
+}
+
+//---------------------------------------------------------------------------
+bool ImageCompressor::IsCodecSupported(int codec)
+{
+#ifdef IGTLIO_IMAGECOMPRESSOR_LZ4
+  return codec >= CODEC_NONE && codec <= CODEC_AUTO;
+#else
+  return codec >= CODEC_NONE && codec <= CODEC_AUTO && codec != CODEC_LZ4;
+#endif
+}
+
+//---------------------------------------------------------------------------
+std::vector<std::string> ImageCompressor::GetCapabilityTypes()
+{
+  std::vector<std::string> types;
+  for (int codec=CODEC_ZLIB; codec<CODEC_AUTO; ++codec)
+    {
+    if (IsCodecSupported(codec))
+      {
+      types.push_back(std::string(GetIGTLTypeName()) + ":" + GetCodecName(codec));
+      }
+    }
+  return types;
+}
+
+//---------------------------------------------------------------------------
+int ImageCompressor::NegotiateCodec(int requested, const std::vector<std::string>& peerTypes)
+{
+  // Fastest first
+  const int preferred[2] = {CODEC_LZ4, CODEC_ZLIB};
+  for (int i=0; i<2; ++i)
+    {
+    int codec = preferred[i];
+    if ((requested != CODEC_AUTO && requested != codec) || !IsCodecSupported(codec))
+      continue;
+    std::string type = std::string(GetIGTLTypeName()) + ":" + GetCodecName(codec);
+    if (std::find(peerTypes.begin(), peerTypes.end(), type) != peerTypes.end())
+      return codec;
+    }
+  return CODEC_NONE;
+}
+
+//---------------------------------------------------------------------------
+bool ImageCompressor::IsImageMessage(const void* pack)
+{
+  const char* type = static_cast<const char*>(pack) + TypeOffset;
+  return strncmp(type, "IMAGE", IGTL_HEADER_TYPE_SIZE) == 0;
+}
+
+//---------------------------------------------------------------------------
+igtl::MessageBase::Pointer ImageCompressor::Compress(int codec, const void* pack, igtlUint64 packSize,
+                                                     const void* pixels, igtlUint64 pixelSize,
+                                                     int numberOfThreads)
+{
+  if (codec == CODEC_NONE || codec == CODEC_AUTO || !IsCodecSupported(codec) || packSize < IGTL_HEADER_SIZE)
+    return NULL;
+
+  const unsigned char* imageHeader = static_cast<const unsigned char*>(pack);
+  BlockJob job;
+  job.Codec = codec;
+  job.Decompress = false;
+  job.Segments[0] = imageHeader + IGTL_HEADER_SIZE;
+  job.SegmentSizes[0] = packSize - IGTL_HEADER_SIZE;
+  job.Segments[1] = static_cast<const unsigned char*>(pixels);
+  job.SegmentSizes[1] = pixels ? pixelSize : 0;
+  job.Size = job.SegmentSizes[0] + job.SegmentSizes[1];
+  job.BlockSize = BlockSize;
+  job.NumberOfBlocks = static_cast<int>((job.Size + job.BlockSize - 1) / job.BlockSize);
+  job.Blocks.resize(job.NumberOfBlocks);
+  job.BlockSizes.resize(job.NumberOfBlocks);
+  job.Compressed = NULL;
+  job.Body = NULL;
+  if (!Execute(&job, numberOfThreads))
+    return NULL;
+
+  igtlUint64 bodySize = FormatHeaderSize + 4*static_cast<igtlUint64>(job.NumberOfBlocks);
+  for (int i=0; i<job.NumberOfBlocks; ++i)
+    {
+    bodySize += job.Blocks[i].size();
+    }
+
+  // Header of the IMAGE message, with the type and body size of the ZIMAGE one
+  unsigned char header[IGTL_HEADER_SIZE];
+  memcpy(header, imageHeader, IGTL_HEADER_SIZE);
+  SetType(header, GetIGTLTypeName());
+  Put64(header + BodySizeOffset, bodySize);
+
+  igtl::MessageHeader::Pointer headerMsg = igtl::MessageHeader::New();
+  headerMsg->InitPack();
+  memcpy(headerMsg->GetPackPointer(), header, IGTL_HEADER_SIZE);
+  headerMsg->Unpack();
+  igtl::MessageBase::Pointer msg = igtl::MessageBase::New();
+  msg->SetMessageHeader(headerMsg);
+  msg->AllocatePack();
+
+  unsigned char* body = static_cast<unsigned char*>(msg->GetPackBodyPointer());
+  Put16(body, FormatVersion);
+  Put16(body + 2, static_cast<igtlUint16>(codec));
+  Put32(body + 4, BlockSize);
+  Put64(body + 8, job.Size);
+  Put64(body + 16, Get64(imageHeader + CRCOffset));
+  Put32(body + 24, static_cast<igtlUint32>(job.NumberOfBlocks));
+  Put32(body + 28, 0);
+  unsigned char* ptr = body + FormatHeaderSize;
+  for (int i=0; i<job.NumberOfBlocks; ++i, ptr+=4)
+    {
+    Put32(ptr, job.BlockSizes[i]);
+    }
+  for (int i=0; i<job.NumberOfBlocks; ++i)
+    {
+    memcpy(ptr, &job.Blocks[i][0], job.Blocks[i].size());
+    ptr += job.Blocks[i].size();
+    }
+
+  Put64(header + CRCOffset, crc64(body, bodySize, crc64(0, 0, 0)));
+  memcpy(msg->GetPackPointer(), header, IGTL_HEADER_SIZE);
+  return msg;
+}
+
+//---------------------------------------------------------------------------
+int ImageCompressor::GetImageHeader(igtl::MessageBase* compressed, igtl::MessageHeader* imageHeader)
+{
+  BlockJob job;
+  igtlUint64 crc = 0;
+  if (!compressed || !imageHeader || !ReadFormat(compressed, &job, &crc))
+    return 0;
+
+  unsigned char header[IGTL_HEADER_SIZE];
+  memcpy(header, compressed->GetPackPointer(), IGTL_HEADER_SIZE);
+  SetType(header, "IMAGE");
+  Put64(header + BodySizeOffset, job.Size);
+  Put64(header + CRCOffset, crc);
+
+  imageHeader->InitPack();
+  memcpy(imageHeader->GetPackPointer(), header, IGTL_HEADER_SIZE);
+  imageHeader->Unpack();
+  return 1;
+}
+
+//---------------------------------------------------------------------------
+int ImageCompressor::Decompress(igtl::MessageBase* compressed, void* body, igtlUint64 bodySize,
+                                int numberOfThreads)
+{
+  BlockJob job;
+  igtlUint64 crc = 0;
+  if (!compressed || !ReadFormat(compressed, &job, &crc) || job.Size != bodySize)
+    return 0;
+  job.Decompress = true;
+  job.Body = static_cast<unsigned char*>(body);
+  return Execute(&job, numberOfThreads) ? 1 : 0;
+}
+
+//---------------------------------------------------------------------------
+void ImageCompressor::SetBlockSize(unsigned int bytes)
+{
+  // Compressed sizes must fit in 31 bits, stored blocks included.
+  BlockSize = std::max(1024u, std::min(bytes, 256u*1024*1024));
+}
+
+//---------------------------------------------------------------------------
+unsigned int ImageCompressor::GetBlockSize()
+{
+  return BlockSize;
+}
+
+} // namespace igtlio
@@ -0,0 +1,82 @@
+#ifndef IGTLIOIMAGECOMPRESSOR_H
+#define IGTLIOIMAGECOMPRESSOR_H
+
+#include "igtlioConverterExport.h"
+
+// OpenIGTLink includes
+#include <igtlMessageBase.h>
+#include <igtlMessageHeader.h>
+
+// STD includes
+#include <string>
+#include <vector>
+
+namespace igtlio
+{
+
+/** Lossless compression of IMAGE messages, exchanged between OpenIGTLinkIO peers.
+ *
+ * A ZIMAGE message holds the body of an IMAGE message compressed in
+ * blocks, which are compressed and decompressed in parallel. Its device
+ * name and timestamp are those of the IMAGE message, which the receiver
+ * restores as it was sent, CRC included.
+ *
+ * ZIMAGE body, in network byte order:
+ *  - version (uint16), codec (uint16), block size (uint32)
+ *  - size (uint64) and CRC (uint64) of the IMAGE body
+ *  - number of blocks (uint32), reserved (uint32)
+ *  - compressed size of each block (uint32), the high bit set if the
+ *    block is stored as is
+ *  - the blocks
+ *
+ * Peers advertise the codecs they decode with the types "ZIMAGE:ZLIB" and
+ * "ZIMAGE:LZ4" in their CAPABILITY message.
+ */
+class OPENIGTLINKIO_CONVERTER_EXPORT ImageCompressor
+{
+public:
+  enum Codec
+  {
+    CODEC_NONE,
+    CODEC_ZLIB,
+    CODEC_LZ4,  // requires VTK 8.1
+    CODEC_AUTO  // the fastest codec supported by both peers
+  };
+
+  static const char* GetIGTLTypeName() { return "ZIMAGE"; }
+
+  static const char* GetCodecName(int codec);
+  static bool IsCodecSupported(int codec);
+
+  /// Types listed in CAPABILITY messages for the supported codecs.
+  static std::vector<std::string> GetCapabilityTypes();
+  /// Codec to use with a peer advertising peerTypes, CODEC_NONE if the
+  /// requested one, or any with CODEC_AUTO, is not supported by both.
+  static int NegotiateCodec(int requested, const std::vector<std::string>& peerTypes);
+
+  /// True if pack starts with the header of an IMAGE message.
+  static bool IsImageMessage(const void* pack);
+
+  /// ZIMAGE message of the IMAGE message made of the pack of packSize bytes,
+  /// followed by pixelSize bytes of pixels sent separately, if any
+  /// (see ImageConverter::GatherData). NULL if the codec is not supported.
+  static igtl::MessageBase::Pointer Compress(int codec, const void* pack, igtlUint64 packSize,
+                                             const void* pixels=NULL, igtlUint64 pixelSize=0,
+                                             int numberOfThreads=0);
+
+  /// Header of the IMAGE message compressed in the received ZIMAGE
+  /// message, to receive its body. Return 0 if the message is invalid.
+  static int GetImageHeader(igtl::MessageBase* compressed, igtl::MessageHeader* imageHeader);
+
+  /// Decompress the IMAGE body into body, of the size given by GetImageHeader().
+  static int Decompress(igtl::MessageBase* compressed, void* body, igtlUint64 bodySize,
+                        int numberOfThreads=0);
+
+  /// Uncompressed bytes per block, 1 MB by default.
+  static void SetBlockSize(unsigned int bytes);
+  static unsigned int GetBlockSize();
+};
+
+} // namespace igtlio
+
+#endif // IGTLIOIMAGECOMPRESSOR_H
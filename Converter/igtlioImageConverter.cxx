@@ -13,57 +13,92 @@
 ==========================================================================*/
 
 #include "igtlioImageConverter.h"
+#include "igtlioImageCopy.h"
+#include "igtlioImageScalarPool.h"
+#include "igtlioPackBuffer.h"
 
+#include <igtl_header.h>
+#include <igtl_image.h>
 #include <igtl_util.h>
 #include <igtlImageMessage.h>
 
+#include <vtkDataArray.h>
 #include <vtkImageData.h>
 #include <vtkMatrix4x4.h>
+#include <vtkPointData.h>
+#include <vtkUnsignedCharArray.h>
 #include <vtkVersion.h>
 
+// STD includes
+#include <algorithm>
+
 namespace // unnamed namespace
 {
 
 //---------------------------------------------------------------------------
-// Stream copy + byte swap
-//---------------------------------------------------------------------------
-int swapCopy16(igtlUint16 * dst, igtlUint16 * src, int n)
+// Message made of already packed message and image headers.
+class GatherHeaderMessage : public igtl::MessageBase
 {
-  igtlUint16 * esrc = src + n;
-  while (src < esrc)
-    {
-    *dst = BYTE_SWAP_INT16(*src);
-    dst ++;
-    src ++;
-    }
-  return 1;
-}
+public:
+  typedef GatherHeaderMessage Self;
+  typedef igtl::MessageBase Superclass;
+  typedef igtl::SmartPointer<Self> Pointer;
+  typedef igtl::SmartPointer<const Self> ConstPointer;
+
+  igtlTypeMacro(GatherHeaderMessage, igtl::MessageBase);
+  igtlNewMacro(GatherHeaderMessage);
+
+  void SetPack(const igtl_header* messageHeader, const igtl_image_header* imageHeader)
+  {
+    this->AllocatePack(IGTL_IMAGE_HEADER_SIZE);
+    memcpy(this->GetPackPointer(), messageHeader, IGTL_HEADER_SIZE);
+    memcpy(this->GetPackBodyPointer(), imageHeader, IGTL_IMAGE_HEADER_SIZE);
+  }
+
+protected:
+  GatherHeaderMessage() {}
+  ~GatherHeaderMessage() {}
+};
 
-int swapCopy32(igtlUint32 * dst, igtlUint32 * src, int n)
+//---------------------------------------------------------------------------
+// Size and offset in voxels of the sub-volume of the image, the whole image
+// if extent is NULL. Return false if the sub-volume is empty.
+bool GetSubVolume(vtkImageData* image, const int* extent, int svsize[3], int svoffset[3])
 {
-  igtlUint32 * esrc = src + n;
-  while (src < esrc)
+  int imageExtent[6];
+  image->GetExtent(imageExtent);
+  for (int i=0; i<3; ++i)
     {
-    *dst = BYTE_SWAP_INT32(*src);
-    dst ++;
-    src ++;
+    int first = imageExtent[2*i];
+    int last = imageExtent[2*i+1];
+    if (extent)
+      {
+      first = std::max(first, extent[2*i]);
+      last = std::min(last, extent[2*i+1]);
+      }
+    if (last < first)
+      {
+      return false;
+      }
+    svoffset[i] = first - imageExtent[2*i];
+    svsize[i] = last - first + 1;
     }
-  return 1;
+  return true;
 }
 
-int swapCopy64(igtlUint64 * dst, igtlUint64 * src, int n)
+//---------------------------------------------------------------------------
+// The rows of the sub-volume follow each other in the volume if they are
+// whole, and so do its slabs.
+bool IsContiguous(const int size[3], const int svsize[3])
 {
-  igtlUint64 * esrc = src + n;
-  while (src < esrc)
+  if (svsize[1]*svsize[2] > 1 && svsize[0] != size[0])
     {
-    *dst = BYTE_SWAP_INT64(*src);
-    dst ++;
-    src ++;
+    return false;
     }
-  return 1;
+  return svsize[2] == 1 || svsize[1] == size[1];
 }
-} // unnamed namespace
 
+} // unnamed namespace
 
 namespace igtlio
 {
@@ -72,12 +107,17 @@ namespace igtlio
 int ImageConverter::fromIGTL(igtl::MessageBase::Pointer source,
                              HeaderData* header,
                              ContentData* dest,
-                             bool checkCRC)
+                             bool checkCRC,
+                             ImageScalarPool* pool)
 {
-  // Create a message buffer to receive image data
-  igtl::ImageMessage::Pointer imgMsg;
-  imgMsg = igtl::ImageMessage::New();
-  imgMsg->Copy(source); // !! TODO: copy makes performance issue.
+  // Unpack in place if the message was received as the concrete type,
+  // otherwise copy into a new message buffer.
+  igtl::ImageMessage::Pointer imgMsg = dynamic_pointer_cast<igtl::ImageMessage>(source);
+  if (imgMsg.IsNull())
+    {
+    imgMsg = igtl::ImageMessage::New();
+    imgMsg->Copy(source);
+    }
 
   // Deserialize the data
   // If CheckCRC==0, CRC check is skipped.
@@ -94,7 +134,7 @@ int ImageConverter::fromIGTL(igtl::MessageBase::Pointer source,
     return 0;
 
   // get image
-  if (IGTLToVTKImageData(imgMsg, dest) == 0)
+  if (IGTLToVTKImageData(imgMsg, dest, pool) == 0)
     return 0;
 
   // set volume orientation
@@ -108,7 +148,7 @@ int ImageConverter::fromIGTL(igtl::MessageBase::Pointer source,
 
 
 //---------------------------------------------------------------------------
-int ImageConverter::IGTLToVTKImageData(igtl::ImageMessage::Pointer imgMsg, ContentData *dest)
+int ImageConverter::IGTLToVTKImageData(igtl::ImageMessage::Pointer imgMsg, ContentData *dest, ImageScalarPool* pool)
 {
   if (!dest->image)
     dest->image = vtkSmartPointer<vtkImageData>::New();
@@ -129,7 +169,31 @@ int ImageConverter::IGTLToVTKImageData(igtl::ImageMessage::Pointer imgMsg, Conte
   numComponents = imgMsg->GetNumComponents();
   imgMsg->GetSubVolume(svsize, svoffset);
 
-  // check if the IGTL data fits to the current MRML node  
+  // Check scalar size
+  int scalarSize = imgMsg->GetScalarSize();
+
+  int fByteSwap = 0;
+  // Check if bytes-swap is required
+  if (scalarSize > 1 &&
+      ((igtl_is_little_endian() && endian == igtl::ImageMessage::ENDIAN_BIG) ||
+       (!igtl_is_little_endian() && endian == igtl::ImageMessage::ENDIAN_LITTLE)))
+    {
+    // Needs byte swap
+    fByteSwap = 1;
+    }
+
+  // The pixels of the message are used as is by the image when possible:
+  // the image takes the pack buffer of the message instead of copying it.
+  vtkSmartPointer<vtkDataArray> adopted;
+  bool fullVolume = imgMsg->GetImageSize() == imgMsg->GetSubVolumeImageSize();
+  if (fullVolume && !fByteSwap)
+    {
+    vtkIdType numberOfValues = static_cast<vtkIdType>(size[0])*size[1]*size[2]*numComponents;
+    adopted.TakeReference(PackBuffer::Adopt(imgMsg, imgMsg->GetScalarPointer(),
+                                            scalarType, numComponents, numberOfValues));
+    }
+
+  // check if the IGTL data fits to the current MRML node
   int sizeInNode[3]={0,0,0};
   int scalarTypeInNode=VTK_VOID;
   int numComponentsInNode=0;
@@ -140,14 +204,18 @@ int ImageConverter::IGTLToVTKImageData(igtl::ImageMessage::Pointer imgMsg, Conte
     scalarTypeInNode = imageData->GetScalarType();
     numComponentsInNode = imageData->GetNumberOfScalarComponents();
     }
-    
+
   if (imageData.GetPointer()==NULL
       || sizeInNode[0] != size[0] || sizeInNode[1] != size[1] || sizeInNode[2] != size[2]
       || scalarType != scalarTypeInNode
       || numComponentsInNode != numComponents)
     {
-    imageData = vtkSmartPointer<vtkImageData>::New();
-    dest->image = imageData;
+    // The image is kept for the pipelines using it, only its scalars change.
+    if (imageData.GetPointer()==NULL)
+      {
+      imageData = vtkSmartPointer<vtkImageData>::New();
+      dest->image = imageData;
+      }
     imageData->SetDimensions(size[0], size[1], size[2]);
     imageData->SetExtent(0, size[0]-1, 0, size[1]-1, 0, size[2]-1);
     imageData->SetOrigin(0.0, 0.0, 0.0);
@@ -157,135 +225,39 @@ int ImageConverter::IGTLToVTKImageData(igtl::ImageMessage::Pointer imgMsg, Conte
     imageData->SetScalarType(scalarType);
     imageData->AllocateScalars();
 #else
-    imageData->AllocateScalars(scalarType, numComponents);
-#endif
-    }
-  
-  // Check scalar size
-  int scalarSize = imgMsg->GetScalarSize();
-  
-  int fByteSwap = 0;
-  // Check if bytes-swap is required
-  if (scalarSize > 1 && 
-      ((igtl_is_little_endian() && endian == igtl::ImageMessage::ENDIAN_BIG) ||
-       (!igtl_is_little_endian() && endian == igtl::ImageMessage::ENDIAN_LITTLE)))
-    {
-    // Needs byte swap
-    fByteSwap = 1;
-    }
-
-  if (imgMsg->GetImageSize() == imgMsg->GetSubVolumeImageSize())
-    {
-    // In case that volume size == sub-volume size,
-    // image is read directly to the memory area of vtkImageData
-    // for better performance. 
-    if (fByteSwap)
+    if (!adopted && pool)
       {
-      switch (scalarSize)
-        {
-        case 2:
-          swapCopy16((igtlUint16 *)imageData->GetScalarPointer(),
-                     (igtlUint16 *)imgMsg->GetScalarPointer(),
-                     imgMsg->GetSubVolumeImageSize() / 2);
-          break;
-        case 4:
-          swapCopy32((igtlUint32 *)imageData->GetScalarPointer(),
-                     (igtlUint32 *)imgMsg->GetScalarPointer(),
-                     imgMsg->GetSubVolumeImageSize() / 4);
-          break;
-        case 8:
-          swapCopy64((igtlUint64 *)imageData->GetScalarPointer(),
-                     (igtlUint64 *)imgMsg->GetScalarPointer(),
-                     imgMsg->GetSubVolumeImageSize() / 8);
-          break;
-        default:
-          break;
-        }
+      pool->AllocateScalars(imageData, scalarType, numComponents);
       }
-    else
+    else if (!adopted)
       {
-      memcpy(imageData->GetScalarPointer(),
-             imgMsg->GetScalarPointer(), imgMsg->GetSubVolumeImageSize());
+      imageData->AllocateScalars(scalarType, numComponents);
       }
+#endif
+    }
+
+  if (adopted)
+    {
+    // Replaces the previous pixels, which go back to their connector.
+    imageData->GetPointData()->SetScalars(adopted);
     }
   else
     {
-    // In case of volume size != sub-volume size,
-    // image is loaded into ImageReadBuffer, then copied to
-    // the memory area of vtkImageData.
-    char* imgPtr = (char*) imageData->GetScalarPointer();
-    char* bufPtr = (char*) imgMsg->GetScalarPointer();
-    int sizei = size[0];
-    int sizej = size[1];
-    //int sizek = size[2];
-    int subsizei = svsize[0];
-    
-    int bg_i = svoffset[0];
-    //int ed_i = bg_i + svsize[0];
-    int bg_j = svoffset[1];
-    int ed_j = bg_j + svsize[1];
-    int bg_k = svoffset[2];
-    int ed_k = bg_k + svsize[2];
-
-    if (fByteSwap)
-      {
-      switch (scalarSize)
-        {
-        case 2:
-          for (int k = bg_k; k < ed_k; k ++)
-            {
-            for (int j = bg_j; j < ed_j; j ++)
-              {
-              swapCopy16((igtlUint16 *)&imgPtr[(sizei*sizej*k + sizei*j + bg_i)*scalarSize],
-                         (igtlUint16 *)bufPtr,
-                         subsizei);
-              bufPtr += subsizei*scalarSize;
-              }
-            }
-          break;
-        case 4:
-          for (int k = bg_k; k < ed_k; k ++)
-            {
-            for (int j = bg_j; j < ed_j; j ++)
-              {
-              swapCopy32((igtlUint32 *)&imgPtr[(sizei*sizej*k + sizei*j + bg_i)*scalarSize],
-                         (igtlUint32 *)bufPtr,
-                         subsizei);
-              bufPtr += subsizei*scalarSize;
-              }
-            }
-          break;
-        case 8:
-          for (int k = bg_k; k < ed_k; k ++)
-            {
-            for (int j = bg_j; j < ed_j; j ++)
-              {
-              swapCopy64((igtlUint64 *)&imgPtr[(sizei*sizej*k + sizei*j + bg_i)*scalarSize],
-                         (igtlUint64 *)bufPtr,
-                         subsizei);
-              bufPtr += subsizei*scalarSize;
-              }
-            }
-          break;
-        default:
-          break;
-        }
-      }
-    else
+    if (fullVolume)
       {
-      for (int k = bg_k; k < ed_k; k ++)
-        {
-        for (int j = bg_j; j < ed_j; j ++)
-          {
-          memcpy(&imgPtr[(sizei*sizej*k + sizei*j + bg_i)*scalarSize],
-                 bufPtr, subsizei*scalarSize);
-          bufPtr += subsizei*scalarSize;
-          }
-        }
+      // In case that volume size == sub-volume size,
+      // image is read directly to the memory area of vtkImageData
+      // for better performance.
+      svsize[0] = size[0];
+      svsize[1] = size[1];
+      svsize[2] = size[2];
+      svoffset[0] = svoffset[1] = svoffset[2] = 0;
       }
-
+    ImageCopy::CopySubVolume(imageData->GetScalarPointer(), size,
+                             imgMsg->GetScalarPointer(), svsize, svoffset,
+                             scalarSize, numComponents, fByteSwap != 0);
     }
-  
+
   imageData->Modified();
 
   return 1;
@@ -305,6 +277,13 @@ int ImageConverter::IGTLToVTKTransform(igtl::ImageMessage::Pointer imgMsg, vtkSm
 
   imgMsg->GetMatrix(matrix);
 
+  return IGTLToVTKTransform(size, spacing, matrix, ijk2ras);
+}
+
+//---------------------------------------------------------------------------
+int ImageConverter::IGTLToVTKTransform(const int size[3], const float spacing[3], igtl::Matrix4x4 matrix,
+                                       vtkSmartPointer<vtkMatrix4x4> ijk2ras)
+{
   float tx = matrix[0][0];
   float ty = matrix[1][0];
   float tz = matrix[2][0];
@@ -368,7 +347,8 @@ int ImageConverter::IGTLToVTKTransform(igtl::ImageMessage::Pointer imgMsg, vtkSm
 }
 
 //---------------------------------------------------------------------------
-int ImageConverter::toIGTL(const HeaderData& header, const ContentData& source, igtl::ImageMessage::Pointer* dest)
+int ImageConverter::toIGTL(const HeaderData& header, const ContentData& source, igtl::ImageMessage::Pointer* dest,
+                           const int* subVolumeExtent)
 {
   if (dest->IsNull())
     *dest = igtl::ImageMessage::New();
@@ -384,14 +364,20 @@ int ImageConverter::toIGTL(const HeaderData& header, const ContentData& source,
 
   vtkSmartPointer<vtkImageData> imageData = source.image;
   int   isize[3];          // image dimension
-  //int   svsize[3];        // sub-volume size
+  int   svsize[3];        // sub-volume size
   int   scalarType;       // scalar type
   //double *origin;
   double *spacing;       // spacing (mm/pixel)
   int   ncomp;
-  int   svoffset[] = {0, 0, 0};           // sub-volume offset
+  int   svoffset[3];      // sub-volume offset
   int   endian;
 
+  if (!GetSubVolume(imageData, subVolumeExtent, svsize, svoffset))
+    {
+    std::cerr << "Empty sub-volume" << std::endl;
+    return 0;
+    }
+
   scalarType = imageData->GetScalarType();
   ncomp = imageData->GetNumberOfScalarComponents();
   imageData->GetDimensions(isize);
@@ -410,15 +396,29 @@ int ImageConverter::toIGTL(const HeaderData& header, const ContentData& source,
   msg->SetSpacing((float)spacing[0], (float)spacing[1], (float)spacing[2]);
   msg->SetScalarType(scalarType);
   msg->SetEndian(endian);
-  msg->SetSubVolume(isize, svoffset);
+  msg->SetSubVolume(svsize, svoffset);
   msg->SetNumComponents(ncomp);
   msg->AllocateScalars();
 
-  memcpy(msg->GetScalarPointer(),
-      imageData->GetScalarPointer(),
-      msg->GetImageSize());
+  ImageCopy::ExtractSubVolume(msg->GetScalarPointer(), imageData->GetScalarPointer(), isize,
+                              svsize, svoffset, imageData->GetScalarSize(), ncomp, false);
+
+  igtl::Matrix4x4 matrix; // Image origin and orientation matrix
+  VTKToIGTLTransform(source, matrix);
+  msg->SetMatrix(matrix);
+  msg->Pack();
+
+  return 1;
+}
+
+//---------------------------------------------------------------------------
+void ImageConverter::VTKToIGTLTransform(const ContentData& source, igtl::Matrix4x4& matrix)
+{
+  int   isize[3];          // image dimension
+  double *spacing;       // spacing (mm/pixel)
+  source.image->GetDimensions(isize);
+  spacing = source.image->GetSpacing();
 
-  // Transform
   float ntx = source.transform->Element[0][0] / (float)spacing[0];
   float nty = source.transform->Element[1][0] / (float)spacing[0];
   float ntz = source.transform->Element[2][0] / (float)spacing[0];
@@ -450,7 +450,6 @@ int ImageConverter::toIGTL(const HeaderData& header, const ContentData& source,
   py = py + cy;
   pz = pz + cz;
 
-  igtl::Matrix4x4 matrix; // Image origin and orientation matrix
   matrix[0][0] = ntx;
   matrix[1][0] = nty;
   matrix[2][0] = ntz;
@@ -463,10 +462,114 @@ int ImageConverter::toIGTL(const HeaderData& header, const ContentData& source,
   matrix[0][3] = px;
   matrix[1][3] = py;
   matrix[2][3] = pz;
+}
 
-  msg->SetMatrix(matrix);
-  msg->Pack();
+//---------------------------------------------------------------------------
+int ImageConverter::toIGTLImageHeader(const ContentData& source, igtl_image_header* imageHeader, GatherData* dest,
+                                      const int* subVolumeExtent)
+{
+  if (source.transform.Get()==NULL || source.image.Get()==NULL)
+    {
+    std::cerr << "Got NULL input image or transform" << std::endl;
+    return 0;
+    }
+
+  vtkImageData* imageData = source.image;
+  int   isize[3];          // image dimension
+  int   svsize[3];        // sub-volume size
+  int   svoffset[3];      // sub-volume offset
+  double *spacing;       // spacing (mm/pixel)
+  imageData->GetDimensions(isize);
+  spacing = imageData->GetSpacing();
+  if (!GetSubVolume(imageData, subVolumeExtent, svsize, svoffset))
+    {
+    std::cerr << "Empty sub-volume" << std::endl;
+    return 0;
+    }
+
+  igtl::Matrix4x4 matrix; // Image origin and orientation matrix
+  VTKToIGTLTransform(source, matrix);
+
+  // Image header, as packed by igtl::ImageMessage
+  memset(imageHeader, 0, sizeof(*imageHeader));
+  imageHeader->header_version = IGTL_IMAGE_HEADER_VERSION;
+  imageHeader->num_components = imageData->GetNumberOfScalarComponents();
+  imageHeader->scalar_type = imageData->GetScalarType(); // same values in VTK and igtl
+  imageHeader->endian = igtl_is_little_endian() ? IGTL_IMAGE_ENDIAN_LITTLE : IGTL_IMAGE_ENDIAN_BIG;
+  imageHeader->coord = IGTL_IMAGE_COORD_RAS;
+  for (int i=0; i<3; ++i)
+    {
+    imageHeader->size[i] = isize[i];
+    imageHeader->subvol_size[i] = svsize[i];
+    imageHeader->subvol_offset[i] = svoffset[i];
+    }
+  float fspacing[3] = { (float)spacing[0], (float)spacing[1], (float)spacing[2] };
+  float origin[3];
+  float norm_i[3];
+  float norm_j[3];
+  float norm_k[3];
+  for (int i=0; i<3; ++i)
+    {
+    norm_i[i] = matrix[i][0];
+    norm_j[i] = matrix[i][1];
+    norm_k[i] = matrix[i][2];
+    origin[i] = matrix[i][3];
+    }
+  igtl_image_set_matrix(fspacing, origin, norm_i, norm_j, norm_k, imageHeader);
+  igtl_image_convert_byte_order(imageHeader);
+
+  int scalarSize = imageData->GetScalarSize();
+  int ncomp = imageData->GetNumberOfScalarComponents();
+  igtlUint64 voxelSize = static_cast<igtlUint64>(scalarSize)*ncomp;
+  dest->pixelSize = static_cast<igtlUint64>(svsize[0])*svsize[1]*svsize[2]*voxelSize;
+  if (IsContiguous(isize, svsize))
+    {
+    igtlUint64 offset = ((static_cast<igtlUint64>(svoffset[2])*isize[1] + svoffset[1])*isize[0] + svoffset[0])*voxelSize;
+    dest->pixels = static_cast<unsigned char*>(imageData->GetScalarPointer()) + offset;
+    dest->pixelOwner = imageData;
+    }
+  else
+    {
+    vtkSmartPointer<vtkUnsignedCharArray> copy = vtkSmartPointer<vtkUnsignedCharArray>::New();
+    copy->SetNumberOfValues(static_cast<vtkIdType>(dest->pixelSize));
+    ImageCopy::ExtractSubVolume(copy->GetPointer(0), imageData->GetScalarPointer(), isize,
+                                svsize, svoffset, scalarSize, ncomp, false);
+    dest->pixels = copy->GetPointer(0);
+    dest->pixelOwner = copy;
+    }
+
+  return 1;
+}
+
+//---------------------------------------------------------------------------
+int ImageConverter::toIGTLGather(const HeaderData& header, const ContentData& source, GatherData* dest,
+                                 const int* subVolumeExtent)
+{
+  igtl_image_header imageHeader;
+  if (!toIGTLImageHeader(source, &imageHeader, dest, subVolumeExtent))
+    {
+    return 0;
+    }
 
+  // CRC of the body, computed over its two parts.
+  igtl_uint64 crc = crc64(0, 0, 0);
+  crc = crc64(reinterpret_cast<unsigned char*>(&imageHeader), IGTL_IMAGE_HEADER_SIZE, crc);
+  crc = crc64(static_cast<unsigned char*>(const_cast<void*>(dest->pixels)), dest->pixelSize, crc);
+
+  igtl_header messageHeader;
+  memset(&messageHeader, 0, sizeof(messageHeader));
+  messageHeader.version = IGTL_HEADER_VERSION;
+  strncpy(messageHeader.name, GetIGTLTypeName(), IGTL_HEADER_TYPE_SIZE);
+  strncpy(messageHeader.device_name, header.deviceName.c_str(), IGTL_HEADER_NAME_SIZE);
+  messageHeader.timestamp = 0; // not set by toIGTL() either
+  messageHeader.body_size = IGTL_IMAGE_HEADER_SIZE + dest->pixelSize;
+  messageHeader.crc = crc;
+  igtl_header_convert_byte_order(&messageHeader);
+
+  GatherHeaderMessage::Pointer headerMsg = GatherHeaderMessage::New();
+  headerMsg->SetDeviceName(header.deviceName.c_str());
+  headerMsg->SetPack(&messageHeader, &imageHeader);
+  dest->header = dynamic_pointer_cast<igtl::MessageBase>(headerMsg);
   return 1;
 }
 
@@ -18,6 +18,7 @@
 #include "igtlioConverterExport.h"
 
 #include <igtlImageMessage.h>
+#include <igtl_image.h>
 
 #include "igtlioBaseConverter.h"
 
@@ -26,6 +27,7 @@ class vtkMatrix4x4;
 
 namespace igtlio
 {
+class ImageScalarPool;
 
 /** Conversion between igtl::ImageMessage and vtk classes.
  *
@@ -46,14 +48,53 @@ public:
   static const char*  GetIGTLName() { return GetIGTLTypeName(); }
   static const char* GetIGTLTypeName() { return "IMAGE"; }
 
-  static int fromIGTL(igtl::MessageBase::Pointer source, HeaderData* header, ContentData* content, bool checkCRC);
-  static int toIGTL(const HeaderData& header, const ContentData& source, igtl::ImageMessage::Pointer* dest);
+  /// The image takes the pack of source when the pixels can be used as is
+  /// (whole volume, no byte swap), which leaves source without pack.
+  /// content->image is kept when the dimensions or scalar type change,
+  /// with new scalars taken from pool if given.
+  static int fromIGTL(igtl::MessageBase::Pointer source, HeaderData* header, ContentData* content, bool checkCRC,
+                      ImageScalarPool* pool=NULL);
+  /// Only the sub-volume of the given extent is sent, if any, clipped to
+  /// the extent of the image. The receiving image is patched with it.
+  static int toIGTL(const HeaderData& header, const ContentData& source, igtl::ImageMessage::Pointer* dest,
+                    const int* subVolumeExtent=NULL);
+
+  /**
+   * IMAGE message sent without copying the pixels into it: the pack of
+   * header holds the message and image headers, with the CRC of the whole
+   * body, and is followed on the wire by the pixels of the image as they are.
+   */
+  struct GatherData
+  {
+  igtl::MessageBase::Pointer header;
+  const void* pixels;
+  igtlUint64 pixelSize;
+  vtkSmartPointer<vtkObject> pixelOwner; // to keep until the pixels are sent
+  };
+
+  /// Same message as toIGTL(), but the pixels stay in source.image, which
+  /// must not be modified until they are sent. The rows of a sub-volume
+  /// that are not contiguous in the image are copied.
+  static int toIGTLGather(const HeaderData& header, const ContentData& source, GatherData* dest,
+                          const int* subVolumeExtent=NULL);
+
+  /// Image header of toIGTLGather(), in network byte order, and the pixels
+  /// following it. dest->header is left unset and no CRC is computed, for
+  /// the messages embedding an image header (see ImageDelta).
+  static int toIGTLImageHeader(const ContentData& source, igtl_image_header* imageHeader, GatherData* dest,
+                               const int* subVolumeExtent=NULL);
+
+  /// ijk2ras of an image of the given size, spacing and OpenIGTLink
+  /// matrix, for the messages embedding an image header (see ImageDelta).
+  static int IGTLToVTKTransform(const int size[3], const float spacing[3], igtl::Matrix4x4 matrix,
+                                vtkSmartPointer<vtkMatrix4x4> ijk2ras);
 
 protected:
 
   static int IGTLToVTKScalarType(int igtlType);
-  static int IGTLToVTKImageData(igtl::ImageMessage::Pointer imgMsg, ContentData *dest);
+  static int IGTLToVTKImageData(igtl::ImageMessage::Pointer imgMsg, ContentData *dest, ImageScalarPool* pool);
   static int IGTLToVTKTransform(igtl::ImageMessage::Pointer imgMsg, vtkSmartPointer<vtkMatrix4x4> ijk2ras);
+  static void VTKToIGTLTransform(const ContentData& source, igtl::Matrix4x4& matrix);
 };
 
 } //namespace igtlio
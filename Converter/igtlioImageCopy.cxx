@@ -0,0 +1,495 @@
+#include "igtlioImageCopy.h"
+
+#include <igtl_util.h>
+
+#include <vtkMultiThreader.h>
+#include <vtkSmartPointer.h>
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define IGTLIO_IMAGECOPY_SSE2
+#include <emmintrin.h>
+#if defined(_MSC_VER) && _MSC_VER >= 1700
+#define IGTLIO_IMAGECOPY_AVX2
+#define IGTLIO_TARGET_AVX2
+#include <immintrin.h>
+#include <intrin.h>
+#elif defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+// Compiled for AVX2 function by function, only called if the CPU has it.
+#define IGTLIO_IMAGECOPY_AVX2
+#define IGTLIO_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+#endif
+
+namespace // unnamed namespace
+{
+
+typedef void (*SwapFunction)(unsigned char* dst, const unsigned char* src, size_t count);
+
+//---------------------------------------------------------------------------
+// Scalar kernels
+//---------------------------------------------------------------------------
+void SwapScalar16(unsigned char* dst, const unsigned char* src, size_t count)
+{
+  for (size_t i=0; i<count; ++i, dst+=2, src+=2)
+    {
+    igtlUint16 v;
+    memcpy(&v, src, 2);
+    v = BYTE_SWAP_INT16(v);
+    memcpy(dst, &v, 2);
+    }
+}
+
+void SwapScalar32(unsigned char* dst, const unsigned char* src, size_t count)
+{
+  for (size_t i=0; i<count; ++i, dst+=4, src+=4)
+    {
+    igtlUint32 v;
+    memcpy(&v, src, 4);
+    v = BYTE_SWAP_INT32(v);
+    memcpy(dst, &v, 4);
+    }
+}
+
+void SwapScalar64(unsigned char* dst, const unsigned char* src, size_t count)
+{
+  for (size_t i=0; i<count; ++i, dst+=8, src+=8)
+    {
+    igtlUint64 v;
+    memcpy(&v, src, 8);
+    v = BYTE_SWAP_INT64(v);
+    memcpy(dst, &v, 8);
+    }
+}
+
+#ifdef IGTLIO_IMAGECOPY_SSE2
+//---------------------------------------------------------------------------
+// SSE2 kernels, 16 bytes per iteration. SSE2 has no byte shuffle: swap the
+// bytes of each 16 bit word, then reorder the words.
+//---------------------------------------------------------------------------
+inline __m128i Swap16SSE2(__m128i v)
+{
+  return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+void SwapSSE2_16(unsigned char* dst, const unsigned char* src, size_t count)
+{
+  size_t n = count / 8;
+  for (size_t i=0; i<n; ++i, dst+=16, src+=16)
+    {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), Swap16SSE2(v));
+    }
+  SwapScalar16(dst, src, count % 8);
+}
+
+void SwapSSE2_32(unsigned char* dst, const unsigned char* src, size_t count)
+{
+  size_t n = count / 4;
+  for (size_t i=0; i<n; ++i, dst+=16, src+=16)
+    {
+    __m128i v = Swap16SSE2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), v);
+    }
+  SwapScalar32(dst, src, count % 4);
+}
+
+void SwapSSE2_64(unsigned char* dst, const unsigned char* src, size_t count)
+{
+  size_t n = count / 2;
+  for (size_t i=0; i<n; ++i, dst+=16, src+=16)
+    {
+    __m128i v = Swap16SSE2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), v);
+    }
+  SwapScalar64(dst, src, count % 2);
+}
+#endif
+
+#ifdef IGTLIO_IMAGECOPY_AVX2
+//---------------------------------------------------------------------------
+// AVX2 kernels, 32 bytes per iteration with a byte shuffle.
+//---------------------------------------------------------------------------
+IGTLIO_TARGET_AVX2
+void SwapAVX2(unsigned char* dst, const unsigned char* src, size_t bytes, __m256i mask)
+{
+  size_t n = bytes / 32;
+  for (size_t i=0; i<n; ++i, dst+=32, src+=32)
+    {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_shuffle_epi8(v, mask));
+    }
+}
+
+IGTLIO_TARGET_AVX2
+void SwapAVX2_16(unsigned char* dst, const unsigned char* src, size_t count)
+{
+  __m256i mask = _mm256_setr_epi8(1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14,
+                                  1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14);
+  size_t done = count - count % 16;
+  SwapAVX2(dst, src, done*2, mask);
+  SwapScalar16(dst + done*2, src + done*2, count - done);
+}
+
+IGTLIO_TARGET_AVX2
+void SwapAVX2_32(unsigned char* dst, const unsigned char* src, size_t count)
+{
+  __m256i mask = _mm256_setr_epi8(3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12,
+                                  3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12);
+  size_t done = count - count % 8;
+  SwapAVX2(dst, src, done*4, mask);
+  SwapScalar32(dst + done*4, src + done*4, count - done);
+}
+
+IGTLIO_TARGET_AVX2
+void SwapAVX2_64(unsigned char* dst, const unsigned char* src, size_t count)
+{
+  __m256i mask = _mm256_setr_epi8(7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8,
+                                  7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8);
+  size_t done = count - count % 4;
+  SwapAVX2(dst, src, done*8, mask);
+  SwapScalar64(dst + done*8, src + done*8, count - done);
+}
+
+//---------------------------------------------------------------------------
+bool HasAVX2()
+{
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx = (info[2] & (1 << 28)) != 0;
+  if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) // YMM state saved by the OS
+    {
+    return false;
+    }
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+//---------------------------------------------------------------------------
+// Kernel selection
+//---------------------------------------------------------------------------
+const SwapFunction Kernels[3][3] =
+{
+  { SwapScalar16, SwapScalar32, SwapScalar64 },
+#ifdef IGTLIO_IMAGECOPY_SSE2
+  { SwapSSE2_16, SwapSSE2_32, SwapSSE2_64 },
+#else
+  { NULL, NULL, NULL },
+#endif
+#ifdef IGTLIO_IMAGECOPY_AVX2
+  { SwapAVX2_16, SwapAVX2_32, SwapAVX2_64 }
+#else
+  { NULL, NULL, NULL }
+#endif
+};
+
+bool KernelSupported(int kernel)
+{
+  switch (kernel)
+    {
+    case igtlio::ImageCopy::KERNEL_SCALAR:
+      return true;
+#ifdef IGTLIO_IMAGECOPY_SSE2
+    case igtlio::ImageCopy::KERNEL_SSE2:
+      return true; // part of x86-64
+#endif
+#ifdef IGTLIO_IMAGECOPY_AVX2
+    case igtlio::ImageCopy::KERNEL_AVX2:
+      {
+      static const bool avx2 = HasAVX2();
+      return avx2;
+      }
+#endif
+    default:
+      return false;
+    }
+}
+
+int BestKernel()
+{
+  for (int kernel=igtlio::ImageCopy::KERNEL_AVX2; kernel>igtlio::ImageCopy::KERNEL_SCALAR; --kernel)
+    {
+    if (KernelSupported(kernel))
+      {
+      return kernel;
+      }
+    }
+  return igtlio::ImageCopy::KERNEL_SCALAR;
+}
+
+int CurrentKernel = BestKernel();
+size_t ParallelThreshold = 4*1024*1024;
+
+//---------------------------------------------------------------------------
+void CopyBytes(unsigned char* dst, const unsigned char* src, size_t bytes, int scalarSize, bool swap)
+{
+  if (!swap || scalarSize < 2)
+    {
+    memcpy(dst, src, bytes);
+    return;
+    }
+  int width = scalarSize == 2 ? 0 : (scalarSize == 4 ? 1 : 2);
+  Kernels[CurrentKernel][width](dst, src, bytes / scalarSize);
+}
+
+//---------------------------------------------------------------------------
+// Copy of a contiguous source into equally sized blocks of the destination,
+// or of the blocks of the source into a contiguous destination. Dimensions
+// that are fully covered are merged, so that a whole volume is one block.
+//---------------------------------------------------------------------------
+struct CopyJob
+{
+  unsigned char* Dst;
+  const unsigned char* Src;
+  size_t Bytes;
+  size_t BlockBytes;
+  size_t BlocksPerSlab; // blocks along j, 1 if merged
+  size_t SlabBytes;     // stride along k in the volume
+  size_t RowBytes;      // stride along j in the volume
+  size_t Start;         // offset of the first block in the volume
+  bool Extract;         // blocks are in the source instead of the destination
+  int ScalarSize;
+  bool Swap;
+  int NumberOfThreads;
+};
+
+void CopyRange(const CopyJob* job, size_t begin, size_t end)
+{
+  size_t block = begin / job->BlockBytes;
+  size_t offset = begin % job->BlockBytes;
+  while (begin < end)
+    {
+    size_t n = job->BlockBytes - offset;
+    if (n > end - begin)
+      {
+      n = end - begin;
+      }
+    size_t k = block / job->BlocksPerSlab;
+    size_t j = block % job->BlocksPerSlab;
+    size_t blockStart = job->Start + k*job->SlabBytes + j*job->RowBytes + offset;
+    if (job->Extract)
+      {
+      CopyBytes(job->Dst + begin, job->Src + blockStart, n, job->ScalarSize, job->Swap);
+      }
+    else
+      {
+      CopyBytes(job->Dst + blockStart, job->Src + begin, n, job->ScalarSize, job->Swap);
+      }
+    begin += n;
+    ++block;
+    offset = 0;
+    }
+}
+
+//---------------------------------------------------------------------------
+// Thread range, on cache line boundaries.
+void GetThreadRange(const CopyJob* job, int thread, size_t* begin, size_t* end)
+{
+  size_t chunk = (job->Bytes / job->NumberOfThreads) & ~static_cast<size_t>(63);
+  *begin = thread*chunk;
+  *end = (thread == job->NumberOfThreads-1) ? job->Bytes : (thread+1)*chunk;
+}
+
+void* CopyThread(void* ptr)
+{
+  vtkMultiThreader::ThreadInfo* info = static_cast<vtkMultiThreader::ThreadInfo*>(ptr);
+  const CopyJob* job = static_cast<const CopyJob*>(info->UserData);
+  size_t begin = 0;
+  size_t end = 0;
+  GetThreadRange(job, info->ThreadID, &begin, &end);
+  CopyRange(job, begin, end);
+  return NULL;
+}
+
+void Execute(CopyJob* job, int numberOfThreads)
+{
+  if (numberOfThreads <= 0)
+    {
+    numberOfThreads = 1;
+    if (job->Bytes >= ParallelThreshold)
+      {
+      numberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+      // At least 1 MB per thread
+      size_t maximum = job->Bytes / (1024*1024);
+      if (static_cast<size_t>(numberOfThreads) > maximum)
+        {
+        numberOfThreads = static_cast<int>(maximum);
+        }
+      }
+    }
+  if (static_cast<size_t>(numberOfThreads) > job->Bytes / 64)
+    {
+    numberOfThreads = static_cast<int>(job->Bytes / 64);
+    }
+  // vtkMultiThreader runs at most VTK_MAX_THREADS: the ranges must match.
+  if (numberOfThreads > VTK_MAX_THREADS)
+    {
+    numberOfThreads = VTK_MAX_THREADS;
+    }
+  if (numberOfThreads <= 1)
+    {
+    CopyRange(job, 0, job->Bytes);
+    return;
+    }
+
+  job->NumberOfThreads = numberOfThreads;
+  vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+  threader->SetNumberOfThreads(numberOfThreads);
+  threader->SetSingleMethod((vtkThreadFunctionType)&CopyThread, job);
+  threader->SingleMethodExecute();
+}
+
+//---------------------------------------------------------------------------
+void SetSubVolumeJob(CopyJob* job, const int size[3], const int svsize[3], const int svoffset[3],
+                     int scalarSize, int numComponents, bool swap)
+{
+  size_t voxelBytes = static_cast<size_t>(scalarSize)*numComponents;
+  job->Bytes = voxelBytes*svsize[0]*svsize[1]*svsize[2];
+  job->RowBytes = voxelBytes*size[0];
+  job->SlabBytes = job->RowBytes*size[1];
+  job->Start = svoffset[2]*job->SlabBytes + svoffset[1]*job->RowBytes + svoffset[0]*voxelBytes;
+  job->BlockBytes = voxelBytes*svsize[0];
+  job->BlocksPerSlab = svsize[1];
+  if (svsize[0] == size[0])
+    {
+    // Whole rows: the rows of a slab are contiguous.
+    job->BlockBytes *= svsize[1];
+    job->BlocksPerSlab = 1;
+    if (svsize[1] == size[1])
+      {
+      // Whole slabs
+      job->BlockBytes *= svsize[2];
+      }
+    }
+  job->ScalarSize = scalarSize;
+  job->Swap = swap;
+  job->NumberOfThreads = 1;
+}
+
+} // unnamed namespace
+
+
+namespace igtlio
+{
+
+//---------------------------------------------------------------------------
+void ImageCopy::CopyScalars(void* dst, const void* src, size_t count, int scalarSize, bool swap,
+                            int numberOfThreads)
+{
+  CopyJob job;
+  job.Dst = static_cast<unsigned char*>(dst);
+  job.Src = static_cast<const unsigned char*>(src);
+  job.Bytes = count*scalarSize;
+  job.BlockBytes = job.Bytes;
+  job.BlocksPerSlab = 1;
+  job.SlabBytes = 0;
+  job.RowBytes = 0;
+  job.Start = 0;
+  job.Extract = false;
+  job.ScalarSize = scalarSize;
+  job.Swap = swap;
+  job.NumberOfThreads = 1;
+  if (job.Bytes == 0)
+    {
+    return;
+    }
+  Execute(&job, numberOfThreads);
+}
+
+//---------------------------------------------------------------------------
+void ImageCopy::CopySubVolume(void* volume, const int size[3],
+                              const void* subVolume, const int svsize[3], const int svoffset[3],
+                              int scalarSize, int numComponents, bool swap,
+                              int numberOfThreads)
+{
+  CopyJob job;
+  job.Dst = static_cast<unsigned char*>(volume);
+  job.Src = static_cast<const unsigned char*>(subVolume);
+  job.Extract = false;
+  SetSubVolumeJob(&job, size, svsize, svoffset, scalarSize, numComponents, swap);
+  if (job.Bytes == 0)
+    {
+    return;
+    }
+  Execute(&job, numberOfThreads);
+}
+
+//---------------------------------------------------------------------------
+void ImageCopy::ExtractSubVolume(void* subVolume, const void* volume, const int size[3],
+                                 const int svsize[3], const int svoffset[3],
+                                 int scalarSize, int numComponents, bool swap,
+                                 int numberOfThreads)
+{
+  CopyJob job;
+  job.Dst = static_cast<unsigned char*>(subVolume);
+  job.Src = static_cast<const unsigned char*>(volume);
+  job.Extract = true;
+  SetSubVolumeJob(&job, size, svsize, svoffset, scalarSize, numComponents, swap);
+  if (job.Bytes == 0)
+    {
+    return;
+    }
+  Execute(&job, numberOfThreads);
+}
+
+//---------------------------------------------------------------------------
+bool ImageCopy::SetKernel(int kernel)
+{
+  if (!KernelSupported(kernel))
+    {
+    return false;
+    }
+  CurrentKernel = kernel;
+  return true;
+}
+
+//---------------------------------------------------------------------------
+int ImageCopy::GetKernel()
+{
+  return CurrentKernel;
+}
+
+//---------------------------------------------------------------------------
+const char* ImageCopy::GetKernelName(int kernel)
+{
+  switch (kernel)
+    {
+    case KERNEL_SCALAR: return "scalar";
+    case KERNEL_SSE2: return "SSE2";
+    case KERNEL_AVX2: return "AVX2";
+    default: return "unknown";
+    }
+}
+
+//---------------------------------------------------------------------------
+bool ImageCopy::IsKernelSupported(int kernel)
+{
+  return KernelSupported(kernel);
+}
+
+//---------------------------------------------------------------------------
+void ImageCopy::SetParallelThreshold(size_t bytes)
+{
+  ParallelThreshold = bytes;
+}
+
+//---------------------------------------------------------------------------
+size_t ImageCopy::GetParallelThreshold()
+{
+  return ParallelThreshold;
+}
+
+} // namespace igtlio
@@ -0,0 +1,62 @@
+#ifndef IGTLIOIMAGECOPY_H
+#define IGTLIOIMAGECOPY_H
+
+#include "igtlioConverterExport.h"
+
+// STD includes
+#include <cstddef>
+
+namespace igtlio
+{
+
+/** Copy of image scalars between messages and vtkImageData, with byte swap.
+ *
+ * The byte swap uses SSE2 or AVX2 kernels when the CPU supports them,
+ * chosen at run time, and a scalar loop otherwise. Large copies are split
+ * across threads.
+ */
+class OPENIGTLINKIO_CONVERTER_EXPORT ImageCopy
+{
+public:
+  enum Kernel
+  {
+    KERNEL_SCALAR,
+    KERNEL_SSE2,
+    KERNEL_AVX2
+  };
+
+  /// Copy count scalars of scalarSize (1, 2, 4 or 8) bytes,
+  /// swapping their bytes if swap is true.
+  static void CopyScalars(void* dst, const void* src, size_t count, int scalarSize, bool swap,
+                          int numberOfThreads=0);
+
+  /// Copy a contiguous sub-volume of svsize voxels into the volume of
+  /// size voxels at svoffset, as sent in image messages.
+  static void CopySubVolume(void* volume, const int size[3],
+                            const void* subVolume, const int svsize[3], const int svoffset[3],
+                            int scalarSize, int numComponents, bool swap,
+                            int numberOfThreads=0);
+
+  /// Copy the sub-volume of svsize voxels at svoffset of the volume of
+  /// size voxels into the contiguous subVolume, as sent in image messages.
+  static void ExtractSubVolume(void* subVolume, const void* volume, const int size[3],
+                               const int svsize[3], const int svoffset[3],
+                               int scalarSize, int numComponents, bool swap,
+                               int numberOfThreads=0);
+
+  /// Kernel used for the byte swap, the best one supported by default.
+  /// Return false if the kernel is not supported by the CPU or the build.
+  static bool SetKernel(int kernel);
+  static int GetKernel();
+  static const char* GetKernelName(int kernel);
+  static bool IsKernelSupported(int kernel);
+
+  /// Copies of at least this many bytes are split across threads, when
+  /// numberOfThreads is 0 (automatic). 4 MB by default.
+  static void SetParallelThreshold(size_t bytes);
+  static size_t GetParallelThreshold();
+};
+
+} // namespace igtlio
+
+#endif // IGTLIOIMAGECOPY_H
@@ -0,0 +1,425 @@
+#include "igtlioImageDelta.h"
+#include "igtlioImageScalarPool.h"
+
+#include <igtl_header.h>
+#include <igtl_image.h>
+#include <igtl_util.h>
+
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkUnsignedCharArray.h>
+#include <vtkVersion.h>
+
+#include <string.h>
+
+namespace // unnamed namespace
+{
+
+const igtlUint16 FormatVersion = 1;
+const igtlUint16 KeyframeFlag = 1;
+const int FormatHeaderSize = 16;
+
+// Unchanged bytes between two changes are kept in the same literal below
+// this count, which costs less than the varints of a new pair.
+const igtlUint64 MinimumUnchangedRun = 4;
+
+// Offset of the CRC in igtl_header
+const int CRCOffset = 50;
+
+//---------------------------------------------------------------------------
+// Message made of the already packed message, delta and image headers.
+class DeltaHeaderMessage : public igtl::MessageBase
+{
+public:
+  typedef DeltaHeaderMessage Self;
+  typedef igtl::MessageBase Superclass;
+  typedef igtl::SmartPointer<Self> Pointer;
+  typedef igtl::SmartPointer<const Self> ConstPointer;
+
+  igtlTypeMacro(DeltaHeaderMessage, igtl::MessageBase);
+  igtlNewMacro(DeltaHeaderMessage);
+
+  void SetPack(const unsigned char* messageHeader, const unsigned char* body, int bodySize)
+  {
+    this->AllocatePack(bodySize);
+    memcpy(this->GetPackPointer(), messageHeader, IGTL_HEADER_SIZE);
+    memcpy(this->GetPackBodyPointer(), body, bodySize);
+  }
+
+protected:
+  DeltaHeaderMessage() {}
+  ~DeltaHeaderMessage() {}
+};
+
+//---------------------------------------------------------------------------
+// Network byte order accessors
+//---------------------------------------------------------------------------
+void Put16(unsigned char* p, igtlUint16 v)
+{
+  p[0] = static_cast<unsigned char>(v >> 8);
+  p[1] = static_cast<unsigned char>(v);
+}
+
+void Put32(unsigned char* p, igtlUint32 v)
+{
+  for (int i=3; i>=0; --i, v >>= 8)
+    p[i] = static_cast<unsigned char>(v);
+}
+
+igtlUint16 Get16(const unsigned char* p)
+{
+  return static_cast<igtlUint16>((p[0] << 8) | p[1]);
+}
+
+igtlUint32 Get32(const unsigned char* p)
+{
+  igtlUint32 v = 0;
+  for (int i=0; i<4; ++i)
+    v = (v << 8) | p[i];
+  return v;
+}
+
+igtlUint64 Get64(const unsigned char* p)
+{
+  igtlUint64 v = 0;
+  for (int i=0; i<8; ++i)
+    v = (v << 8) | p[i];
+  return v;
+}
+
+//---------------------------------------------------------------------------
+// Unsigned LEB128 varints. NULL if end is reached first.
+unsigned char* PutVarint(unsigned char* p, unsigned char* end, igtlUint64 v)
+{
+  for (; p != end; v >>= 7)
+    {
+    if (v < 0x80)
+      {
+      *p++ = static_cast<unsigned char>(v);
+      return p;
+      }
+    *p++ = static_cast<unsigned char>(v | 0x80);
+    }
+  return NULL;
+}
+
+const unsigned char* GetVarint(const unsigned char* p, const unsigned char* end, igtlUint64* v)
+{
+  *v = 0;
+  for (int shift=0; p != end && shift < 64; shift += 7)
+    {
+    unsigned char byte = *p++;
+    *v |= static_cast<igtlUint64>(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return p;
+    }
+  return NULL;
+}
+
+//---------------------------------------------------------------------------
+// Image header of a DLT_IMAGE body, in host byte order, with the VTK scalar
+// type and the size of the whole frame. Return false if it does not
+// describe a whole 8 bit frame.
+bool ReadImageHeader(const unsigned char* body, igtl_image_header* imageHeader, int* scalarType, igtlUint64* frameSize)
+{
+  memcpy(imageHeader, body + FormatHeaderSize, IGTL_IMAGE_HEADER_SIZE);
+  igtl_image_convert_byte_order(imageHeader);
+  if (imageHeader->scalar_type == IGTL_IMAGE_STYPE_TYPE_UINT8)
+    *scalarType = VTK_UNSIGNED_CHAR;
+  else if (imageHeader->scalar_type == IGTL_IMAGE_STYPE_TYPE_INT8)
+    *scalarType = VTK_CHAR; // as ImageConverter
+  else
+    return false;
+  *frameSize = imageHeader->num_components;
+  for (int i=0; i<3; ++i)
+    {
+    if (imageHeader->subvol_size[i] != imageHeader->size[i] || imageHeader->subvol_offset[i] != 0)
+      return false;
+    *frameSize *= imageHeader->size[i];
+    }
+  return *frameSize > 0;
+}
+
+} // unnamed namespace
+
+namespace igtlio
+{
+
+//---------------------------------------------------------------------------
+bool ImageDelta::IsSupported(vtkImageData* image)
+{
+  return image && image->GetScalarSize() == 1;
+}
+
+//---------------------------------------------------------------------------
+int ImageDelta::toIGTLGather(const HeaderData& header, const ContentData& source,
+                             std::vector<unsigned char>* previous, FrameInfo* frame, GatherData* dest,
+                             bool copyKeyframe)
+{
+  if (!IsSupported(source.image))
+    {
+    std::cerr << "Only 8 bit images can be sent as deltas" << std::endl;
+    return 0;
+    }
+
+  // The image header and pixels of the IMAGE message of the whole frame.
+  igtl_image_header imageHeader;
+  GatherData image;
+  if (!ImageConverter::toIGTLImageHeader(source, &imageHeader, &image))
+    return 0;
+  const unsigned char* pixels = static_cast<const unsigned char*>(image.pixels);
+  igtlUint64 size = image.pixelSize;
+
+  if (previous->size() != size)
+    frame->keyframe = true;
+  if (!frame->keyframe)
+    {
+    // Not filled: only the written part of the delta is sent.
+    vtkSmartPointer<vtkUnsignedCharArray> delta = vtkSmartPointer<vtkUnsignedCharArray>::New();
+    delta->SetNumberOfValues(static_cast<vtkIdType>(size));
+    igtlUint64 deltaSize = 0;
+    if (Encode(&(*previous)[0], pixels, size, delta->GetPointer(0), size, &deltaSize))
+      {
+      dest->pixels = delta->GetPointer(0);
+      dest->pixelSize = deltaSize;
+      dest->pixelOwner = delta;
+      }
+    else
+      {
+      frame->keyframe = true;
+      }
+    }
+  if (frame->keyframe)
+    {
+    previous->assign(pixels, pixels + size);
+    frame->referenceFrame = frame->frame;
+    dest->pixels = image.pixels;
+    dest->pixelSize = size;
+    dest->pixelOwner = image.pixelOwner;
+    if (copyKeyframe)
+      {
+      // The image may be modified before the pixels are sent, and a torn
+      // keyframe would corrupt all the deltas applied to it.
+      vtkSmartPointer<vtkUnsignedCharArray> copy = vtkSmartPointer<vtkUnsignedCharArray>::New();
+      copy->SetNumberOfValues(static_cast<vtkIdType>(size));
+      memcpy(copy->GetPointer(0), &(*previous)[0], size);
+      dest->pixels = copy->GetPointer(0);
+      dest->pixelOwner = copy;
+      }
+    }
+
+  unsigned char body[FormatHeaderSize + IGTL_IMAGE_HEADER_SIZE];
+  Put16(body, FormatVersion);
+  Put16(body + 2, frame->keyframe ? KeyframeFlag : 0);
+  Put32(body + 4, frame->frame);
+  Put32(body + 8, frame->referenceFrame);
+  Put32(body + 12, 0);
+  memcpy(body + FormatHeaderSize, &imageHeader, IGTL_IMAGE_HEADER_SIZE);
+
+  igtl_uint64 crc = crc64(0, 0, 0);
+  crc = crc64(body, sizeof(body), crc);
+  crc = crc64(static_cast<unsigned char*>(const_cast<void*>(dest->pixels)), dest->pixelSize, crc);
+
+  igtl_header messageHeader;
+  memset(&messageHeader, 0, sizeof(messageHeader));
+  messageHeader.version = IGTL_HEADER_VERSION;
+  strncpy(messageHeader.name, GetIGTLTypeName(), IGTL_HEADER_TYPE_SIZE);
+  strncpy(messageHeader.device_name, header.deviceName.c_str(), IGTL_HEADER_NAME_SIZE);
+  messageHeader.timestamp = 0; // as for IMAGE
+  messageHeader.body_size = sizeof(body) + dest->pixelSize;
+  messageHeader.crc = crc;
+  igtl_header_convert_byte_order(&messageHeader);
+
+  DeltaHeaderMessage::Pointer headerMsg = DeltaHeaderMessage::New();
+  headerMsg->SetDeviceName(header.deviceName.c_str());
+  headerMsg->SetPack(reinterpret_cast<unsigned char*>(&messageHeader), body, sizeof(body));
+  dest->header = dynamic_pointer_cast<igtl::MessageBase>(headerMsg);
+  return 1;
+}
+
+//---------------------------------------------------------------------------
+int ImageDelta::GetFrameInfo(igtl::MessageBase* source, FrameInfo* frame)
+{
+  if (!source || source->GetPackBodySize() < FormatHeaderSize + IGTL_IMAGE_HEADER_SIZE)
+    return 0;
+  const unsigned char* body = static_cast<const unsigned char*>(source->GetPackBodyPointer());
+  if (Get16(body) != FormatVersion)
+    return 0;
+  frame->keyframe = (Get16(body + 2) & KeyframeFlag) != 0;
+  frame->frame = Get32(body + 4);
+  frame->referenceFrame = Get32(body + 8);
+  return 1;
+}
+
+//---------------------------------------------------------------------------
+int ImageDelta::fromIGTL(igtl::MessageBase::Pointer source, HeaderData* header, ContentData* dest, bool checkCRC,
+                         ImageScalarPool* pool)
+{
+  FrameInfo frame;
+  if (!GetFrameInfo(source, &frame))
+    return 0;
+
+  const unsigned char* pack = static_cast<const unsigned char*>(source->GetPackPointer());
+  unsigned char* body = static_cast<unsigned char*>(source->GetPackBodyPointer());
+  igtlUint64 bodySize = source->GetPackBodySize();
+  if (checkCRC && crc64(body, bodySize, crc64(0, 0, 0)) != Get64(pack + CRCOffset))
+    return 0;
+
+  igtl_image_header imageHeader;
+  int scalarType = VTK_VOID;
+  igtlUint64 frameSize = 0;
+  if (!ReadImageHeader(body, &imageHeader, &scalarType, &frameSize))
+    return 0;
+  const unsigned char* data = body + FormatHeaderSize + IGTL_IMAGE_HEADER_SIZE;
+  igtlUint64 dataSize = bodySize - FormatHeaderSize - IGTL_IMAGE_HEADER_SIZE;
+
+  int size[3] = { imageHeader.size[0], imageHeader.size[1], imageHeader.size[2] };
+  int numComponents = imageHeader.num_components;
+  vtkImageData* imageData = dest->image;
+  int sizeInImage[3] = { 0, 0, 0 };
+  if (imageData)
+    imageData->GetDimensions(sizeInImage);
+  bool fits = imageData
+    && sizeInImage[0] == size[0] && sizeInImage[1] == size[1] && sizeInImage[2] == size[2]
+    && imageData->GetScalarType() == scalarType
+    && imageData->GetNumberOfScalarComponents() == numComponents;
+
+  if (!IGTLtoHeader(source, header))
+    return 0;
+
+  if (frame.keyframe)
+    {
+    if (dataSize != frameSize)
+      return 0;
+    if (!fits)
+      {
+      if (!imageData)
+        {
+        dest->image = vtkSmartPointer<vtkImageData>::New();
+        imageData = dest->image;
+        }
+      imageData->SetDimensions(size[0], size[1], size[2]);
+      imageData->SetExtent(0, size[0]-1, 0, size[1]-1, 0, size[2]-1);
+      imageData->SetOrigin(0.0, 0.0, 0.0);
+      imageData->SetSpacing(1.0, 1.0, 1.0);
+#if (VTK_MAJOR_VERSION <= 5)
+      imageData->SetNumberOfScalarComponents(numComponents);
+      imageData->SetScalarType(scalarType);
+      imageData->AllocateScalars();
+#else
+      if (pool)
+        pool->AllocateScalars(imageData, scalarType, numComponents);
+      else
+        imageData->AllocateScalars(scalarType, numComponents);
+#endif
+      }
+    memcpy(imageData->GetScalarPointer(), data, frameSize);
+    }
+  else if (!fits || !Apply(data, dataSize, static_cast<unsigned char*>(imageData->GetScalarPointer()), frameSize))
+    {
+    return 0;
+    }
+  imageData->Modified();
+
+  float spacing[3];
+  float origin[3];
+  float norm_i[3];
+  float norm_j[3];
+  float norm_k[3];
+  igtl_image_get_matrix(spacing, origin, norm_i, norm_j, norm_k, &imageHeader);
+  igtl::Matrix4x4 matrix;
+  for (int i=0; i<3; ++i)
+    {
+    matrix[i][0] = norm_i[i];
+    matrix[i][1] = norm_j[i];
+    matrix[i][2] = norm_k[i];
+    matrix[i][3] = origin[i];
+    matrix[3][i] = 0.0;
+    }
+  matrix[3][3] = 1.0;
+  if (!dest->transform)
+    dest->transform = vtkSmartPointer<vtkMatrix4x4>::New();
+  return ImageConverter::IGTLToVTKTransform(size, spacing, matrix, dest->transform);
+}
+
+//---------------------------------------------------------------------------
+bool ImageDelta::Encode(unsigned char* previous, const unsigned char* current, igtlUint64 size,
+                        unsigned char* delta, igtlUint64 capacity, igtlUint64* deltaSize)
+{
+  unsigned char* out = delta;
+  unsigned char* end = delta + capacity;
+  igtlUint64 i = 0;
+  igtlUint64 unchangedStart = 0;
+  for (;;)
+    {
+    // Unchanged bytes, 8 at a time first
+    while (i+8 <= size && memcmp(previous + i, current + i, 8) == 0)
+      i += 8;
+    while (i < size && previous[i] == current[i])
+      ++i;
+    if (i == size)
+      break;
+
+    // Changed bytes, up to MinimumUnchangedRun unchanged ones
+    igtlUint64 changedStart = i;
+    igtlUint64 changedEnd = i;
+    while (i < size && i - changedEnd < MinimumUnchangedRun)
+      {
+      if (previous[i] != current[i])
+        changedEnd = i+1;
+      ++i;
+      }
+    i = changedEnd;
+
+    igtlUint64 length = changedEnd - changedStart;
+    out = PutVarint(out, end, changedStart - unchangedStart);
+    if (out)
+      out = PutVarint(out, end, length);
+    if (!out || static_cast<igtlUint64>(end - out) < length)
+      return false;
+    for (igtlUint64 k=changedStart; k<changedEnd; ++k)
+      {
+      *out++ = previous[k] ^ current[k];
+      previous[k] = current[k];
+      }
+    unchangedStart = changedEnd;
+    }
+  *deltaSize = out - delta;
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool ImageDelta::Apply(const unsigned char* delta, igtlUint64 deltaSize, unsigned char* pixels, igtlUint64 size)
+{
+  const unsigned char* end = delta + deltaSize;
+
+  // Validated first, so that a malformed delta leaves the pixels as they were.
+  for (int pass=0; pass<2; ++pass)
+    {
+    const unsigned char* p = delta;
+    igtlUint64 position = 0;
+    while (p != end)
+      {
+      igtlUint64 unchanged = 0;
+      igtlUint64 length = 0;
+      p = GetVarint(p, end, &unchanged);
+      if (p)
+        p = GetVarint(p, end, &length);
+      if (!p || unchanged > size - position || length > size - position - unchanged
+          || length > static_cast<igtlUint64>(end - p))
+        return false;
+      position += unchanged;
+      if (pass == 1)
+        {
+        unsigned char* ptr = pixels + position;
+        for (igtlUint64 k=0; k<length; ++k)
+          ptr[k] ^= p[k];
+        }
+      p += length;
+      position += length;
+      }
+    }
+  return true;
+}
+
+} // namespace igtlio
@@ -0,0 +1,85 @@
+#ifndef IGTLIOIMAGEDELTA_H
+#define IGTLIOIMAGEDELTA_H
+
+#include "igtlioConverterExport.h"
+
+#include "igtlioImageConverter.h"
+
+// STD includes
+#include <vector>
+
+namespace igtlio
+{
+
+/** Temporal delta encoding of 8 bit image streams, exchanged between OpenIGTLinkIO peers.
+ *
+ * A DLT_IMAGE message holds either a whole frame (keyframe), or the XOR of
+ * the frame with the previous one, run-length encoded. Ultrasound frames
+ * only change partially from one to the next, which makes most deltas a
+ * fraction of the frame. The receiver applies them in place to its image.
+ *
+ * DLT_IMAGE body, in network byte order:
+ *  - version (uint16), flags (uint16, 1 for a keyframe)
+ *  - frame number (uint32), frame the delta applies to (uint32)
+ *  - reserved (uint32)
+ *  - the header of the IMAGE message of the whole frame
+ *  - the pixels of a keyframe, or the delta: pairs of varints giving the
+ *    number of unchanged bytes and of changed bytes, followed by the XOR
+ *    of the changed bytes. The bytes after the last pair are unchanged.
+ *
+ * Its DLT_ prefix gives it the device key of IMAGE: both are received by
+ * the same ImageDevice. Peers list "DLT_IMAGE" in their CAPABILITY message.
+ */
+class OPENIGTLINKIO_CONVERTER_EXPORT ImageDelta : public BaseConverter
+{
+public:
+  typedef ImageConverter::ContentData ContentData;
+  typedef ImageConverter::GatherData GatherData;
+
+  struct FrameInfo
+  {
+  igtlUint32 frame;
+  igtlUint32 referenceFrame; // frame the delta applies to, frame for a keyframe
+  bool keyframe;
+  };
+
+  static const char* GetIGTLTypeName() { return "DLT_IMAGE"; }
+
+  /// True if the frames of image can be sent as deltas: 8 bit scalars,
+  /// of which the deltas do not depend on the byte order.
+  static bool IsSupported(vtkImageData* image);
+
+  /// Message of the frame in source.image, sent as a GatherData: the
+  /// pixels of a keyframe stay in the image unless copyKeyframe is set,
+  /// e.g. when sent later from another thread, a delta is owned by dest.
+  /// previous holds the last frame sent and is updated to this one. The
+  /// frame is sent as a keyframe if frame->keyframe is set, if previous
+  /// does not match the image, or if the delta is not smaller than it.
+  static int toIGTLGather(const HeaderData& header, const ContentData& source,
+                          std::vector<unsigned char>* previous, FrameInfo* frame, GatherData* dest,
+                          bool copyKeyframe=false);
+
+  /// Frame numbers of a received DLT_IMAGE message. Return 0 if invalid.
+  static int GetFrameInfo(igtl::MessageBase* source, FrameInfo* frame);
+
+  /// Copy a keyframe into dest->image, with new scalars (from pool if given)
+  /// if its dimensions or scalar type differ, or apply a delta to it in
+  /// place. The caller checks that dest->image holds the reference frame of
+  /// the delta. Return 0 if the message is invalid or does not apply to
+  /// dest->image, unmodified then.
+  static int fromIGTL(igtl::MessageBase::Pointer source, HeaderData* header, ContentData* dest, bool checkCRC,
+                      ImageScalarPool* pool=NULL);
+
+  /// Write the delta from previous to current into delta, and update
+  /// previous to current. Return false if the delta exceeds capacity.
+  static bool Encode(unsigned char* previous, const unsigned char* current, igtlUint64 size,
+                     unsigned char* delta, igtlUint64 capacity, igtlUint64* deltaSize);
+
+  /// Apply a delta to pixels. Return false, pixels unmodified, if the
+  /// delta is malformed or exceeds size.
+  static bool Apply(const unsigned char* delta, igtlUint64 deltaSize, unsigned char* pixels, igtlUint64 size);
+};
+
+} // namespace igtlio
+
+#endif // IGTLIOIMAGEDELTA_H
@@ -0,0 +1,156 @@
+#include "igtlioImageScalarPool.h"
+
+// VTK includes
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+
+// STD includes
+#include <stdlib.h>
+
+namespace igtlio
+{
+
+//---------------------------------------------------------------------------
+vtkStandardNewMacro(ImageScalarPool);
+
+//---------------------------------------------------------------------------
+ImageScalarPool::ImageScalarPool()
+{
+  this->MaximumNumberOfBuffers = 4;
+  this->NumberOfUses = 0;
+  this->NumberOfReuses = 0;
+  this->NumberOfAllocations = 0;
+}
+
+//---------------------------------------------------------------------------
+ImageScalarPool::~ImageScalarPool()
+{
+  for (unsigned i=0; i<this->Buffers.size(); ++i)
+    {
+    Buffer& buffer = this->Buffers[i];
+    if (this->IsIdle(buffer))
+      {
+      free(buffer.Data);
+      }
+    else
+      {
+      // The array frees the buffer when it is done with it.
+      buffer.Array->SetVoidArray(buffer.Data, buffer.Array->GetNumberOfValues(), 0,
+                                 vtkAbstractArray::VTK_DATA_ARRAY_FREE);
+      }
+    }
+}
+
+//---------------------------------------------------------------------------
+void ImageScalarPool::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "MaximumNumberOfBuffers: " << this->MaximumNumberOfBuffers << "\n";
+  os << indent << "NumberOfBuffers: " << this->Buffers.size() << "\n";
+  os << indent << "NumberOfReuses: " << this->NumberOfReuses << "\n";
+  os << indent << "NumberOfAllocations: " << this->NumberOfAllocations << "\n";
+  os << indent << "AllocatedBytes: " << this->GetAllocatedBytes() << "\n";
+}
+
+//---------------------------------------------------------------------------
+bool ImageScalarPool::IsIdle(const Buffer& buffer)
+{
+  return !buffer.Array || buffer.Array->GetReferenceCount() == 1;
+}
+
+//---------------------------------------------------------------------------
+void ImageScalarPool::AllocateScalars(vtkImageData* image, int scalarType, int numComponents)
+{
+  // Released first, so that its buffer can be reused for the new scalars.
+  image->GetPointData()->SetScalars(NULL);
+  vtkIdType numberOfTuples = image->GetNumberOfPoints();
+  image->GetPointData()->SetScalars(this->GetScalars(scalarType, numComponents, numberOfTuples));
+}
+
+//---------------------------------------------------------------------------
+vtkDataArray* ImageScalarPool::GetScalars(int scalarType, int numComponents, vtkIdType numberOfTuples)
+{
+  vtkSmartPointer<vtkDataArray> array;
+  array.TakeReference(vtkDataArray::CreateDataArray(scalarType));
+  array->SetNumberOfComponents(numComponents);
+  vtkIdType numberOfValues = numberOfTuples*numComponents;
+  size_t size = static_cast<size_t>(numberOfValues)*array->GetDataTypeSize();
+
+  // The smallest idle buffer large enough
+  Buffer* buffer = NULL;
+  for (unsigned i=0; i<this->Buffers.size(); ++i)
+    {
+    Buffer& candidate = this->Buffers[i];
+    if (candidate.Capacity >= size && this->IsIdle(candidate)
+        && (!buffer || candidate.Capacity < buffer->Capacity))
+      {
+      buffer = &candidate;
+      }
+    }
+  if (buffer)
+    {
+    ++this->NumberOfReuses;
+    }
+  else
+    {
+    Buffer added;
+    added.Capacity = size > 0 ? size : 1;
+    added.Data = malloc(added.Capacity);
+    this->Buffers.push_back(added);
+    buffer = &this->Buffers.back();
+    ++this->NumberOfAllocations;
+    }
+
+  // Kept by the pool, which frees the buffer: the array must not.
+  array->SetVoidArray(buffer->Data, numberOfValues, 1);
+  array->SetName("ImageScalars");
+  buffer->Array = array;
+  buffer->LastUse = ++this->NumberOfUses;
+  this->FreeIdleBuffers();
+  return array;
+}
+
+//---------------------------------------------------------------------------
+void ImageScalarPool::FreeIdleBuffers()
+{
+  while (static_cast<int>(this->Buffers.size()) > this->MaximumNumberOfBuffers)
+    {
+    int oldest = -1;
+    for (unsigned i=0; i<this->Buffers.size(); ++i)
+      {
+      if (this->IsIdle(this->Buffers[i])
+          && (oldest < 0 || this->Buffers[i].LastUse < this->Buffers[oldest].LastUse))
+        {
+        oldest = i;
+        }
+      }
+    if (oldest < 0)
+      {
+      return;
+      }
+    free(this->Buffers[oldest].Data);
+    this->Buffers.erase(this->Buffers.begin() + oldest);
+    }
+}
+
+//---------------------------------------------------------------------------
+vtkTypeInt64 ImageScalarPool::GetAllocatedBytes()
+{
+  vtkTypeInt64 bytes = 0;
+  for (unsigned i=0; i<this->Buffers.size(); ++i)
+    {
+    bytes += this->Buffers[i].Capacity;
+    }
+  return bytes;
+}
+
+//---------------------------------------------------------------------------
+void ImageScalarPool::ResetStatistics()
+{
+  this->NumberOfReuses = 0;
+  this->NumberOfAllocations = 0;
+}
+
+} // namespace igtlio
@@ -0,0 +1,90 @@
+#ifndef IGTLIOIMAGESCALARPOOL_H
+#define IGTLIOIMAGESCALARPOOL_H
+
+#include "igtlioConverterExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <vector>
+
+class vtkDataArray;
+class vtkImageData;
+
+namespace igtlio
+{
+typedef vtkSmartPointer<class ImageScalarPool> ImageScalarPoolPointer;
+
+/// Scalar buffers of an image stream, reused when its geometry changes.
+///
+/// When the dimensions, scalar type or number of components of received
+/// images change, the scalars of the image are taken from the pool instead
+/// of newly allocated: the smallest idle buffer the frame fits in is
+/// reused, whatever the scalar type it held. A buffer is idle once its
+/// array is no longer referenced outside the pool, by the image or by a
+/// pipeline. The image itself is kept, see ImageConverter::fromIGTL().
+///
+/// Up to MaximumNumberOfBuffers buffers are kept, the least recently used
+/// idle ones are freed beyond. Buffers still in use when the pool is
+/// deleted are handed over to their arrays.
+///
+/// Not thread safe: each ImageDevice has its own.
+///
+class OPENIGTLINKIO_CONVERTER_EXPORT ImageScalarPool : public vtkObject
+{
+public:
+  static ImageScalarPool *New();
+  vtkTypeMacro(ImageScalarPool, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Replace the scalars of image, for its current dimensions, as
+  /// vtkImageData::AllocateScalars() does. The values are not initialized.
+  void AllocateScalars(vtkImageData* image, int scalarType, int numComponents);
+
+  /// Array of numberOfTuples tuples on a pooled buffer, referenced by the pool.
+  vtkDataArray* GetScalars(int scalarType, int numComponents, vtkIdType numberOfTuples);
+
+  /// 4 by default, which covers a scanner switching between a few depths.
+  vtkSetMacro(MaximumNumberOfBuffers, int);
+  vtkGetMacro(MaximumNumberOfBuffers, int);
+
+  /// Statistics
+  /// Arrays given on an idle buffer, and on a newly allocated one.
+  vtkGetMacro(NumberOfReuses, vtkTypeInt64);
+  vtkGetMacro(NumberOfAllocations, vtkTypeInt64);
+  /// Bytes of the buffers kept, in use or idle.
+  vtkTypeInt64 GetAllocatedBytes();
+  void ResetStatistics();
+
+protected:
+  ImageScalarPool();
+  virtual ~ImageScalarPool();
+
+private:
+  ImageScalarPool(const ImageScalarPool&); // Not implemented
+  void operator=(const ImageScalarPool&); // Not implemented
+
+  struct Buffer
+  {
+    void* Data;
+    size_t Capacity;
+    vtkSmartPointer<vtkDataArray> Array; // the last one given on the buffer
+    vtkTypeInt64 LastUse;
+  };
+
+  bool IsIdle(const Buffer& buffer);
+  void FreeIdleBuffers();
+
+  std::vector<Buffer> Buffers;
+  int MaximumNumberOfBuffers;
+  vtkTypeInt64 NumberOfUses;
+
+  vtkTypeInt64 NumberOfReuses;
+  vtkTypeInt64 NumberOfAllocations;
+};
+
+} // namespace igtlio
+
+#endif // IGTLIOIMAGESCALARPOOL_H
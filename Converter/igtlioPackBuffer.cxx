@@ -0,0 +1,239 @@
+#include "igtlioPackBuffer.h"
+
+#include <vtkDataArray.h>
+#include <vtkMutexLock.h>
+#include <vtkVersion.h>
+
+// STD includes
+#include <map>
+#include <vector>
+
+// vtkAbstractArray::SetArrayFreeFunction() appeared in VTK 8.1
+#if VTK_MAJOR_VERSION > 8 || (VTK_MAJOR_VERSION == 8 && VTK_MINOR_VERSION >= 1)
+#define IGTLIO_PACKBUFFER_ADOPT
+#endif
+
+namespace // unnamed namespace
+{
+
+//---------------------------------------------------------------------------
+// Gives access to the protected pack of igtl::MessageBase.
+struct PackAccess : public igtl::MessageBase
+{
+  static unsigned char*& Header(igtl::MessageBase* message)
+  {
+    return message->*(&PackAccess::m_Header);
+  }
+  static unsigned char*& Body(igtl::MessageBase* message)
+  {
+    return message->*(&PackAccess::m_Body);
+  }
+  static int& PackSize(igtl::MessageBase* message)
+  {
+    return message->*(&PackAccess::m_PackSize);
+  }
+};
+
+struct Owner
+{
+  void* Object;
+  igtlio::PackBuffer::DetachFunction Detach;
+  igtlio::PackBuffer::ReleaseFunction Release;
+};
+
+struct AdoptedPack
+{
+  unsigned char* Pack;
+  size_t Capacity;
+  void* Owner; // NULL: allocated by igtl, or owner removed
+  bool NewPack; // allocated by PackBuffer::NewPack()
+};
+
+const size_t PackAlignment = 16;
+
+//---------------------------------------------------------------------------
+// Adopted packs by the data pointer given to their array.
+class Registry
+{
+public:
+  vtkSimpleMutexLock Mutex;
+  std::vector<Owner> Owners;
+  std::map<void*, AdoptedPack> Packs;
+};
+
+Registry& GetRegistry()
+{
+  static Registry registry;
+  return registry;
+}
+
+//---------------------------------------------------------------------------
+void ReleasePack(void* data)
+{
+  Registry& registry = GetRegistry();
+  registry.Mutex.Lock();
+  std::map<void*, AdoptedPack>::iterator iter = registry.Packs.find(data);
+  if (iter == registry.Packs.end())
+    {
+    registry.Mutex.Unlock();
+    return;
+    }
+  AdoptedPack pack = iter->second;
+  registry.Packs.erase(iter);
+
+  // Under the lock, so that the owner cannot be removed meanwhile.
+  for (unsigned i=0; pack.Owner && i<registry.Owners.size(); ++i)
+    {
+    if (registry.Owners[i].Object == pack.Owner)
+      {
+      registry.Owners[i].Release(pack.Owner, pack.Pack, pack.Capacity);
+      registry.Mutex.Unlock();
+      return;
+      }
+    }
+  registry.Mutex.Unlock();
+
+  if (pack.NewPack)
+    {
+    igtlio::PackBuffer::DeletePack(pack.Pack);
+    }
+  else
+    {
+    delete [] pack.Pack;
+    }
+}
+
+} // unnamed namespace
+
+
+namespace igtlio
+{
+
+//---------------------------------------------------------------------------
+vtkDataArray* PackBuffer::Adopt(igtl::MessageBase* message, void* data,
+                                int scalarType, int numComponents, vtkIdType numberOfValues)
+{
+#ifdef IGTLIO_PACKBUFFER_ADOPT
+  unsigned char* pack = PackAccess::Header(message);
+  unsigned char* begin = static_cast<unsigned char*>(data);
+  if (!pack || begin < pack)
+    {
+    return NULL;
+    }
+
+  vtkDataArray* array = vtkDataArray::CreateDataArray(scalarType);
+  if (!array)
+    {
+    return NULL;
+    }
+  size_t end = (begin - pack) + numberOfValues*array->GetDataTypeSize();
+  if (end > static_cast<size_t>(PackAccess::PackSize(message))
+      || reinterpret_cast<size_t>(begin) % array->GetDataTypeSize() != 0)
+    {
+    array->Delete();
+    return NULL;
+    }
+
+  AdoptedPack adopted;
+  adopted.Pack = pack;
+  adopted.Capacity = PackAccess::PackSize(message);
+  adopted.Owner = NULL;
+  adopted.NewPack = false;
+
+  Registry& registry = GetRegistry();
+  registry.Mutex.Lock();
+  for (unsigned i=0; i<registry.Owners.size(); ++i)
+    {
+    if (registry.Owners[i].Detach(registry.Owners[i].Object, message, &adopted.Capacity))
+      {
+      adopted.Owner = registry.Owners[i].Object;
+      adopted.NewPack = true;
+      break;
+      }
+    }
+  registry.Packs[data] = adopted;
+  registry.Mutex.Unlock();
+
+  PackAccess::Header(message) = NULL;
+  PackAccess::Body(message) = NULL;
+  PackAccess::PackSize(message) = 0;
+
+  array->SetNumberOfComponents(numComponents);
+  array->SetArrayFreeFunction(&ReleasePack);
+  array->SetVoidArray(data, numberOfValues, 0, vtkAbstractArray::VTK_DATA_ARRAY_USER_DEFINED);
+  return array;
+#else
+  return NULL;
+#endif
+}
+
+//---------------------------------------------------------------------------
+void PackBuffer::AddOwner(void* owner, DetachFunction detach, ReleaseFunction release)
+{
+  Owner entry;
+  entry.Object = owner;
+  entry.Detach = detach;
+  entry.Release = release;
+
+  Registry& registry = GetRegistry();
+  registry.Mutex.Lock();
+  registry.Owners.push_back(entry);
+  registry.Mutex.Unlock();
+}
+
+//---------------------------------------------------------------------------
+void PackBuffer::RemoveOwner(void* owner)
+{
+  Registry& registry = GetRegistry();
+  registry.Mutex.Lock();
+  for (unsigned i=0; i<registry.Owners.size(); ++i)
+    {
+    if (registry.Owners[i].Object == owner)
+      {
+      registry.Owners.erase(registry.Owners.begin()+i);
+      break;
+      }
+    }
+  for (std::map<void*, AdoptedPack>::iterator iter = registry.Packs.begin(); iter != registry.Packs.end(); ++iter)
+    {
+    if (iter->second.Owner == owner)
+      {
+      iter->second.Owner = NULL;
+      }
+    }
+  registry.Mutex.Unlock();
+}
+
+//---------------------------------------------------------------------------
+unsigned char* PackBuffer::NewPack(size_t capacity, size_t dataOffset)
+{
+  // Shifted by 1 to PackAlignment bytes from the allocation, the shift
+  // being stored in the byte before the pack.
+  unsigned char* allocation = new unsigned char[capacity + PackAlignment];
+  size_t misalignment = (reinterpret_cast<size_t>(allocation) + 1 + dataOffset) % PackAlignment;
+  size_t shift = 1 + (misalignment ? PackAlignment - misalignment : 0);
+  unsigned char* pack = allocation + shift;
+  pack[-1] = static_cast<unsigned char>(shift);
+  return pack;
+}
+
+//---------------------------------------------------------------------------
+void PackBuffer::DeletePack(unsigned char* pack)
+{
+  if (pack)
+    {
+    delete [] (pack - pack[-1]);
+    }
+}
+
+//---------------------------------------------------------------------------
+int PackBuffer::GetNumberOfAdoptedPacks()
+{
+  Registry& registry = GetRegistry();
+  registry.Mutex.Lock();
+  int n = static_cast<int>(registry.Packs.size());
+  registry.Mutex.Unlock();
+  return n;
+}
+
+} // namespace igtlio
@@ -0,0 +1,58 @@
+#ifndef IGTLIOPACKBUFFER_H
+#define IGTLIOPACKBUFFER_H
+
+#include "igtlioConverterExport.h"
+
+#include <igtlMessageBase.h>
+
+#include <vtkType.h>
+
+// STD includes
+#include <cstddef>
+
+class vtkDataArray;
+
+namespace igtlio
+{
+
+/** Hands the pack of a received message over to a vtkDataArray.
+ *
+ * The array takes the pack buffer of the message, which is left without
+ * pack as if newly created. When the array releases the buffer, it goes
+ * back to the owner of the pack, e.g. the BufferPool of the connector the
+ * message was received by, or is deleted.
+ */
+class OPENIGTLINKIO_CONVERTER_EXPORT PackBuffer
+{
+public:
+  /// Give the pack of message to the owner, if it allocated it: on
+  /// success, set capacity and return true.
+  typedef bool (*DetachFunction)(void* owner, igtl::MessageBase* message, size_t* capacity);
+  /// Return a pack to its owner. Called from any thread.
+  typedef void (*ReleaseFunction)(void* owner, unsigned char* pack, size_t capacity);
+
+  /// Create an array of scalarType over numberOfValues values at data,
+  /// inside the pack of message, taking the pack. Return NULL if the pack
+  /// cannot be adopted (misaligned data, VTK older than 8.1).
+  static vtkDataArray* Adopt(igtl::MessageBase* message, void* data,
+                             int scalarType, int numComponents, vtkIdType numberOfValues);
+
+  /// Owners of packs are asked to detach the packs adopted by arrays.
+  /// Their packs are allocated by NewPack().
+  static void AddOwner(void* owner, DetachFunction detach, ReleaseFunction release);
+  /// Packs still adopted are deleted instead of returned to the owner.
+  static void RemoveOwner(void* owner);
+
+  /// Pack of capacity bytes, of which the data at dataOffset, e.g. the
+  /// pixels of an IMAGE message, is 16 byte aligned so that arrays of any
+  /// scalar type can adopt it. Deleted by DeletePack(), not delete [].
+  static unsigned char* NewPack(size_t capacity, size_t dataOffset);
+  static void DeletePack(unsigned char* pack);
+
+  /// Number of packs currently held by arrays.
+  static int GetNumberOfAdoptedPacks();
+};
+
+} // namespace igtlio
+
+#endif // IGTLIOPACKBUFFER_H
@@ -13,243 +13,673 @@
 ==========================================================================*/
 
 #include "igtlioPolyDataConverter.h"
+#include "igtlioImageCopy.h"
+
+#include <igtl_header.h>
+#include <igtl_util.h>
 
 #include <vtkPolyData.h>
-#include <vtkVertex.h>
 #include <vtkCellArray.h>
-#include <vtkPolyLine.h>
-#include <vtkPolygon.h>
-#include <vtkTriangleStrip.h>
 #include <vtkFloatArray.h>
+#include <vtkIdTypeArray.h>
 #include <vtkPointData.h>
 #include <vtkCellData.h>
+#include <vtkVersion.h>
 
+#include <string.h>
+#include <limits>
+#include <vector>
 
-namespace igtlio
+namespace // unnamed namespace
 {
 
+// Layout of the POLYDATA content, see igtl_polydata.h
+const int PolyDataHeaderSize = 40;
+const int AttributeHeaderSize = 6;
+const size_t MaximumAttributeNameLength = 255;
+
 //---------------------------------------------------------------------------
-int PolyDataConverter::IGTLToVTK(igtl::MessageBase::Pointer source, PolyDataConverter::MessageContent *dest, bool checkCRC)
+// POLYDATA message packed from a vtkPolyData, without the igtl arrays.
+class PackedPolyDataMessage : public igtl::PolyDataMessage
 {
- // Create a message buffer to receive image data
- igtl::PolyDataMessage::Pointer polyDataMsg;
- polyDataMsg = igtl::PolyDataMessage::New();
- polyDataMsg->Copy(source); // !! TODO: copy makes performance issue.
+public:
+  typedef PackedPolyDataMessage Self;
+  typedef igtl::PolyDataMessage Superclass;
+  typedef igtl::SmartPointer<Self> Pointer;
+  typedef igtl::SmartPointer<const Self> ConstPointer;
+
+  igtlTypeMacro(PackedPolyDataMessage, igtl::PolyDataMessage);
+  igtlNewMacro(PackedPolyDataMessage);
+
+  unsigned char* AllocateBody(int bodySize)
+  {
+    this->AllocatePack(bodySize);
+    return static_cast<unsigned char*>(this->GetPackBodyPointer());
+  }
+
+  // Cells written in the body by the last call, left in place by
+  // AllocatePack() when the size of the pack is unchanged.
+  vtkCellArray* Cells[4];
+  vtkMTimeType CellsTime[4];
+  vtkIdType NumberOfPoints;
+  int BodySize;
+  void* Body;
+
+protected:
+  PackedPolyDataMessage() : NumberOfPoints(0), BodySize(0), Body(NULL)
+  {
+    for (int c=0; c<4; ++c)
+      {
+      this->Cells[c] = NULL;
+      this->CellsTime[c] = 0;
+      }
+  }
+  ~PackedPolyDataMessage() {}
+};
 
- // Deserialize the data
- // If CheckCRC==0, CRC check is skipped.
- int c = polyDataMsg->Unpack(checkCRC);
+//---------------------------------------------------------------------------
+// Network byte order accessors
+//---------------------------------------------------------------------------
+void Put32(unsigned char* p, igtlUint32 v)
+{
+  p[0] = static_cast<unsigned char>(v >> 24);
+  p[1] = static_cast<unsigned char>(v >> 16);
+  p[2] = static_cast<unsigned char>(v >> 8);
+  p[3] = static_cast<unsigned char>(v);
+}
+
+igtlUint32 Get32(const unsigned char* p)
+{
+  return (static_cast<igtlUint32>(p[0]) << 24) | (static_cast<igtlUint32>(p[1]) << 16)
+    | (static_cast<igtlUint32>(p[2]) << 8) | p[3];
+}
+
+//---------------------------------------------------------------------------
+// Big endian float32 <-> float arrays, byte swapped with the kernels of ImageCopy.
+void ReadFloats(float* dst, const unsigned char* src, size_t count)
+{
+  igtlio::ImageCopy::CopyScalars(dst, src, count, 4, igtl_is_little_endian() != 0);
+}
+
+template <class T>
+void ConvertToFloats(unsigned char* dst, const T* src, size_t count)
+{
+  for (size_t i=0; i<count; ++i, dst+=4)
+    {
+    igtlFloat32 value = static_cast<igtlFloat32>(src[i]);
+    igtlUint32 bits;
+    memcpy(&bits, &value, 4);
+    Put32(dst, bits);
+    }
+}
+
+unsigned char* WriteFloats(unsigned char* dst, vtkDataArray* array)
+{
+  size_t count = static_cast<size_t>(array->GetNumberOfTuples())*array->GetNumberOfComponents();
+  if (array->GetDataType() == VTK_FLOAT)
+    {
+    igtlio::ImageCopy::CopyScalars(dst, array->GetVoidPointer(0), count, 4, igtl_is_little_endian() != 0);
+    }
+  else
+    {
+    switch (array->GetDataType())
+      {
+      vtkTemplateMacro(ConvertToFloats(dst, static_cast<const VTK_TT*>(array->GetVoidPointer(0)), count));
+      }
+    }
+  return dst + 4*count;
+}
+
+//---------------------------------------------------------------------------
+// Cells of the message: for each one, its number of points then their ids.
+// NULL if malformed or if an id exceeds npoints.
+vtkSmartPointer<vtkCellArray> ReadCells(const unsigned char* data, igtlUint32 ncells, igtlUint32 size, igtlUint32 npoints)
+{
+  igtlUint32 words = size/4;
+  if (size%4 != 0 || words < ncells)
+    {
+    return NULL;
+    }
 
- if ((c & igtl::MessageHeader::UNPACK_BODY) == 0) // if CRC check fails
+  vtkSmartPointer<vtkIdTypeArray> connectivity = vtkSmartPointer<vtkIdTypeArray>::New();
+#if VTK_MAJOR_VERSION >= 9
+  vtkSmartPointer<vtkIdTypeArray> offsets = vtkSmartPointer<vtkIdTypeArray>::New();
+  offsets->SetNumberOfValues(static_cast<vtkIdType>(ncells)+1);
+  connectivity->SetNumberOfValues(words - ncells);
+  vtkIdType* offset = offsets->GetPointer(0);
+#else
+  // Legacy layout, the same as the message.
+  connectivity->SetNumberOfValues(words);
+#endif
+  vtkIdType* id = connectivity->GetPointer(0);
+
+  const unsigned char* p = data;
+  const unsigned char* end = data + size;
+  vtkIdType position = 0;
+  for (igtlUint32 i=0; i<ncells; ++i)
+    {
+    if (p == end)
+      {
+      return NULL;
+      }
+    igtlUint32 n = Get32(p);
+    p += 4;
+    // The count words of the cells to come must still fit.
+    igtlUint32 left = static_cast<igtlUint32>(end - p)/4;
+    igtlUint32 counts = ncells - i - 1;
+    if (left < counts || n > left - counts)
+      {
+      return NULL;
+      }
+#if VTK_MAJOR_VERSION >= 9
+    offset[i] = position;
+#else
+    *id++ = n;
+#endif
+    for (const unsigned char* last = p + 4*n; p != last; p += 4)
+      {
+      igtlUint32 pointId = Get32(p);
+      if (pointId >= npoints)
+        {
+        return NULL;
+        }
+      *id++ = pointId;
+      }
+    position += n;
+    }
+  if (p != end)
+    {
+    return NULL;
+    }
+
+  vtkSmartPointer<vtkCellArray> cells = vtkSmartPointer<vtkCellArray>::New();
+#if VTK_MAJOR_VERSION >= 9
+  offset[ncells] = position;
+  cells->SetData(offsets, connectivity);
+#else
+  cells->SetCells(ncells, connectivity);
+#endif
+  return cells;
+}
+
+//---------------------------------------------------------------------------
+igtlUint32 GetCellsSize(vtkCellArray* cells)
+{
+  if (!cells || cells->GetNumberOfCells() == 0)
+    {
+    return 0;
+    }
+#if VTK_MAJOR_VERSION >= 9
+  return static_cast<igtlUint32>(4*(cells->GetNumberOfCells() + cells->GetNumberOfConnectivityIds()));
+#else
+  return static_cast<igtlUint32>(4*cells->GetNumberOfConnectivityEntries());
+#endif
+}
+
+//---------------------------------------------------------------------------
+// Whether the cells of the message are those of cells, as checked by
+// ReadCells() when they were read.
+#if VTK_MAJOR_VERSION >= 9
+template <class ArrayT>
+bool SameCells(const unsigned char* p, ArrayT* offsets, ArrayT* connectivity)
+{
+  vtkIdType ncells = offsets->GetNumberOfValues() - 1;
+  const typename ArrayT::ValueType* offset = offsets->GetPointer(0);
+  const typename ArrayT::ValueType* id = connectivity->GetPointer(0);
+  for (vtkIdType i=0; i<ncells; ++i)
+    {
+    if (Get32(p) != static_cast<igtlUint32>(offset[i+1] - offset[i]))
+      {
+      return false;
+      }
+    p += 4;
+    for (vtkIdType j=offset[i]; j<offset[i+1]; ++j, p += 4)
+      {
+      if (Get32(p) != static_cast<igtlUint32>(id[j]))
+        {
+        return false;
+        }
+      }
+    }
+  return true;
+}
+#endif
+
+bool SameCells(const unsigned char* data, igtlUint32 ncells, igtlUint32 size, vtkCellArray* cells)
+{
+  vtkIdType current = cells ? cells->GetNumberOfCells() : 0;
+  if (current != static_cast<vtkIdType>(ncells))
+    {
+    return false;
+    }
+  if (ncells == 0)
+    {
+    return size == 0;
+    }
+  if (GetCellsSize(cells) != size)
+    {
+    return false;
+    }
+#if VTK_MAJOR_VERSION >= 9
+  if (cells->IsStorage64Bit())
+    {
+    return SameCells(data, cells->GetOffsetsArray64(), cells->GetConnectivityArray64());
+    }
+  return SameCells(data, cells->GetOffsetsArray32(), cells->GetConnectivityArray32());
+#else
+  // Legacy layout, the same as the message.
+  const vtkIdType* entry = cells->GetPointer();
+  for (igtlUint32 i=0; i<size/4; ++i, data += 4)
+    {
+    if (Get32(data) != static_cast<igtlUint32>(entry[i]))
+      {
+      return false;
+      }
+    }
+  return true;
+#endif
+}
+
+#if VTK_MAJOR_VERSION >= 9
+template <class ArrayT>
+unsigned char* WriteCells(unsigned char* p, ArrayT* offsets, ArrayT* connectivity)
+{
+  vtkIdType ncells = offsets->GetNumberOfValues() - 1;
+  const typename ArrayT::ValueType* offset = offsets->GetPointer(0);
+  const typename ArrayT::ValueType* id = connectivity->GetPointer(0);
+  for (vtkIdType i=0; i<ncells; ++i)
+    {
+    Put32(p, static_cast<igtlUint32>(offset[i+1] - offset[i]));
+    p += 4;
+    for (vtkIdType j=offset[i]; j<offset[i+1]; ++j, p += 4)
+      {
+      Put32(p, static_cast<igtlUint32>(id[j]));
+      }
+    }
+  return p;
+}
+#endif
+
+unsigned char* WriteCells(unsigned char* p, vtkCellArray* cells)
+{
+  if (!cells || cells->GetNumberOfCells() == 0)
+    {
+    return p;
+    }
+#if VTK_MAJOR_VERSION >= 9
+  if (cells->IsStorage64Bit())
+    {
+    return WriteCells(p, cells->GetOffsetsArray64(), cells->GetConnectivityArray64());
+    }
+  return WriteCells(p, cells->GetOffsetsArray32(), cells->GetConnectivityArray32());
+#else
+  const vtkIdType* entry = cells->GetPointer();
+  vtkIdType nentries = cells->GetNumberOfConnectivityEntries();
+  for (vtkIdType i=0; i<nentries; ++i, p += 4)
+    {
+    Put32(p, static_cast<igtlUint32>(entry[i]));
+    }
+  return p;
+#endif
+}
+
+//---------------------------------------------------------------------------
+// Point data then cell data arrays, with their igtl attribute type.
+void GetAttributes(vtkPolyData* poly, std::vector<vtkDataArray*>* arrays, std::vector<int>* types)
+{
+  vtkDataSetAttributes* attributes[2] = { poly->GetPointData(), poly->GetCellData() };
+  for (int a=0; a<2; ++a)
+    {
+    // NOTE: Data types for POINT (igtl::PolyDataMessage::POINT_*) and CELL
+    // (igtl::PolyDataMessage::CELL_*) have the same bits exept the 3rd bit (0x10).
+    // See, igtlPolyDataMessage.h in the OpenIGTLink library.
+    int attrTypeBit = a == 0 ? 0x00 : 0x10;
+    for (int i=0; i<attributes[a]->GetNumberOfArrays(); ++i)
+      {
+      vtkDataArray* array = attributes[a]->GetArray(i);
+      int type;
+      switch (array ? array->GetNumberOfComponents() : 0)
+        {
+        case 1: type = igtl::PolyDataAttribute::POINT_SCALAR; break;
+        case 3: type = igtl::PolyDataAttribute::POINT_NORMAL; break; // TODO: how to differenciate normal and vector?
+        case 4: type = igtl::PolyDataAttribute::POINT_RGBA; break;
+        case 9: type = igtl::PolyDataAttribute::POINT_TENSOR; break;
+        default: continue;
+        }
+      arrays->push_back(array);
+      types->push_back(type | attrTypeBit);
+      }
+    }
+}
+
+size_t GetAttributeNameLength(vtkDataArray* array)
+{
+  const char* name = array->GetName();
+  size_t length = name ? strlen(name) : 0;
+  return length < MaximumAttributeNameLength ? length : MaximumAttributeNameLength;
+}
+
+//---------------------------------------------------------------------------
+// Sections of the content of a POLYDATA message, checked against its size.
+struct AttributeSection
+{
+  int Type;
+  int NumberOfComponents;
+  igtlUint32 NumberOfTuples;
+  const char* Name;
+  const unsigned char* Data;
+
+  size_t GetNumberOfValues() const
+  {
+    return static_cast<size_t>(this->NumberOfTuples)*this->NumberOfComponents;
+  }
+};
+
+struct Sections
+{
+  igtlUint32 NumberOfPoints;
+  const unsigned char* Points;
+  igtlUint32 NumberOfCells[4];
+  igtlUint32 CellsSize[4];
+  const unsigned char* Cells[4];
+  std::vector<AttributeSection> Attributes;
+};
+
+bool ParseContent(const unsigned char* content, igtlUint64 size, Sections* sections)
+{
+  if (size < PolyDataHeaderSize)
+    {
+    return false;
+    }
+  sections->NumberOfPoints = Get32(content);
+  for (int c=0; c<4; ++c)
+    {
+    sections->NumberOfCells[c] = Get32(content + 4 + 8*c);
+    sections->CellsSize[c] = Get32(content + 8 + 8*c);
+    }
+  igtlUint32 nattributes = Get32(content + 36);
+
+  const unsigned char* p = content + PolyDataHeaderSize;
+  const unsigned char* end = content + size;
+
+  // Points
+  if (static_cast<igtlUint64>(sections->NumberOfPoints)*12 > static_cast<igtlUint64>(end - p))
+    {
+    return false;
+    }
+  sections->Points = p;
+  p += static_cast<size_t>(sections->NumberOfPoints)*12;
+
+  // Vertices, lines, polygons and triangle strips
+  for (int c=0; c<4; ++c)
+    {
+    if (sections->CellsSize[c] > static_cast<igtlUint64>(end - p))
+      {
+      return false;
+      }
+    sections->Cells[c] = p;
+    p += sections->CellsSize[c];
+    }
+
+  // Attributes: headers, names, then data.
+  if (static_cast<igtlUint64>(nattributes)*AttributeHeaderSize > static_cast<igtlUint64>(end - p))
+    {
+    return false;
+    }
+  const unsigned char* attributeHeader = p;
+  p += static_cast<size_t>(nattributes)*AttributeHeaderSize;
+  const unsigned char* names = p;
+  for (igtlUint32 i=0; i<nattributes; ++i)
+    {
+    const void* nameEnd = memchr(p, '\0', end - p);
+    if (!nameEnd)
+      {
+      return false;
+      }
+    p = static_cast<const unsigned char*>(nameEnd) + 1;
+    }
+  if ((p - names)%2 != 0)
+    {
+    if (p == end)
+      {
+      return false;
+      }
+    ++p;
+    }
+
+  const char* name = reinterpret_cast<const char*>(names);
+  sections->Attributes.resize(nattributes);
+  for (igtlUint32 i=0; i<nattributes; ++i, attributeHeader += AttributeHeaderSize)
+    {
+    AttributeSection& attribute = sections->Attributes[i];
+    attribute.Type = attributeHeader[0];
+    attribute.NumberOfComponents = attributeHeader[1];
+    attribute.NumberOfTuples = Get32(attributeHeader + 2);
+    attribute.Name = name;
+    attribute.Data = p;
+    igtlUint64 count = static_cast<igtlUint64>(attribute.NumberOfTuples)*attribute.NumberOfComponents;
+    if (attribute.NumberOfComponents == 0 || count*4 > static_cast<igtlUint64>(end - p))
+      {
+      return false;
+      }
+    p += count*4;
+    name += strlen(name) + 1;
+    }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+// Whether data holds float arrays of the layout of attributes, in order.
+bool SameArrays(vtkDataSetAttributes* data, const std::vector<const AttributeSection*>& attributes)
+{
+  if (data->GetNumberOfArrays() != static_cast<int>(attributes.size()))
+    {
+    return false;
+    }
+  for (unsigned i=0; i<attributes.size(); ++i)
+    {
+    vtkFloatArray* array = vtkFloatArray::SafeDownCast(data->GetAbstractArray(i));
+    if (!array || array->GetNumberOfComponents() != attributes[i]->NumberOfComponents
+        || array->GetNumberOfTuples() != static_cast<vtkIdType>(attributes[i]->NumberOfTuples)
+        || strcmp(array->GetName() ? array->GetName() : "", attributes[i]->Name) != 0)
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+} // unnamed namespace
+
+namespace igtlio
+{
+
+//---------------------------------------------------------------------------
+int PolyDataConverter::IGTLToVTK(igtl::MessageBase::Pointer source, PolyDataConverter::MessageContent *dest, bool checkCRC)
+{
+ // The body is read from the pack as received, whatever the class of the
+ // message: igtl::PolyDataMessage::Unpack() would copy it point by point.
+ igtlUint64 contentSize = 0;
+ const unsigned char* content = GetPackContent(source, checkCRC, &contentSize);
+ if (!content)
    {
    std::cerr << "Unable to create vtkPolyData from incoming POLYDATA message. Failed to unpack the message" << std::endl;
    return 0;
    }
 
  vtkSmartPointer<vtkPolyData> poly = vtkSmartPointer<vtkPolyData>::New();
-
- if (poly.GetPointer()==NULL)
+ if (!IGTLToVTKPolyData(content, contentSize, poly, NULL))
    {
-   // TODO: Error handling
+   std::cerr << "Unable to create vtkPolyData from incoming POLYDATA message. Malformed message" << std::endl;
+   return 0;
    }
 
- if (!IGTLToVTKPolyData(polyDataMsg, poly))
-  return 0;
-
  dest->polydata = poly;
- dest->deviceName = polyDataMsg->GetDeviceName();
+ dest->deviceName = source->GetDeviceName();
 
  return 1;
 }
 
 //---------------------------------------------------------------------------
-int PolyDataConverter::IGTLToVTKPolyData(igtl::PolyDataMessage::Pointer polyDataMsg, vtkSmartPointer<vtkPolyData> poly)
+int PolyDataConverter::IGTLToVTKInPlace(igtl::MessageBase::Pointer source, PolyDataConverter::MessageContent *dest, bool checkCRC, bool* cellsKept)
 {
- // Points
- igtl::PolyDataPointArray::Pointer pointsArray = polyDataMsg->GetPoints();
- int npoints = pointsArray->GetNumberOfPoints();
- if (npoints > 0)
+ // The body is read from the pack as received, whatever the class of the
+ // message: igtl::PolyDataMessage::Unpack() would copy it point by point.
+ igtlUint64 contentSize = 0;
+ const unsigned char* content = GetPackContent(source, checkCRC, &contentSize);
+ if (!content)
    {
-   vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
-   for (int i = 0; i < npoints; i ++)
-     {
-     igtlFloat32 point[3];
-     pointsArray->GetPoint(i, point);
-     points->InsertNextPoint(point); // TODO: use the id returned by this call?
-     }
-   poly->SetPoints(points);
+   std::cerr << "Unable to create vtkPolyData from incoming POLYDATA message. Failed to unpack the message" << std::endl;
+   return 0;
    }
- else
+
+ if (!dest->polydata)
    {
-   // ERROR: No points defined
+   dest->polydata = vtkSmartPointer<vtkPolyData>::New();
    }
-
- // Vertices
- igtl::PolyDataCellArray::Pointer verticesArray =  polyDataMsg->GetVertices();
- int nvertices = verticesArray.IsNotNull() ? verticesArray->GetNumberOfCells() : 0;
- if (nvertices > 0)
+ bool kept = false;
+ if (!IGTLToVTKPolyData(content, contentSize, dest->polydata, &kept))
    {
-   vtkSmartPointer<vtkCellArray> vertCells = vtkSmartPointer<vtkCellArray>::New();
-   for (int i = 0; i < nvertices; i ++)
-     {
-     vtkSmartPointer<vtkVertex> vertex = vtkSmartPointer<vtkVertex>::New();
-
-     std::list<igtlUint32> cell;
-     verticesArray->GetCell(i, cell);
-     //for (unsigned int j = 0; j < cell.size(); j ++) // TODO: is cell.size() always 1?
-     //{
-     std::list<igtlUint32>::iterator iter;
-     iter = cell.begin();
-     vertex->GetPointIds()->SetId(i, *iter);
-     //}
-     vertCells->InsertNextCell(vertex);
-     }
-   poly->SetVerts(vertCells);
+   std::cerr << "Unable to create vtkPolyData from incoming POLYDATA message. Malformed message" << std::endl;
+   return 0;
    }
+ dest->deviceName = source->GetDeviceName();
+ if (cellsKept)
+   {
+   *cellsKept = kept;
+   }
+
+ return 1;
+}
 
- // Lines
- igtl::PolyDataCellArray::Pointer linesArray = polyDataMsg->GetLines();
- int nlines = linesArray.IsNotNull() ? linesArray->GetNumberOfCells() : 0;
- if (nlines > 0)
+//---------------------------------------------------------------------------
+int PolyDataConverter::IGTLToVTKPolyData(const unsigned char* content, igtlUint64 size, vtkPolyData* poly, bool* cellsKept)
+{
+ // All sections are checked before poly is modified.
+ Sections sections;
+ if (!ParseContent(content, size, &sections))
+   {
+   return 0;
+   }
+ bool inPlace = cellsKept != NULL;
+ bool modified = !inPlace;
+
+ // Vertices, lines, polygons and triangle strips, kept if unchanged: their
+ // point ids were checked when they were read.
+ vtkCellArray* current[4] = { poly->GetVerts(), poly->GetLines(), poly->GetPolys(), poly->GetStrips() };
+ vtkPoints* points = poly->GetPoints();
+ bool keepCells = inPlace && (points ? points->GetNumberOfPoints() : 0) == static_cast<vtkIdType>(sections.NumberOfPoints);
+ for (int c=0; c<4 && keepCells; ++c)
+   {
+   keepCells = SameCells(sections.Cells[c], sections.NumberOfCells[c], sections.CellsSize[c], current[c]);
+   }
+ vtkSmartPointer<vtkCellArray> cells[4];
+ for (int c=0; c<4 && !keepCells; ++c)
    {
-   vtkSmartPointer<vtkCellArray> lineCells = vtkSmartPointer<vtkCellArray>::New();
-   for(int i = 0; i < nlines; i++)
+   if (sections.NumberOfCells[c] > 0)
      {
-     vtkSmartPointer<vtkPolyLine> polyLine = vtkSmartPointer<vtkPolyLine>::New();
-
-     std::list<igtlUint32> cell;
-     linesArray->GetCell(i, cell);
-     polyLine->GetPointIds()->SetNumberOfIds(cell.size());
-     std::list<igtlUint32>::iterator iter;
-     int j = 0;
-     for (iter = cell.begin(); iter != cell.end(); iter ++)
+     cells[c] = ReadCells(sections.Cells[c], sections.NumberOfCells[c], sections.CellsSize[c], sections.NumberOfPoints);
+     if (!cells[c])
        {
-       polyLine->GetPointIds()->SetId(j, *iter);
-       j++;
+       return 0;
        }
-     lineCells->InsertNextCell(polyLine);
      }
-   poly->SetLines(lineCells);
    }
 
- // Polygons
- igtl::PolyDataCellArray::Pointer polygonsArray = polyDataMsg->GetPolygons();
- int npolygons = polygonsArray.IsNotNull() ? polygonsArray->GetNumberOfCells() : 0;
- if (npolygons > 0)
+ // Points
+ igtlUint32 npoints = sections.NumberOfPoints;
+ vtkFloatArray* pointArray = points ? vtkFloatArray::SafeDownCast(points->GetData()) : NULL;
+ if (inPlace && npoints > 0 && pointArray && pointArray->GetNumberOfComponents() == 3
+     && pointArray->GetNumberOfTuples() == static_cast<vtkIdType>(npoints))
    {
-   vtkSmartPointer<vtkCellArray> polygonCells = vtkSmartPointer<vtkCellArray>::New();
-   for(int i = 0; i < npolygons; i++)
-     {
-     vtkSmartPointer<vtkPolygon> polygon = vtkSmartPointer<vtkPolygon>::New();
-
-     std::list<igtlUint32> cell;
-     polygonsArray->GetCell(i, cell);
-     polygon->GetPointIds()->SetNumberOfIds(cell.size());
-     std::list<igtlUint32>::iterator iter;
-     int j = 0;
-     for (iter = cell.begin(); iter != cell.end(); iter ++)
-       {
-       polygon->GetPointIds()->SetId(j, *iter);
-       j++;
-       }
-     polygonCells->InsertNextCell(polygon);
-     }
-   poly->SetPolys(polygonCells);
+   ReadFloats(pointArray->GetPointer(0), sections.Points, static_cast<size_t>(npoints)*3);
+   pointArray->Modified();
+   points->Modified();
+   }
+ else if (npoints > 0)
+   {
+   vtkSmartPointer<vtkFloatArray> newPointArray = vtkSmartPointer<vtkFloatArray>::New();
+   newPointArray->SetName("Points"); // as named by vtkPoints
+   newPointArray->SetNumberOfComponents(3);
+   newPointArray->SetNumberOfTuples(npoints);
+   ReadFloats(newPointArray->GetPointer(0), sections.Points, static_cast<size_t>(npoints)*3);
+   vtkSmartPointer<vtkPoints> newPoints = vtkSmartPointer<vtkPoints>::New();
+   newPoints->SetData(newPointArray);
+   poly->SetPoints(newPoints);
+   modified = true;
+   }
+ else if (points)
+   {
+   poly->SetPoints(NULL);
+   modified = true;
    }
 
- // Triangle Strips
- igtl::PolyDataCellArray::Pointer triangleStripsArray = polyDataMsg->GetTriangleStrips();
- int ntstrips = triangleStripsArray.IsNotNull() ? triangleStripsArray->GetNumberOfCells() : 0;
- if (ntstrips > 0)
+ if (!keepCells)
    {
-   vtkSmartPointer<vtkCellArray> tstripCells = vtkSmartPointer<vtkCellArray>::New();
-   for(int i = 0; i < ntstrips; i++)
+   poly->SetVerts(cells[0]);
+   poly->SetLines(cells[1]);
+   poly->SetPolys(cells[2]);
+   poly->SetStrips(cells[3]);
+   modified = true;
+   }
+
+ // Attributes, overwritten if the arrays are the same.
+ // NOTE: Data types for POINT (igtl::PolyDataMessage::POINT_*) and CELL
+ // (igtl::PolyDataMessage::CELL_*) have the same lower 4 bit.
+ // By masking the value with 0xF0, data types (POINT or CELL) can be obtained.
+ // See, igtlPolyDataMessage.h in the OpenIGTLink library.
+ std::vector<const AttributeSection*> attributes[2];
+ for (unsigned i=0; i<sections.Attributes.size(); ++i)
+   {
+   const AttributeSection& attribute = sections.Attributes[i];
+   attributes[(attribute.Type & 0xF0) == 0 ? 0 : 1].push_back(&attribute);
+   }
+ vtkDataSetAttributes* data[2] = { poly->GetPointData(), poly->GetCellData() };
+ if (inPlace && SameArrays(data[0], attributes[0]) && SameArrays(data[1], attributes[1]))
+   {
+   for (int a=0; a<2; ++a)
      {
-     vtkSmartPointer<vtkTriangleStrip> tstrip = vtkSmartPointer<vtkTriangleStrip>::New();
-
-     std::list<igtlUint32> cell;
-     triangleStripsArray->GetCell(i, cell);
-     tstrip->GetPointIds()->SetNumberOfIds(cell.size());
-     std::list<igtlUint32>::iterator iter;
-     int j = 0;
-     for (iter = cell.begin(); iter != cell.end(); iter ++)
+     for (unsigned i=0; i<attributes[a].size(); ++i)
        {
-       tstrip->GetPointIds()->SetId(j, *iter);
-       j++;
+       vtkFloatArray* array = vtkFloatArray::SafeDownCast(data[a]->GetAbstractArray(i));
+       ReadFloats(array->GetPointer(0), attributes[a][i]->Data, attributes[a][i]->GetNumberOfValues());
+       array->Modified();
        }
-     tstripCells->InsertNextCell(tstrip);
      }
-   poly->SetStrips(tstripCells);
    }
-
- // Attribute
- int nAttributes = polyDataMsg->GetNumberOfAttributes();
- for (int i = 0; i < nAttributes; i ++)
+ else
    {
-   igtl::PolyDataAttribute::Pointer attribute;
-   attribute = polyDataMsg->GetAttribute(i);
-
-   vtkSmartPointer<vtkFloatArray> data =
-     vtkSmartPointer<vtkFloatArray>::New();
-
-   data->SetName(attribute->GetName()); //set the name of the value
-   int n = attribute->GetSize();
-
-   // NOTE: Data types for POINT (igtl::PolyDataMessage::POINT_*) and CELL
-   // (igtl::PolyDataMessage::CELL_*) have the same lower 4 bit.
-   // By masking the values with 0x0F, attribute types (either SCALAR, VECTOR, NORMAL,
-   // TENSOR, or RGBA) can be obtained. On the other hand, by masking the value
-   // with 0xF0, data types (POINT or CELL) can be obtained.
-   // See, igtlPolyDataMessage.h in the OpenIGTLink library.
-   switch (attribute->GetType() & 0x0F)
+   for (int a=0; a<2; ++a)
      {
-     case igtl::PolyDataAttribute::POINT_SCALAR:
-       {
-       data->SetNumberOfComponents(1);
-       break;
-       }
-     case igtl::PolyDataAttribute::POINT_VECTOR:
-     case igtl::PolyDataAttribute::POINT_NORMAL:
-       {
-       data->SetNumberOfComponents(3);
-       break;
-       }
-     case igtl::PolyDataAttribute::POINT_TENSOR:
-       {
-       data->SetNumberOfComponents(9); // TODO: Is it valid in Slicer?
-       break;
-       }
-     case igtl::PolyDataAttribute::POINT_RGBA:
-       {
-       data->SetNumberOfComponents(4); // TODO: Is it valid in Slicer?
-       break;
-       }
-     default:
+     data[a]->Initialize();
+     for (unsigned i=0; i<attributes[a].size(); ++i)
        {
-       // ERROR
-       break;
+       const AttributeSection* attribute = attributes[a][i];
+       vtkSmartPointer<vtkFloatArray> array = vtkSmartPointer<vtkFloatArray>::New();
+       array->SetName(attribute->Name); //set the name of the value
+       array->SetNumberOfComponents(attribute->NumberOfComponents);
+       array->SetNumberOfTuples(attribute->NumberOfTuples);
+       ReadFloats(array->GetPointer(0), attribute->Data, attribute->GetNumberOfValues());
+       data[a]->AddArray(array);
        }
      }
-   data->SetNumberOfTuples(n);
-   attribute->GetData(static_cast<igtl_float32*>(data->GetPointer(0)));
-
-   if ((attribute->GetType() & 0xF0) == 0) // POINT
-     {
-     poly->GetPointData()->AddArray(data);
-     }
-   else // CELL
-     {
-     poly->GetCellData()->AddArray(data);
-     }
+   modified = true;
    }
 
- poly->Modified();
+ if (modified)
+   {
+   poly->Modified();
+   }
+ if (cellsKept)
+   {
+   *cellsKept = keepCells;
+   }
 
  return 1;
 }
 
 //---------------------------------------------------------------------------
-int PolyDataConverter::VTKToIGTL(const PolyDataConverter::MessageContent &source, igtl::PolyDataMessage::Pointer *dest)
+int PolyDataConverter::VTKToIGTL(const PolyDataConverter::MessageContent &source, igtl::PolyDataMessage::Pointer *dest, bool* cellsKept)
 {
    if (source.polydata.GetPointer() == NULL)
      {
@@ -257,228 +687,151 @@ int PolyDataConverter::VTKToIGTL(const PolyDataConverter::MessageContent &source
      return 0;
      }
 
-   //------------------------------------------------------------
-   // Allocate Status Message Class
-   if ((*dest).IsNull())
-     {
-     (*dest) = igtl::PolyDataMessage::New();
-     }
-   else
+   igtlUint64 contentSize = GetIGTLContentSize(source.polydata);
+   if (contentSize > static_cast<igtlUint64>(std::numeric_limits<int>::max()))
      {
-     (*dest)->Clear();
-     }
-   igtl::PolyDataMessage::Pointer outMessage = *dest;
-
-   // Set message name -- use the same name as the MRML node
-   outMessage->SetDeviceName(source.deviceName.c_str());
-
-   if (!VTKPolyDataToIGTL(source.polydata, outMessage))
+     std::cerr << "Unable to create POLYDATA message: polydata too large" << std::endl;
      return 0;
-
-   // Pack the message
-   outMessage->Pack();
-
-   return 1;
-}
-
-//---------------------------------------------------------------------------
-int PolyDataConverter::VTKPolyDataToIGTL(vtkSmartPointer<vtkPolyData> poly, igtl::PolyDataMessage::Pointer outMessage)
-{
-   // Points
-   vtkSmartPointer<vtkPoints> points = poly->GetPoints();
-   if (points.GetPointer() != NULL)
-     {
-     int npoints = points->GetNumberOfPoints();
-     if (npoints > 0)
-       {
-       igtl::PolyDataPointArray::Pointer pointArray = igtl::PolyDataPointArray::New();
-       for (int i = 0; i < npoints; i ++)
-         {
-         double *p = points->GetPoint(i);
-         pointArray->AddPoint(static_cast<igtlFloat32>(p[0]),
-                              static_cast<igtlFloat32>(p[1]),
-                              static_cast<igtlFloat32>(p[2]));
-         }
-       outMessage->SetPoints(pointArray);
-       }
      }
 
-   // Vertices
-   vtkSmartPointer<vtkCellArray> vertCells = poly->GetVerts();
-   if (vertCells.GetPointer() != NULL)
+   //------------------------------------------------------------
+   // Allocate the message, packed directly.
+   PackedPolyDataMessage* outMessage = dynamic_cast<PackedPolyDataMessage*>((*dest).GetPointer());
+   if (!outMessage)
      {
-     igtl::PolyDataCellArray::Pointer verticesArray = igtl::PolyDataCellArray::New();
-     if (VTKToIGTLCellArray(vertCells, verticesArray) > 0)
-       {
-       outMessage->SetVertices(verticesArray);
-       }
+     PackedPolyDataMessage::Pointer newMessage = PackedPolyDataMessage::New();
+     (*dest) = newMessage.GetPointer();
+     outMessage = newMessage;
      }
 
-   // Lines
-   vtkSmartPointer<vtkCellArray> lineCells = poly->GetLines();
-   if (lineCells.GetPointer() != NULL)
-     {
-     igtl::PolyDataCellArray::Pointer linesArray = igtl::PolyDataCellArray::New();
-     if (VTKToIGTLCellArray(lineCells, linesArray) > 0)
-       {
-       outMessage->SetLines(linesArray);
-       }
-     }
+   // Set message name -- use the same name as the MRML node
+   outMessage->SetDeviceName(source.deviceName.c_str());
 
-   // Polygons
-   vtkSmartPointer<vtkCellArray> polygonCells = poly->GetPolys();
-   if (polygonCells.GetPointer() != NULL)
-     {
-     igtl::PolyDataCellArray::Pointer polygonsArray = igtl::PolyDataCellArray::New();
-     if (VTKToIGTLCellArray(polygonCells, polygonsArray) > 0)
-       {
-       outMessage->SetPolygons(polygonsArray);
-       }
-     }
+   unsigned char* content = outMessage->AllocateBody(static_cast<int>(contentSize));
 
-   // Triangl strips
-   vtkSmartPointer<vtkCellArray> triangleStripCells = poly->GetStrips();
-   if (triangleStripCells.GetPointer() != NULL)
+   // The cells are at the same place in a body of the same size, for the
+   // same number of points: they are not written again if unchanged.
+   vtkPolyData* poly = source.polydata;
+   vtkCellArray* cells[4] = { poly->GetVerts(), poly->GetLines(), poly->GetPolys(), poly->GetStrips() };
+   vtkIdType npoints = poly->GetPoints() ? poly->GetPoints()->GetNumberOfPoints() : 0;
+   bool keepCells = content == outMessage->Body && static_cast<int>(contentSize) == outMessage->BodySize
+     && npoints == outMessage->NumberOfPoints;
+   for (int c=0; c<4; ++c)
      {
-     igtl::PolyDataCellArray::Pointer triangleStripsArray = igtl::PolyDataCellArray::New();
-     if (VTKToIGTLCellArray(triangleStripCells, triangleStripsArray) > 0)
-       {
-       outMessage->SetTriangleStrips(triangleStripsArray);
-       }
+     vtkMTimeType time = cells[c] ? cells[c]->GetMTime() : 0;
+     keepCells = keepCells && cells[c] == outMessage->Cells[c] && time == outMessage->CellsTime[c];
+     outMessage->Cells[c] = cells[c];
+     outMessage->CellsTime[c] = time;
      }
+   outMessage->NumberOfPoints = npoints;
+   outMessage->BodySize = static_cast<int>(contentSize);
+   outMessage->Body = content;
 
-   // Attributes for points
-   vtkSmartPointer<vtkPointData> pdata = poly->GetPointData();
-   int nPointAttributes = pdata->GetNumberOfArrays();
-   if (nPointAttributes > 0)
+   VTKPolyDataToIGTL(poly, content, !keepCells);
+   if (cellsKept)
      {
-     for (int i = 0; i < nPointAttributes; i ++)
-       {
-       igtl::PolyDataAttribute::Pointer attribute = igtl::PolyDataAttribute::New();
-       if (VTKToIGTLAttribute(pdata, i, attribute) > 0)
-         {
-         outMessage->AddAttribute(attribute);
-         }
-       }
+     *cellsKept = keepCells;
      }
 
-
-   // Attributes for cells
-   vtkSmartPointer<vtkCellData> cdata = poly->GetCellData();
-   int nCellAttributes = cdata->GetNumberOfArrays();
-   if (nCellAttributes > 0)
-     {
-     for (int i = 0; i < nCellAttributes; i ++)
-       {
-       igtl::PolyDataAttribute::Pointer attribute = igtl::PolyDataAttribute::New();
-       if (VTKToIGTLAttribute(cdata, i, attribute) > 0)
-         {
-         outMessage->AddAttribute(attribute);
-         }
-       }
-     }
+   igtl_header messageHeader;
+   memset(&messageHeader, 0, sizeof(messageHeader));
+   messageHeader.version = IGTL_HEADER_VERSION;
+   strncpy(messageHeader.name, GetIGTLTypeName(), IGTL_HEADER_TYPE_SIZE);
+   strncpy(messageHeader.device_name, source.deviceName.c_str(), IGTL_HEADER_NAME_SIZE);
+   messageHeader.timestamp = 0;
+   messageHeader.body_size = contentSize;
+   messageHeader.crc = crc64(content, contentSize, crc64(0, 0, 0));
+   igtl_header_convert_byte_order(&messageHeader);
+   memcpy(outMessage->GetPackPointer(), &messageHeader, IGTL_HEADER_SIZE);
 
    return 1;
 }
 
 //---------------------------------------------------------------------------
-int PolyDataConverter::VTKToIGTLCellArray(vtkCellArray* src, igtl::PolyDataCellArray* dest)
+igtlUint64 PolyDataConverter::GetIGTLContentSize(vtkPolyData* poly)
 {
-
-  if (src && dest)
+  igtlUint64 size = PolyDataHeaderSize;
+  vtkPoints* points = poly->GetPoints();
+  if (points)
     {
-    int ncells = src->GetNumberOfCells();
-    if (ncells > 0)
-      {
-      vtkSmartPointer<vtkIdList> idList = vtkSmartPointer<vtkIdList>::New();
-      src->InitTraversal();
-      while (src->GetNextCell(idList))
-        {
-        std::list<igtlUint32> cell;
-        int nIds = idList->GetNumberOfIds();
-        for (int i = 0; i < nIds; i ++)
-          {
-          cell.push_back(idList->GetId(i));
-          }
-        dest->AddCell(cell);
-        }
-      }
-    return ncells;
+    size += 12*static_cast<igtlUint64>(points->GetNumberOfPoints());
     }
-  else
+  size += GetCellsSize(poly->GetVerts());
+  size += GetCellsSize(poly->GetLines());
+  size += GetCellsSize(poly->GetPolys());
+  size += GetCellsSize(poly->GetStrips());
+
+  std::vector<vtkDataArray*> arrays;
+  std::vector<int> types;
+  GetAttributes(poly, &arrays, &types);
+  igtlUint64 namesSize = 0;
+  for (unsigned i=0; i<arrays.size(); ++i)
     {
-    return 0;
+    size += AttributeHeaderSize;
+    size += 4*static_cast<igtlUint64>(arrays[i]->GetNumberOfTuples())*arrays[i]->GetNumberOfComponents();
+    namesSize += GetAttributeNameLength(arrays[i]) + 1;
     }
-
+  return size + namesSize + namesSize%2;
 }
 
-
 //---------------------------------------------------------------------------
-int PolyDataConverter::VTKToIGTLAttribute(vtkDataSetAttributes* src, int i, igtl::PolyDataAttribute* dest)
+void PolyDataConverter::VTKPolyDataToIGTL(vtkPolyData* poly, unsigned char* content, bool writeCells)
 {
-
-  //vtkSmartPointer<vtkPointData> src = poly->GetPointData();
-  if ((!src) || (!dest))
+  vtkPoints* points = poly->GetPoints();
+  vtkIdType npoints = points ? points->GetNumberOfPoints() : 0;
+  vtkCellArray* cells[4] = { poly->GetVerts(), poly->GetLines(), poly->GetPolys(), poly->GetStrips() };
+  std::vector<vtkDataArray*> arrays;
+  std::vector<int> types;
+  GetAttributes(poly, &arrays, &types);
+
+  // Header
+  Put32(content, static_cast<igtlUint32>(npoints));
+  for (int c=0; c<4; ++c)
     {
-    return 0;
+    Put32(content + 4 + 8*c, cells[c] ? static_cast<igtlUint32>(cells[c]->GetNumberOfCells()) : 0);
+    Put32(content + 8 + 8*c, GetCellsSize(cells[c]));
     }
+  Put32(content + 36, static_cast<igtlUint32>(arrays.size()));
+  unsigned char* p = content + PolyDataHeaderSize;
 
-  // Check the range of index i
-  if (i < 0 || i >= src->GetNumberOfArrays())
+  // Points
+  if (npoints > 0)
     {
-    return 0;
+    p = WriteFloats(p, points->GetData());
     }
 
-  // NOTE: Data types for POINT (igtl::PolyDataMessage::POINT_*) and CELL
-  // (igtl::PolyDataMessage::CELL_*) have the same bits exept the 3rd bit (0x10).
-  // attrType will contain the 3rd bit based on the type of vtkDataSetAttributes
-  // (either vtkCellData or vtkPointData). See, igtlPolyDataMessage.h in the OpenIGTLink library.
-  int attrTypeBit;
-  if (src->IsTypeOf("vtkCellData"))
-    {
-    attrTypeBit = 0x10;
-    }
-  else // vtkPointData
+  // Vertices, lines, polygons and triangle strips
+  for (int c=0; c<4; ++c)
     {
-    attrTypeBit = 0x00;
+    p = writeCells ? WriteCells(p, cells[c]) : p + GetCellsSize(cells[c]);
     }
 
-  vtkSmartPointer<vtkDataArray> array = src->GetArray(i);
-  int ncomps  = array->GetNumberOfComponents();
-  if (ncomps == 1)
+  // Attributes: headers, names, then data.
+  for (unsigned i=0; i<arrays.size(); ++i, p += AttributeHeaderSize)
     {
-    dest->SetType(igtl::PolyDataAttribute::POINT_SCALAR | attrTypeBit);
+    p[0] = static_cast<unsigned char>(types[i]);
+    p[1] = static_cast<unsigned char>(arrays[i]->GetNumberOfComponents());
+    Put32(p + 2, static_cast<igtlUint32>(arrays[i]->GetNumberOfTuples()));
     }
-  else if (ncomps == 3)
+  unsigned char* names = p;
+  for (unsigned i=0; i<arrays.size(); ++i)
     {
-    // TODO: how to differenciate normal and vector?
-    dest->SetType(igtl::PolyDataAttribute::POINT_NORMAL | attrTypeBit);
+    size_t length = GetAttributeNameLength(arrays[i]);
+    if (length > 0)
+      {
+      memcpy(p, arrays[i]->GetName(), length);
+      }
+    p[length] = '\0';
+    p += length + 1;
     }
-  else if (ncomps == 9)
+  if ((p - names)%2 != 0)
     {
-    dest->SetType(igtl::PolyDataAttribute::POINT_TENSOR | attrTypeBit);
+    *p++ = '\0';
     }
-  else if (ncomps == 4)
+  for (unsigned i=0; i<arrays.size(); ++i)
     {
-    dest->SetType(igtl::PolyDataAttribute::POINT_RGBA | attrTypeBit);
+    p = WriteFloats(p, arrays[i]);
     }
-  dest->SetName(array->GetName() ? array->GetName() : "");
-  int ntuples = array->GetNumberOfTuples();
-  dest->SetSize(ntuples);
-
-  for (int j = 0; j < ntuples; j ++)
-    {
-    double * tuple = array->GetTuple(j);
-    igtlFloat32 data[9];
-    for (int k = 0; k < ncomps; k ++)
-      {
-      data[k] = static_cast<igtlFloat32>(tuple[k]);
-      }
-    dest->SetNthData(j, data);
-    }
-
-  return 1;
-
 }
 
 } // namespace igtlio
@@ -21,14 +21,20 @@
 #include "igtlioBaseConverter.h"
 
 class vtkPolyData;
-class vtkCellArray;
-class vtkDataSetAttributes;
 
 namespace igtlio
 {
 
 /** Conversion between igtl::PolyDataMessage and vtk classes.
  *
+ * The message body is read and written directly, in one pass over each
+ * array: points and attributes are converted in bulk, and cells are
+ * copied between the message layout (number of points, then their ids)
+ * and the arrays of vtkCellArray.
+ *
+ * For streams of which the topology is fixed, such as a deforming surface,
+ * the cells are kept when unchanged: IGTLToVTKInPlace() then only writes
+ * the points and attributes, and VTKToIGTL() skips writing the cells.
  */
 class OPENIGTLINKIO_CONVERTER_EXPORT PolyDataConverter : public BaseConverter
 {
@@ -47,21 +53,34 @@ public:
   static const char* GetIGTLTypeName() { return "POLYDATA"; }
 
   static int IGTLToVTK(igtl::MessageBase::Pointer source, MessageContent* dest, bool checkCRC);
-  static int VTKToIGTL(const MessageContent& source, igtl::PolyDataMessage::Pointer* dest);
 
-protected:
-  // Extract vtkPolyData from existing polyDataMsg, insert into existing poly.
-  static int IGTLToVTKPolyData(igtl::PolyDataMessage::Pointer polyDataMsg, vtkSmartPointer<vtkPolyData> poly);
+  /// Update dest->polydata from the message, created if NULL. If the message
+  /// has the same cells, they are kept and cellsKept is set: the points
+  /// and attributes of the same layout are overwritten in their arrays,
+  /// of which only the MTime changes. The polydata is left unmodified if
+  /// the message is malformed.
+  static int IGTLToVTKInPlace(igtl::MessageBase::Pointer source, MessageContent* dest, bool checkCRC,
+                              bool* cellsKept=NULL);
+
+  /// The message is packed, from the polydata: its point, cell and
+  /// attribute accessors are left empty. dest is replaced by a new
+  /// message unless it was given by a previous call, in which case the
+  /// cells it holds are kept if the cell arrays and their MTime are the
+  /// same: cellsKept is then set.
+  static int VTKToIGTL(const MessageContent& source, igtl::PolyDataMessage::Pointer* dest,
+                       bool* cellsKept=NULL);
 
-  // Insert an existing vtkPolyData into a cleared PolyDataMessage.
-  static int VTKPolyDataToIGTL(vtkSmartPointer<vtkPolyData> poly, igtl::PolyDataMessage::Pointer outMessage);
+protected:
+  // Fill poly from the content of a POLYDATA message, of size bytes, in
+  // place if cellsKept is given. Return 0 if the content is malformed.
+  static int IGTLToVTKPolyData(const unsigned char* content, igtlUint64 size, vtkPolyData* poly, bool* cellsKept);
 
-  // Utility function for MRMLToIGTL(): Convert vtkCellArray to igtl::PolyDataCellArray
-  static int VTKToIGTLCellArray(vtkCellArray* src, igtl::PolyDataCellArray* dest);
+  // Size in bytes of the content of the POLYDATA message of poly.
+  static igtlUint64 GetIGTLContentSize(vtkPolyData* poly);
 
-  // Utility function for MRMLToIGTL(): Convert i-th vtkDataSetAttributes (vtkCellData and vtkPointData)
-  // to igtl::PolyDataAttribute
-  static int VTKToIGTLAttribute(vtkDataSetAttributes* src, int i, igtl::PolyDataAttribute* dest);
+  // Write the content of the POLYDATA message of poly, of GetIGTLContentSize() bytes,
+  // but the cells if they are already there.
+  static void VTKPolyDataToIGTL(vtkPolyData* poly, unsigned char* content, bool writeCells);
 };
 
 } // namespace igtlio
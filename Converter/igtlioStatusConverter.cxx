@@ -12,10 +12,14 @@ int StatusConverter::fromIGTL(igtl::MessageBase::Pointer source,
                              ContentData* dest,
                              bool checkCRC)
 {
-  // Create a message buffer to receive  data
-  igtl::StatusMessage::Pointer msg;
-  msg = igtl::StatusMessage::New();
-  msg->Copy(source); // !! TODO: copy makes performance issue.
+  // Unpack in place if the message was received as the concrete type,
+  // otherwise copy into a new message buffer.
+  igtl::StatusMessage::Pointer msg = dynamic_pointer_cast<igtl::StatusMessage>(source);
+  if (msg.IsNull())
+    {
+    msg = igtl::StatusMessage::New();
+    msg->Copy(source);
+    }
 
   // Deserialize the data
   // If CheckCRC==0, CRC check is skipped.
@@ -14,8 +14,11 @@
 
 #include "igtlioTransformConverter.h"
 
+#include <igtl_transform.h>
 #include <vtkMatrix4x4.h>
 
+#include <string.h>
+
 namespace igtlio
 {
 
@@ -25,66 +28,41 @@ int TransformConverter::fromIGTL(igtl::MessageBase::Pointer source,
                              ContentData* dest,
                              bool checkCRC)
 {
-    // Create a message buffer to receive image data
-    igtl::TransformMessage::Pointer transMsg;
-    transMsg = igtl::TransformMessage::New();
-    transMsg->Copy(source); // !! TODO: copy makes performance issue.
-
-    // Deserialize the transform data
-    // If CheckCRC==0, CRC check is skipped.
-    int c = transMsg->Unpack(checkCRC);
-
-    if (!(c & igtl::MessageHeader::UNPACK_BODY)) // if CRC check fails
+    // The body is read from the pack as received, whatever the class of
+    // the message: no message or matrix is allocated for each one.
+    igtlUint64 contentSize = 0;
+    const unsigned char* content = GetPackContent(source, checkCRC, &contentSize);
+    if (!content || contentSize < IGTL_TRANSFORM_SIZE) // if CRC check fails or malformed
       {
       // TODO: error handling
       return 0;
       }
 
-    igtl::Matrix4x4 matrix;
-    transMsg->GetMatrix(matrix);
-
-    float tx = matrix[0][0];
-    float ty = matrix[1][0];
-    float tz = matrix[2][0];
-    float sx = matrix[0][1];
-    float sy = matrix[1][1];
-    float sz = matrix[2][1];
-    float nx = matrix[0][2];
-    float ny = matrix[1][2];
-    float nz = matrix[2][2];
-    float px = matrix[0][3];
-    float py = matrix[1][3];
-    float pz = matrix[2][3];
-
-    //std::cerr << "\n\nmatrix = " << std::endl;
-    //std::cerr << tx << ", " << ty << ", " << tz << std::endl;
-    //std::cerr << sx << ", " << sy << ", " << sz << std::endl;
-    //std::cerr << nx << ", " << ny << ", " << nz << std::endl;
-    //std::cerr << px << ", " << py << ", " << pz << std::endl;
-
-    // set volume orientation
-    vtkSmartPointer<vtkMatrix4x4> transform = vtkSmartPointer<vtkMatrix4x4>::New();
-    transform->Identity();
-    transform->Element[0][0] = tx;
-    transform->Element[1][0] = ty;
-    transform->Element[2][0] = tz;
-    transform->Element[0][1] = sx;
-    transform->Element[1][1] = sy;
-    transform->Element[2][1] = sz;
-    transform->Element[0][2] = nx;
-    transform->Element[1][2] = ny;
-    transform->Element[2][2] = nz;
-    transform->Element[0][3] = px;
-    transform->Element[1][3] = py;
-    transform->Element[2][3] = pz;
-
-    //std::cerr << "IGTL matrix = " << std::endl;
-    //transform->Print(cerr);
-    //std::cerr << "MRML matrix = " << std::endl;
-    //transformToParent->Print(cerr);
-
-    dest->transform = transform;
-    dest->deviceName = transMsg->GetDeviceName();
+    if (!IGTLtoHeader(source, header))
+      return 0;
+
+    igtl_float32 matrix[12];
+    memcpy(matrix, content, IGTL_TRANSFORM_SIZE);
+    igtl_transform_convert_byte_order(matrix);
+
+    // set volume orientation, in the matrix of the content if any
+    if (!dest->transform)
+      {
+      dest->transform = vtkSmartPointer<vtkMatrix4x4>::New();
+      }
+    vtkMatrix4x4* transform = dest->transform;
+    for (int i=0; i<3; ++i)
+      {
+      transform->Element[i][0] = matrix[i];     // t
+      transform->Element[i][1] = matrix[3+i];   // s
+      transform->Element[i][2] = matrix[6+i];   // n
+      transform->Element[i][3] = matrix[9+i];   // p
+      transform->Element[3][i] = 0.0;
+      }
+    transform->Element[3][3] = 1.0;
+    transform->Modified();
+
+    dest->deviceName = source->GetDeviceName();
 
     return 1;
 
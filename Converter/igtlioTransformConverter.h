@@ -28,6 +28,8 @@ namespace igtlio
 
 /** Conversion between igtl::TransformMessage and vtk classes.
  *
+ * Received transforms are decoded from the message as received into the
+ * matrix of the content, so that a stream of them allocates nothing.
  */
 class OPENIGTLINKIO_CONVERTER_EXPORT TransformConverter : public BaseConverter
 {
@@ -45,6 +47,7 @@ public:
   static const char*  GetIGTLName() { return GetIGTLTypeName(); };
   static const char* GetIGTLTypeName() { return "TRANSFORM"; };
 
+  /// The matrix of content is overwritten and modified, or created if NULL.
   static int fromIGTL(igtl::MessageBase::Pointer source, HeaderData* header, ContentData* content, bool checkCRC);
   static int toIGTL(const HeaderData& header, const ContentData& source, igtl::TransformMessage::Pointer* dest);
 
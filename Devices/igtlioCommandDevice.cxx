@@ -20,6 +20,16 @@ std::string CommandDeviceCreator::GetDeviceType() const
  return CommandConverter::GetIGTLTypeName();
 }
 
+//---------------------------------------------------------------------------
+igtl::MessageBase::Pointer CommandDeviceCreator::CreateReceiveMessage(std::string device_type) const
+{
+  if (device_type==CommandConverter::GetIGTLTypeName())
+    return dynamic_pointer_cast<igtl::MessageBase>(igtl::CommandMessage::New());
+  if (device_type==CommandConverter::GetIGTLResponseName())
+    return dynamic_pointer_cast<igtl::MessageBase>(igtl::RTSCommandMessage::New());
+  return igtl::MessageBase::New();
+}
+
 //---------------------------------------------------------------------------
 vtkStandardNewMacro(CommandDeviceCreator);
 
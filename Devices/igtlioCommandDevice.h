@@ -49,6 +49,7 @@ class OPENIGTLINKIO_DEVICES_EXPORT CommandDeviceCreator : public DeviceCreator
 public:
   virtual DevicePointer Create(std::string device_name);
   virtual std::string GetDeviceType() const;
+  virtual igtl::MessageBase::Pointer CreateReceiveMessage(std::string device_type) const;
 
   static CommandDeviceCreator *New();
   vtkTypeMacro(CommandDeviceCreator,vtkObject);
@@ -177,6 +177,10 @@ public:
   virtual DevicePointer Create(std::string device_name) = 0;
   // Return the device_type this factory creates devices for.
   virtual std::string GetDeviceType() const = 0;
+  // Create an empty igtl message able to receive the given device_type
+  // (e.g. IMAGE or RTS_COMMAND). The incoming body can then be read directly
+  // into it and unpacked in place. Unsupported types get a plain MessageBase.
+  virtual igtl::MessageBase::Pointer CreateReceiveMessage(std::string device_type) const { return igtl::MessageBase::New(); }
   vtkAbstractTypeMacro(DeviceCreator,vtkObject);
 };
 
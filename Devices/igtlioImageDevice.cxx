@@ -13,11 +13,93 @@
 ==========================================================================*/
 
 #include "igtlioImageDevice.h"
+#include "igtlioImageDelta.h"
 
 #include <vtkImageData.h>
 #include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkVersion.h>
 #include "vtkMatrix4x4.h"
 
+// STD includes
+#include <algorithm>
+#include <string.h>
+
+namespace // unnamed namespace
+{
+
+//---------------------------------------------------------------------------
+void ResetExtent(int extent[6])
+{
+  for (int i=0; i<3; ++i)
+    {
+    extent[2*i] = VTK_INT_MAX;
+    extent[2*i+1] = VTK_INT_MIN;
+    }
+}
+
+//---------------------------------------------------------------------------
+bool IsEmptyExtent(const int extent[6])
+{
+  return extent[1] < extent[0] || extent[3] < extent[2] || extent[5] < extent[4];
+}
+
+//---------------------------------------------------------------------------
+void MergeExtent(int extent[6], const int other[6])
+{
+  for (int i=0; i<3; ++i)
+    {
+    extent[2*i] = std::min(extent[2*i], other[2*i]);
+    extent[2*i+1] = std::max(extent[2*i+1], other[2*i+1]);
+    }
+}
+
+//---------------------------------------------------------------------------
+// Merge the extent of the voxels of image that differ from previous into
+// modified, and update previous.
+void CompareScalars(vtkImageData* image, unsigned char* previous, int modified[6])
+{
+  int dims[3];
+  int imageExtent[6];
+  image->GetDimensions(dims);
+  image->GetExtent(imageExtent);
+  size_t voxelBytes = static_cast<size_t>(image->GetScalarSize())*image->GetNumberOfScalarComponents();
+  size_t rowBytes = voxelBytes*dims[0];
+  const unsigned char* current = static_cast<const unsigned char*>(image->GetScalarPointer());
+
+  for (int k=0; k<dims[2]; ++k)
+    {
+    for (int j=0; j<dims[1]; ++j)
+      {
+      size_t offset = (static_cast<size_t>(k)*dims[1] + j)*rowBytes;
+      const unsigned char* row = current + offset;
+      unsigned char* previousRow = previous + offset;
+      if (memcmp(row, previousRow, rowBytes) == 0)
+        {
+        continue;
+        }
+      size_t first = 0;
+      while (row[first] == previousRow[first])
+        {
+        ++first;
+        }
+      size_t last = rowBytes-1;
+      while (row[last] == previousRow[last])
+        {
+        --last;
+        }
+      int rowExtent[6] = { imageExtent[0] + static_cast<int>(first/voxelBytes),
+                           imageExtent[0] + static_cast<int>(last/voxelBytes),
+                           imageExtent[2] + j, imageExtent[2] + j,
+                           imageExtent[4] + k, imageExtent[4] + k };
+      MergeExtent(modified, rowExtent);
+      memcpy(previousRow, row, rowBytes);
+      }
+    }
+}
+
+} // unnamed namespace
+
 namespace igtlio
 {
 
@@ -35,6 +117,14 @@ std::string ImageDeviceCreator::GetDeviceType() const
   return ImageConverter::GetIGTLTypeName();
 }
 
+//---------------------------------------------------------------------------
+igtl::MessageBase::Pointer ImageDeviceCreator::CreateReceiveMessage(std::string device_type) const
+{
+  if (device_type==ImageConverter::GetIGTLTypeName())
+    return dynamic_pointer_cast<igtl::MessageBase>(igtl::ImageMessage::New());
+  return igtl::MessageBase::New();
+}
+
 //---------------------------------------------------------------------------
 vtkStandardNewMacro(ImageDeviceCreator);
 
@@ -44,6 +134,28 @@ vtkStandardNewMacro(ImageDevice);
 //---------------------------------------------------------------------------
 ImageDevice::ImageDevice()
 {
+  ResetExtent(this->ModifiedExtent);
+  this->ComputeModifiedExtent = false;
+  this->KeyframeInterval = 30;
+  this->KeyframeRequested = false;
+  this->NumberOfMessagesSinceKeyframe = -1;
+  for (int i=0; i<3; ++i)
+    {
+    this->LastDimensions[i] = 0;
+    }
+  this->LastScalarType = VTK_VOID;
+  this->LastNumberOfComponents = 0;
+  this->DeltaEncoding = false;
+  this->DeltaReferenceSent = false;
+  this->DeltaFrame = 0;
+  this->DeltaLossRecovery = RECOVER_REQUEST_KEYFRAME;
+  this->DeltaReferenceReceived = false;
+  this->LastReceivedFrame = 0;
+  this->KeyframeAsked = false;
+  this->KeyframeRequestPending = false;
+  this->NumberOfSkippedDeltas = 0;
+  this->ScalarPool = ImageScalarPoolPointer::New();
+  this->PublishSnapshots = false;
 }
 
 //---------------------------------------------------------------------------
@@ -60,6 +172,7 @@ std::string ImageDevice::GetDeviceType() const
 void ImageDevice::SetContent(ImageConverter::ContentData content)
 {
   Content = content;
+  this->PublishSnapshot();
   this->Modified();
 }
 
@@ -68,12 +181,243 @@ ImageConverter::ContentData ImageDevice::GetContent()
   return Content;
 }
 
+//---------------------------------------------------------------------------
+void ImageDevice::SetPublishSnapshots(bool publish)
+{
+  if (this->PublishSnapshots == publish)
+    {
+    return;
+    }
+  this->PublishSnapshots = publish;
+  this->PublishSnapshot();
+  this->Modified();
+}
+
+//---------------------------------------------------------------------------
+ImageDevice::Snapshot ImageDevice::GetSnapshot() const
+{
+  return this->Snapshots.GetLatest();
+}
+
+//---------------------------------------------------------------------------
+vtkTypeInt64 ImageDevice::GetSnapshotFrameNumber() const
+{
+  return this->Snapshots.GetFrameNumber();
+}
+
+//---------------------------------------------------------------------------
+void ImageDevice::PublishSnapshot()
+{
+  vtkImageData* source = Content.image;
+  if (!this->PublishSnapshots || !source || !source->GetPointData()->GetScalars())
+    {
+    return;
+    }
+
+  // The slot holds an older frame, of which the allocations are reused.
+  BaseConverter::HeaderData* header = NULL;
+  ImageConverter::ContentData* snapshot = this->Snapshots.BeginWrite(&header);
+  *header = HeaderData;
+  if (!snapshot->image)
+    {
+    snapshot->image = vtkSmartPointer<vtkImageData>::New();
+    }
+  if (!snapshot->transform)
+    {
+    snapshot->transform = vtkSmartPointer<vtkMatrix4x4>::New();
+    }
+
+  vtkImageData* image = snapshot->image;
+  int extent[6];
+  int snapshotExtent[6];
+  source->GetExtent(extent);
+  image->GetExtent(snapshotExtent);
+  int scalarType = source->GetScalarType();
+  int numComponents = source->GetNumberOfScalarComponents();
+  if (!image->GetPointData()->GetScalars()
+      || memcmp(extent, snapshotExtent, sizeof(extent)) != 0
+      || image->GetScalarType() != scalarType
+      || image->GetNumberOfScalarComponents() != numComponents)
+    {
+    image->SetExtent(extent);
+#if (VTK_MAJOR_VERSION <= 5)
+    image->SetNumberOfScalarComponents(numComponents);
+    image->SetScalarType(scalarType);
+    image->AllocateScalars();
+#else
+    image->AllocateScalars(scalarType, numComponents);
+#endif
+    }
+  image->SetOrigin(source->GetOrigin());
+  image->SetSpacing(source->GetSpacing());
+  memcpy(image->GetScalarPointer(), source->GetScalarPointer(),
+         static_cast<size_t>(source->GetNumberOfPoints())*numComponents*source->GetScalarSize());
+
+  if (Content.transform)
+    {
+    snapshot->transform->DeepCopy(Content.transform);
+    }
+  else
+    {
+    snapshot->transform->Identity();
+    }
+  this->Snapshots.EndWrite();
+}
+
+//---------------------------------------------------------------------------
+void ImageDevice::AddModifiedExtent(const int extent[6])
+{
+  MergeExtent(this->ModifiedExtent, extent);
+}
+
+//---------------------------------------------------------------------------
+void ImageDevice::RequestKeyframe()
+{
+  this->KeyframeRequested = true;
+}
+
+//---------------------------------------------------------------------------
+bool ImageDevice::IsKeyframeDue(vtkImageData* image)
+{
+  int dims[3];
+  image->GetDimensions(dims);
+  return this->KeyframeRequested
+    || this->NumberOfMessagesSinceKeyframe < 0
+    || (this->KeyframeInterval > 0 && this->NumberOfMessagesSinceKeyframe+1 >= this->KeyframeInterval)
+    || dims[0] != this->LastDimensions[0] || dims[1] != this->LastDimensions[1] || dims[2] != this->LastDimensions[2]
+    || image->GetScalarType() != this->LastScalarType
+    || image->GetNumberOfScalarComponents() != this->LastNumberOfComponents;
+}
+
+//---------------------------------------------------------------------------
+void ImageDevice::SetFrameSent(vtkImageData* image, bool keyframe)
+{
+  ResetExtent(this->ModifiedExtent);
+  this->KeyframeRequested = false;
+  image->GetDimensions(this->LastDimensions);
+  this->LastScalarType = image->GetScalarType();
+  this->LastNumberOfComponents = image->GetNumberOfScalarComponents();
+  if (keyframe)
+    {
+    this->NumberOfMessagesSinceKeyframe = 0;
+    }
+  else
+    {
+    ++this->NumberOfMessagesSinceKeyframe;
+    }
+}
+
+//---------------------------------------------------------------------------
+bool ImageDevice::TakeNextSubVolume(int extent[6])
+{
+  vtkImageData* image = this->Content.image;
+  int dims[3];
+  image->GetExtent(extent);
+  image->GetDimensions(dims);
+  int numComponents = image->GetNumberOfScalarComponents();
+
+  bool keyframe = this->IsKeyframeDue(image)
+    || (IsEmptyExtent(this->ModifiedExtent) && !this->ComputeModifiedExtent);
+
+  int modified[6];
+  std::copy(this->ModifiedExtent, this->ModifiedExtent+6, modified);
+  if (this->ComputeModifiedExtent)
+    {
+    size_t size = static_cast<size_t>(dims[0])*dims[1]*dims[2]*image->GetScalarSize()*numComponents;
+    unsigned char* scalars = static_cast<unsigned char*>(image->GetScalarPointer());
+    if (keyframe || this->LastScalars.size() != size)
+      {
+      keyframe = true;
+      this->LastScalars.assign(scalars, scalars+size);
+      }
+    else if (size > 0)
+      {
+      CompareScalars(image, &this->LastScalars[0], modified);
+      }
+    }
+  else
+    {
+    std::vector<unsigned char>().swap(this->LastScalars);
+    }
+
+  // The receivers no longer hold the reference frame of the next delta.
+  this->DeltaReferenceSent = false;
+  this->SetFrameSent(image, keyframe);
+  if (keyframe)
+    {
+    return false;
+    }
+
+  for (int i=0; i<3; ++i)
+    {
+    modified[2*i] = std::max(modified[2*i], extent[2*i]);
+    modified[2*i+1] = std::min(modified[2*i+1], extent[2*i+1]);
+    }
+  if (IsEmptyExtent(modified))
+    {
+    extent[1] = extent[0];
+    extent[3] = extent[2];
+    extent[5] = extent[4];
+    }
+  else
+    {
+    std::copy(modified, modified+6, extent);
+    }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+int ImageDevice::GetDeltaGather(ImageConverter::GatherData* dest, bool copyKeyframe)
+{
+  vtkImageData* image = this->Content.image;
+  if (!ImageDelta::IsSupported(image) || !this->Content.transform)
+    {
+    vtkWarningMacro("Only 8 bit images can be sent as deltas, message not generated.")
+    return 0;
+    }
+
+  ImageDelta::FrameInfo frame;
+  frame.frame = this->DeltaFrame + 1;
+  frame.referenceFrame = this->DeltaFrame;
+  frame.keyframe = !this->DeltaReferenceSent || this->IsKeyframeDue(image);
+  if (!ImageDelta::toIGTLGather(HeaderData, Content, &this->LastScalars, &frame, dest, copyKeyframe))
+    {
+    return 0;
+    }
+
+  this->DeltaFrame = frame.frame;
+  this->DeltaReferenceSent = true;
+  this->SetFrameSent(image, frame.keyframe);
+  return 1;
+}
+
+//---------------------------------------------------------------------------
+bool ImageDevice::TakeKeyframeRequest()
+{
+  bool pending = this->KeyframeRequestPending;
+  this->KeyframeRequestPending = false;
+  return pending;
+}
 
 //---------------------------------------------------------------------------
 int ImageDevice::ReceiveIGTLMessage(igtl::MessageBase::Pointer buffer, bool checkCRC)
 {
- if (ImageConverter::fromIGTL(buffer, &HeaderData, &Content, checkCRC))
+ if (strcmp(buffer->GetDeviceType(), ImageDelta::GetIGTLTypeName()) == 0)
+   {
+   return this->ReceiveDelta(buffer, checkCRC);
+   }
+
+ if (this->DeltaEncoding && strcmp(buffer->GetDeviceType(), "GET_IMAGE") == 0)
    {
+   // Sent by receivers of deltas that need a keyframe.
+   this->RequestKeyframe();
+   return 1;
+   }
+
+ if (ImageConverter::fromIGTL(buffer, &HeaderData, &Content, checkCRC, this->ScalarPool))
+   {
+   this->DeltaReferenceReceived = false;
+   this->PublishSnapshot();
    this->Modified();
    return 1;
    }
@@ -81,6 +425,43 @@ int ImageDevice::ReceiveIGTLMessage(igtl::MessageBase::Pointer buffer, bool chec
  return 0;
 }
 
+//---------------------------------------------------------------------------
+int ImageDevice::ReceiveDelta(igtl::MessageBase::Pointer buffer, bool checkCRC)
+{
+  ImageDelta::FrameInfo frame;
+  if (!ImageDelta::GetFrameInfo(buffer, &frame))
+    {
+    return 0;
+    }
+
+  if (!frame.keyframe && (!this->DeltaReferenceReceived || frame.referenceFrame != this->LastReceivedFrame))
+    {
+    ++this->NumberOfSkippedDeltas;
+    this->DeltaReferenceReceived = false;
+    if (this->DeltaLossRecovery == RECOVER_REQUEST_KEYFRAME && !this->KeyframeAsked)
+      {
+      this->KeyframeAsked = true;
+      this->KeyframeRequestPending = true;
+      }
+    return 0;
+    }
+
+  // Applied in place to the image, which keeps its frame if the message is invalid.
+  if (!ImageDelta::fromIGTL(buffer, &HeaderData, &Content, checkCRC, this->ScalarPool))
+    {
+    return 0;
+    }
+  this->LastReceivedFrame = frame.frame;
+  this->DeltaReferenceReceived = true;
+  if (frame.keyframe)
+    {
+    this->KeyframeAsked = false;
+    }
+  this->PublishSnapshot();
+  this->Modified();
+  return 1;
+}
+
 
 //---------------------------------------------------------------------------
 igtl::MessageBase::Pointer ImageDevice::GetIGTLMessage()
@@ -91,7 +472,9 @@ igtl::MessageBase::Pointer ImageDevice::GetIGTLMessage()
   return 0;
   }
 
- if (!ImageConverter::toIGTL(HeaderData, Content, &this->OutImageMessage))
+ int extent[6];
+ bool subVolume = this->TakeNextSubVolume(extent);
+ if (!ImageConverter::toIGTL(HeaderData, Content, &this->OutImageMessage, subVolume ? extent : NULL))
    {
    return 0;
    }
@@ -137,6 +520,15 @@ void ImageDevice::PrintSelf(ostream& os, vtkIndent indent)
   Content.image->PrintSelf(os, indent.GetNextIndent());
   os << indent << "Transform:\t" << "\n";
   Content.transform->PrintSelf(os, indent.GetNextIndent());
+  os << indent << "ComputeModifiedExtent:\t" << this->ComputeModifiedExtent << "\n";
+  os << indent << "KeyframeInterval:\t" << this->KeyframeInterval << "\n";
+  os << indent << "DeltaEncoding:\t" << this->DeltaEncoding << "\n";
+  os << indent << "DeltaLossRecovery:\t" << this->DeltaLossRecovery << "\n";
+  os << indent << "NumberOfSkippedDeltas:\t" << this->NumberOfSkippedDeltas << "\n";
+  os << indent << "ScalarPool:\t" << "\n";
+  this->ScalarPool->PrintSelf(os, indent.GetNextIndent());
+  os << indent << "PublishSnapshots:\t" << this->PublishSnapshots << "\n";
+  os << indent << "SnapshotFrameNumber:\t" << this->GetSnapshotFrameNumber() << "\n";
 }
 } // namespace igtlio
 
@@ -18,7 +18,12 @@
 #include "igtlioDevicesExport.h"
 
 #include "igtlioImageConverter.h"
+#include "igtlioImageScalarPool.h"
 #include "igtlioDevice.h"
+#include "igtlioSnapshotBuffer.h"
+
+// STD includes
+#include <vector>
 
 
 class vtkImageData;
@@ -41,6 +46,89 @@ public:
   void SetContent(ImageConverter::ContentData content);
   ImageConverter::ContentData GetContent();
 
+  /// Content as published for other threads, see SnapshotBuffer.
+  typedef SnapshotBuffer<ImageConverter::ContentData>::Snapshot Snapshot;
+
+  /// Publish a copy of each content received or set, for readers on other
+  /// threads. GetContent() gives the image the next message is decoded
+  /// into, only for the thread receiving them. Off by default, as the
+  /// pixels are copied once per frame.
+  void SetPublishSnapshots(bool publish);
+  vtkGetMacro(PublishSnapshots, bool);
+  vtkBooleanMacro(PublishSnapshots, bool);
+
+  /// Last content published, left unmodified while the snapshot is held.
+  /// Lock-free, from any thread. Invalid before the first one.
+  Snapshot GetSnapshot() const;
+
+  /// Number of the last content published, to check for a new one.
+  vtkTypeInt64 GetSnapshotFrameNumber() const;
+
+  /// Mark a part of the image, as an extent (imin,imax,jmin,jmax,kmin,kmax),
+  /// as modified since the last message. Successive extents are merged.
+  /// The next message only holds the modified sub-volume, unless a
+  /// keyframe is due. Without modified extent, the whole image is sent.
+  void AddModifiedExtent(const int extent[6]);
+
+  /// Find the modified extent by comparing the image with the last sent
+  /// one, of which a copy is kept. Off by default.
+  vtkSetMacro(ComputeModifiedExtent, bool);
+  vtkGetMacro(ComputeModifiedExtent, bool);
+  vtkBooleanMacro(ComputeModifiedExtent, bool);
+
+  /// Send the whole image every KeyframeInterval messages, for receivers
+  /// that missed a message or connected later. 0 only sends the first one,
+  /// and those after a change of dimensions or scalar type. 30 by default.
+  vtkSetMacro(KeyframeInterval, int);
+  vtkGetMacro(KeyframeInterval, int);
+
+  /// Send the whole image with the next message. Also requested by
+  /// receivers of deltas with a GET_IMAGE message.
+  void RequestKeyframe();
+
+  /// Send the frames of 8 bit images as DLT_IMAGE deltas against the
+  /// previous frame, with a keyframe every KeyframeInterval frames, to
+  /// OpenIGTLinkIO peers that support them (see ImageDelta). Other peers,
+  /// and other images, get IMAGE messages. Off by default.
+  /// As every delta depends on the previous frame, the receiver should not
+  /// drop any: set its delivery policy to DELIVER_FIFO.
+  vtkSetMacro(DeltaEncoding, bool);
+  vtkGetMacro(DeltaEncoding, bool);
+  vtkBooleanMacro(DeltaEncoding, bool);
+
+  enum DeltaLossRecovery
+  {
+    RECOVER_WAIT_KEYFRAME,   // skip the deltas until the next keyframe
+    RECOVER_REQUEST_KEYFRAME // also ask the sender for one (default)
+  };
+
+  /// What the receiver does with a delta of which it missed the reference
+  /// frame, after a dropped message or when connecting in the middle of
+  /// a stream. The image keeps the last frame meanwhile.
+  vtkSetMacro(DeltaLossRecovery, int);
+  vtkGetMacro(DeltaLossRecovery, int);
+
+  /// Received deltas skipped as their reference frame was missing.
+  vtkGetMacro(NumberOfSkippedDeltas, unsigned long);
+
+  /// DLT_IMAGE message of the image, which is considered sent: a keyframe
+  /// when due, otherwise a delta against the last frame sent. The pixels
+  /// of a keyframe are copied if copyKeyframe is set, when sent later.
+  int GetDeltaGather(ImageConverter::GatherData* dest, bool copyKeyframe=false);
+
+  /// True once after a delta was skipped with RECOVER_REQUEST_KEYFRAME,
+  /// for the connector to ask the sender for a keyframe.
+  bool TakeKeyframeRequest();
+
+  /// Scalar buffers of the received images, reused when their dimensions
+  /// or scalar type change, with the reuse statistics.
+  ImageScalarPool* GetScalarPool() { return this->ScalarPool; }
+
+  /// Extent of the image to put in the next message, which is considered
+  /// sent. Return false for a keyframe, with the whole extent of the image.
+  /// Nothing modified gives the first voxel, to still send the header.
+  bool TakeNextSubVolume(int extent[6]);
+
 public:
   static ImageDevice *New();
   vtkTypeMacro(ImageDevice,Device);
@@ -50,11 +138,42 @@ protected:
   ImageDevice();
   ~ImageDevice();
 
+  int ReceiveDelta(igtl::MessageBase::Pointer buffer, bool checkCRC);
+  bool IsKeyframeDue(vtkImageData* image);
+  void SetFrameSent(vtkImageData* image, bool keyframe);
+  void PublishSnapshot();
+
  protected:
   igtl::ImageMessage::Pointer OutImageMessage;
   igtl::GetImageMessage::Pointer GetImageMessage;
 
   ImageConverter::ContentData Content;
+
+  int ModifiedExtent[6];
+  bool ComputeModifiedExtent;
+  int KeyframeInterval;
+  bool KeyframeRequested;
+  int NumberOfMessagesSinceKeyframe; // -1 before the first one
+  int LastDimensions[3];
+  int LastScalarType;
+  int LastNumberOfComponents;
+  std::vector<unsigned char> LastScalars; // with ComputeModifiedExtent or DeltaEncoding
+
+  bool DeltaEncoding;
+  bool DeltaReferenceSent; // the last message sent was a DLT_IMAGE
+  igtlUint32 DeltaFrame;   // number of the last DLT_IMAGE sent
+
+  int DeltaLossRecovery;
+  bool DeltaReferenceReceived; // the image holds frame LastReceivedFrame
+  igtlUint32 LastReceivedFrame;
+  bool KeyframeAsked;
+  bool KeyframeRequestPending;
+  unsigned long NumberOfSkippedDeltas;
+
+  ImageScalarPoolPointer ScalarPool;
+
+  bool PublishSnapshots;
+  SnapshotBuffer<ImageConverter::ContentData> Snapshots;
 };
 
 //---------------------------------------------------------------------------
@@ -63,6 +182,7 @@ class OPENIGTLINKIO_DEVICES_EXPORT ImageDeviceCreator : public DeviceCreator
 public:
   virtual DevicePointer Create(std::string device_name);
   virtual std::string GetDeviceType() const;
+  virtual igtl::MessageBase::Pointer CreateReceiveMessage(std::string device_type) const;
 
   static ImageDeviceCreator *New();
   vtkTypeMacro(ImageDeviceCreator,vtkObject);
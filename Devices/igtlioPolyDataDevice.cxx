@@ -0,0 +1,147 @@
+#include "igtlioPolyDataDevice.h"
+
+#include <vtkObjectFactory.h>
+#include <vtkPolyData.h>
+
+namespace igtlio
+{
+
+//---------------------------------------------------------------------------
+DevicePointer PolyDataDeviceCreator::Create(std::string device_name)
+{
+ PolyDataDevicePointer retval = PolyDataDevicePointer::New();
+ retval->SetDeviceName(device_name);
+ return retval;
+}
+
+//---------------------------------------------------------------------------
+std::string PolyDataDeviceCreator::GetDeviceType() const
+{
+  return PolyDataConverter::GetIGTLTypeName();
+}
+
+//---------------------------------------------------------------------------
+igtl::MessageBase::Pointer PolyDataDeviceCreator::CreateReceiveMessage(std::string device_type) const
+{
+  // The converter reads the pack as received: the message is not unpacked.
+  if (device_type==PolyDataConverter::GetIGTLTypeName())
+    return dynamic_pointer_cast<igtl::MessageBase>(igtl::PolyDataMessage::New());
+  return igtl::MessageBase::New();
+}
+
+//---------------------------------------------------------------------------
+vtkStandardNewMacro(PolyDataDeviceCreator);
+
+
+//---------------------------------------------------------------------------
+vtkStandardNewMacro(PolyDataDevice);
+//---------------------------------------------------------------------------
+PolyDataDevice::PolyDataDevice()
+{
+  this->NumberOfCellsKept = 0;
+}
+
+//---------------------------------------------------------------------------
+PolyDataDevice::~PolyDataDevice()
+{
+}
+
+//---------------------------------------------------------------------------
+std::string PolyDataDevice::GetDeviceType() const
+{
+  return PolyDataConverter::GetIGTLTypeName();
+}
+
+void PolyDataDevice::SetContent(PolyDataConverter::MessageContent content)
+{
+  Content = content;
+  this->Modified();
+}
+
+PolyDataConverter::MessageContent PolyDataDevice::GetContent()
+{
+  return Content;
+}
+
+//---------------------------------------------------------------------------
+int PolyDataDevice::ReceiveIGTLMessage(igtl::MessageBase::Pointer buffer, bool checkCRC)
+{
+ bool cellsKept = false;
+ if (!PolyDataConverter::IGTLToVTKInPlace(buffer, &Content, checkCRC, &cellsKept))
+   {
+   return 0;
+   }
+ BaseConverter::IGTLtoHeader(buffer, &HeaderData);
+ if (cellsKept)
+   {
+   ++this->NumberOfCellsKept;
+   }
+ this->Modified();
+ return 1;
+}
+
+//---------------------------------------------------------------------------
+igtl::MessageBase::Pointer PolyDataDevice::GetIGTLMessage()
+{
+ // cannot send a non-existent polydata
+ if (!Content.polydata)
+   {
+   return 0;
+   }
+
+ bool cellsKept = false;
+ if (!PolyDataConverter::VTKToIGTL(Content, &this->OutPolyDataMessage, &cellsKept))
+   {
+   return 0;
+   }
+ if (cellsKept)
+   {
+   ++this->NumberOfCellsKept;
+   }
+
+ return dynamic_pointer_cast<igtl::MessageBase>(this->OutPolyDataMessage);
+}
+
+//---------------------------------------------------------------------------
+igtl::MessageBase::Pointer PolyDataDevice::GetIGTLMessage(MESSAGE_PREFIX prefix)
+{
+ if (prefix==MESSAGE_PREFIX_GET)
+  {
+   if (this->GetPolyDataMessage.IsNull())
+     {
+     this->GetPolyDataMessage = igtl::GetPolyDataMessage::New();
+     }
+   this->GetPolyDataMessage->SetDeviceName(HeaderData.deviceName.c_str());
+   this->GetPolyDataMessage->Pack();
+   return dynamic_pointer_cast<igtl::MessageBase>(this->GetPolyDataMessage);
+  }
+ if (prefix==MESSAGE_PREFIX_NOT_DEFINED)
+   {
+     return this->GetIGTLMessage();
+   }
+
+ return igtl::MessageBase::Pointer();
+}
+
+//---------------------------------------------------------------------------
+std::set<Device::MESSAGE_PREFIX> PolyDataDevice::GetSupportedMessagePrefixes() const
+{
+ std::set<MESSAGE_PREFIX> retval;
+ retval.insert(MESSAGE_PREFIX_GET);
+ return retval;
+}
+
+//---------------------------------------------------------------------------
+void PolyDataDevice::PrintSelf(ostream& os, vtkIndent indent)
+{
+  Device::PrintSelf(os, indent);
+
+  os << indent << "NumberOfCellsKept:\t" << this->NumberOfCellsKept << "\n";
+  if (Content.polydata)
+    {
+    os << indent << "NumberOfPoints:\t" << Content.polydata->GetNumberOfPoints() << "\n";
+    os << indent << "NumberOfCells:\t" << Content.polydata->GetNumberOfCells() << "\n";
+    }
+}
+
+} // namespace igtlio
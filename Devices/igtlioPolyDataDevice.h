@@ -0,0 +1,66 @@
+#ifndef IGTLIOPOLYDATADEVICE_H
+#define IGTLIOPOLYDATADEVICE_H
+
+#include "igtlioDevicesExport.h"
+
+#include "igtlioPolyDataConverter.h"
+#include "igtlioDevice.h"
+
+namespace igtlio
+{
+
+typedef vtkSmartPointer<class PolyDataDevice> PolyDataDevicePointer;
+
+/// A Device supporting the POLYDATA igtl Message.
+///
+/// Received messages update the polydata of the content in place: when
+/// the topology is unchanged, as for a deforming surface, only the arrays
+/// of the points and attributes are overwritten and modified. Sending
+/// again a polydata of which the cells are unchanged reuses their encoding.
+class OPENIGTLINKIO_DEVICES_EXPORT PolyDataDevice : public Device
+{
+public:
+ virtual std::string GetDeviceType() const;
+ virtual int ReceiveIGTLMessage(igtl::MessageBase::Pointer buffer, bool checkCRC);
+ virtual igtl::MessageBase::Pointer GetIGTLMessage();
+ virtual igtl::MessageBase::Pointer GetIGTLMessage(MESSAGE_PREFIX prefix);
+ virtual std::set<MESSAGE_PREFIX> GetSupportedMessagePrefixes() const;
+
+  void SetContent(PolyDataConverter::MessageContent content);
+  PolyDataConverter::MessageContent GetContent();
+
+  /// Number of messages received or sent of which the cells were kept.
+  vtkGetMacro(NumberOfCellsKept, int);
+
+public:
+  static PolyDataDevice *New();
+  vtkTypeMacro(PolyDataDevice,Device);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+protected:
+  PolyDataDevice();
+  ~PolyDataDevice();
+
+ protected:
+  igtl::PolyDataMessage::Pointer OutPolyDataMessage;
+  igtl::GetPolyDataMessage::Pointer GetPolyDataMessage;
+
+  PolyDataConverter::MessageContent Content;
+  int NumberOfCellsKept;
+};
+
+//---------------------------------------------------------------------------
+class OPENIGTLINKIO_DEVICES_EXPORT PolyDataDeviceCreator : public DeviceCreator
+{
+public:
+  virtual DevicePointer Create(std::string device_name);
+  virtual std::string GetDeviceType() const;
+  virtual igtl::MessageBase::Pointer CreateReceiveMessage(std::string device_type) const;
+
+  static PolyDataDeviceCreator *New();
+  vtkTypeMacro(PolyDataDeviceCreator,vtkObject);
+};
+
+} // namespace igtlio
+
+#endif // IGTLIOPOLYDATADEVICE_H
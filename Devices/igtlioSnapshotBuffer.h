@@ -0,0 +1,189 @@
+#ifndef IGTLIOSNAPSHOTBUFFER_H
+#define IGTLIOSNAPSHOTBUFFER_H
+
+// IGTLIO includes
+#include "igtlioBaseConverter.h"
+
+// VTK includes
+#include <vtkAtomic.h>
+
+// STD includes
+#include <vector>
+
+namespace igtlio
+{
+
+/// Latest content of a device, published by the thread receiving it for
+/// readers on any thread.
+///
+/// The writer fills a slot no reader holds, then publishes it: readers
+/// get the last published slot, which is not modified while they hold
+/// it. Three slots cover a reader holding a frame while the writer
+/// fills the next one; the writer adds a slot instead of waiting when
+/// readers hold all of them.
+///
+/// Threading:
+///  - BeginWrite() and EndWrite() are only called from one thread at a
+///    time, the one receiving messages, usually the main thread.
+///  - GetLatest() can be called from any thread, without locking.
+///
+/// Snapshots must be released before the buffer is deleted.
+///
+template <class T>
+class SnapshotBuffer
+{
+  struct Slot
+  {
+    Slot() : FrameNumber(0) { this->References = 0; }
+    BaseConverter::HeaderData Header;
+    T Content;
+    vtkTypeInt64 FrameNumber;
+    vtkAtomic<int> References;
+  };
+
+public:
+  /// Handle on a published frame, which stays unmodified while held.
+  class Snapshot
+  {
+  public:
+    Snapshot() : Held(NULL) {}
+    Snapshot(const Snapshot& other) : Held(other.Held)
+    {
+      if (this->Held)
+        ++this->Held->References;
+    }
+    ~Snapshot()
+    {
+      this->Release();
+    }
+    Snapshot& operator=(const Snapshot& other)
+    {
+      if (other.Held)
+        ++other.Held->References;
+      this->Release();
+      this->Held = other.Held;
+      return *this;
+    }
+
+    /// False before the first frame was published.
+    bool IsValid() const { return this->Held != NULL; }
+    /// Increases by one for each frame published, from 1.
+    vtkTypeInt64 GetFrameNumber() const { return this->Held ? this->Held->FrameNumber : 0; }
+    const BaseConverter::HeaderData& GetHeader() const { return this->Held->Header; }
+    const T& GetContent() const { return this->Held->Content; }
+
+    void Release()
+    {
+      if (this->Held)
+        --this->Held->References;
+      this->Held = NULL;
+    }
+
+  private:
+    friend class SnapshotBuffer;
+    Slot* Held;
+  };
+
+  SnapshotBuffer() : Writing(NULL)
+  {
+    for (int i=0; i<3; ++i)
+      {
+      this->Slots.push_back(new Slot);
+      }
+    this->Current = NULL;
+    this->FrameNumber = 0;
+  }
+
+  ~SnapshotBuffer()
+  {
+    for (unsigned i=0; i<this->Slots.size(); ++i)
+      {
+      delete this->Slots[i];
+      }
+  }
+
+  /// Writer: content of a slot no reader holds, to fill completely. It
+  /// holds the frame published two or more frames ago, for reuse of its
+  /// allocations.
+  T* BeginWrite(BaseConverter::HeaderData** header=NULL)
+  {
+    Slot* current = this->Current;
+    this->Writing = NULL;
+    for (unsigned i=0; i<this->Slots.size() && !this->Writing; ++i)
+      {
+      // A reader takes a slot by counting a reference, then checks that
+      // it is still the current one: it cannot take a slot being written.
+      if (this->Slots[i] != current && this->Slots[i]->References == 0)
+        {
+        this->Writing = this->Slots[i];
+        }
+      }
+    if (!this->Writing)
+      {
+      this->Writing = new Slot;
+      this->Slots.push_back(this->Writing);
+      }
+    if (header)
+      {
+      *header = &this->Writing->Header;
+      }
+    return &this->Writing->Content;
+  }
+
+  /// Writer: publish the slot given by BeginWrite().
+  void EndWrite()
+  {
+    this->Writing->FrameNumber = this->FrameNumber + 1;
+    this->Current = this->Writing;
+    this->FrameNumber = this->Writing->FrameNumber;
+    this->Writing = NULL;
+  }
+
+  /// Number of the last frame published, 0 if none.
+  vtkTypeInt64 GetFrameNumber() const
+  {
+    return this->FrameNumber;
+  }
+
+  /// Reader: the last frame published. Lock-free, from any thread.
+  Snapshot GetLatest() const
+  {
+    Snapshot snapshot;
+    for (;;)
+      {
+      Slot* current = this->Current;
+      if (!current)
+        {
+        return snapshot;
+        }
+      ++current->References;
+      if (current == this->Current)
+        {
+        snapshot.Held = current;
+        return snapshot;
+        }
+      // Replaced meanwhile, and maybe being written: take the new one.
+      --current->References;
+      }
+  }
+
+  /// Number of slots, more than three if readers held frames for long.
+  unsigned int GetNumberOfSlots() const
+  {
+    return static_cast<unsigned int>(this->Slots.size());
+  }
+
+private:
+  SnapshotBuffer(const SnapshotBuffer&); // Not implemented
+  void operator=(const SnapshotBuffer&); // Not implemented
+
+  // vtkAtomic accesses are sequentially consistent.
+  vtkAtomic<Slot*> Current;
+  std::vector<Slot*> Slots; // writer only
+  Slot* Writing;
+  vtkAtomic<vtkTypeInt64> FrameNumber; // set after Current
+};
+
+} // namespace igtlio
+
+#endif // IGTLIOSNAPSHOTBUFFER_H
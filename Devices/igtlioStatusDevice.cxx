@@ -19,6 +19,14 @@ std::string StatusDeviceCreator::GetDeviceType() const
  return StatusConverter::GetIGTLTypeName();
 }
 
+//---------------------------------------------------------------------------
+igtl::MessageBase::Pointer StatusDeviceCreator::CreateReceiveMessage(std::string device_type) const
+{
+  if (device_type==StatusConverter::GetIGTLTypeName())
+    return dynamic_pointer_cast<igtl::MessageBase>(igtl::StatusMessage::New());
+  return igtl::MessageBase::New();
+}
+
 //---------------------------------------------------------------------------
 vtkStandardNewMacro(StatusDeviceCreator);
 
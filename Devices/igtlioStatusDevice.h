@@ -49,6 +49,7 @@ class OPENIGTLINKIO_DEVICES_EXPORT StatusDeviceCreator : public DeviceCreator
 public:
   virtual DevicePointer Create(std::string device_name);
   virtual std::string GetDeviceType() const;
+  virtual igtl::MessageBase::Pointer CreateReceiveMessage(std::string device_type) const;
 
   static StatusDeviceCreator *New();
   vtkTypeMacro(StatusDeviceCreator,vtkObject);
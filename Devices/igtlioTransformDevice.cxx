@@ -34,6 +34,14 @@ std::string TransformDeviceCreator::GetDeviceType() const
   return TransformConverter::GetIGTLTypeName();
 }
 
+//---------------------------------------------------------------------------
+igtl::MessageBase::Pointer TransformDeviceCreator::CreateReceiveMessage(std::string device_type) const
+{
+  if (device_type==TransformConverter::GetIGTLTypeName())
+    return dynamic_pointer_cast<igtl::MessageBase>(igtl::TransformMessage::New());
+  return igtl::MessageBase::New();
+}
+
 //---------------------------------------------------------------------------
 vtkStandardNewMacro(TransformDeviceCreator);
 
@@ -58,7 +66,22 @@ std::string TransformDevice::GetDeviceType() const
 
 void TransformDevice::SetContent(TransformConverter::ContentData content)
 {
-  Content = content;
+  // Copied into the matrix of the device, which received transforms
+  // overwrite: the matrix of the caller is left alone.
+  Content.deviceName = content.deviceName;
+  if (!content.transform)
+    {
+    Content.transform = NULL;
+    }
+  else
+    {
+    if (!Content.transform)
+      {
+      Content.transform = vtkSmartPointer<vtkMatrix4x4>::New();
+      }
+    Content.transform->DeepCopy(content.transform);
+    }
+  this->PublishSnapshot();
   this->Modified();
 }
 
@@ -67,12 +90,46 @@ TransformConverter::ContentData TransformDevice::GetContent()
   return Content;
 }
 
+//---------------------------------------------------------------------------
+TransformDevice::Snapshot TransformDevice::GetSnapshot() const
+{
+  return this->Snapshots.GetLatest();
+}
+
+//---------------------------------------------------------------------------
+vtkTypeInt64 TransformDevice::GetSnapshotFrameNumber() const
+{
+  return this->Snapshots.GetFrameNumber();
+}
+
+//---------------------------------------------------------------------------
+void TransformDevice::PublishSnapshot()
+{
+  if (!Content.transform)
+    {
+    return;
+    }
+
+  // Copied, as the owner of the content may modify its matrix.
+  BaseConverter::HeaderData* header = NULL;
+  TransformConverter::ContentData* snapshot = this->Snapshots.BeginWrite(&header);
+  *header = HeaderData;
+  if (!snapshot->transform)
+    {
+    snapshot->transform = vtkSmartPointer<vtkMatrix4x4>::New();
+    }
+  snapshot->transform->DeepCopy(Content.transform);
+  snapshot->deviceName = Content.deviceName;
+  this->Snapshots.EndWrite();
+}
+
 
 //---------------------------------------------------------------------------
 int TransformDevice::ReceiveIGTLMessage(igtl::MessageBase::Pointer buffer, bool checkCRC)
 {
  if (TransformConverter::fromIGTL(buffer, &HeaderData, &Content, checkCRC))
    {
+   this->PublishSnapshot();
    this->Modified();
    return 1;
    }
@@ -19,6 +19,7 @@
 
 #include "igtlioTransformConverter.h"
 #include "igtlioDevice.h"
+#include "igtlioSnapshotBuffer.h"
 
 class vtkImageData;
 
@@ -36,9 +37,22 @@ public:
  virtual igtl::MessageBase::Pointer GetIGTLMessage(MESSAGE_PREFIX prefix);
  virtual std::set<MESSAGE_PREFIX> GetSupportedMessagePrefixes() const;
 
+  /// The content is copied into a matrix owned by the device, allocated
+  /// once, into which received transforms are written: nothing is
+  /// allocated for each message.
   void SetContent(TransformConverter::ContentData content);
   TransformConverter::ContentData GetContent();
 
+  /// Content as published for other threads, see SnapshotBuffer.
+  typedef SnapshotBuffer<TransformConverter::ContentData>::Snapshot Snapshot;
+
+  /// Last content received or set, left unmodified while the snapshot is
+  /// held. Lock-free, from any thread. Invalid before the first one.
+  Snapshot GetSnapshot() const;
+
+  /// Number of the last content published, to check for a new one.
+  vtkTypeInt64 GetSnapshotFrameNumber() const;
+
 public:
   static TransformDevice *New();
   vtkTypeMacro(TransformDevice,Device);
@@ -48,11 +62,14 @@ protected:
   TransformDevice();
   ~TransformDevice();
 
+  void PublishSnapshot();
+
  protected:
   igtl::TransformMessage::Pointer OutTransformMessage;
   igtl::GetTransformMessage::Pointer GetTransformMessage;
 
   TransformConverter::ContentData Content;
+  SnapshotBuffer<TransformConverter::ContentData> Snapshots;
 };
 
 //---------------------------------------------------------------------------
@@ -61,6 +78,7 @@ class OPENIGTLINKIO_DEVICES_EXPORT TransformDeviceCreator : public DeviceCreator
 public:
   virtual DevicePointer Create(std::string device_name);
   virtual std::string GetDeviceType() const;
+  virtual igtl::MessageBase::Pointer CreateReceiveMessage(std::string device_type) const;
 
   static TransformDeviceCreator *New();
   vtkTypeMacro(TransformDeviceCreator,vtkObject);
@@ -1,4 +1,5 @@
 #include "qIGTLIOLogicController.h"
+#include <QSocketNotifier>
 #include <QTimer>
 #include "igtlioLogic.h"
 
@@ -8,6 +9,7 @@ qIGTLIOLogicController::qIGTLIOLogicController()
   ImportDataAndEventsTimer->setInterval(5);
   connect(ImportDataAndEventsTimer, SIGNAL(timeout()),
           this, SLOT(importDataAndEvents()));
+  ImportDataAndEventsNotifier = NULL;
 }
 
 void qIGTLIOLogicController::setLogic(igtlio::LogicPointer logic)
@@ -22,12 +24,30 @@ void qIGTLIOLogicController::setLogic(igtlio::LogicPointer logic)
 
   this->Logic = logic;
 
+  delete ImportDataAndEventsNotifier;
+  ImportDataAndEventsNotifier = NULL;
+  int descriptor = Logic ? Logic->GetWaitHandle()->GetDescriptor() : -1;
+  if (descriptor >= 0)
+    {
+    // Data and events wake us up, the timer only handles query timeouts.
+    ImportDataAndEventsNotifier = new QSocketNotifier(descriptor, QSocketNotifier::Read, this);
+    ImportDataAndEventsNotifier->setEnabled(false);
+    connect(ImportDataAndEventsNotifier, SIGNAL(activated(int)),
+            this, SLOT(importDataAndEvents()));
+    ImportDataAndEventsTimer->setInterval(100);
+    }
+  else
+    {
+    ImportDataAndEventsTimer->setInterval(5);
+    }
+
   this->onConnectionsChanged();
 }
 
 void qIGTLIOLogicController::onConnectionsChanged()
 {
-  if (Logic->GetNumberOfConnectors() > 0)
+  bool active = Logic && Logic->GetNumberOfConnectors() > 0;
+  if (active)
     {
       if (!ImportDataAndEventsTimer->isActive())
         ImportDataAndEventsTimer->start();
@@ -36,6 +56,8 @@ void qIGTLIOLogicController::onConnectionsChanged()
     {
       ImportDataAndEventsTimer->stop();
     }
+  if (ImportDataAndEventsNotifier)
+    ImportDataAndEventsNotifier->setEnabled(active);
 }
 
 //-----------------------------------------------------------------------------
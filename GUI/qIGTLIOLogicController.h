@@ -3,6 +3,7 @@
 
 #include <QObject>
 class QTimer;
+class QSocketNotifier;
 
 #include "qIGTLIOVtkConnectionMacro.h"
 
@@ -14,7 +15,9 @@ typedef vtkSmartPointer<class Logic> LogicPointer;
 // igtlio includes
 #include "igtlioGUIExport.h"
 
-/// Adds a timer calling vtkIGTLIOLogic regularly.
+/// Calls vtkIGTLIOLogic::PeriodicProcess() when its wait handle signals
+/// pending data or events, and on a slow timer for timeouts.
+/// Falls back to a fast timer where the handle has no descriptor.
 ///
 class OPENIGTLINKIO_GUI_EXPORT qIGTLIOLogicController : public QObject
 {
@@ -34,6 +37,7 @@ private slots:
   void importDataAndEvents();
 private:
   QTimer* ImportDataAndEventsTimer;
+  QSocketNotifier* ImportDataAndEventsNotifier;
   igtlio::LogicPointer Logic;
 
 };
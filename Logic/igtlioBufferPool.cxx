@@ -0,0 +1,382 @@
+#include "igtlioBufferPool.h"
+#include "igtlioPackBuffer.h"
+
+// OpenIGTLink includes
+#include <igtl_header.h>
+#include <igtl_image.h>
+
+// VTK includes
+#include <vtkMutexLock.h>
+#include <vtkObjectFactory.h>
+
+// STD includes
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace igtlio
+{
+
+namespace
+{
+/// Gives access to the protected pack of igtl::MessageBase, as for the
+/// socket descriptor in igtlioSocketUtilities.
+struct PackAccess : public igtl::MessageBase
+{
+  static unsigned char*& Header(igtl::MessageBase* message)
+  {
+    return message->*(&PackAccess::m_Header);
+  }
+  static unsigned char*& Body(igtl::MessageBase* message)
+  {
+    return message->*(&PackAccess::m_Body);
+  }
+  static int& PackSize(igtl::MessageBase* message)
+  {
+    return message->*(&PackAccess::m_PackSize);
+  }
+};
+
+const size_t HugePageSize = 2*1024*1024;
+
+// Pixels of an IMAGE message, aligned for adoption by images.
+const size_t PixelOffset = IGTL_HEADER_SIZE + IGTL_IMAGE_HEADER_SIZE;
+}
+
+//---------------------------------------------------------------------------
+vtkStandardNewMacro(BufferPool);
+
+//---------------------------------------------------------------------------
+BufferPool::BufferPool()
+{
+  this->Mutex = vtkMutexLockPointer::New();
+  this->MinimumPooledSize = 64*1024;
+  this->MaximumIdleBytes = 256*1024*1024;
+  this->UseHugePages = false;
+  this->NumberOfHits = 0;
+  this->NumberOfMisses = 0;
+  this->ResidentBytes = 0;
+  this->IdleBytes = 0;
+  PackBuffer::AddOwner(this, &BufferPool::DetachPack, &BufferPool::ReleasePack);
+}
+
+//---------------------------------------------------------------------------
+BufferPool::~BufferPool()
+{
+  // Buffers still adopted by images are deleted by them.
+  PackBuffer::RemoveOwner(this);
+
+  // igtl frees the pack of a message with delete []: messages still
+  // referenced elsewhere get a copy of their pack, the others none.
+  for (std::map<igtl::MessageBase*, Lease>::iterator iter = this->Leases.begin(); iter != this->Leases.end(); ++iter)
+    {
+    igtl::MessageBase* message = iter->first;
+    unsigned char*& header = PackAccess::Header(message);
+    if (header == iter->second.Buffer)
+      {
+      unsigned char* copy = NULL;
+      if (message->GetReferenceCount() > 1)
+        {
+        copy = new unsigned char[PackAccess::PackSize(message)];
+        memcpy(copy, header, PackAccess::PackSize(message));
+        PackAccess::Body(message) = copy + (PackAccess::Body(message) - header);
+        }
+      else
+        {
+        PackAccess::Body(message) = NULL;
+        PackAccess::PackSize(message) = 0;
+        }
+      this->FreeBuffer(header, iter->second.Capacity);
+      header = copy;
+      }
+    iter->second.Message = NULL;
+    }
+  for (std::map<size_t, std::vector<unsigned char*> >::iterator iter = this->IdleBuffers.begin(); iter != this->IdleBuffers.end(); ++iter)
+    {
+    for (unsigned i=0; i<iter->second.size(); ++i)
+      {
+      this->FreeBuffer(iter->second[i], iter->first);
+      }
+    }
+}
+
+//---------------------------------------------------------------------------
+void BufferPool::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "MinimumPooledSize: " << this->MinimumPooledSize << "\n";
+  os << indent << "MaximumIdleBytes: " << this->MaximumIdleBytes << "\n";
+  os << indent << "UseHugePages: " << this->UseHugePages << "\n";
+  os << indent << "NumberOfHits: " << this->GetNumberOfHits() << "\n";
+  os << indent << "NumberOfMisses: " << this->GetNumberOfMisses() << "\n";
+  os << indent << "ResidentBytes: " << this->GetResidentBytes() << "\n";
+  os << indent << "IdleBytes: " << this->GetIdleBytes() << "\n";
+}
+
+//---------------------------------------------------------------------------
+size_t BufferPool::GetSizeClass(size_t size)
+{
+  size_t power = 1;
+  while (power < size)
+    {
+    power *= 2;
+    }
+  size_t step = power >= 8 ? power/8 : 1; // 4 classes between power/2 and power
+  return ((size + step - 1) / step) * step;
+}
+
+//---------------------------------------------------------------------------
+void BufferPool::AllocatePack(igtl::MessageBase* message, int bodySize)
+{
+  if (bodySize < 0)
+    {
+    bodySize = static_cast<int>(message->GetBodySizeToRead());
+    }
+  size_t packSize = IGTL_HEADER_SIZE + bodySize;
+  if (packSize < static_cast<size_t>(this->MinimumPooledSize))
+    {
+    message->AllocatePack();
+    return;
+    }
+  size_t capacity = GetSizeClass(packSize);
+
+  unsigned char*& header = PackAccess::Header(message);
+  this->Mutex->Lock();
+  std::map<igtl::MessageBase*, Lease>::iterator lease = this->Leases.find(message);
+  if (lease != this->Leases.end() && lease->second.Buffer != header)
+    {
+    // igtl reallocated the pack meanwhile, and freed our buffer.
+    this->ResidentBytes -= lease->second.Capacity;
+    this->Leases.erase(lease);
+    lease = this->Leases.end();
+    }
+
+  unsigned char* buffer = NULL;
+  if (lease != this->Leases.end() && lease->second.Capacity == capacity)
+    {
+    // Same class: keep the buffer.
+    buffer = header;
+    ++this->NumberOfHits;
+    }
+  else
+    {
+    std::vector<unsigned char*>& idle = this->IdleBuffers[capacity];
+    if (!idle.empty())
+      {
+      buffer = idle.back();
+      idle.pop_back();
+      this->IdleBytes -= capacity;
+      ++this->NumberOfHits;
+      }
+    }
+  this->Mutex->Unlock();
+
+  bool allocated = false;
+  if (!buffer)
+    {
+    buffer = this->NewBuffer(capacity);
+    allocated = true;
+    }
+
+  unsigned char* previous = NULL;
+  if (buffer != header && header)
+    {
+    memcpy(buffer, header, IGTL_HEADER_SIZE);
+    previous = header;
+    }
+
+  // The pack is switched under the lock, so that Trim() never sees a lease
+  // whose buffer is not yet the one of its message.
+  this->Mutex->Lock();
+  if (buffer != header)
+    {
+    if (allocated)
+      {
+      ++this->NumberOfMisses;
+      this->ResidentBytes += capacity;
+      }
+    if (lease != this->Leases.end())
+      {
+      // Back to the pool.
+      this->IdleBuffers[lease->second.Capacity].push_back(previous);
+      this->IdleBytes += lease->second.Capacity;
+      lease->second.Buffer = buffer;
+      lease->second.Capacity = capacity;
+      previous = NULL;
+      }
+    else
+      {
+      Lease& newLease = this->Leases[message];
+      newLease.Message = message;
+      newLease.Buffer = buffer;
+      newLease.Capacity = capacity;
+      }
+    header = buffer;
+    }
+  // igtl keeps the pack when its size is unchanged.
+  PackAccess::PackSize(message) = static_cast<int>(packSize);
+  PackAccess::Body(message) = header + IGTL_HEADER_SIZE;
+  this->Mutex->Unlock();
+
+  // Allocated by igtl
+  delete [] previous;
+
+  if (message->GetBodySizeToRead() == bodySize)
+    {
+    message->AllocatePack();
+    }
+}
+
+//---------------------------------------------------------------------------
+void BufferPool::Trim()
+{
+  std::vector<igtl::MessageBase::Pointer> released;
+
+  this->Mutex->Lock();
+  std::map<igtl::MessageBase*, Lease>::iterator iter = this->Leases.begin();
+  while (iter != this->Leases.end())
+    {
+    igtl::MessageBase* message = iter->first;
+    if (PackAccess::Header(message) != iter->second.Buffer)
+      {
+      // Reallocated by igtl, our buffer is gone.
+      this->ResidentBytes -= iter->second.Capacity;
+      released.push_back(iter->second.Message);
+      this->Leases.erase(iter++);
+      }
+    else if (message->GetReferenceCount() == 1)
+      {
+      // Only referenced by the lease: detach the buffer and let it go.
+      PackAccess::Header(message) = NULL;
+      PackAccess::Body(message) = NULL;
+      PackAccess::PackSize(message) = 0;
+      this->IdleBuffers[iter->second.Capacity].push_back(iter->second.Buffer);
+      this->IdleBytes += iter->second.Capacity;
+      released.push_back(iter->second.Message);
+      this->Leases.erase(iter++);
+      }
+    else
+      {
+      ++iter;
+      }
+    }
+
+  // Free the largest idle buffers first.
+  std::map<size_t, std::vector<unsigned char*> >::reverse_iterator idle = this->IdleBuffers.rbegin();
+  while (this->IdleBytes > this->MaximumIdleBytes && idle != this->IdleBuffers.rend())
+    {
+    while (this->IdleBytes > this->MaximumIdleBytes && !idle->second.empty())
+      {
+      this->FreeBuffer(idle->second.back(), idle->first);
+      idle->second.pop_back();
+      this->IdleBytes -= idle->first;
+      this->ResidentBytes -= idle->first;
+      }
+    ++idle;
+    }
+  this->Mutex->Unlock();
+
+  // The messages are deleted here, outside the lock.
+}
+
+//---------------------------------------------------------------------------
+bool BufferPool::DetachPack(void* pool, igtl::MessageBase* message, size_t* capacity)
+{
+  BufferPool* self = static_cast<BufferPool*>(pool);
+  bool detached = false;
+  self->Mutex->Lock();
+  std::map<igtl::MessageBase*, Lease>::iterator lease = self->Leases.find(message);
+  if (lease != self->Leases.end() && lease->second.Buffer == PackAccess::Header(message))
+    {
+    // Still resident, until released by the image.
+    *capacity = lease->second.Capacity;
+    self->Leases.erase(lease);
+    detached = true;
+    }
+  self->Mutex->Unlock();
+  return detached;
+}
+
+//---------------------------------------------------------------------------
+void BufferPool::ReleasePack(void* pool, unsigned char* pack, size_t capacity)
+{
+  BufferPool* self = static_cast<BufferPool*>(pool);
+  self->Mutex->Lock();
+  self->IdleBuffers[capacity].push_back(pack);
+  self->IdleBytes += capacity;
+  self->Mutex->Unlock();
+}
+
+//---------------------------------------------------------------------------
+unsigned char* BufferPool::NewBuffer(size_t capacity)
+{
+  unsigned char* buffer = PackBuffer::NewPack(capacity, PixelOffset);
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  if (this->UseHugePages && capacity >= HugePageSize)
+    {
+    // Large allocations are mmap'ed by malloc: advise the aligned interior.
+    size_t begin = (reinterpret_cast<size_t>(buffer) + HugePageSize - 1) & ~(HugePageSize - 1);
+    size_t end = (reinterpret_cast<size_t>(buffer) + capacity) & ~(HugePageSize - 1);
+    if (end > begin)
+      {
+      madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE);
+      }
+    }
+#endif
+  return buffer;
+}
+
+//---------------------------------------------------------------------------
+void BufferPool::FreeBuffer(unsigned char* buffer, size_t capacity)
+{
+  PackBuffer::DeletePack(buffer);
+}
+
+//---------------------------------------------------------------------------
+vtkTypeInt64 BufferPool::GetNumberOfHits()
+{
+  this->Mutex->Lock();
+  vtkTypeInt64 n = this->NumberOfHits;
+  this->Mutex->Unlock();
+  return n;
+}
+
+//---------------------------------------------------------------------------
+vtkTypeInt64 BufferPool::GetNumberOfMisses()
+{
+  this->Mutex->Lock();
+  vtkTypeInt64 n = this->NumberOfMisses;
+  this->Mutex->Unlock();
+  return n;
+}
+
+//---------------------------------------------------------------------------
+vtkTypeInt64 BufferPool::GetResidentBytes()
+{
+  this->Mutex->Lock();
+  vtkTypeInt64 n = this->ResidentBytes;
+  this->Mutex->Unlock();
+  return n;
+}
+
+//---------------------------------------------------------------------------
+vtkTypeInt64 BufferPool::GetIdleBytes()
+{
+  this->Mutex->Lock();
+  vtkTypeInt64 n = this->IdleBytes;
+  this->Mutex->Unlock();
+  return n;
+}
+
+//---------------------------------------------------------------------------
+void BufferPool::ResetStatistics()
+{
+  this->Mutex->Lock();
+  this->NumberOfHits = 0;
+  this->NumberOfMisses = 0;
+  this->Mutex->Unlock();
+}
+
+} // namespace igtlio
@@ -0,0 +1,119 @@
+#ifndef IGTLIOBUFFERPOOL_H
+#define IGTLIOBUFFERPOOL_H
+
+// OpenIGTLink includes
+#include <igtlMessageBase.h>
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// IGTLIO includes
+#include "igtlioLogicExport.h"
+
+// STD includes
+#include <map>
+#include <vector>
+
+typedef vtkSmartPointer<class vtkMutexLock> vtkMutexLockPointer;
+
+namespace igtlio
+{
+typedef vtkSmartPointer<class BufferPool> BufferPoolPointer;
+
+/// Reusable pack buffers for large messages, bucketed by size class.
+///
+/// igtl::MessageBase reallocates its pack whenever the body size changes.
+/// AllocatePack() instead gives the message a buffer of the size class of
+/// the body (at most 25% larger), taken from the pool when possible. The
+/// message can then be packed or received into without reallocation, as
+/// long as the size stays within the class.
+///
+/// The pool keeps a reference to each message holding one of its buffers.
+/// Trim() takes the buffers back from the messages nobody else references
+/// anymore, and frees idle buffers beyond MaximumIdleBytes.
+///
+/// Buffers adopted by images (see PackBuffer) come back to the pool when
+/// the images release them. They are allocated with the pixels of IMAGE
+/// messages 16 byte aligned, so that images of any scalar type adopt them.
+///
+/// Packs smaller than MinimumPooledSize are left to igtl. Thread safe.
+///
+class OPENIGTLINKIO_LOGIC_EXPORT BufferPool : public vtkObject
+{
+public:
+  static BufferPool *New();
+  vtkTypeMacro(BufferPool, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Allocate the pack of the message for bodySize bytes, or for
+  /// GetBodySizeToRead() if negative, as igtl::MessageBase::AllocatePack()
+  /// does. The header bytes already in the pack are kept.
+  void AllocatePack(igtl::MessageBase* message, int bodySize=-1);
+
+  /// Reclaim the buffers of unused messages. Called regularly from the
+  /// main thread, e.g. by Connector::PeriodicProcess().
+  void Trim();
+
+  /// Size class of a pack: rounded up to a quarter of its power of two.
+  static size_t GetSizeClass(size_t size);
+
+  vtkSetMacro(MinimumPooledSize, int);
+  vtkGetMacro(MinimumPooledSize, int);
+  /// Idle bytes kept for reuse, the rest is freed by Trim().
+  vtkSetMacro(MaximumIdleBytes, vtkTypeInt64);
+  vtkGetMacro(MaximumIdleBytes, vtkTypeInt64);
+  /// Ask the system to back buffers of 2 MB and more with huge pages
+  /// (Linux transparent huge pages). Applies to new buffers.
+  vtkSetMacro(UseHugePages, bool);
+  vtkGetMacro(UseHugePages, bool);
+  vtkBooleanMacro(UseHugePages, bool);
+
+  /// Statistics
+  /// Hits reuse a buffer, either the one of the message or an idle one.
+  vtkTypeInt64 GetNumberOfHits();
+  vtkTypeInt64 GetNumberOfMisses();
+  /// Bytes of all the buffers allocated by the pool, in use or idle.
+  vtkTypeInt64 GetResidentBytes();
+  vtkTypeInt64 GetIdleBytes();
+  void ResetStatistics();
+
+protected:
+  BufferPool();
+  virtual ~BufferPool();
+
+private:
+  BufferPool(const BufferPool&); // Not implemented
+  void operator=(const BufferPool&); // Not implemented
+
+  struct Lease
+  {
+    igtl::MessageBase::Pointer Message; // keeps the message alive
+    unsigned char* Buffer;
+    size_t Capacity;
+  };
+
+  // PackBuffer owner callbacks
+  static bool DetachPack(void* pool, igtl::MessageBase* message, size_t* capacity);
+  static void ReleasePack(void* pool, unsigned char* pack, size_t capacity);
+
+  unsigned char* NewBuffer(size_t capacity);
+  void FreeBuffer(unsigned char* buffer, size_t capacity);
+
+  vtkMutexLockPointer Mutex;
+  std::map<igtl::MessageBase*, Lease> Leases;
+  std::map<size_t, std::vector<unsigned char*> > IdleBuffers; // by capacity
+
+  int MinimumPooledSize;
+  vtkTypeInt64 MaximumIdleBytes;
+  bool UseHugePages;
+
+  vtkTypeInt64 NumberOfHits;
+  vtkTypeInt64 NumberOfMisses;
+  vtkTypeInt64 ResidentBytes;
+  vtkTypeInt64 IdleBytes;
+};
+
+} // namespace igtlio
+
+#endif // IGTLIOBUFFERPOOL_H
@@ -12,10 +12,12 @@
 
 #include <vtkObjectFactory.h>
 #include <vtkMutexLock.h>
+#include <vtkTimerLog.h>
 #include <vtksys/SystemTools.hxx>
 
 // OpenIGTLink includes
 #include <igtlMessageBase.h>
+#include <igtlOSUtil.h>
 
 // STD includes
 #include <string>
@@ -23,54 +25,152 @@
 namespace igtlio
 {
 
+namespace
+{
+// Set in CircularBuffer::Latest while the slot has not been pulled.
+const int FreshFlag = 0x10000;
+}
+
 //---------------------------------------------------------------------------
 vtkStandardNewMacro(CircularBuffer);
 
 //---------------------------------------------------------------------------
 CircularBuffer::CircularBuffer()
 {
-  this->Mutex = vtkMutexLock::New();
-  this->Mutex->Lock();
-  // Allocate Circular buffer for the new device
+  this->PushMutex = vtkMutexLock::New();
+  this->Ready = 0;
+  this->MaximumPushWait = 1.0;
+  this->DeliveryPolicy = DELIVER_LATEST;
+  this->Depth = 1;
+  this->AllocateSlots(IGTLCB_CIRC_BUFFER_SIZE);
+  this->InPush = 0;
   this->InUse = -1;
-  this->Last  = -1;
-  for (int i = 0; i < IGTLCB_CIRC_BUFFER_SIZE; i ++)
+  this->Latest = 1;
+  this->PullSlot = 2;
+  this->ScratchSlot = -1;
+}
+
+
+//---------------------------------------------------------------------------
+CircularBuffer::~CircularBuffer()
+{
+  this->PushMutex->Delete();
+}
+
+
+//---------------------------------------------------------------------------
+void CircularBuffer::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->vtkObject::PrintSelf(os, indent);
+  os << indent << "DeliveryPolicy: " << this->DeliveryPolicy << "\n";
+  os << indent << "Depth: " << this->Depth << "\n";
+  os << indent << "MaximumPushWait: " << this->MaximumPushWait << "\n";
+  os << indent << "NumberOfPendingMessages: " << this->GetNumberOfPendingMessages() << "\n";
+  os << indent << "NumberOfPushedMessages: " << this->GetNumberOfPushedMessages() << "\n";
+  os << indent << "NumberOfOverwrittenMessages: " << this->GetNumberOfOverwrittenMessages() << "\n";
+  os << indent << "NumberOfDroppedMessages: " << this->GetNumberOfDroppedMessages() << "\n";
+  os << indent << "NumberOfBlockedPushes: " << this->GetNumberOfBlockedPushes() << "\n";
+}
+
+
+//---------------------------------------------------------------------------
+void CircularBuffer::AllocateSlots(int count)
+{
+  this->Messages.clear();
+  for (int i = 0; i < count; i ++)
     {
-    this->DeviceType[i] = "";
-    this->Size[i]       = 0;
-    this->Data[i]       = NULL;
-    this->Messages[i] = igtl::MessageBase::New();
-    this->Messages[i]->InitPack();
+    igtl::MessageBase::Pointer message = igtl::MessageBase::New();
+    message->InitPack();
+    this->Messages.push_back(message);
     }
-
-  this->UpdateFlag = 0;
-  this->Mutex->Unlock();
 }
 
 
 //---------------------------------------------------------------------------
-CircularBuffer::~CircularBuffer()
+void CircularBuffer::SetDeliveryPolicy(int policy, int depth)
 {
-  this->Mutex->Lock();
+  if (this->NumberOfPushedMessages + this->NumberOfDroppedMessages > 0)
+    {
+    vtkErrorMacro("The delivery policy must be set before receiving messages.");
+    return;
+    }
+
+  if (policy == DELIVER_LATEST || depth < 1)
+    {
+    depth = 1;
+    }
+  this->DeliveryPolicy = policy;
+  this->Depth = depth;
   this->InUse = -1;
-  this->Last  = -1;
-  this->Mutex->Unlock();
 
-  for (int i = 0; i < IGTLCB_CIRC_BUFFER_SIZE; i ++)
+  if (policy == DELIVER_LATEST)
+    {
+    this->AllocateSlots(IGTLCB_CIRC_BUFFER_SIZE);
+    this->InPush = 0;
+    this->Latest = 1;
+    this->PullSlot = 2;
+    this->ScratchSlot = -1;
+    this->PublishedSlots.Reserve(0);
+    this->FreeSlots.Reserve(0);
+    }
+  else
     {
-    if (this->Data[i] != NULL)
+    // Room for the queued messages, plus the ones being pushed and pulled.
+    // Older messages are dropped when pulling in DELIVER_DROP_OLDEST,
+    // so let twice the depth accumulate before the receiving thread drops
+    // the oldest itself.
+    int queued = (policy == DELIVER_DROP_OLDEST) ? 2*depth : depth;
+    int slots = queued + 2;
+    this->AllocateSlots(slots + 1);
+    this->ScratchSlot = slots;
+    this->InPush = -1;
+    this->PublishedSlots.Reserve(slots);
+    this->FreeSlots.Reserve(slots);
+    for (int i = 0; i < slots; i ++)
       {
-      delete this->Data[i];
+      this->FreeSlots.Push(i);
       }
     }
-  this->Mutex->Delete();
+  this->Modified();
 }
 
 
 //---------------------------------------------------------------------------
-void CircularBuffer::PrintSelf(ostream& os, vtkIndent indent)
+int CircularBuffer::GetNumberOfPendingMessages()
 {
-  this->vtkObject::PrintSelf(os, indent);
+  if (this->DeliveryPolicy == DELIVER_LATEST)
+    {
+    return (this->Latest & FreshFlag) ? 1 : 0;
+    }
+  return static_cast<int>(this->PublishedSlots.GetSize());
+}
+
+
+//---------------------------------------------------------------------------
+unsigned long CircularBuffer::GetNumberOfPushedMessages()
+{
+  return static_cast<unsigned long>(this->NumberOfPushedMessages);
+}
+
+
+//---------------------------------------------------------------------------
+unsigned long CircularBuffer::GetNumberOfOverwrittenMessages()
+{
+  return static_cast<unsigned long>(this->NumberOfOverwrittenMessages);
+}
+
+
+//---------------------------------------------------------------------------
+unsigned long CircularBuffer::GetNumberOfDroppedMessages()
+{
+  return static_cast<unsigned long>(this->NumberOfDroppedMessages);
+}
+
+
+//---------------------------------------------------------------------------
+unsigned long CircularBuffer::GetNumberOfBlockedPushes()
+{
+  return static_cast<unsigned long>(this->NumberOfBlockedPushes);
 }
 
 
@@ -85,32 +185,111 @@ void CircularBuffer::PrintSelf(ostream& os, vtkIndent indent)
 //---------------------------------------------------------------------------
 
 //---------------------------------------------------------------------------
-int CircularBuffer::StartPush()
+int CircularBuffer::StartPush(bool wait)
 {
-  this->Mutex->Lock();
-  this->InPush = (this->Last + 1) % IGTLCB_CIRC_BUFFER_SIZE;
-  if (this->InPush == this->InUse)
+  if (this->DeliveryPolicy == DELIVER_LATEST)
     {
-    this->InPush = (this->Last + 1) % IGTLCB_CIRC_BUFFER_SIZE;
+    return this->InPush;
     }
-  this->Mutex->Unlock();
 
+  // A push that was not ended, e.g. on a receive error, is reused.
+  if (this->InPush >= 0 && this->InPush != this->ScratchSlot)
+    {
+    return this->InPush;
+    }
+
+  if (wait && this->IsFull())
+    {
+    // Slow the receiving thread down to the pace of the main thread,
+    // which in turn makes TCP flow control slow the sender down.
+    ++this->NumberOfBlockedPushes;
+    double start = vtkTimerLog::GetUniversalTime();
+    while (this->IsFull()
+           && vtkTimerLog::GetUniversalTime() - start < this->MaximumPushWait)
+      {
+      igtl::Sleep(1);
+      }
+    }
+
+  if (!this->IsFull() && this->FreeSlots.Pop(this->InPush))
+    {
+    return this->InPush;
+    }
+  if (this->DeliveryPolicy == DELIVER_DROP_OLDEST && this->PublishedSlots.Pop(this->InPush))
+    {
+    // The main thread is behind: receive into the oldest message instead.
+    ++this->NumberOfDroppedMessages;
+    return this->InPush;
+    }
+  this->InPush = this->ScratchSlot;
   return this->InPush;
 }
 
+//---------------------------------------------------------------------------
+bool CircularBuffer::IsFull()
+{
+  return this->DeliveryPolicy == DELIVER_FIFO
+    && static_cast<int>(this->PublishedSlots.GetSize()) >= this->Depth;
+}
+
 //---------------------------------------------------------------------------
 igtl::MessageBase::Pointer CircularBuffer::GetPushBuffer()
 {
   return this->Messages[this->InPush];
 }
 
+//---------------------------------------------------------------------------
+void CircularBuffer::SetPushBuffer(igtl::MessageBase::Pointer buffer)
+{
+  this->Messages[this->InPush] = buffer;
+}
+
 //---------------------------------------------------------------------------
 void CircularBuffer::EndPush()
 {
-  this->Mutex->Lock();
-  this->Last = this->InPush;
-  this->UpdateFlag = 1;
-  this->Mutex->Unlock();
+  if (this->DeliveryPolicy == DELIVER_LATEST)
+    {
+    // Publish the slot, and take back the previous one if it was not pulled,
+    // or the one released by the main thread.
+    int previous = AtomicExchange(&this->Latest, this->InPush | FreshFlag);
+    if (previous & FreshFlag)
+      {
+      ++this->NumberOfOverwrittenMessages;
+      }
+    this->InPush = previous & ~FreshFlag;
+    ++this->NumberOfPushedMessages;
+    return;
+    }
+
+  if (this->InPush < 0)
+    {
+    return;
+    }
+  if (this->InPush == this->ScratchSlot)
+    {
+    ++this->NumberOfDroppedMessages;
+    }
+  else
+    {
+    // Never full: it can hold all the slots.
+    this->PublishedSlots.Push(this->InPush);
+    ++this->NumberOfPushedMessages;
+    }
+  this->InPush = -1;
+}
+
+
+//---------------------------------------------------------------------------
+igtl::MessageBase::Pointer CircularBuffer::Push(igtl::MessageBase::Pointer message)
+{
+  this->PushMutex->Lock();
+  int slot = this->StartPush();
+  igtl::MessageBase::Pointer previous = this->Messages[slot];
+  this->Messages[slot] = message;
+  this->EndPush();
+  this->PushMutex->Unlock();
+
+  return previous;
 }
 
 
@@ -126,11 +305,36 @@ void CircularBuffer::EndPush()
 //---------------------------------------------------------------------------
 int CircularBuffer::StartPull()
 {
-  this->Mutex->Lock();
-  this->InUse = this->Last;
-  this->UpdateFlag = 0;
-  this->Mutex->Unlock();
-  return this->Last;   // return -1 if it is not available
+  if (this->DeliveryPolicy == DELIVER_LATEST)
+    {
+    if (!(this->Latest & FreshFlag))
+      {
+      this->InUse = -1;
+      return -1;
+      }
+    // Hand the previously pulled slot over to the receiving thread.
+    int latest = AtomicExchange(&this->Latest, this->PullSlot);
+    this->PullSlot = latest & ~FreshFlag;
+    this->InUse = this->PullSlot;
+    return this->InUse;
+    }
+
+  this->EndPull();
+  if (this->DeliveryPolicy == DELIVER_DROP_OLDEST)
+    {
+    int slot;
+    while (static_cast<int>(this->PublishedSlots.GetSize()) > this->Depth
+           && this->PublishedSlots.Pop(slot))
+      {
+      this->FreeSlots.Push(slot);
+      ++this->NumberOfDroppedMessages;
+      }
+    }
+  if (!this->PublishedSlots.Pop(this->InUse))
+    {
+    this->InUse = -1;
+    }
+  return this->InUse;   // return -1 if it is not available
 }
 
 
@@ -144,9 +348,16 @@ igtl::MessageBase::Pointer CircularBuffer::GetPullBuffer()
 //---------------------------------------------------------------------------
 void CircularBuffer::EndPull()
 {
-  this->Mutex->Lock();
-  this->InUse = -1;
-  this->Mutex->Unlock();
+  if (this->DeliveryPolicy == DELIVER_LATEST)
+    {
+    this->InUse = -1; // the slot is handed over by the next pull
+    return;
+    }
+  if (this->InUse >= 0)
+    {
+    this->FreeSlots.Push(this->InUse);
+    this->InUse = -1;
+    }
 }
 
 } // namespace igtlio
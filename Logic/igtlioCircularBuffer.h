@@ -17,10 +17,12 @@
 #include <igtlMessageBase.h>
 
 // IGTLIO includes
+#include "igtlioLockFree.h"
 #include "igtlioLogicExport.h"
 
 // STD includes
 #include <string>
+#include <vector>
 
 #define IGTLCB_CIRC_BUFFER_SIZE    3
 
@@ -29,6 +31,24 @@ class vtkMutexLock;
 namespace igtlio
 {
 
+/// Hands the received messages of one device over to the main thread.
+///
+/// The handoff is wait-free for one receiving thread and the main thread:
+/// messages are received into preallocated slots, which are passed back
+/// and forth without locking.
+///
+/// The delivery policy decides what happens to messages received faster
+/// than they are pulled:
+///  - DELIVER_LATEST: only the most recent message is kept (default).
+///    Replaced messages are counted as overwritten.
+///  - DELIVER_FIFO: up to Depth messages are queued and all delivered in
+///    order. When the queue is full, the receiving thread waits for the
+///    main thread to pull, at most MaximumPushWait seconds, before
+///    dropping the new message. A receiving thread shared by several
+///    connections must not wait: it checks IsFull() before pushing.
+///  - DELIVER_DROP_OLDEST: the most recent Depth messages are delivered,
+///    older ones are dropped without waiting, even when the main thread
+///    stops pulling.
 class OPENIGTLINKIO_LOGIC_EXPORT CircularBuffer : public vtkObject
 {
  public:
@@ -38,36 +58,103 @@ class OPENIGTLINKIO_LOGIC_EXPORT CircularBuffer : public vtkObject
 
   void PrintSelf(ostream& os, vtkIndent indent);
 
-  int GetNumberOfBuffer() { return IGTLCB_CIRC_BUFFER_SIZE; }
+  enum {
+    DELIVER_LATEST,
+    DELIVER_FIFO,
+    DELIVER_DROP_OLDEST
+  };
 
-  int            StartPush();
+  /// Set the policy, and the maximum number of messages waiting to be
+  /// pulled (always 1 with DELIVER_LATEST).
+  /// Must be set before the first message is pushed.
+  void SetDeliveryPolicy(int policy, int depth=1);
+  vtkGetMacro(DeliveryPolicy, int);
+  vtkGetMacro(Depth, int);
+
+  vtkSetMacro(MaximumPushWait, double);
+  vtkGetMacro(MaximumPushWait, double);
+
+  int GetNumberOfBuffer() { return static_cast<int>(this->Messages.size()); }
+
+  // Push from one receiving thread. With wait false, a full DELIVER_FIFO
+  // queue drops the message at once instead of waiting for a pull.
+  int            StartPush(bool wait=true);
   void           EndPush();
   igtl::MessageBase::Pointer GetPushBuffer();
-
+  // Replace the message in the slot currently being pushed, e.g. with a
+  // typed message the body can be unpacked into without copying.
+  void           SetPushBuffer(igtl::MessageBase::Pointer buffer);
+
+  // Publish a completely received message in one step, without
+  // StartPush()/EndPush(). Safe to call from several receiving threads,
+  // which are serialized by a lock.
+  // Returns the message previously held by the reused slot, so that
+  // the caller can receive the next message into it.
+  igtl::MessageBase::Pointer Push(igtl::MessageBase::Pointer message);
+
+  // Pull the next message from the main thread.
+  // Returns -1 if there is none.
   int            StartPull();
   void           EndPull();
   igtl::MessageBase::Pointer GetPullBuffer();
 
-  int            IsUpdated() { return this->UpdateFlag; };
+  // True if a DELIVER_FIFO queue has Depth messages waiting to be pulled,
+  // so that the next push would wait. From any thread.
+  bool           IsFull();
+
+  // Non-zero if messages are waiting to be pulled.
+  int            IsUpdated() { return this->GetNumberOfPendingMessages() > 0; };
+
+  // Flag for the owner to list buffers with new messages only once.
+  // MarkReady() is called after pushing and returns 1 if the flag was
+  // clear, ClearReady() is called before pulling.
+  int            MarkReady() { return AtomicExchange(&this->Ready, 1) == 0; };
+  void           ClearReady() { AtomicExchange(&this->Ready, 0); };
+
+  /// Number of messages waiting to be pulled.
+  int GetNumberOfPendingMessages();
+
+  /// Statistics
+  unsigned long GetNumberOfPushedMessages();
+  unsigned long GetNumberOfOverwrittenMessages(); // replaced in DELIVER_LATEST
+  unsigned long GetNumberOfDroppedMessages();     // queue overflow
+  unsigned long GetNumberOfBlockedPushes();       // waits for room in DELIVER_FIFO
 
  protected:
   CircularBuffer();
   virtual ~CircularBuffer();
 
+  void AllocateSlots(int count);
+
  protected:
 
-  vtkMutexLock*      Mutex;
-  int                Last;        // updated by connector thread
-  int                InPush;      // updated by connector thread
-  int                InUse;       // updated by main thread
+  int                DeliveryPolicy;
+  int                Depth;
+  double             MaximumPushWait;
+
+  std::vector<igtl::MessageBase::Pointer> Messages; // slots
+
+  int                InPush;      // updated by connector thread, -1 if none
+  int                InUse;       // updated by main thread, -1 if none
+
+  // DELIVER_LATEST: triple buffering. The receiving thread owns the slot
+  // InPush, the main thread owns PullSlot, and they exchange the third one.
+  volatile int       Latest;      // last published slot, with FreshFlag until pulled
+  int                PullSlot;
 
-  int                UpdateFlag;  // non-zero if updated since StartPull() has called
+  // Other policies: slots are passed through two rings.
+  SPSCRing<int>      PublishedSlots; // to the main thread, oldest first,
+                                     // also popped on push in DELIVER_DROP_OLDEST
+  SPSCRing<int>      FreeSlots;      // back to the receiving thread
+  int                ScratchSlot;    // receives the messages dropped on push
 
-  std::string        DeviceType[IGTLCB_CIRC_BUFFER_SIZE];
-  long long          Size[IGTLCB_CIRC_BUFFER_SIZE];
-  unsigned char*     Data[IGTLCB_CIRC_BUFFER_SIZE];
+  vtkMutexLock*      PushMutex;   // serializes Push()
+  volatile int       Ready;
 
-  igtl::MessageBase::Pointer Messages[IGTLCB_CIRC_BUFFER_SIZE];
+  vtkAtomic<vtkTypeInt64> NumberOfPushedMessages;
+  vtkAtomic<vtkTypeInt64> NumberOfOverwrittenMessages;
+  vtkAtomic<vtkTypeInt64> NumberOfDroppedMessages;
+  vtkAtomic<vtkTypeInt64> NumberOfBlockedPushes;
 
 };
 
@@ -16,6 +16,8 @@ Version:   $Revision: 1.2 $
 #include "igtlioConnector.h"
 
 #include <igtl_header.h>
+#include <igtl_util.h>
+#include <igtlCapabilityMessage.h>
 #include <igtlServerSocket.h>
 #include <igtlClientSocket.h>
 #include <igtlOSUtil.h>
@@ -41,51 +43,30 @@ Version:   $Revision: 1.2 $
 #include <iostream>
 #include <sstream>
 #include <map>
+#include <algorithm>
+#include "igtlioBufferPool.h"
 #include "igtlioCircularBuffer.h"
+#include "igtlioImageDelta.h"
+#include "igtlioImageDevice.h"
+#include "igtlioSocketUtilities.h"
+#include "igtlioStreamReader.h"
 
 namespace igtlio
 {
 
-std::string DeviceKeyType::GetBaseTypeName() const
-{
-  int pos = type.find("_");
-  if (pos>=0)
-    return type.substr(pos+1);
-  return type;
-}
-
-DeviceKeyType CreateDeviceKey(igtl::MessageBase::Pointer message)
-{
-  if (!message)
-    return DeviceKeyType();
-  return DeviceKeyType(message->GetDeviceType(), message->GetDeviceName());
-}
-
-DeviceKeyType CreateDeviceKey(DevicePointer device)
-{
-  if (!device)
-    return DeviceKeyType();
-  return DeviceKeyType(device->GetDeviceType(), device->GetDeviceName());
-}
-
-
-bool operator<(const DeviceKeyType &lhs, const DeviceKeyType &rhs)
-{
-  if (lhs.GetBaseTypeName() > rhs.GetBaseTypeName())
-      return false;
-  if (lhs.GetBaseTypeName() < rhs.GetBaseTypeName())
-      return true;
-  return (lhs.name < rhs.name);
-}
-
-bool operator==(const DeviceKeyType &lhs, const DeviceKeyType &rhs)
+//------------------------------------------------------------------------------
+// A client of a server serving several clients.
+struct Connector::ClientConnection
 {
-  return (lhs.GetBaseTypeName()==rhs.GetBaseTypeName()) &&
-      (lhs.name==rhs.name);
-}
-
-
-
+  Connector* Self;
+  igtl::ClientSocket::Pointer Socket;
+  SendQueuePointer Queue;
+  int ThreadID;
+  bool Finished; // set when the receive thread ends, protected by ClientsMutex
+  // Messages to receive into, for each device type. They are swapped with
+  // the circular buffers, as several clients may push to the same buffer.
+  std::map<DeviceKeyType, igtl::MessageBase::Pointer> ReceiveMessages;
+};
 
 //------------------------------------------------------------------------------
 vtkStandardNewMacro(Connector);
@@ -120,15 +101,43 @@ Connector::Connector()
   this->ServerPort = 18944;
   this->Mutex = vtkMutexLockPointer::New();
   this->CircularBufferMutex = vtkMutexLockPointer::New();
+  BufferTable* table = new BufferTable;
+  table->Size = 0;
+  table->Buffers = NULL;
+  this->BufferTables.push_back(table);
+  this->Buffers = table;
+  this->ConnectorWaitHandle = WaitHandlePointer::New();
+  this->Pool = BufferPoolPointer::New();
+  this->ReadyKeysMutex = vtkMutexLockPointer::New();
   this->RestrictDeviceName = 0;
 
   this->EventQueueMutex = vtkMutexLockPointer::New();
+  this->EventQueue.Reserve(256);
 
   this->PushOutgoingMessageFlag = 0;
   this->PushOutgoingMessageMutex = vtkMutexLockPointer::New();
 
   this->CheckCRC = 1;
 
+  this->DefaultDeliveryPolicy.Policy = CircularBuffer::DELIVER_LATEST;
+  this->DefaultDeliveryPolicy.Depth = 1;
+
+  this->OutgoingQueue = SendQueuePointer::New();
+  this->AsynchronousSend = false;
+  this->SendPolicy = SEND_ALL;
+  this->ImageCompression = ImageCompressor::CODEC_NONE;
+
+  this->MaximumNumberOfClients = 1;
+  this->ClientsMutex = vtkMutexLockPointer::New();
+  this->ClientThreads = vtkMultiThreaderPointer::New();
+
+  this->ReactorActive = false;
+  this->ReactorConnectDescriptor = -1;
+  this->ReactorRetryTime = 0;
+  this->ReactorOffset = 0;
+  this->ReactorSkip = 0;
+  this->ReactorPaused = 0;
+
   DeviceFactory = DeviceFactoryPointer::New();
 }
 
@@ -136,6 +145,11 @@ Connector::Connector()
 Connector::~Connector()
 {
   this->Stop();
+  for (size_t i=0; i<this->BufferTables.size(); ++i)
+    {
+    delete [] this->BufferTables[i]->Buffers;
+    delete this->BufferTables[i];
+    }
 }
 
 void Connector::PrintSelf(ostream& os, vtkIndent indent)
@@ -170,6 +184,9 @@ void Connector::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "Restrict Device Name: " << this->RestrictDeviceName << "\n";
   os << indent << "Push Outgoing Message Flag: " << this->PushOutgoingMessageFlag << "\n";
   os << indent << "Check CRC: " << this->CheckCRC << "\n";
+  os << indent << "Maximum Number of Clients: " << this->MaximumNumberOfClients << "\n";
+  os << indent << "Reactor: " << (this->ReactorActive ? "ON" : "OFF") << "\n";
+  os << indent << "Image Compression: " << ImageCompressor::GetCodecName(this->ImageCompression) << "\n";
   os << indent << "Number of devices: " << this->GetNumberOfDevices() << "\n";
 }
 
@@ -237,12 +254,18 @@ int Connector::Start()
     }
 
   // Check if thread is detached
-  if (this->ThreadID >= 0)
+  if (this->ThreadID >= 0 || this->ReactorActive)
     {
       //vtkErrorMacro("Thread exists.");
     return 0;
     }
 
+  bool multipleClients = (this->Type == TYPE_SERVER && this->MaximumNumberOfClients > 1);
+  if (this->IOReactor && this->IOReactor->IsRunning() && !multipleClients)
+    {
+    return this->StartReactor();
+    }
+
   this->ServerStopFlag = false;
   this->ThreadID = this->Thread->SpawnThread((vtkThreadFunctionType) &Connector::ThreadFunction, this);
 
@@ -260,6 +283,11 @@ int Connector::Start()
 //---------------------------------------------------------------------------
 int Connector::Stop()
 {
+  if (this->ReactorActive)
+    {
+    return this->StopReactor();
+    }
+
   // Check if thread exists
   if (this->ThreadID >= 0)
     {
@@ -301,6 +329,11 @@ void* Connector::ThreadFunction(void* ptr)
       }
     }
 
+  if (igtlcon->Type == TYPE_SERVER && igtlcon->MaximumNumberOfClients > 1)
+    {
+    igtlcon->ServeClients();
+    }
+
   // Communication -- common to both Server and Client
   while (!igtlcon->ServerStopFlag)
     {
@@ -311,12 +344,17 @@ void* Connector::ThreadFunction(void* ptr)
     igtlcon->Mutex->Unlock();
     if (igtlcon->Socket.IsNotNull() && igtlcon->Socket->GetConnected())
       {
+      igtlcon->OutgoingQueue->Start(igtlcon->Socket.GetPointer());
+      if (igtlcon->ImageCompression != ImageCompressor::CODEC_NONE)
+        {
+        igtlcon->RequestPeerCapabilities(igtlcon->OutgoingQueue);
+        }
       igtlcon->State = STATE_CONNECTED;
       // need to Request the InvokeEvent, because we are not on the main thread now
       igtlcon->RequestInvokeEvent(Connector::ConnectedEvent);
       //vtkErrorMacro("vtkOpenIGTLinkIFLogic::ThreadFunction(): Client Connected.");
       igtlcon->RequestPushOutgoingMessages();
-      igtlcon->ReceiveController();
+      igtlcon->ReceiveController(igtlcon->Socket);
       igtlcon->State = STATE_WAIT_CONNECTION;
       igtlcon->RequestInvokeEvent(Connector::DisconnectedEvent); // need to Request the InvokeEvent, because we are not on the main thread now
       }
@@ -343,9 +381,16 @@ void* Connector::ThreadFunction(void* ptr)
 //----------------------------------------------------------------------------
 void Connector::RequestInvokeEvent(unsigned long eventId)
 {
-  this->EventQueueMutex->Lock();
-  this->EventQueue.push_back(eventId);
-  this->EventQueueMutex->Unlock();
+  // Wait-free unless the main thread lags far behind.
+  if (this->EventOverflowSize != 0 || !this->EventQueue.Push(eventId))
+    {
+    // The ring is full: queue this and the next events aside, in order.
+    this->EventQueueMutex->Lock();
+    this->EventOverflow.push_back(eventId);
+    this->EventOverflowSize = static_cast<int>(this->EventOverflow.size());
+    this->EventQueueMutex->Unlock();
+    }
+  this->ConnectorWaitHandle->Signal();
 }
 
 
@@ -355,6 +400,7 @@ void Connector::RequestPushOutgoingMessages()
   this->PushOutgoingMessageMutex->Lock();
   this->PushOutgoingMessageFlag = 1;
   this->PushOutgoingMessageMutex->Unlock();
+  this->ConnectorWaitHandle->Signal();
 }
 
 
@@ -413,21 +459,27 @@ int Connector::WaitForConnection()
 
 
 //----------------------------------------------------------------------------
-int Connector::ReceiveController()
+int Connector::ReceiveController(igtl::ClientSocket::Pointer socket, ClientConnection* client)
 {
   //igtl_header header;
   igtl::MessageHeader::Pointer headerMsg;
   headerMsg = igtl::MessageHeader::New();
 
-  if (this->Socket.IsNull())
+  if (socket.IsNull())
     {
     return 0;
     }
 
+  // Small messages are framed out of large reads, bodies of large
+  // messages are received directly into the message.
+  StreamReader reader;
+  reader.SetSocket(socket);
+  igtl::MessageBase::Pointer staging; // receives ZIMAGE messages
+
   while (!this->ServerStopFlag)
     {
     // check if connection is alive
-    if (!this->Socket->GetConnected())
+    if (!socket->GetConnected())
       {
       break;
       }
@@ -436,105 +488,88 @@ int Connector::ReceiveController()
     // Receive Header
     headerMsg->InitPack();
 
-
     vtkDebugMacro("Waiting for header of size: " << headerMsg->GetPackSize());
 
-    int r = this->Socket->Receive(headerMsg->GetPackPointer(), headerMsg->GetPackSize());
+    int r = reader.Read(headerMsg->GetPackPointer(), headerMsg->GetPackSize());
 
     vtkDebugMacro("Received header of size: " << headerMsg->GetPackSize());
 
-
     if (r != headerMsg->GetPackSize())
       {
-      //vtkErrorMacro("Irregluar size.");
-      //vtkErrorMacro("Irregluar size " << r << " expecting " << headerMsg->GetPackSize() );
       vtkDebugMacro("ignoring header, breaking. received=" << r);
       break;
       }
 
-    // Deserialize the header
-    headerMsg->Unpack();
+    // Deserialize the header. An invalid header means the stream lost
+    // its framing: drop the connection rather than parse garbage.
+    if (!(headerMsg->Unpack() & igtl::MessageHeader::UNPACK_HEADER))
+      {
+      vtkErrorMacro("Invalid message header, closing the connection.");
+      break;
+      }
 
-    //----------------------------------------------------------------
-    // Check Device Name
-    // Nov 16, 2010: Currently the following code only checks
-    // if the device name is defined in the message.
-    const char* devName = headerMsg->GetDeviceName();
-    if (devName[0] == '\0')
-      {
-      /// Dec 7, 2010: Removing the following code, since message without
-      /// device name should be handled in the MRML scene as well.
-      //// If no device name is defined, skip processing the message.
-      //this->Skip(headerMsg->GetBodySizeToRead());
-      //continue; //  while (!this->ServerStopFlag)
+    // Capabilities and compressed images are handled here, not by devices.
+    if (IsConnectionMessage(headerMsg->GetDeviceType()))
+      {
+      igtl::MessageBase::Pointer message = this->StartReceiveConnectionMessage(headerMsg, &staging);
+      int size = message->GetPackBodySize();
+      if ((size > 0 && reader.Read(message->GetPackBodyPointer(), size) != size)
+          || !this->ReceiveConnectionMessage(message, client))
+        {
+        break;
+        }
+      continue; //  while (!this->ServerStopFlag)
       }
-    //----------------------------------------------------------------
-    // If device name is restricted
-    else if (this->RestrictDeviceName)
-      {
-      // Check if the node has already been registered.
-        //TODO: Cannot call GetDevice in Thread!!!!
-        DeviceKeyType key = CreateDeviceKey(headerMsg);
-      int registered = this->GetDevice(key).GetPointer() != NULL;
-      if (registered == 0)
+
+    if (!this->AcceptHeader(headerMsg))
+      {
+      igtlUint64 skip = headerMsg->GetBodySizeToRead();
+      if (reader.Skip(skip) != skip)
         {
-        this->Skip(headerMsg->GetBodySizeToRead());
-        continue; //  while (!this->ServerStopFlag)
+        break;
         }
+      continue; //  while (!this->ServerStopFlag)
       }
 
     vtkDebugMacro("completed read header : " << headerMsg->GetDeviceName() << " body size to read: " << headerMsg->GetBodySizeToRead());
 
-
     //----------------------------------------------------------------
-    // Search Circular Buffer
+    // Load to the circular buffer
     DeviceKeyType key = CreateDeviceKey(headerMsg);
+    CircularBufferPointer circBuffer;
+    igtl::MessageBase::Pointer buffer = this->StartReceiveBody(key, headerMsg, &circBuffer, client);
 
-    CircularBufferMap::iterator iter = this->Buffer.find(key);
-    if (iter == this->Buffer.end()) // First time to refer the device name
+    if (buffer.IsNull())
       {
-      this->CircularBufferMutex->Lock();
-      this->Buffer[key] = CircularBufferPointer::New();
-      this->CircularBufferMutex->Unlock();
+      break;
       }
 
-    //----------------------------------------------------------------
-    // Load to the circular buffer
-
-    CircularBufferPointer circBuffer = this->Buffer[key];
-
-    if (circBuffer && circBuffer->StartPush() != -1)
-      {
-      //std::cerr << "Pushing into the circular buffer." << std::endl;
-      circBuffer->StartPush();
-
-      igtl::MessageBase::Pointer buffer = circBuffer->GetPushBuffer();
-      buffer->SetMessageHeader(headerMsg);
-      buffer->AllocatePack();
-
-      vtkDebugMacro("Waiting to receive body:  size=" << buffer->GetPackBodySize()
-                    << ", GetBodySizeToRead=" << buffer->GetBodySizeToRead()
-                    << ", GetPackSize=" << buffer->GetPackSize());
-      int read = this->Socket->Receive(buffer->GetPackBodyPointer(), buffer->GetPackBodySize());
-      vtkDebugMacro("Received body: " << read);
-      if (read != buffer->GetPackBodySize())
-        {
-        vtkErrorMacro ("Only read " << read << " but expected to read "
-                       << buffer->GetPackBodySize() << "\n");
-        continue;
-        }
-
-      circBuffer->EndPush();
-
-      }
-    else
+    vtkDebugMacro("Waiting to receive body:  size=" << buffer->GetPackBodySize()
+                  << ", GetBodySizeToRead=" << buffer->GetBodySizeToRead()
+                  << ", GetPackSize=" << buffer->GetPackSize());
+    int read = reader.Read(buffer->GetPackBodyPointer(), buffer->GetPackBodySize());
+    vtkDebugMacro("Received body: " << read);
+    if (read != buffer->GetPackBodySize())
       {
+      // The rest of the body is lost, the next bytes cannot be framed.
+      // The partial message is not published.
+      vtkErrorMacro ("Only read " << read << " but expected to read "
+                     << buffer->GetPackBodySize() << ", closing the connection.\n");
       break;
       }
 
+    this->EndReceiveBody(key, circBuffer, buffer, client);
+
     } // while (!this->ServerStopFlag)
 
-  this->Socket->CloseSocket();
+  // Clients are closed by RemoveClients(), once their SendQueue is stopped.
+  if (!client)
+    {
+    // Unblock the writer thread before waiting for it.
+    ShutdownSocket(socket);
+    this->OutgoingQueue->Stop();
+    socket->CloseSocket();
+    }
 
   return 0;
 
@@ -542,259 +577,1287 @@ int Connector::ReceiveController()
 
 
 //----------------------------------------------------------------------------
-int Connector::SendData(int size, unsigned char* data)
+int Connector::AcceptHeader(igtl::MessageHeader::Pointer headerMsg)
 {
-
-  if (this->Socket.IsNull())
+  //----------------------------------------------------------------
+  // Check Device Name
+  // Nov 16, 2010: Currently the following code only checks
+  // if the device name is defined in the message.
+  const char* devName = headerMsg->GetDeviceName();
+  if (devName[0] == '\0')
     {
-    return 0;
+    /// Dec 7, 2010: Removing the following code, since message without
+    /// device name should be handled in the MRML scene as well.
+    //// If no device name is defined, skip processing the message.
+    //this->Skip(headerMsg->GetBodySizeToRead());
+    //continue; //  while (!this->ServerStopFlag)
     }
-
-  // check if connection is alive
-  if (!this->Socket->GetConnected())
+  //----------------------------------------------------------------
+  // If device name is restricted
+  else if (this->RestrictDeviceName)
     {
-    return 0;
+    // Check if the node has already been registered.
+    // Called from the receiving threads: lock-free lookup.
+    DeviceKeyType key = CreateReceiveKey(headerMsg);
+    if (!this->Devices.Contains(key))
+      {
+      return 0;
+      }
     }
+  return 1;
+}
 
-  return this->Socket->Send(data, size);  // return 1 on success, otherwise 0.
 
+//----------------------------------------------------------------------------
+DeviceKeyType Connector::CreateReceiveKey(igtl::MessageHeader::Pointer headerMsg)
+{
+  // A ZIMAGE message holds the IMAGE of the same device name.
+  if (strcmp(headerMsg->GetDeviceType(), ImageCompressor::GetIGTLTypeName()) == 0)
+    {
+    return DeviceKeyType("IMAGE", headerMsg->GetDeviceName());
+    }
+  return CreateDeviceKey(headerMsg);
 }
 
 
 //----------------------------------------------------------------------------
-int Connector::Skip(int length, int skipFully)
+igtl::MessageBase::Pointer Connector::StartReceiveBody(const DeviceKeyType& key, igtl::MessageHeader::Pointer headerMsg, CircularBufferPointer* circBuffer, ClientConnection* client)
 {
-  unsigned char dummy[256];
-  int block  = 256;
-  int n      = 0;
-  int remain = length;
+  //----------------------------------------------------------------
+  // Search Circular Buffer
+  *circBuffer = this->GetOrCreateCircularBuffer(key);
 
-  do
+  if (client)
     {
-    if (remain < block)
+    // Receive into a message owned by the client, published by EndReceiveBody()
+    igtl::MessageBase::Pointer buffer;
+    std::map<DeviceKeyType, igtl::MessageBase::Pointer>::iterator iter = client->ReceiveMessages.find(key);
+    if (iter != client->ReceiveMessages.end())
       {
-      block = remain;
+      buffer = iter->second;
+      client->ReceiveMessages.erase(iter);
       }
+    else
+      {
+      buffer = this->DeviceFactory->CreateReceiveMessage(headerMsg);
+      }
+    buffer->SetMessageHeader(headerMsg);
+    this->Pool->AllocatePack(buffer);
+    return buffer;
+    }
 
-    n = this->Socket->Receive(dummy, block, skipFully);
-    remain -= n;
+  // The reactor thread is shared with other connectors: it never waits
+  // for the main thread, see StartReactorBody().
+  if (!(*circBuffer) || (*circBuffer)->StartPush(!this->ReactorActive) == -1)
+    {
+    return NULL;
     }
-  while (remain > 0 || (skipFully && n < block));
 
-  return (length - remain);
+  //std::cerr << "Pushing into the circular buffer." << std::endl;
+  igtl::MessageBase::Pointer buffer = (*circBuffer)->GetPushBuffer();
+
+  // Receive directly into a message of the concrete type, so that the
+  // converters can unpack it in place instead of copying the body.
+  if (strcmp(buffer->GetDeviceType(), headerMsg->GetDeviceType()) != 0)
+    {
+    buffer = this->DeviceFactory->CreateReceiveMessage(headerMsg);
+    (*circBuffer)->SetPushBuffer(buffer);
+    }
+  buffer->SetMessageHeader(headerMsg);
+  this->Pool->AllocatePack(buffer);
+  return buffer;
 }
 
 
 //----------------------------------------------------------------------------
-unsigned int Connector::GetUpdatedBuffersList(NameListType& nameList)
+void Connector::EndReceiveBody(const DeviceKeyType& key, CircularBufferPointer circBuffer, igtl::MessageBase::Pointer buffer, ClientConnection* client)
 {
-  nameList.clear();
-
-  CircularBufferMap::iterator iter;
-  for (iter = this->Buffer.begin(); iter != this->Buffer.end(); iter ++)
+  if (!client)
+    {
+    circBuffer->EndPush();
+    }
+  else
     {
-    if (iter->second != NULL && iter->second->IsUpdated())
+    igtl::MessageBase::Pointer previous = circBuffer->Push(buffer);
+    if (previous.IsNotNull() && previous->GetDeviceType()[0] != '\0')
       {
-      nameList.push_back(iter->first);
+      client->ReceiveMessages[CreateDeviceKey(previous)] = previous;
       }
     }
-  return nameList.size();
+
+  // The message is published before the key is listed, so that the main
+  // thread finds it when it clears the flag.
+  if (circBuffer->MarkReady())
+    {
+    this->ReadyKeysMutex->Lock();
+    this->ReadyKeys.push_back(key);
+    this->ReadyKeysMutex->Unlock();
+    this->ConnectorWaitHandle->Signal();
+    }
 }
 
 
 //----------------------------------------------------------------------------
-CircularBufferPointer Connector::GetCircularBuffer(const DeviceKeyType &key)
+bool Connector::IsConnectionMessage(const char* deviceType)
+{
+  return strcmp(deviceType, "GET_CAPABIL") == 0
+    || strcmp(deviceType, "CAPABILITY") == 0
+    || strcmp(deviceType, ImageCompressor::GetIGTLTypeName()) == 0;
+}
+
+
+//----------------------------------------------------------------------------
+igtl::MessageBase::Pointer Connector::StartReceiveConnectionMessage(igtl::MessageHeader::Pointer headerMsg, igtl::MessageBase::Pointer* staging)
 {
-  CircularBufferMap::iterator iter = this->Buffer.find(key);
-  if (iter != this->Buffer.end())
+  igtl::MessageBase::Pointer message;
+  if (strcmp(headerMsg->GetDeviceType(), "CAPABILITY") == 0)
     {
-    return this->Buffer[key]; // the key has been found in the list
+    message = dynamic_pointer_cast<igtl::MessageBase>(igtl::CapabilityMessage::New());
     }
   else
     {
-    return NULL;  // nothing found
+    // ZIMAGE messages are decompressed as soon as received: one is enough.
+    if (staging->IsNull())
+      {
+      *staging = igtl::MessageBase::New();
+      }
+    message = *staging;
     }
+  message->SetMessageHeader(headerMsg);
+  this->Pool->AllocatePack(message);
+  memcpy(message->GetPackPointer(), headerMsg->GetPackPointer(), IGTL_HEADER_SIZE);
+  return message;
 }
 
 
-//---------------------------------------------------------------------------
-void Connector::ImportDataFromCircularBuffer()
+//----------------------------------------------------------------------------
+int Connector::ReceiveConnectionMessage(igtl::MessageBase::Pointer message, ClientConnection* client)
 {
-  Connector::NameListType nameList;
-  this->GetUpdatedBuffersList(nameList);
+  SendQueue* queue = client ? client->Queue.GetPointer() : this->OutgoingQueue.GetPointer();
+  const char* deviceType = message->GetDeviceType();
 
-  Connector::NameListType::iterator nameIter;
-  for (nameIter = nameList.begin(); nameIter != nameList.end(); nameIter ++)
+  if (strcmp(deviceType, "GET_CAPABIL") == 0)
     {
-    DeviceKeyType key = *nameIter;
-    CircularBuffer* circBuffer = this->GetCircularBuffer(key);
-    circBuffer->StartPull();
-
-    igtl::MessageBase::Pointer buffer = circBuffer->GetPullBuffer();
-
-    vtkSmartPointer<DeviceCreator> deviceCreator = DeviceFactory->GetCreator(key.GetBaseTypeName());
-
-    if (!deviceCreator)
+    std::vector<std::string> types = this->DeviceFactory->GetAvailableDeviceTypes();
+    std::vector<std::string> compression = ImageCompressor::GetCapabilityTypes();
+    types.insert(types.end(), compression.begin(), compression.end());
+    types.push_back(ImageDelta::GetIGTLTypeName());
+
+    igtl::CapabilityMessage::Pointer reply = igtl::CapabilityMessage::New();
+    reply->SetDeviceName(message->GetDeviceName());
+    reply->SetTypes(types);
+    reply->Pack();
+    if (this->ReactorActive)
       {
-      vtkErrorMacro(<< "Received unknown device type " << buffer->GetDeviceType() << ", device=" << buffer->GetDeviceName());
-      continue;
+      // Sent by the writer thread: the reactor thread, shared with the
+      // other connectors, does not wait for the socket.
+      queue->Push(reply.GetPointer());
       }
-
-    DevicePointer device = this->GetDevice(key);
-
-    if ((device.GetPointer()!=NULL) && !(CreateDeviceKey(device)==CreateDeviceKey(buffer)))
+    else
       {
-        vtkErrorMacro(
-            << "Received an IGTL message of the wrong type, device=" << key.name
-            << " has type " << device->GetDeviceType()
-            << " got type " << buffer->GetDeviceType()
-              );
-        continue;
+      queue->Send(reply->GetPackPointer(), reply->GetPackSize());
       }
+    return 1;
+    }
 
-    if (!device && !this->RestrictDeviceName)
+  if (strcmp(deviceType, "CAPABILITY") == 0)
+    {
+    igtl::CapabilityMessage::Pointer capability = dynamic_pointer_cast<igtl::CapabilityMessage>(message);
+    if (capability.IsNull() || !(capability->Unpack(this->CheckCRC) & igtl::MessageHeader::UNPACK_BODY))
       {
-        device = deviceCreator->Create(key.name);
-        device->SetMessageDirection(Device::MESSAGE_DIRECTION_IN);
-        this->AddDevice(device);
+      vtkWarningMacro("Invalid CAPABILITY message, images are sent uncompressed.");
+      return 1;
       }
-
-    device->ReceiveIGTLMessage(buffer, this->CheckCRC);
-    device->Modified();
-    this->InvokeEvent(Connector::DeviceModifiedEvent, device.GetPointer());
-
-    circBuffer->EndPull();
+    std::vector<std::string> types = capability->GetTypes();
+    queue->SetImageCompression(ImageCompressor::NegotiateCodec(this->ImageCompression, types));
+    queue->SetPeerAcceptsImageDelta(std::find(types.begin(), types.end(), ImageDelta::GetIGTLTypeName()) != types.end());
+    return 1;
     }
 
-  for (unsigned int i=0; i<Devices.size(); ++i)
+  // ZIMAGE: received as the IMAGE message it holds.
+  igtl::MessageHeader::Pointer imageHeader = igtl::MessageHeader::New();
+  if (!ImageCompressor::GetImageHeader(message, imageHeader))
     {
-    Devices[i]->CheckQueryExpiration();
+    vtkErrorMacro("Invalid ZIMAGE message, closing the connection.");
+    return 0;
     }
-}
-
-//---------------------------------------------------------------------------
-void Connector::ImportEventsFromEventBuffer()
-{
-  // Invoke all events in the EventQueue
-
-  bool emptyQueue=true;
-  unsigned long eventId=0;
-  do
-  {
-    emptyQueue=true;
-    this->EventQueueMutex->Lock();
-    if (this->EventQueue.size()>0)
+  if (!this->AcceptHeader(imageHeader))
     {
-      eventId=this->EventQueue.front();
-      this->EventQueue.pop_front();
-      emptyQueue=false;
+    return 1;
     }
-    this->EventQueueMutex->Unlock();
+  DeviceKeyType key = CreateDeviceKey(imageHeader);
+  CircularBufferPointer circBuffer;
+  igtl::MessageBase::Pointer buffer = this->StartReceiveBody(key, imageHeader, &circBuffer, client);
+  if (buffer.IsNull())
+    {
+    return 0;
+    }
+  // As for a truncated body, the partial message is not published.
+  if (!ImageCompressor::Decompress(message, buffer->GetPackBodyPointer(), buffer->GetPackBodySize()))
+    {
+    vtkErrorMacro("Failed to decompress the image " << imageHeader->GetDeviceName() << ", closing the connection.");
+    return 0;
+    }
+  this->EndReceiveBody(key, circBuffer, buffer, client);
+  return 1;
+}
 
-    // Invoke the event
-    this->InvokeEvent(eventId);
 
-  } while (!emptyQueue);
+//----------------------------------------------------------------------------
+void Connector::RequestPeerCapabilities(SendQueue* queue)
+{
+  // GET_CAPABIL has no body.
+  igtl_header header;
+  memset(&header, 0, sizeof(header));
+  header.version = IGTL_HEADER_VERSION;
+  strncpy(header.name, "GET_CAPABIL", IGTL_HEADER_TYPE_SIZE);
+  header.crc = crc64(0, 0, 0);
+  igtl_header_convert_byte_order(&header);
+  queue->SetPeerCapabilitiesRequested(true);
+  queue->Send(&header, IGTL_HEADER_SIZE);
 }
 
-//---------------------------------------------------------------------------
-void Connector::PushOutgoingMessages()
-{
-  int push = 0;
 
-  // Read PushOutgoingMessageFlag and reset it.
-  this->PushOutgoingMessageMutex->Lock();
-  push = this->PushOutgoingMessageFlag;
-  this->PushOutgoingMessageFlag = 0;
-  this->PushOutgoingMessageMutex->Unlock();
+//----------------------------------------------------------------------------
+bool Connector::AcceptImageDelta()
+{
+  std::vector<SendQueuePointer> queues;
+  if (this->Type == TYPE_SERVER && this->MaximumNumberOfClients > 1)
+    {
+    this->ClientsMutex->Lock();
+    for (unsigned i=0; i<this->Clients.size(); ++i)
+      {
+      queues.push_back(this->Clients[i]->Queue);
+      }
+    this->ClientsMutex->Unlock();
+    }
+  else
+    {
+    queues.push_back(this->OutgoingQueue);
+    }
 
-  if (push)
+  // Images are sent as IMAGE until every peer replied.
+  bool accepted = !queues.empty();
+  for (unsigned i=0; i<queues.size(); ++i)
     {
-      for (unsigned i=0; i<Devices.size(); ++i)
-        {
-          if (Devices[i]->MessageDirectionIsOut() && Devices[i]->GetPushOnConnect())
-            this->PushNode(Devices[i]);
-        }
+    if (!queues[i]->IsRunning())
+      {
+      accepted = false;
+      continue;
+      }
+    if (!queues[i]->GetPeerCapabilitiesRequested())
+      {
+      this->RequestPeerCapabilities(queues[i]);
+      }
+    accepted = accepted && queues[i]->GetPeerAcceptsImageDelta();
     }
+  return accepted;
 }
 
-//----------------------------------------------------------------------------
-void Connector::PeriodicProcess()
-{
-  this->ImportDataFromCircularBuffer();
-  this->ImportEventsFromEventBuffer();
-  this->PushOutgoingMessages();
-}
 
-int Connector::AddDevice(DevicePointer device)
+//----------------------------------------------------------------------------
+void Connector::SetImageCompression(int codec)
 {
-  if (this->GetDevice(CreateDeviceKey(device))!=NULL)
+  if (!ImageCompressor::IsCodecSupported(codec))
     {
-    vtkErrorMacro("Failed to add igtl device: " << device->GetDeviceName() << " already present");
-    return 0;
+    vtkErrorMacro("Unsupported image compression " << ImageCompressor::GetCodecName(codec));
+    return;
+    }
+  if (this->ImageCompression == codec)
+    {
+    return;
     }
+  this->ImageCompression = codec;
+  this->Modified();
 
-  device->SetTimestamp(vtkTimerLog::GetUniversalTime());
-  Devices.push_back(device);
-  //TODO: listen to device events?
-  this->InvokeEvent(Connector::NewDeviceEvent, device.GetPointer());
-  return 1;
-}
-  
-int Connector::RemoveDevice(DevicePointer device)
-{
-  DeviceKeyType key = CreateDeviceKey(device);
-  for (unsigned i=0; i<Devices.size(); ++i)
-  {
-    if (CreateDeviceKey(Devices[i])==key)
+  // Negotiate again with the connected peers.
+  std::vector<SendQueuePointer> queues(1, this->OutgoingQueue);
+  this->ClientsMutex->Lock();
+  for (unsigned i=0; i<this->Clients.size(); ++i)
     {
-      Devices.erase(Devices.begin()+i);
-      this->InvokeEvent(Connector::RemovedDeviceEvent, device.GetPointer());
-      return 1;
+    queues.push_back(this->Clients[i]->Queue);
+    }
+  this->ClientsMutex->Unlock();
+  for (unsigned i=0; i<queues.size(); ++i)
+    {
+    if (codec == ImageCompressor::CODEC_NONE)
+      {
+      queues[i]->SetImageCompression(ImageCompressor::CODEC_NONE);
+      }
+    else if (queues[i]->IsRunning())
+      {
+      this->RequestPeerCapabilities(queues[i]);
+      }
     }
-  }
-  vtkErrorMacro("Failed to remove igtl device: " << device->GetDeviceName());
-  return 0;
 }
 
-//---------------------------------------------------------------------------
-unsigned int Connector::GetNumberOfDevices() const
-{
-  return Devices.size();
-}
 
-//---------------------------------------------------------------------------
-void Connector::RemoveDevice(int index)
+//----------------------------------------------------------------------------
+int Connector::GetNegotiatedImageCompression()
 {
-  //TODO: disconnect listen to device events?
-  DevicePointer device = Devices[index]; // ensure object lives until event has completed
-  Devices.erase(Devices.begin()+index);
-  this->InvokeEvent(Connector::RemovedDeviceEvent, device.GetPointer());
+  if (this->MaximumNumberOfClients <= 1)
+    {
+    return this->OutgoingQueue->GetImageCompression();
+    }
+  int codec = ImageCompressor::CODEC_NONE;
+  this->ClientsMutex->Lock();
+  if (!this->Clients.empty())
+    {
+    codec = this->Clients.front()->Queue->GetImageCompression();
+    }
+  this->ClientsMutex->Unlock();
+  return codec;
 }
 
-//---------------------------------------------------------------------------
-DevicePointer Connector::GetDevice(int index)
-{
-  return Devices[index];
-}
 
-//---------------------------------------------------------------------------
-DevicePointer Connector::GetDevice(DeviceKeyType key)
+//----------------------------------------------------------------------------
+int Connector::GetNumberOfClients()
 {
-  for (unsigned i=0; i<Devices.size(); ++i)
-    if (CreateDeviceKey(Devices[i])==key)
-      return Devices[i];
-  return DevicePointer();
+  if (this->MaximumNumberOfClients <= 1)
+    {
+    return this->State == STATE_CONNECTED ? 1 : 0;
+    }
+  this->ClientsMutex->Lock();
+  int n = static_cast<int>(this->Clients.size());
+  this->ClientsMutex->Unlock();
+  return n;
 }
 
-//---------------------------------------------------------------------------
-int Connector::SendMessage(DeviceKeyType device_id, Device::MESSAGE_PREFIX prefix)
+
+//----------------------------------------------------------------------------
+void Connector::ServeClients()
+{
+  while (!this->ServerStopFlag)
+    {
+    this->RemoveClients(true);
+
+    if (this->GetNumberOfClients() >= this->MaximumNumberOfClients)
+      {
+      igtl::Sleep(100);
+      continue;
+      }
+
+    igtl::ClientSocket::Pointer socket = this->ServerSocket->WaitForConnection(100);
+    if (socket.IsNull())
+      {
+      continue;
+      }
+
+    ClientConnection* client = new ClientConnection;
+    client->Self = this;
+    client->Socket = socket;
+    client->Finished = false;
+    client->Queue = SendQueuePointer::New();
+    client->Queue->CopySettings(this->OutgoingQueue);
+    client->Queue->Start(socket.GetPointer());
+    if (this->ImageCompression != ImageCompressor::CODEC_NONE)
+      {
+      this->RequestPeerCapabilities(client->Queue);
+      }
+
+    this->ClientsMutex->Lock();
+    this->Clients.push_back(client);
+    this->ClientsMutex->Unlock();
+    client->ThreadID = this->ClientThreads->SpawnThread((vtkThreadFunctionType) &Connector::ClientThreadFunction, client);
+
+    this->State = STATE_CONNECTED;
+    this->RequestInvokeEvent(Connector::ConnectedEvent);
+    this->RequestPushOutgoingMessages();
+    }
+
+  this->RemoveClients(false);
+}
+
+
+//----------------------------------------------------------------------------
+void* Connector::ClientThreadFunction(void* ptr)
+{
+  vtkMultiThreader::ThreadInfo* vinfo =
+    static_cast<vtkMultiThreader::ThreadInfo*>(ptr);
+  ClientConnection* client = static_cast<ClientConnection*>(vinfo->UserData);
+  Connector* self = client->Self;
+
+  self->ReceiveController(client->Socket, client);
+
+  self->ClientsMutex->Lock();
+  client->Finished = true;
+  self->ClientsMutex->Unlock();
+  return NULL;
+}
+
+
+//----------------------------------------------------------------------------
+void Connector::RemoveClients(bool finishedOnly)
+{
+  std::vector<ClientConnection*> removed;
+
+  this->ClientsMutex->Lock();
+  std::vector<ClientConnection*>::iterator iter = this->Clients.begin();
+  while (iter != this->Clients.end())
+    {
+    if (!finishedOnly || (*iter)->Finished || (*iter)->Queue->GetFailed())
+      {
+      removed.push_back(*iter);
+      iter = this->Clients.erase(iter);
+      }
+    else
+      {
+      ++iter;
+      }
+    }
+  bool empty = this->Clients.empty();
+  this->ClientsMutex->Unlock();
+
+  for (unsigned i=0; i<removed.size(); ++i)
+    {
+    ClientConnection* client = removed[i];
+    // Unblock the receive and writer threads before waiting for them.
+    ShutdownSocket(client->Socket);
+    this->ClientThreads->TerminateThread(client->ThreadID);
+    client->Queue->Stop();
+    client->Socket->CloseSocket();
+    delete client;
+    this->RequestInvokeEvent(Connector::DisconnectedEvent);
+    }
+
+  if (!removed.empty() && empty)
+    {
+    this->State = STATE_WAIT_CONNECTION;
+    }
+}
+
+
+//----------------------------------------------------------------------------
+int Connector::Broadcast(igtl::MessageBase::Pointer msg, const std::string& coalesceKey, vtkCommand* callback,
+                         const void* payload, long long payloadSize, vtkObject* payloadOwner)
+{
+  // The message is shared by all clients, and released once sent to all of them.
+  int sent = 0;
+  this->ClientsMutex->Lock();
+  for (unsigned i=0; i<this->Clients.size(); ++i)
+    {
+    if (this->Clients[i]->Finished)
+      {
+      continue;
+      }
+    SendQueuePointer queue = this->Clients[i]->Queue;
+    if (payload ? queue->PushGather(msg, payload, payloadSize, payloadOwner, coalesceKey, callback)
+                : queue->Push(msg, coalesceKey, callback))
+      {
+      ++sent;
+      }
+    }
+  this->ClientsMutex->Unlock();
+  return sent > 0 ? 1 : 0;
+}
+
+
+//----------------------------------------------------------------------------
+int Connector::SendData(int size, unsigned char* data)
+{
+
+  if (this->Socket.IsNull())
+    {
+    return 0;
+    }
+
+  // check if connection is alive
+  if (!this->Socket->GetConnected())
+    {
+    return 0;
+    }
+
+  // Serialized with the messages sent by the writer thread.
+  return this->OutgoingQueue->Send(data, size);  // return 1 on success, otherwise 0.
+
+}
+
+
+//---------------------------------------------------------------------------
+int Connector::StartReactor()
+{
+  if (this->Type == TYPE_SERVER)
+    {
+    this->ServerSocket = igtl::ServerSocket::New();
+    if (this->ServerSocket->CreateServer(this->ServerPort) == -1)
+      {
+      vtkErrorMacro("Failed to create server socket !");
+      return 0;
+      }
+    }
+
+  this->ServerStopFlag = false;
+  this->ReactorActive = true;
+  this->ReactorConnectDescriptor = -1;
+  this->ReactorRetryTime = 0;
+  this->State = STATE_WAIT_CONNECTION;
+
+  this->IOReactor->AddConnector(this);
+  if (this->Type == TYPE_SERVER)
+    {
+    this->IOReactor->Watch(this, GetSocketDescriptor(this->ServerSocket), Reactor::ReadEvent);
+    }
+
+  this->InvokeEvent(Connector::ActivatedEvent);
+  return 1;
+}
+
+//---------------------------------------------------------------------------
+int Connector::StopReactor()
+{
+  this->ServerStopFlag = true;
+
+  // No reactor callbacks are running or will run after this.
+  this->IOReactor->RemoveConnector(this);
+
+  this->Mutex->Lock();
+  if (this->Socket.IsNotNull())
+    {
+    ShutdownSocket(this->Socket);
+    this->OutgoingQueue->Stop();
+    this->Socket->CloseSocket();
+    }
+  this->Mutex->Unlock();
+
+  if (this->ServerSocket.IsNotNull())
+    {
+    this->ServerSocket->CloseSocket();
+    }
+  CloseSocketDescriptor(this->ReactorConnectDescriptor);
+  this->ReactorConnectDescriptor = -1;
+
+  this->ReactorBody = NULL;
+  this->ReactorBuffer = NULL;
+  this->ReactorActive = false;
+
+  if (this->State == STATE_CONNECTED)
+    {
+    this->RequestInvokeEvent(Connector::DisconnectedEvent);
+    }
+  this->State = STATE_OFF;
+  this->RequestInvokeEvent(Connector::DeactivatedEvent);
+  return 1;
+}
+
+//---------------------------------------------------------------------------
+void Connector::HandleReactorEvent(int events)
+{
+  if (this->State == STATE_CONNECTED)
+    {
+    if (this->ReceiveAvailable() < 0)
+      {
+      this->ReactorDisconnected();
+      }
+    return;
+    }
+
+  if (this->Type == TYPE_SERVER)
+    {
+    // The listening socket is readable: a client is waiting.
+    igtl::ClientSocket::Pointer socket = this->ServerSocket->WaitForConnection(1);
+    if (socket.IsNull())
+      {
+      return;
+      }
+    // Serve one client at a time, as in the threaded mode.
+    this->IOReactor->Unwatch(this, GetSocketDescriptor(this->ServerSocket));
+    this->ReactorConnected(socket);
+    }
+  else if (this->ReactorConnectDescriptor >= 0)
+    {
+    int r = FinishConnect(this->ReactorConnectDescriptor);
+    if (r == 0)
+      {
+      return;
+      }
+    int descriptor = this->ReactorConnectDescriptor;
+    this->ReactorConnectDescriptor = -1;
+    this->IOReactor->Unwatch(this, descriptor);
+    if (r < 0)
+      {
+      CloseSocketDescriptor(descriptor);
+      return; // retried by HandleReactorTimer()
+      }
+    igtl::ClientSocket::Pointer socket = igtl::ClientSocket::New();
+    SetSocketDescriptor(socket, descriptor);
+    this->ReactorConnected(socket);
+    }
+}
+
+//---------------------------------------------------------------------------
+void Connector::HandleReactorTimer()
+{
+  if (this->State == STATE_CONNECTED && this->ReactorPaused)
+    {
+    // Resume receiving once the main thread pulled from the full queue.
+    if (this->StartReactorBody()
+        && (this->ReactorBody.IsNull() || this->ReceiveAvailable() < 0))
+      {
+      this->ReactorDisconnected();
+      }
+    return;
+    }
+
+  if (this->Type != TYPE_CLIENT
+      || this->State != STATE_WAIT_CONNECTION
+      || this->ReactorConnectDescriptor >= 0)
+    {
+    return;
+    }
+
+  // Retry every 100ms, as in the threaded mode.
+  double now = vtkTimerLog::GetUniversalTime();
+  if (now < this->ReactorRetryTime)
+    {
+    return;
+    }
+  this->ReactorRetryTime = now + 0.1;
+
+  this->ReactorConnectDescriptor = StartConnect(this->ServerHostname, this->ServerPort);
+  if (this->ReactorConnectDescriptor >= 0)
+    {
+    this->IOReactor->Watch(this, this->ReactorConnectDescriptor, Reactor::WriteEvent);
+    }
+}
+
+//---------------------------------------------------------------------------
+void Connector::ReactorConnected(igtl::ClientSocket::Pointer socket)
+{
+  this->Mutex->Lock();
+  this->Socket = socket;
+  this->Mutex->Unlock();
+  this->OutgoingQueue->Start(socket.GetPointer());
+  if (this->ImageCompression != ImageCompressor::CODEC_NONE)
+    {
+    this->RequestPeerCapabilities(this->OutgoingQueue);
+    }
+
+  this->ReactorHeader = igtl::MessageHeader::New();
+  this->ReactorHeader->InitPack();
+  this->ReactorBody = NULL;
+  this->ReactorBuffer = NULL;
+  this->ReactorOffset = 0;
+  this->ReactorSkip = 0;
+  this->ReactorPaused = 0;
+
+  this->IOReactor->Watch(this, GetSocketDescriptor(socket), Reactor::ReadEvent);
+
+  this->State = STATE_CONNECTED;
+  this->RequestInvokeEvent(Connector::ConnectedEvent);
+  this->RequestPushOutgoingMessages();
+}
+
+//---------------------------------------------------------------------------
+void Connector::ReactorDisconnected()
+{
+  this->IOReactor->Unwatch(this, GetSocketDescriptor(this->Socket));
+  ShutdownSocket(this->Socket);
+  this->OutgoingQueue->Stop();
+  this->Mutex->Lock();
+  this->Socket->CloseSocket();
+  this->Mutex->Unlock();
+
+  this->ReactorBody = NULL;
+  this->ReactorBuffer = NULL;
+  this->ReactorPaused = 0;
+
+  this->State = STATE_WAIT_CONNECTION;
+  this->RequestInvokeEvent(Connector::DisconnectedEvent);
+
+  if (this->Type == TYPE_SERVER)
+    {
+    this->IOReactor->Watch(this, GetSocketDescriptor(this->ServerSocket), Reactor::ReadEvent);
+    }
+  else
+    {
+    this->ReactorRetryTime = vtkTimerLog::GetUniversalTime() + 0.1;
+    }
+}
+
+//---------------------------------------------------------------------------
+int Connector::ReceiveAvailable()
+{
+  if (this->ReactorPaused)
+    {
+    return 1; // resumed by HandleReactorTimer()
+    }
+  int descriptor = GetSocketDescriptor(this->Socket);
+
+  // Bounded, so that a peer sending continuously cannot starve the other
+  // connectors of the reactor thread. Remaining data triggers a new event.
+  for (int i = 0; i < 64; ++i)
+    {
+    //----------------------------------------------------------------
+    // Discard the body of a rejected message
+    if (this->ReactorSkip > 0)
+      {
+      unsigned char dummy[256];
+      int n = ReceiveNonBlocking(descriptor, dummy, (int)std::min<igtlUint64>(this->ReactorSkip, sizeof(dummy)));
+      if (n <= 0)
+        {
+        return n;
+        }
+      this->ReactorSkip -= n;
+      continue;
+      }
+
+    //----------------------------------------------------------------
+    // Receive Header
+    if (this->ReactorBody.IsNull())
+      {
+      unsigned char* ptr = (unsigned char*)this->ReactorHeader->GetPackPointer();
+      int size = this->ReactorHeader->GetPackSize();
+      int n = ReceiveNonBlocking(descriptor, ptr+this->ReactorOffset, size-this->ReactorOffset);
+      if (n <= 0)
+        {
+        return n;
+        }
+      this->ReactorOffset += n;
+      if (this->ReactorOffset < size)
+        {
+        continue;
+        }
+
+      this->ReactorOffset = 0;
+      if (!(this->ReactorHeader->Unpack() & igtl::MessageHeader::UNPACK_HEADER))
+        {
+        return -1; // framing lost
+        }
+      // ZIMAGE messages are queued as received, and decompressed by the
+      // main thread when imported, see ImportDataFromCircularBuffer().
+      const char* deviceType = this->ReactorHeader->GetDeviceType();
+      if (IsConnectionMessage(deviceType) && strcmp(deviceType, ImageCompressor::GetIGTLTypeName()) != 0)
+        {
+        this->ReactorBody = this->StartReceiveConnectionMessage(this->ReactorHeader, &this->ReactorStaging);
+        this->ReactorBuffer = NULL;
+        this->ReactorHeader->InitPack();
+        }
+      else
+        {
+        if (!this->AcceptHeader(this->ReactorHeader))
+          {
+          this->ReactorSkip = this->ReactorHeader->GetBodySizeToRead();
+          this->ReactorHeader->InitPack();
+          continue;
+          }
+        this->ReactorKey = CreateReceiveKey(this->ReactorHeader);
+        if (!this->StartReactorBody())
+          {
+          return 1;
+          }
+        }
+      if (this->ReactorBody.IsNull())
+        {
+        return -1;
+        }
+      }
+
+    //----------------------------------------------------------------
+    // Receive Body
+    unsigned char* ptr = (unsigned char*)this->ReactorBody->GetPackBodyPointer();
+    int size = this->ReactorBody->GetPackBodySize();
+    if (this->ReactorOffset < size)
+      {
+      int n = ReceiveNonBlocking(descriptor, ptr+this->ReactorOffset, size-this->ReactorOffset);
+      if (n <= 0)
+        {
+        return n;
+        }
+      this->ReactorOffset += n;
+      }
+    if (this->ReactorOffset == size)
+      {
+      int r = 1;
+      if (!this->ReactorBuffer)
+        {
+        r = this->ReceiveConnectionMessage(this->ReactorBody);
+        }
+      else
+        {
+        this->EndReceiveBody(this->ReactorKey, this->ReactorBuffer, this->ReactorBody);
+        }
+      this->ReactorBody = NULL;
+      this->ReactorBuffer = NULL;
+      this->ReactorOffset = 0;
+      if (!r)
+        {
+        return -1;
+        }
+      }
+    }
+  return 1;
+}
+
+
+//----------------------------------------------------------------------------
+int Connector::StartReactorBody()
+{
+  // Instead of waiting for the main thread to pull from a full FIFO queue,
+  // which would stall the other connectors of the reactor thread, stop
+  // reading the socket: TCP flow control then slows the sender down. The
+  // header is kept, and the body received once the queue was pulled.
+  CircularBufferPointer circBuffer = this->GetOrCreateCircularBuffer(this->ReactorKey);
+  if (circBuffer->IsFull())
+    {
+    // Paused before checking again, so that a pull made meanwhile sees it
+    // and wakes the thread up.
+    if (!this->ReactorPaused)
+      {
+      this->ReactorPaused = 1;
+      this->IOReactor->Unwatch(this, GetSocketDescriptor(this->Socket));
+      }
+    if (circBuffer->IsFull())
+      {
+      return 0;
+      }
+    }
+  if (this->ReactorPaused)
+    {
+    this->ReactorPaused = 0;
+    this->IOReactor->Watch(this, GetSocketDescriptor(this->Socket), Reactor::ReadEvent);
+    }
+
+  this->ReactorBody = this->StartReceiveBody(this->ReactorKey, this->ReactorHeader, &this->ReactorBuffer);
+  if (this->ReactorBody.IsNotNull()
+      && strcmp(this->ReactorHeader->GetDeviceType(), ImageCompressor::GetIGTLTypeName()) == 0)
+    {
+    // The compressor reads the ZIMAGE header from the pack.
+    memcpy(this->ReactorBody->GetPackPointer(), this->ReactorHeader->GetPackPointer(), IGTL_HEADER_SIZE);
+    }
+  this->ReactorHeader->InitPack();
+  return 1;
+}
+
+
+//----------------------------------------------------------------------------
+unsigned int Connector::GetUpdatedBuffersList(NameListType& nameList)
+{
+  nameList.clear();
+
+  // Only the buffers that received messages since the last call are
+  // listed by the receiving threads, each one once.
+  this->ReadyKeysMutex->Lock();
+  nameList.swap(this->ReadyKeys);
+  this->ReadyKeysMutex->Unlock();
+  return nameList.size();
+}
+
+
+//----------------------------------------------------------------------------
+CircularBufferPointer Connector::GetOrCreateCircularBuffer(const DeviceKeyType &key)
+{
+  CircularBufferPointer circBuffer = this->GetCircularBuffer(key);
+  if (circBuffer)
+    {
+    return circBuffer;
+    }
+
+  // First time to refer the device name. Several receiving threads may
+  // create buffers concurrently.
+  this->CircularBufferMutex->Lock();
+  unsigned int id = key.GetId();
+  BufferTable* table = this->Buffers.Load();
+  if (id >= table->Size)
+    {
+    BufferTable* grown = new BufferTable;
+    grown->Size = std::max(DeviceKeyType::GetNumberOfIds(), id + 1);
+    grown->Buffers = new vtkAtomic<CircularBuffer*>[grown->Size];
+    for (unsigned int i=0; i<grown->Size; ++i)
+      {
+      grown->Buffers[i] = i < table->Size ? table->Buffers[i].Load() : static_cast<CircularBuffer*>(NULL);
+      }
+    this->BufferTables.push_back(grown);
+    this->Buffers = grown;
+    table = grown;
+    }
+  circBuffer = table->Buffers[id].Load();
+  if (!circBuffer)
+    {
+    circBuffer = CircularBufferPointer::New();
+    this->ApplyDeliveryPolicy(key, circBuffer);
+    this->BufferOwners.push_back(circBuffer);
+    table->Buffers[id] = circBuffer.GetPointer();
+    this->BufferKeys.push_back(key);
+    }
+  this->CircularBufferMutex->Unlock();
+  return circBuffer;
+}
+
+
+//----------------------------------------------------------------------------
+CircularBufferPointer Connector::GetCircularBuffer(const DeviceKeyType &key)
+{
+  BufferTable* table = this->Buffers.Load();
+  if (key.GetId() < table->Size)
+    {
+    return table->Buffers[key.GetId()].Load();
+    }
+  return NULL;
+}
+
+
+//----------------------------------------------------------------------------
+CircularBufferPointer Connector::GetReceiveBuffer(const DeviceKeyType &key)
+{
+  return this->GetCircularBuffer(key);
+}
+
+
+//----------------------------------------------------------------------------
+void Connector::SetDefaultDeliveryPolicy(int policy, int depth)
+{
+  this->CircularBufferMutex->Lock();
+  this->DefaultDeliveryPolicy.Policy = policy;
+  this->DefaultDeliveryPolicy.Depth = depth;
+  this->ApplyDeliveryPolicies();
+  this->CircularBufferMutex->Unlock();
+}
+
+
+//----------------------------------------------------------------------------
+void Connector::SetDeliveryPolicy(const std::string& deviceType, int policy, int depth)
+{
+  this->CircularBufferMutex->Lock();
+  this->TypeDeliveryPolicies[deviceType].Policy = policy;
+  this->TypeDeliveryPolicies[deviceType].Depth = depth;
+  this->ApplyDeliveryPolicies();
+  this->CircularBufferMutex->Unlock();
+}
+
+
+//----------------------------------------------------------------------------
+void Connector::SetDeliveryPolicy(const DeviceKeyType& key, int policy, int depth)
+{
+  this->CircularBufferMutex->Lock();
+  this->DeviceDeliveryPolicies[key].Policy = policy;
+  this->DeviceDeliveryPolicies[key].Depth = depth;
+  this->ApplyDeliveryPolicies();
+  this->CircularBufferMutex->Unlock();
+}
+
+
+//----------------------------------------------------------------------------
+void Connector::ApplyDeliveryPolicy(const DeviceKeyType& key, CircularBuffer* circBuffer)
+{
+  DeliveryPolicyType policy = this->DefaultDeliveryPolicy;
+  std::map<std::string, DeliveryPolicyType>::iterator typeIter = this->TypeDeliveryPolicies.find(key.GetBaseTypeName());
+  if (typeIter != this->TypeDeliveryPolicies.end())
+    {
+    policy = typeIter->second;
+    }
+  std::map<DeviceKeyType, DeliveryPolicyType>::iterator deviceIter = this->DeviceDeliveryPolicies.find(key);
+  if (deviceIter != this->DeviceDeliveryPolicies.end())
+    {
+    policy = deviceIter->second;
+    }
+  circBuffer->SetDeliveryPolicy(policy.Policy, policy.Depth);
+}
+
+
+//----------------------------------------------------------------------------
+void Connector::ApplyDeliveryPolicies()
+{
+  // The policy of a buffer is fixed once it received messages: replace it.
+  for (NameListType::iterator iter = this->BufferKeys.begin(); iter != this->BufferKeys.end(); ++iter)
+    {
+    vtkAtomic<CircularBuffer*>& current = this->Buffers.Load()->Buffers[iter->GetId()];
+    CircularBufferPointer circBuffer = CircularBufferPointer::New();
+    this->ApplyDeliveryPolicy(*iter, circBuffer);
+    if (circBuffer->GetDeliveryPolicy() != current.Load()->GetDeliveryPolicy()
+        || circBuffer->GetDepth() != current.Load()->GetDepth())
+      {
+      this->BufferOwners.push_back(circBuffer);
+      current = circBuffer.GetPointer();
+      }
+    }
+}
+
+
+//---------------------------------------------------------------------------
+igtl::MessageBase::Pointer Connector::DecompressImage(igtl::MessageBase::Pointer compressed)
+{
+  if (this->ImportImageHeader.IsNull())
+    {
+    this->ImportImageHeader = igtl::MessageHeader::New();
+    }
+  if (!ImageCompressor::GetImageHeader(compressed, this->ImportImageHeader))
+    {
+    return NULL;
+    }
+
+  // The device adopts the pack of the message, which is then reallocated
+  // from the pool for the next image.
+  if (this->ImportImage.IsNull())
+    {
+    this->ImportImage = this->DeviceFactory->CreateReceiveMessage(this->ImportImageHeader);
+    }
+  this->ImportImage->SetMessageHeader(this->ImportImageHeader);
+  this->Pool->AllocatePack(this->ImportImage);
+  memcpy(this->ImportImage->GetPackPointer(), this->ImportImageHeader->GetPackPointer(), IGTL_HEADER_SIZE);
+  if (!ImageCompressor::Decompress(compressed, this->ImportImage->GetPackBodyPointer(), this->ImportImage->GetPackBodySize()))
+    {
+    return NULL;
+    }
+  return this->ImportImage;
+}
+
+
+//---------------------------------------------------------------------------
+void Connector::ImportDataFromCircularBuffer()
+{
+  // Reused between calls, along with ReadyKeys, to avoid reallocations.
+  Connector::NameListType& nameList = this->ImportKeys;
+  this->GetUpdatedBuffersList(nameList);
+
+  Connector::NameListType::iterator nameIter;
+  for (nameIter = nameList.begin(); nameIter != nameList.end(); nameIter ++)
+    {
+    DeviceKeyType key = *nameIter;
+    CircularBufferPointer circBuffer = this->GetCircularBuffer(key);
+
+    // Cleared before pulling: messages pushed from now on list the key again.
+    circBuffer->ClearReady();
+
+    // Deliver every pending message, in order. Only one is pending with
+    // the default DELIVER_LATEST policy.
+    while (circBuffer->StartPull() != -1)
+      {
+      igtl::MessageBase::Pointer buffer = circBuffer->GetPullBuffer();
+      if (strcmp(buffer->GetDeviceType(), ImageCompressor::GetIGTLTypeName()) == 0)
+        {
+        buffer = this->DecompressImage(buffer);
+        if (buffer.IsNull())
+          {
+          vtkErrorMacro(<< "Failed to decompress the image " << key.GetName());
+          continue;
+          }
+        }
+
+      vtkSmartPointer<DeviceCreator> deviceCreator = DeviceFactory->GetCreator(key.GetBaseTypeName());
+
+      if (!deviceCreator)
+        {
+        vtkErrorMacro(<< "Received unknown device type " << buffer->GetDeviceType() << ", device=" << buffer->GetDeviceName());
+        continue;
+        }
+
+      DevicePointer device = this->GetDevice(key);
+
+      if ((device.GetPointer()!=NULL) && CreateDeviceKey(buffer)!=key)
+        {
+          vtkErrorMacro(
+              << "Received an IGTL message of the wrong type, device=" << key.GetName()
+              << " has type " << device->GetDeviceType()
+              << " got type " << buffer->GetDeviceType()
+                );
+          continue;
+        }
+
+      if (!device && !this->RestrictDeviceName)
+        {
+          device = deviceCreator->Create(key.GetName());
+          device->SetMessageDirection(Device::MESSAGE_DIRECTION_IN);
+          this->AddDevice(device);
+        }
+
+      if (!device)
+        {
+        continue;
+        }
+
+      device->ReceiveIGTLMessage(buffer, this->CheckCRC);
+      ImageDevice* imageDevice = ImageDevice::SafeDownCast(device);
+      if (imageDevice && imageDevice->TakeKeyframeRequest())
+        {
+        // Missed the reference frame of a delta: GET_IMAGE asks for a keyframe.
+        this->SendMessage(key, Device::MESSAGE_PREFIX_GET);
+        }
+      device->Modified();
+      this->InvokeEvent(Connector::DeviceModifiedEvent, device.GetPointer());
+      }
+
+    circBuffer->EndPull();
+    }
+
+  // A reactor thread that stopped reading from a full queue resumes.
+  if (this->ReactorActive && this->ReactorPaused)
+    {
+    this->IOReactor->Wakeup(this);
+    }
+
+  for (unsigned int i=0; i<Devices.GetNumberOfDevices(); ++i)
+    {
+    Devices.GetDevice(i)->CheckQueryExpiration();
+    }
+}
+
+//---------------------------------------------------------------------------
+void Connector::ImportEventsFromEventBuffer()
+{
+  // Invoke all events in the EventQueue
+  unsigned long eventId=0;
+  while (this->EventQueue.Pop(eventId))
+    {
+    this->InvokeEvent(eventId);
+    }
+
+  // Then the ones queued aside, which are more recent.
+  if (this->EventOverflowSize > 0)
+    {
+    std::list<unsigned long> overflow;
+    this->EventQueueMutex->Lock();
+    overflow.swap(this->EventOverflow);
+    this->EventOverflowSize = 0;
+    this->EventQueueMutex->Unlock();
+
+    for (std::list<unsigned long>::iterator iter = overflow.begin(); iter != overflow.end(); ++iter)
+      {
+      this->InvokeEvent(*iter);
+      }
+    }
+}
+
+//---------------------------------------------------------------------------
+void Connector::PushOutgoingMessages()
+{
+  int push = 0;
+
+  // Read PushOutgoingMessageFlag and reset it.
+  this->PushOutgoingMessageMutex->Lock();
+  push = this->PushOutgoingMessageFlag;
+  this->PushOutgoingMessageFlag = 0;
+  this->PushOutgoingMessageMutex->Unlock();
+
+  if (push)
+    {
+      for (unsigned i=0; i<Devices.GetNumberOfDevices(); ++i)
+        {
+          DevicePointer device = Devices.GetDevice(i);
+          if (device->MessageDirectionIsOut() && device->GetPushOnConnect())
+            this->PushNode(device);
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+void Connector::PeriodicProcess()
+{
+  // Cleared first: work arriving from now on signals the handle again.
+  this->ConnectorWaitHandle->Clear();
+  this->Devices.Reclaim();
+  this->Pool->Trim();
+  this->ImportDataFromCircularBuffer();
+  this->ImportEventsFromEventBuffer();
+  this->PushOutgoingMessages();
+  this->FlushSendQueues();
+}
+
+//---------------------------------------------------------------------------
+void Connector::FlushSendQueues()
+{
+  // Messages gathered during this tick are sent together.
+  this->OutgoingQueue->Flush();
+
+  this->ClientsMutex->Lock();
+  for (unsigned i=0; i<this->Clients.size(); ++i)
+    {
+    this->Clients[i]->Queue->Flush();
+    }
+  this->ClientsMutex->Unlock();
+}
+
+int Connector::AddDevice(DevicePointer device)
+{
+  if (!Devices.Add(device))
+    {
+    vtkErrorMacro("Failed to add igtl device: " << device->GetDeviceName() << " already present");
+    return 0;
+    }
+
+  device->SetTimestamp(vtkTimerLog::GetUniversalTime());
+  //TODO: listen to device events?
+  this->InvokeEvent(Connector::NewDeviceEvent, device.GetPointer());
+  return 1;
+}
+  
+int Connector::RemoveDevice(DevicePointer device)
+{
+  if (Devices.Remove(CreateDeviceKey(device)))
+  {
+    this->InvokeEvent(Connector::RemovedDeviceEvent, device.GetPointer());
+    return 1;
+  }
+  vtkErrorMacro("Failed to remove igtl device: " << device->GetDeviceName());
+  return 0;
+}
+
+//---------------------------------------------------------------------------
+unsigned int Connector::GetNumberOfDevices() const
+{
+  return Devices.GetNumberOfDevices();
+}
+
+//---------------------------------------------------------------------------
+void Connector::RemoveDevice(int index)
+{
+  //TODO: disconnect listen to device events?
+  DevicePointer device = Devices.RemoveAt(index); // ensure object lives until event has completed
+  this->InvokeEvent(Connector::RemovedDeviceEvent, device.GetPointer());
+}
+
+//---------------------------------------------------------------------------
+DevicePointer Connector::GetDevice(int index)
+{
+  return Devices.GetDevice(index);
+}
+
+//---------------------------------------------------------------------------
+DevicePointer Connector::GetDevice(DeviceKeyType key)
+{
+  return Devices.Find(key);
+}
+
+//---------------------------------------------------------------------------
+int Connector::SendMessage(DeviceKeyType device_id, Device::MESSAGE_PREFIX prefix)
 {
   DevicePointer device = this->GetDevice(device_id);
   if (!device)
     {
-      vtkErrorMacro("Sending OpenIGTLinkMessage: " << device_id.type << "/" << device_id.name<< ", device not found");
+      vtkErrorMacro("Sending OpenIGTLinkMessage: " << device_id.GetType() << "/" << device_id.GetName()<< ", device not found");
+      return 1;
+    }
+
+  // Images are sent from their pixels, instead of packing them into the message.
+  ImageDevice* imageDevice = ImageDevice::SafeDownCast(device);
+  if (imageDevice && prefix == Device::MESSAGE_PREFIX_NOT_DEFINED && imageDevice->GetDeltaEncoding()
+      && ImageDelta::IsSupported(imageDevice->GetContent().image) && this->AcceptImageDelta())
+    {
+    ImageConverter::GatherData gather;
+    // A queued keyframe must not be read from the image, which the
+    // application may modify before it is sent.
+    if (!imageDevice->GetDeltaGather(&gather, this->IsSendQueued()))
+      {
+      vtkErrorMacro("Sending OpenIGTLinkMessage: " << device_id.GetType() << "/" << device_id.GetName() << ", delta not available from device");
       return 1;
+      }
+    // Never coalesced: each delta applies to the previous frame.
+    return this->SendGathered(gather, "", NULL);
+    }
+  if (imageDevice && prefix == Device::MESSAGE_PREFIX_NOT_DEFINED && !this->IsSendQueued())
+    {
+    ImageConverter::ContentData content = imageDevice->GetContent();
+    if (content.image && content.transform)
+      {
+      int extent[6];
+      bool subVolume = imageDevice->TakeNextSubVolume(extent);
+      return this->SendImage(imageDevice->GetHeader(), content, NULL, subVolume ? extent : NULL);
+      }
+    }
+
+  if (imageDevice && this->IsSendQueued() && this->SendPolicy == SEND_LATEST)
+    {
+    // A queued sub-volume could be replaced by the next one: send whole images.
+    imageDevice->RequestKeyframe();
     }
 
   //TODO replace prefix with message-type or similar - giving the basic message same status as the queries
@@ -802,14 +1865,31 @@ int Connector::SendMessage(DeviceKeyType device_id, Device::MESSAGE_PREFIX prefi
 
   if (!msg)
     {
-      vtkErrorMacro("Sending OpenIGTLinkMessage: " << device_id.type << "/" << device_id.name << ", message not available from device");
+      vtkErrorMacro("Sending OpenIGTLinkMessage: " << device_id.GetType() << "/" << device_id.GetName() << ", message not available from device");
       return 1;
     }
 
-  int r = this->SendData(msg->GetPackSize(), (unsigned char*)msg->GetPackPointer());
+  int r = 0;
+  if (this->IsSendQueued())
+    {
+    // Devices reuse their message for the next send, so queue a copy.
+    igtl::MessageBase::Pointer copy = igtl::MessageBase::New();
+    this->Pool->AllocatePack(copy, msg->GetPackBodySize());
+    copy->Copy(msg);
+    std::string coalesceKey;
+    if (this->SendPolicy == SEND_LATEST)
+      {
+      coalesceKey = device_id.GetBaseTypeName() + "_" + device_id.GetName();
+      }
+    r = this->SendMessageAsync(copy, coalesceKey);
+    }
+  else
+    {
+    r = this->SendData(msg->GetPackSize(), (unsigned char*)msg->GetPackPointer());
+    }
   if (r == 0)
     {
-      vtkDebugMacro("Sending OpenIGTLinkMessage: " << device_id.type << "/" << device_id.name << " failed.");
+      vtkDebugMacro("Sending OpenIGTLinkMessage: " << device_id.GetType() << "/" << device_id.GetName() << " failed.");
       return 0;
     }
   return r;
@@ -820,6 +1900,97 @@ int Connector::SendMessage(DeviceKeyType device_id, Device::MESSAGE_PREFIX prefi
 //  return 0;
 }
 
+//---------------------------------------------------------------------------
+int Connector::SendMessageAsync(igtl::MessageBase::Pointer msg, const std::string& coalesceKey, vtkCommand* callback)
+{
+  if (this->Type == TYPE_SERVER && this->MaximumNumberOfClients > 1)
+    {
+    return this->Broadcast(msg, coalesceKey, callback);
+    }
+  return this->OutgoingQueue->Push(msg, coalesceKey, callback);
+}
+
+//---------------------------------------------------------------------------
+int Connector::SendImage(const ImageConverter::HeaderData& header, const ImageConverter::ContentData& content, vtkCommand* callback,
+                         const int* subVolumeExtent)
+{
+  if (this->IsSendQueued() && this->SendPolicy == SEND_LATEST)
+    {
+    subVolumeExtent = NULL;
+    }
+
+  ImageConverter::GatherData gather;
+  if (!ImageConverter::toIGTLGather(header, content, &gather, subVolumeExtent))
+    {
+    vtkErrorMacro("Sending image " << header.deviceName << " failed: invalid image");
+    return 0;
+    }
+
+  std::string coalesceKey;
+  if (this->IsSendQueued() && this->SendPolicy == SEND_LATEST)
+    {
+    coalesceKey = std::string(ImageConverter::GetIGTLTypeName()) + "_" + header.deviceName;
+    }
+  return this->SendGathered(gather, coalesceKey, callback);
+}
+
+//---------------------------------------------------------------------------
+int Connector::SendGathered(const ImageConverter::GatherData& gather, const std::string& coalesceKey, vtkCommand* callback)
+{
+  if (this->IsSendQueued())
+    {
+    if (this->Type == TYPE_SERVER && this->MaximumNumberOfClients > 1)
+      {
+      return this->Broadcast(gather.header, coalesceKey, callback, gather.pixels, gather.pixelSize, gather.pixelOwner);
+      }
+    return this->OutgoingQueue->PushGather(gather.header, gather.pixels, gather.pixelSize, gather.pixelOwner, coalesceKey, callback);
+    }
+
+  int r = 0;
+  if (this->Socket.IsNotNull() && this->Socket->GetConnected())
+    {
+    r = this->OutgoingQueue->SendGather(gather.header->GetPackPointer(), gather.header->GetPackSize(),
+                                        gather.pixels, gather.pixelSize);
+    }
+  if (callback)
+    {
+    callback->Execute(this->OutgoingQueue, r ? SendQueue::MessageSentEvent : SendQueue::MessageDroppedEvent,
+                      gather.header.GetPointer());
+    }
+  return r;
+}
+
+//---------------------------------------------------------------------------
+bool Connector::IsSendQueued()
+{
+  bool multipleClients = this->Type == TYPE_SERVER && this->MaximumNumberOfClients > 1;
+  return this->AsynchronousSend || multipleClients || this->OutgoingQueue->GetCoalesceWrites();
+}
+
+//---------------------------------------------------------------------------
+SendQueuePointer Connector::GetSendQueue()
+{
+  return this->OutgoingQueue;
+}
+
+//---------------------------------------------------------------------------
+WaitHandlePointer Connector::GetWaitHandle()
+{
+  return this->ConnectorWaitHandle;
+}
+
+//---------------------------------------------------------------------------
+BufferPoolPointer Connector::GetBufferPool()
+{
+  return this->Pool;
+}
+
+//---------------------------------------------------------------------------
+void Connector::SetBufferPool(BufferPoolPointer pool)
+{
+  this->Pool = pool ? pool : BufferPoolPointer::New();
+}
+
 DeviceFactoryPointer Connector::GetDeviceFactory()
 {
   return DeviceFactory;
@@ -833,6 +2004,21 @@ void Connector::SetDeviceFactory(DeviceFactoryPointer val)
   this->Modified();
 }
 
+//---------------------------------------------------------------------------
+ReactorPointer Connector::GetReactor()
+{
+  return this->IOReactor;
+}
+
+//---------------------------------------------------------------------------
+void Connector::SetReactor(ReactorPointer reactor)
+{
+  if (reactor==this->IOReactor)
+    return;
+  this->IOReactor = reactor;
+  this->Modified();
+}
+
 //---------------------------------------------------------------------------
 int Connector::PushNode(DevicePointer node, int event)
 {
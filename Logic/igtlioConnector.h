@@ -22,13 +22,22 @@
 // OpenIGTLink includes
 #include <igtlServerSocket.h>
 #include <igtlClientSocket.h>
+#include <igtlMessageHeader.h>
 
 // IGTLIO includes
 #include "igtlioLogicExport.h"
+#include "igtlioBufferPool.h"
 #include "igtlioDevice.h"
 #include "igtlioDeviceFactory.h"
+#include "igtlioDeviceRegistry.h"
+#include "igtlioImageCompressor.h"
+#include "igtlioImageConverter.h"
+#include "igtlioLockFree.h"
 #include "igtlioObject.h"
+#include "igtlioReactor.h"
+#include "igtlioSendQueue.h"
 #include "igtlioUtilities.h"
+#include "igtlioWaitHandle.h"
 
 //// MRML includes
 //#include <vtkMRML.h>
@@ -82,11 +91,16 @@ enum CONNECTION_ROLE
 ///     - Interprets messages from the receive buffer, i.e. converts messages
 ///       to Device content or handles query responses.
 ///
+///   If a running Reactor is set, the receiving is instead done by the
+///   shared reactor threads, using non-blocking I/O. Compressed images are
+///   then decompressed by the main thread and GET_CAPABIL answered through
+///   the send queue, so that no connector holds up the others.
+///
 /// Requirements:
 ///  - Call the Start() method in order to start the communication thread.
 ///  - Call the PeriodicProcess() method every N ms in order to do the
 ///    main thread processing. This should be handled externally by a timer
-///    or similar.
+///    or similar, or when GetWaitHandle() is signaled.
 ///
 class OPENIGTLINKIO_LOGIC_EXPORT Connector : public vtkIGTLIOObject
 {
@@ -105,13 +119,37 @@ public:
  void RemoveDevice(int index); //TODO: look at OnNodeReferenceRemoved
   int RemoveDevice(DevicePointer device);
  /// Get the given Device. This can be used to modify the Device contents.
+ /// Main thread only, the receiving threads use a lock-free lookup.
  DevicePointer GetDevice(int index);
  DevicePointer GetDevice(DeviceKeyType key);
 
  /// Request the given Device to send a message with the given prefix.
  /// An undefined prefix means sending the normal message.
+ /// Image devices with DeltaEncoding send DLT_IMAGE messages to peers
+ /// that support them, see ImageDevice::SetDeltaEncoding().
  int SendMessage(DeviceKeyType device_id, Device::MESSAGE_PREFIX=Device::MESSAGE_PREFIX_NOT_DEFINED);
 
+ /// Queue a packed message for sending by the writer thread. Thread safe.
+ /// Messages with the same non-empty coalesceKey replace each other
+ /// while queued. The message must not be modified until the callback
+ /// reports SendQueue::MessageSentEvent or MessageDroppedEvent.
+ /// With several clients, the message is queued (and reported) once per client.
+ /// Return 0 if the message was rejected, e.g. the queue is full (see GetSendQueue()).
+ int SendMessageAsync(igtl::MessageBase::Pointer msg, const std::string& coalesceKey="", vtkCommand* callback=NULL);
+
+ /// Send an image without copying its pixels into a message: the headers
+ /// and the pixels of content.image are sent with one gathered write.
+ /// SendMessage() uses it for image devices when not queuing.
+ /// When queuing (see SendMessage()), the image is referenced until sent,
+ /// and must not be modified until the callback reports
+ /// SendQueue::MessageSentEvent or MessageDroppedEvent. Otherwise the image
+ /// can be modified again when this returns, after the callback was called.
+ /// If subVolumeExtent is given, only this part of the image is sent,
+ /// except when queuing with SEND_LATEST: a queued sub-volume must not be
+ /// replaced by another one.
+ int SendImage(const ImageConverter::HeaderData& header, const ImageConverter::ContentData& content, vtkCommand* callback=NULL,
+               const int* subVolumeExtent=NULL);
+
  DeviceFactoryPointer GetDeviceFactory();
  void SetDeviceFactory(DeviceFactoryPointer val);
 
@@ -210,9 +248,77 @@ public:
   int SetTypeServer(int port);
   int SetTypeClient(std::string hostname, int port);
 
+  /// Maximum number of clients served at once by a server connector (default 1).
+  /// With more than one, messages are received from all clients, and
+  /// SendMessage() broadcasts to every client through its own SendQueue,
+  /// so that a slow client cannot stall the others.
+  /// Takes effect on the next Start(). Such servers always use dedicated threads.
+  vtkSetMacro( MaximumNumberOfClients, int );
+  vtkGetMacro( MaximumNumberOfClients, int );
+  int GetNumberOfClients();
+
   vtkGetMacro( CheckCRC, bool);
   void SetCheckCRC(bool c);
 
+  enum {
+    SEND_ALL,    // every message is sent
+    SEND_LATEST  // a queued message is replaced by the next one of the same device
+  };
+
+  /// If on, SendMessage() queues a copy of the device message and returns
+  /// without waiting for the network. Off by default.
+  vtkSetMacro( AsynchronousSend, bool );
+  vtkGetMacro( AsynchronousSend, bool );
+  vtkBooleanMacro( AsynchronousSend, bool );
+
+  /// Queuing policy of SendMessage() in asynchronous mode (default SEND_ALL).
+  vtkSetMacro( SendPolicy, int );
+  vtkGetMacro( SendPolicy, int );
+
+  /// Delivery of the messages received faster than PeriodicProcess()
+  /// imports them (see CircularBuffer): only the latest one (default),
+  /// all of them in order up to depth pending messages, or the most
+  /// recent depth ones. The policy of a device overrides the policy of its
+  /// type, e.g. "STATUS", which overrides the default. In reactor mode, a
+  /// full FIFO queue makes the connector stop reading its socket until it
+  /// is pulled, instead of waiting on the shared reactor thread.
+  void SetDefaultDeliveryPolicy(int policy, int depth=1);
+  void SetDeliveryPolicy(const std::string& deviceType, int policy, int depth=1);
+  void SetDeliveryPolicy(const DeviceKeyType& key, int policy, int depth=1);
+  /// Changing the policy of a device that already received messages
+  /// discards its pending messages.
+
+  /// Buffer of the messages received for the device, with its
+  /// overwrite and drop counters. NULL until a message is received.
+  CircularBufferPointer GetReceiveBuffer(const DeviceKeyType& key);
+
+  /// Lossless compression of the images sent (ImageCompressor::Codec),
+  /// CODEC_NONE by default. On connection, the peer is asked for its
+  /// capabilities, and images are compressed only if it is an
+  /// OpenIGTLinkIO peer supporting the codec: other peers get plain IMAGE
+  /// messages. CODEC_AUTO takes the fastest codec supported by both.
+  /// Received ZIMAGE messages are always decompressed.
+  void SetImageCompression(int codec);
+  vtkGetMacro( ImageCompression, int );
+  /// Codec negotiated with the connected peer, or the first client of a
+  /// multi-client server. CODEC_NONE until the peer replied.
+  int GetNegotiatedImageCompression();
+
+  /// Queue of the connected peer. Its limits and policies
+  /// also apply to the queues of each client of a multi-client server.
+  /// If its CoalesceWrites is on, SendMessage() queues the messages, and
+  /// those sent during one PeriodicProcess() tick are written together.
+  SendQueuePointer GetSendQueue();
+
+  /// Signaled when received data or events are pending, i.e. when
+  /// PeriodicProcess() has work to do. Cleared by PeriodicProcess().
+  WaitHandlePointer GetWaitHandle();
+
+  /// Pack buffers of the received messages and of the queued copies of
+  /// device messages. Connectors may share one pool.
+  BufferPoolPointer GetBufferPool();
+  void SetBufferPool(BufferPoolPointer pool);
+
   //----------------------------------------------------------------
   // Thread Control
   //----------------------------------------------------------------
@@ -220,17 +326,62 @@ public:
   int Start();
   int Stop();
 
+  /// Receive using the threads of the given reactor instead of a dedicated
+  /// thread. Takes effect on the next Start(), if the reactor is running.
+  void SetReactor(ReactorPointer reactor);
+  ReactorPointer GetReactor();
+
 private:
+  friend class Reactor;
+  struct ClientConnection;
 
   static void* ThreadFunction(void* ptr);
+  static void* ClientThreadFunction(void* ptr);
 
   //----------------------------------------------------------------
   // OpenIGTLink Message handlers
   //----------------------------------------------------------------
   int WaitForConnection(); // called from Thread
-  int ReceiveController(); // called from Thread
+  int ReceiveController(igtl::ClientSocket::Pointer socket, ClientConnection* client=NULL); // called from Thread
+  int AcceptHeader(igtl::MessageHeader::Pointer headerMsg); // called from Thread
+  static DeviceKeyType CreateReceiveKey(igtl::MessageHeader::Pointer headerMsg); // IMAGE key of a ZIMAGE message
+  igtl::MessageBase::Pointer StartReceiveBody(const DeviceKeyType& key, igtl::MessageHeader::Pointer headerMsg, CircularBufferPointer* circBuffer, ClientConnection* client=NULL); // called from Thread
+  void EndReceiveBody(const DeviceKeyType& key, CircularBufferPointer circBuffer, igtl::MessageBase::Pointer buffer, ClientConnection* client=NULL); // called from Thread
   int SendData(int size, unsigned char* data);
-  int Skip(int length, int skipFully=1);
+
+  //----------------------------------------------------------------
+  // Capabilities and image compression, handled by the connector
+  //----------------------------------------------------------------
+  static bool IsConnectionMessage(const char* deviceType);
+  igtl::MessageBase::Pointer DecompressImage(igtl::MessageBase::Pointer compressed); // called from main thread, ZIMAGE queued in reactor mode
+  igtl::MessageBase::Pointer StartReceiveConnectionMessage(igtl::MessageHeader::Pointer headerMsg, igtl::MessageBase::Pointer* staging); // called from Thread
+  int ReceiveConnectionMessage(igtl::MessageBase::Pointer message, ClientConnection* client=NULL); // called from Thread
+  void RequestPeerCapabilities(SendQueue* queue);
+  /// True if every peer accepts DLT_IMAGE, asking those that were not asked yet.
+  bool AcceptImageDelta();
+
+  //----------------------------------------------------------------
+  // Multiple clients
+  //----------------------------------------------------------------
+  void ServeClients(); // called from Thread
+  void RemoveClients(bool finishedOnly); // called from Thread
+  int Broadcast(igtl::MessageBase::Pointer msg, const std::string& coalesceKey, vtkCommand* callback,
+                const void* payload=NULL, long long payloadSize=0, vtkObject* payloadOwner=NULL);
+  int SendGathered(const ImageConverter::GatherData& gather, const std::string& coalesceKey, vtkCommand* callback);
+  bool IsSendQueued();
+  void FlushSendQueues();
+
+  //----------------------------------------------------------------
+  // Reactor mode
+  //----------------------------------------------------------------
+  int StartReactor();
+  int StopReactor();
+  void HandleReactorEvent(int events); // called from Reactor thread
+  void HandleReactorTimer(); // called from Reactor thread
+  void ReactorConnected(igtl::ClientSocket::Pointer socket); // called from Reactor thread
+  void ReactorDisconnected(); // called from Reactor thread
+  int ReceiveAvailable(); // called from Reactor thread
+  int StartReactorBody(); // called from Reactor thread, 0 if paused
 
   //----------------------------------------------------------------
   // Circular Buffer
@@ -239,6 +390,9 @@ private:
   typedef std::vector<DeviceKeyType> NameListType;
   unsigned int GetUpdatedBuffersList(NameListType& nameList); // TODO: this will be moved to private
   CircularBufferPointer GetCircularBuffer(const DeviceKeyType& key);     // TODO: Is it OK to use device name as a key?
+  CircularBufferPointer GetOrCreateCircularBuffer(const DeviceKeyType& key); // called from Thread
+  void ApplyDeliveryPolicy(const DeviceKeyType& key, CircularBuffer* circBuffer); // called with CircularBufferMutex locked
+  void ApplyDeliveryPolicies(); // called with CircularBufferMutex locked
 
   //----------------------------------------------------------------
   // Device Lists
@@ -282,7 +436,7 @@ private:
   //----------------------------------------------------------------
   // Devices
   //----------------------------------------------------------------
-  std::vector<DevicePointer> Devices;
+  DeviceRegistry Devices;
 
   //----------------------------------------------------------------
   // Connector configuration
@@ -307,21 +461,88 @@ private:
 
   std::string       ServerHostname;
 
+  // Sends to the connected peer, either queued or from the calling thread.
+  SendQueuePointer  OutgoingQueue;
+  WaitHandlePointer ConnectorWaitHandle;
+  BufferPoolPointer Pool;
+  bool              AsynchronousSend;
+  int               SendPolicy;
+  int               ImageCompression;
+
+  // Server with more than one client: one receive thread and
+  // one SendQueue per client
+  int               MaximumNumberOfClients;
+  std::vector<ClientConnection*> Clients;
+  vtkMutexLockPointer     ClientsMutex;
+  vtkMultiThreaderPointer ClientThreads;
+
+  //----------------------------------------------------------------
+  // Reactor
+  //----------------------------------------------------------------
+
+  ReactorPointer    IOReactor;
+  bool              ReactorActive;            // true if started in reactor mode
+  int               ReactorConnectDescriptor; // client connect in progress, -1 otherwise
+  double            ReactorRetryTime;         // earliest time of the next connect attempt
+
+  // Partially received message, completed by successive non-blocking reads
+  igtl::MessageHeader::Pointer ReactorHeader;
+  igtl::MessageBase::Pointer   ReactorBody;   // NULL while receiving the header
+  CircularBufferPointer        ReactorBuffer;
+  DeviceKeyType                ReactorKey;
+  int                          ReactorOffset;
+  igtlUint64                   ReactorSkip;   // body bytes to discard
+  igtl::MessageBase::Pointer   ReactorStaging; // receives GET_CAPABIL messages
+  vtkAtomic<int>               ReactorPaused;  // socket not read until the full FIFO queue of ReactorKey is pulled
+
   //----------------------------------------------------------------
   // Data
   //----------------------------------------------------------------
 
 
-  typedef std::map<DeviceKeyType, CircularBufferPointer> CircularBufferMap;
-  CircularBufferMap Buffer;
+  // Indexed by DeviceKeyType::GetId(), NULL for devices not received yet.
+  // Read without locking by the receiving threads and the main thread:
+  // grown by copy-and-swap and updated under CircularBufferMutex. The
+  // tables and buffers it replaces are kept until destruction, as a reader
+  // may still be using them.
+  struct BufferTable
+  {
+    unsigned int Size;
+    vtkAtomic<CircularBuffer*>* Buffers;
+  };
+  vtkAtomic<BufferTable*> Buffers;
+  std::vector<BufferTable*> BufferTables;     // current one last
+  std::vector<CircularBufferPointer> BufferOwners; // every buffer created
+  NameListType BufferKeys; // keys of the buffers, in creation order
+
+  // Keys of the buffers with new messages, each listed once until the main
+  // thread imports it. Swapped with ImportKeys by GetUpdatedBuffersList().
+  NameListType ReadyKeys;
+  NameListType ImportKeys;
+  igtl::MessageHeader::Pointer ImportImageHeader; // of the ZIMAGE being imported
+  igtl::MessageBase::Pointer   ImportImage;       // decompressed ZIMAGE, adopted by the device
+  vtkMutexLockPointer ReadyKeysMutex;
 
   vtkMutexLockPointer CircularBufferMutex;
+
+  struct DeliveryPolicyType
+  {
+    int Policy;
+    int Depth;
+  };
+  DeliveryPolicyType DefaultDeliveryPolicy;
+  std::map<std::string, DeliveryPolicyType> TypeDeliveryPolicies;
+  std::map<DeviceKeyType, DeliveryPolicyType> DeviceDeliveryPolicies;
   int           RestrictDeviceName;  // Flag to restrict incoming and outgoing data by device names
 
   // Event queueing mechanism is needed to send all event notifications from the main thread.
   // Events can be pushed to the end of the EventQueue by calling RequestInvoke from any thread,
   // and they will be Invoked in the main thread.
-  std::list<unsigned long> EventQueue;
+  // Only one thread requests events at a time: the connector thread, or the
+  // reactor thread, or the main thread once they are stopped.
+  SPSCRing<unsigned long> EventQueue;
+  std::list<unsigned long> EventOverflow; // used when EventQueue is full
+  vtkAtomic<int> EventOverflowSize;
   vtkMutexLockPointer EventQueueMutex;
 
   // Flag for the push outoing message request
@@ -12,6 +12,8 @@
 #include "igtlioStatusDevice.h"
 #include "igtlioCommandDevice.h"
 #include "igtlioTransformDevice.h"
+#include "igtlioPolyDataDevice.h"
+#include "igtlioUtilities.h"
 
 namespace igtlio
 {
@@ -25,6 +27,7 @@ DeviceFactory::DeviceFactory()
   this->registerCreator<StatusDeviceCreator>();
   this->registerCreator<CommandDeviceCreator>();
   this->registerCreator<igtlio::TransformDeviceCreator>();
+  this->registerCreator<PolyDataDeviceCreator>();
 }
 
 //---------------------------------------------------------------------------
@@ -38,7 +41,7 @@ void DeviceFactory::PrintSelf(ostream &os, vtkIndent indent)
 }
 
 //---------------------------------------------------------------------------
-vtkIGTLIODeviceCreatorPointer DeviceFactory::GetCreator(std::string device_type) const
+vtkIGTLIODeviceCreatorPointer DeviceFactory::GetCreator(const std::string& device_type) const
 {
   std::map<std::string, vtkIGTLIODeviceCreatorPointer>::const_iterator iter = Creators.find(device_type);
   if (iter==Creators.end())
@@ -69,6 +72,16 @@ DevicePointer DeviceFactory::create(std::string device_type, std::string device_
   return creator->Create(device_name);
 }
 
+//---------------------------------------------------------------------------
+igtl::MessageBase::Pointer DeviceFactory::CreateReceiveMessage(igtl::MessageBase::Pointer header) const
+{
+  DeviceKeyType key = CreateDeviceKey(header);
+  vtkIGTLIODeviceCreatorPointer creator = this->GetCreator(key.GetBaseTypeName());
+  if (!creator)
+    return igtl::MessageBase::New();
+  return creator->CreateReceiveMessage(key.GetType());
+}
+
 //---------------------------------------------------------------------------
 template<class CREATOR_TYPE>
 void DeviceFactory::registerCreator()
@@ -33,13 +33,18 @@ class OPENIGTLINKIO_LOGIC_EXPORT DeviceFactory : public vtkObject
 
   void PrintSelf(ostream& os, vtkIndent indent);
 
-  vtkIGTLIODeviceCreatorPointer GetCreator(std::string device_type) const;
+  vtkIGTLIODeviceCreatorPointer GetCreator(const std::string& device_type) const;
   std::vector<std::string> GetAvailableDeviceTypes() const;
 
   // Create a Device object based on an input device_type
   // TODO: Should we accept prefixed message types as well?
   DevicePointer create(std::string device_type, std::string device_name) const;
 
+  // Create an empty igtl message of the concrete type matching the incoming
+  // header, so that the body can be received and unpacked in place.
+  // Falls back to a plain MessageBase for unknown types.
+  igtl::MessageBase::Pointer CreateReceiveMessage(igtl::MessageBase::Pointer header) const;
+
 protected:
   DeviceFactory();
   virtual ~DeviceFactory();
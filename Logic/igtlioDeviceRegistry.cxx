@@ -0,0 +1,150 @@
+#include "igtlioDeviceRegistry.h"
+#include "igtlioDevice.h"
+
+namespace igtlio
+{
+
+//---------------------------------------------------------------------------
+int DeviceRegistry::Version::Find(const DeviceKeyType& key) const
+{
+  unsigned int id = key.GetId();
+  if (id >= this->Index.size())
+    return -1;
+  return static_cast<int>(this->Index[id]) - 1;
+}
+
+//---------------------------------------------------------------------------
+DeviceRegistry::DeviceRegistry()
+{
+  this->Current = new Version;
+  this->NumberOfReaders = 0;
+}
+
+//---------------------------------------------------------------------------
+DeviceRegistry::~DeviceRegistry()
+{
+  Version* current = this->Current;
+  delete current;
+  for (unsigned i=0; i<this->Retired.size(); ++i)
+    {
+    delete this->Retired[i];
+    }
+}
+
+//---------------------------------------------------------------------------
+bool DeviceRegistry::Add(DevicePointer device)
+{
+  DeviceKeyType key = CreateDeviceKey(device);
+  const Version* current = this->Current;
+  if (current->Find(key) >= 0)
+    {
+    return false;
+    }
+
+  Version* version = new Version(*current);
+  version->Devices.push_back(device);
+  version->Keys.push_back(key);
+  if (key.GetId() >= version->Index.size())
+    {
+    version->Index.resize(DeviceKeyType::GetNumberOfIds(), 0);
+    }
+  version->Index[key.GetId()] = static_cast<unsigned int>(version->Devices.size());
+  this->Publish(version);
+  return true;
+}
+
+//---------------------------------------------------------------------------
+DevicePointer DeviceRegistry::Remove(const DeviceKeyType& key)
+{
+  const Version* current = this->Current;
+  int index = current->Find(key);
+  if (index < 0)
+    {
+    return DevicePointer();
+    }
+  return this->RemoveAt(index);
+}
+
+//---------------------------------------------------------------------------
+DevicePointer DeviceRegistry::RemoveAt(unsigned int index)
+{
+  const Version* current = this->Current;
+  if (index >= current->Devices.size())
+    {
+    return DevicePointer();
+    }
+  DevicePointer device = current->Devices[index];
+
+  Version* version = new Version(*current);
+  version->Devices.erase(version->Devices.begin()+index);
+  version->Keys.erase(version->Keys.begin()+index);
+  version->Index[current->Keys[index].GetId()] = 0;
+  for (unsigned i=index; i<version->Keys.size(); ++i)
+    {
+    version->Index[version->Keys[i].GetId()] = i+1;
+    }
+  this->Publish(version);
+  return device;
+}
+
+//---------------------------------------------------------------------------
+unsigned int DeviceRegistry::GetNumberOfDevices() const
+{
+  const Version* current = this->Current;
+  return static_cast<unsigned int>(current->Devices.size());
+}
+
+//---------------------------------------------------------------------------
+DevicePointer DeviceRegistry::GetDevice(unsigned int index) const
+{
+  const Version* current = this->Current;
+  return current->Devices[index];
+}
+
+//---------------------------------------------------------------------------
+DevicePointer DeviceRegistry::Find(const DeviceKeyType& key) const
+{
+  const Version* current = this->Current;
+  int index = current->Find(key);
+  if (index < 0)
+    {
+    return DevicePointer();
+    }
+  return current->Devices[index];
+}
+
+//---------------------------------------------------------------------------
+bool DeviceRegistry::Contains(const DeviceKeyType& key) const
+{
+  // Registered before loading the version: Reclaim() frees a version only
+  // if it saw no reader after the version was replaced.
+  ++this->NumberOfReaders;
+  const Version* current = this->Current;
+  bool found = current->Find(key) >= 0;
+  --this->NumberOfReaders;
+  return found;
+}
+
+//---------------------------------------------------------------------------
+void DeviceRegistry::Publish(Version* version)
+{
+  Version* current = this->Current;
+  this->Retired.push_back(current);
+  this->Current = version;
+}
+
+//---------------------------------------------------------------------------
+void DeviceRegistry::Reclaim()
+{
+  if (this->Retired.empty() || this->NumberOfReaders != 0)
+    {
+    return;
+    }
+  for (unsigned i=0; i<this->Retired.size(); ++i)
+    {
+    delete this->Retired[i];
+    }
+  this->Retired.clear();
+}
+
+} // namespace igtlio
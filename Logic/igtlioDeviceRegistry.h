@@ -0,0 +1,76 @@
+#ifndef IGTLIODEVICEREGISTRY_H
+#define IGTLIODEVICEREGISTRY_H
+
+// IGTLIO includes
+#include "igtlioLogicExport.h"
+#include "igtlioUtilities.h"
+
+// VTK includes
+#include <vtkAtomic.h>
+
+// STD includes
+#include <vector>
+
+namespace igtlio
+{
+
+/// The devices of a Connector, indexed by DeviceKeyType.
+///
+/// The list is copied on write: the main thread publishes a new version
+/// for each change, so that the I/O threads can look keys up without
+/// locking, and without ever blocking the main thread.
+///
+/// Threading:
+///  - Add(), Remove(), Reclaim() and the index based accessors are only
+///    called from the main thread.
+///  - Contains() can be called from any thread.
+///
+/// Replaced versions are kept until Reclaim() finds no reader active,
+/// so the main thread may iterate over a version while it changes.
+///
+class OPENIGTLINKIO_LOGIC_EXPORT DeviceRegistry
+{
+public:
+  DeviceRegistry();
+  ~DeviceRegistry();
+
+  /// Return false if a device with the same key is present.
+  bool Add(DevicePointer device);
+  /// Remove the device with the key. Return the removed device, or NULL.
+  DevicePointer Remove(const DeviceKeyType& key);
+  DevicePointer RemoveAt(unsigned int index);
+
+  unsigned int GetNumberOfDevices() const;
+  DevicePointer GetDevice(unsigned int index) const;
+  /// The device with the key, or NULL. Main thread.
+  DevicePointer Find(const DeviceKeyType& key) const;
+
+  /// Lock-free lookup, from any thread.
+  bool Contains(const DeviceKeyType& key) const;
+
+  /// Free the replaced versions no thread is reading.
+  /// Called regularly from the main thread, e.g. by PeriodicProcess().
+  void Reclaim();
+
+private:
+  DeviceRegistry(const DeviceRegistry&); // Not implemented
+  void operator=(const DeviceRegistry&); // Not implemented
+
+  struct Version
+  {
+    std::vector<DevicePointer> Devices;
+    std::vector<DeviceKeyType> Keys;   // same order as Devices
+    std::vector<unsigned int> Index;   // by key id: position+1, 0 if absent
+    int Find(const DeviceKeyType& key) const;
+  };
+
+  void Publish(Version* version);
+
+  vtkAtomic<Version*> Current;
+  mutable vtkAtomic<int> NumberOfReaders;
+  std::vector<Version*> Retired;
+};
+
+} // namespace igtlio
+
+#endif // IGTLIODEVICEREGISTRY_H
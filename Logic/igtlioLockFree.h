@@ -0,0 +1,148 @@
+#ifndef IGTLIOLOCKFREE_H
+#define IGTLIOLOCKFREE_H
+
+// VTK includes
+#include <vtkAtomic.h>
+
+// STD includes
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace igtlio
+{
+
+/// Atomically replace the value, and return the previous one.
+/// Full memory barrier.
+inline int AtomicExchange(volatile int* target, int value)
+{
+#if defined(_MSC_VER)
+  return _InterlockedExchange(reinterpret_cast<volatile long*>(target), value);
+#else
+  // __sync_lock_test_and_set() is only an acquire barrier.
+  __sync_synchronize();
+  return __sync_lock_test_and_set(target, value);
+#endif
+}
+
+/// Atomically replace the value if it is the expected one. Return true if
+/// it was replaced. Full memory barrier.
+inline bool AtomicCompareAndSwap(volatile unsigned int* target, unsigned int expected, unsigned int value)
+{
+#if defined(_MSC_VER)
+  return _InterlockedCompareExchange(reinterpret_cast<volatile long*>(target),
+                                     static_cast<long>(value), static_cast<long>(expected))
+    == static_cast<long>(expected);
+#else
+  return __sync_bool_compare_and_swap(target, expected, value);
+#endif
+}
+
+/// Read the value. Full memory barrier.
+inline unsigned int AtomicLoad(volatile unsigned int* target)
+{
+#if defined(_MSC_VER)
+  return static_cast<unsigned int>(_InterlockedOr(reinterpret_cast<volatile long*>(target), 0));
+#else
+  return __sync_fetch_and_add(target, 0);
+#endif
+}
+
+/// Wait-free ring for one producer thread and one consumer thread.
+///
+/// Storage is allocated once by Reserve(), which must not be called while
+/// the ring is in use. Push() is only called by the producer. Pop() is
+/// lock-free and may also be called by the producer, e.g. to drop the
+/// oldest item when it runs out of room elsewhere. The producer (resp.
+/// consumer) role may move to another thread, provided the threads are
+/// synchronized at the handover, e.g. by joining the previous one.
+///
+/// T is copied by Pop() before the item is claimed, so it must be cheap
+/// and safe to copy while being overwritten, e.g. an integer.
+template <class T>
+class SPSCRing
+{
+public:
+  SPSCRing(unsigned int capacity=0) : Mask(0), Head(0), Tail(0)
+  {
+    this->Reserve(capacity);
+  }
+
+  /// Allocate room for at least capacity items. Discards the content.
+  void Reserve(unsigned int capacity)
+  {
+    unsigned int size = 1;
+    while (size < capacity)
+      {
+      size *= 2;
+      }
+    this->Items.assign(size, T());
+    this->Mask = size - 1;
+    this->Head = 0;
+    this->Tail = 0;
+  }
+
+  unsigned int GetCapacity() const
+  {
+    return this->Mask + 1;
+  }
+
+  /// Number of items, exact from either thread when the other is idle.
+  unsigned int GetSize() const
+  {
+    unsigned int head = this->Head;
+    unsigned int tail = AtomicLoad(&this->Tail);
+    return head - tail;
+  }
+
+  /// Producer: append an item. Return false if the ring is full.
+  bool Push(const T& item)
+  {
+    unsigned int head = this->Head;
+    unsigned int tail = AtomicLoad(&this->Tail);
+    if (head - tail > this->Mask)
+      {
+      return false;
+      }
+    this->Items[head & this->Mask] = item;
+    this->Head = head + 1; // publishes the item
+    return true;
+  }
+
+  /// Remove the oldest item. Return false if the ring is empty.
+  bool Pop(T& item)
+  {
+    for (;;)
+      {
+      unsigned int tail = AtomicLoad(&this->Tail);
+      unsigned int head = this->Head;
+      if (head == tail)
+        {
+        return false;
+        }
+      T candidate = this->Items[tail & this->Mask];
+      if (AtomicCompareAndSwap(&this->Tail, tail, tail + 1)) // releases the storage
+        {
+        item = candidate;
+        return true;
+        }
+      }
+  }
+
+private:
+  SPSCRing(const SPSCRing&); // Not implemented
+  void operator=(const SPSCRing&); // Not implemented
+
+  std::vector<T> Items;
+  unsigned int Mask;
+  // Free running counters, only the producer writes Head, Tail is advanced
+  // by compare-and-swap. vtkAtomic accesses are sequentially consistent.
+  vtkAtomic<unsigned int> Head;
+  mutable volatile unsigned int Tail; // read with a full barrier
+};
+
+} // namespace igtlio
+
+#endif // IGTLIOLOCKFREE_H
@@ -16,6 +16,7 @@
 // IGTLIO includes
 #include "igtlioLogic.h"
 #include "igtlioConnector.h"
+#include "igtlioReactor.h"
 #include "igtlioSession.h"
 
 #include <vtkObjectFactory.h>
@@ -34,9 +35,10 @@ namespace igtlio
 void onNewDeviceEventFunc(vtkObject* caller, unsigned long eid, void* clientdata, void *calldata)
 {
   Logic* logic = reinterpret_cast<Logic*>(clientdata);
+  Device* device = reinterpret_cast<Device*>(calldata);
+  logic->AddToDeviceList(device);
   logic->InvokeEvent(Logic::NewDeviceEvent, calldata);
 
-  Device* device = reinterpret_cast<Device*>(calldata);
   device->AddObserver(Device::CommandQueryReceivedEvent, logic->DeviceEventCallback);
   device->AddObserver(Device::CommandResponseReceivedEvent, logic->DeviceEventCallback);
 }
@@ -45,9 +47,10 @@ void onNewDeviceEventFunc(vtkObject* caller, unsigned long eid, void* clientdata
 void onRemovedDeviceEventFunc(vtkObject* caller, unsigned long eid, void* clientdata, void *calldata)
 {
   Logic* logic = reinterpret_cast<Logic*>(clientdata);
+  Device* device = reinterpret_cast<Device*>(calldata);
+  logic->RemoveFromDeviceList(device);
   logic->InvokeEvent(Logic::RemovedDeviceEvent, calldata);
 
-  Device* device = reinterpret_cast<Device*>(calldata);
   device->RemoveObserver(logic->DeviceEventCallback);
 }
 
@@ -71,6 +74,8 @@ vtkStandardNewMacro(Logic);
 //---------------------------------------------------------------------------
 Logic::Logic()
 {
+  LogicWaitHandle = WaitHandlePointer::New();
+
   NewDeviceCallback = vtkSmartPointer<vtkCallbackCommand>::New();
   NewDeviceCallback->SetCallback(onNewDeviceEventFunc);
   NewDeviceCallback->SetClientData(this);
@@ -104,6 +109,8 @@ ConnectorPointer Logic::CreateConnector()
   std::stringstream ss;
   ss << "IGTLConnector_" << connector->GetUID();
   connector->SetName(ss.str());
+  connector->SetReactor(this->IOReactor);
+  connector->GetWaitHandle()->SetParent(LogicWaitHandle);
   Connectors.push_back(connector);
 
   connector->AddObserver(Connector::NewDeviceEvent, NewDeviceCallback);
@@ -131,6 +138,10 @@ int Logic::RemoveConnector(unsigned int index)
 
   toRemove->GetPointer()->RemoveObserver(NewDeviceCallback);
   toRemove->GetPointer()->RemoveObserver(RemovedDeviceCallback);
+  for (unsigned i=0; i<(*toRemove)->GetNumberOfDevices(); ++i)
+    {
+    this->RemoveFromDeviceList((*toRemove)->GetDevice(i));
+    }
 
   this->InvokeEvent(ConnectionAboutToBeRemovedEvent, toRemove->GetPointer());
   Connectors.erase(toRemove);
@@ -172,62 +183,145 @@ vtkIGTLIOSessionPointer Logic::ConnectToServer(std::string serverHost, int serve
 //---------------------------------------------------------------------------
 void Logic::PeriodicProcess()
 {
+  LogicWaitHandle->Clear();
   for (unsigned i=0; i<Connectors.size(); ++i)
     {
       Connectors[i]->PeriodicProcess();
     }
 }
 
+//---------------------------------------------------------------------------
+WaitHandlePointer Logic::GetWaitHandle()
+{
+  return LogicWaitHandle;
+}
+
+//---------------------------------------------------------------------------
+void Logic::SetNumberOfIOThreads(int n)
+{
+  if (n == this->GetNumberOfIOThreads())
+    return;
+
+  // Connectors using the previous reactor keep it alive until they are deleted.
+  this->IOReactor = NULL;
+
+  if (n > 0)
+    {
+    ReactorPointer reactor = ReactorPointer::New();
+    reactor->SetNumberOfThreads(n);
+    if (reactor->Start())
+      {
+      this->IOReactor = reactor;
+      }
+    else
+      {
+      vtkWarningMacro("I/O reactor not available, using one thread per connector.");
+      }
+    }
+
+  for (unsigned i=0; i<Connectors.size(); ++i)
+    {
+    if (Connectors[i]->GetState() == Connector::STATE_OFF)
+      Connectors[i]->SetReactor(this->IOReactor);
+    }
+  this->Modified();
+}
+
+//---------------------------------------------------------------------------
+int Logic::GetNumberOfIOThreads() const
+{
+  if (!this->IOReactor)
+    return 0;
+  return this->IOReactor->GetNumberOfThreads();
+}
+
 //---------------------------------------------------------------------------
 unsigned int Logic::GetNumberOfDevices() const
 {
-  std::vector<DevicePointer> all = this->CreateDeviceList();
-  return all.size();
+  return DeviceList.size();
 }
 
 //---------------------------------------------------------------------------
 void Logic::RemoveDevice(unsigned int index)
 {
   DevicePointer device = this->GetDevice(index);
+  if (!device)
+    return;
 
-  for (unsigned i=0; i<Connectors.size(); ++i)
+  // Each removal updates DeviceList through the connector events.
+  std::vector<ConnectorPointer> connectors = Connectors;
+  for (unsigned i=0; i<connectors.size(); ++i)
     {
-      for (unsigned j=0; j<Connectors[i]->GetNumberOfDevices(); ++j)
-        {
-          DevicePointer local = Connectors[i]->GetDevice(j);
-          if (device==local)
-            Connectors[i]->RemoveDevice(j);
-        }
+      if (connectors[i]->GetDevice(CreateDeviceKey(device)) == device)
+        connectors[i]->RemoveDevice(device);
     }
 }
 
 //---------------------------------------------------------------------------
 DevicePointer Logic::GetDevice(unsigned int index)
 {
-  // TODO: optimize by caching the vector if necessary
-  std::vector<DevicePointer> all = this->CreateDeviceList();
-
-  if (index>=0 && index<all.size())
-    return all[index];
+  if (index<DeviceList.size())
+    return DeviceList[index];
 
   vtkErrorMacro("index " << index << " out of bounds.");
   return NULL;
 }
 
 //---------------------------------------------------------------------------
-std::vector<DevicePointer> Logic::CreateDeviceList() const
+DevicePointer Logic::GetDevice(const DeviceKeyType& key)
 {
-  std::set<DevicePointer> all;
+  unsigned int id = key.GetId();
+  if (id<DeviceIndex.size() && DeviceIndex[id]>0)
+    return DeviceList[DeviceIndex[id]-1];
+  return NULL;
+}
 
-  for (unsigned i=0; i<Connectors.size(); ++i)
+//---------------------------------------------------------------------------
+void Logic::AddToDeviceList(Device* device)
+{
+  // The same device may be shared by several connectors.
+  if (DeviceReferences[device]++ > 0)
+    return;
+
+  DeviceList.push_back(device);
+  DeviceKeyType key = CreateDeviceKey(device);
+  if (key.GetId() >= DeviceIndex.size())
+    DeviceIndex.resize(DeviceKeyType::GetNumberOfIds(), 0);
+  if (DeviceIndex[key.GetId()] == 0)
+    DeviceIndex[key.GetId()] = DeviceList.size();
+}
+
+//---------------------------------------------------------------------------
+void Logic::RemoveFromDeviceList(Device* device)
+{
+  std::map<Device*, int>::iterator iter = DeviceReferences.find(device);
+  if (iter == DeviceReferences.end() || --iter->second > 0)
+    return;
+  DeviceReferences.erase(iter);
+
+  for (unsigned i=0; i<DeviceList.size(); ++i)
     {
-      for (unsigned j=0; j<Connectors[i]->GetNumberOfDevices(); ++j)
+      if (DeviceList[i] == device)
         {
-          all.insert(Connectors[i]->GetDevice(j));
+        DeviceList.erase(DeviceList.begin()+i);
+        break;
         }
     }
+  this->RebuildDeviceIndex();
+}
 
-  return std::vector<DevicePointer>(all.begin(), all.end());
+//---------------------------------------------------------------------------
+void Logic::RebuildDeviceIndex()
+{
+  // Positions shift after a removal, which is rare compared to lookups.
+  std::fill(DeviceIndex.begin(), DeviceIndex.end(), 0);
+  for (unsigned i=DeviceList.size(); i>0; --i)
+    {
+      unsigned int id = CreateDeviceKey(DeviceList[i-1]).GetId();
+      if (id >= DeviceIndex.size())
+        DeviceIndex.resize(DeviceKeyType::GetNumberOfIds(), 0);
+      DeviceIndex[id] = i;
+    }
 }
 
 } // namespace igtlio
@@ -33,12 +33,14 @@
 #include <vtkMultiThreader.h>
 
 // STD includes
+#include <map>
 #include <vector>
 
 // IGTLIO includes
 #include "igtlioLogicExport.h"
 #include "igtlioDevice.h"
 #include "igtlioUtilities.h"
+#include "igtlioWaitHandle.h"
 
 namespace igtlio
 {
@@ -47,6 +49,7 @@ typedef vtkSmartPointer<class Logic> LogicPointer;
 
 typedef vtkSmartPointer<class Connector> ConnectorPointer;
 typedef vtkSmartPointer<class vtkIGTLIOSession> vtkIGTLIOSessionPointer;
+typedef vtkSmartPointer<class Reactor> ReactorPointer;
 
 
 /// Logic is the manager for the IGTLIO module.
@@ -67,7 +70,8 @@ typedef vtkSmartPointer<class vtkIGTLIOSession> vtkIGTLIOSessionPointer;
 /// Requirements:
 ///  - Call the PeriodicProcess() method every N ms in order to do the
 ///    main thread processing. This should be handled externally by a timer
-///    or similar.
+///    or similar. Alternatively, watch the descriptor of GetWaitHandle()
+///    and call PeriodicProcess() when it becomes readable.
 ///
 class OPENIGTLINKIO_LOGIC_EXPORT Logic : public vtkObject
 {
@@ -104,10 +108,27 @@ public:
  /// Call timer-driven routines for each connector
  void PeriodicProcess();
 
- //TODO: interface for accessing Devices
+ /// Signaled when any connector has work for PeriodicProcess(), which
+ /// clears it. Timeouts (e.g. of command queries) still need a slow timer.
+ WaitHandlePointer GetWaitHandle();
+
+ /// Receive on a pool of n I/O threads shared by all connectors created
+ /// afterwards, instead of one thread per connector. 0 (default) disables
+ /// the pool. Connectors already started keep their current mode.
+ void SetNumberOfIOThreads(int n);
+ int GetNumberOfIOThreads() const;
+
+ /// Devices of all connectors, each listed once, in order of addition.
+ /// The list is maintained from the connector events: counts, indexed
+ /// and by-key access are O(1).
  unsigned int GetNumberOfDevices() const;
  void RemoveDevice(unsigned int index);
  DevicePointer GetDevice(unsigned int index);
+ /// The first device with the key, or NULL.
+ DevicePointer GetDevice(const DeviceKeyType& key);
+ /// All devices, without copying. The reference is invalidated when devices
+ /// are added or removed: copy the vector to keep a snapshot.
+ const std::vector<DevicePointer>& GetDevices() const { return DeviceList; }
 
 
 protected:
@@ -116,13 +137,19 @@ protected:
 
 private:
  std::vector<ConnectorPointer> Connectors;
+ ReactorPointer IOReactor;
+ WaitHandlePointer LogicWaitHandle;
 
 private:
   Logic(const Logic&); // Not implemented
   void operator=(const Logic&); // Not implemented
 
   int CreateUniqueConnectorID() const;
-  std::vector<DevicePointer> CreateDeviceList() const;
+  void RebuildDeviceIndex();
+
+  std::vector<DevicePointer> DeviceList;
+  std::map<Device*, int> DeviceReferences; // number of connectors holding each device
+  std::vector<unsigned int> DeviceIndex;   // by key id: position+1 in DeviceList, 0 if absent
 
   vtkSmartPointer<class vtkCallbackCommand> NewDeviceCallback;
   vtkSmartPointer<class vtkCallbackCommand> RemovedDeviceCallback;
@@ -130,6 +157,10 @@ private:
 public:
   vtkSmartPointer<class vtkCallbackCommand> DeviceEventCallback;
 
+  // Called by the connector event callbacks.
+  void AddToDeviceList(Device* device);
+  void RemoveFromDeviceList(Device* device);
+
 };
 } // namespace igtlio
 
@@ -0,0 +1,317 @@
+#include "igtlioReactor.h"
+#include "igtlioConnector.h"
+
+// VTK includes
+#include <vtkMultiThreader.h>
+#include <vtkMutexLock.h>
+#include <vtkObjectFactory.h>
+
+// STD includes
+#include <algorithm>
+
+#if defined(__linux__)
+#define IGTLIO_USE_EPOLL
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+namespace igtlio
+{
+
+// Timeout of one wait, also the period of the connectors' timers.
+static const int IGTLIO_REACTOR_TIMEOUT_MS = 100;
+static const int IGTLIO_REACTOR_MAX_EVENTS = 64;
+
+//---------------------------------------------------------------------------
+vtkStandardNewMacro(Reactor);
+
+//---------------------------------------------------------------------------
+Reactor::Reactor()
+{
+  this->NumberOfThreads = 1;
+  this->Threader = vtkMultiThreaderPointer::New();
+  this->ConnectorThreadsMutex = vtkMutexLockPointer::New();
+}
+
+//---------------------------------------------------------------------------
+Reactor::~Reactor()
+{
+  this->Stop();
+}
+
+//---------------------------------------------------------------------------
+void Reactor::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->vtkObject::PrintSelf(os, indent);
+  os << indent << "Number of threads: " << this->NumberOfThreads << "\n";
+  os << indent << "Running: " << this->IsRunning() << "\n";
+  for (unsigned i=0; i<this->Threads.size(); ++i)
+    {
+    os << indent << "Thread " << i << ": " << this->Threads[i]->Connectors.size() << " connectors\n";
+    }
+}
+
+//---------------------------------------------------------------------------
+void Reactor::SetNumberOfThreads(int n)
+{
+  if (this->IsRunning())
+    {
+    vtkErrorMacro("Cannot change the number of threads of a running reactor.");
+    return;
+    }
+  n = std::max(n, 1);
+  if (n == this->NumberOfThreads)
+    return;
+  this->NumberOfThreads = n;
+  this->Modified();
+}
+
+//---------------------------------------------------------------------------
+int Reactor::Start()
+{
+  if (this->IsRunning())
+    return 1;
+
+#ifdef IGTLIO_USE_EPOLL
+  for (int i=0; i<this->NumberOfThreads; ++i)
+    {
+    IOThread* thread = new IOThread;
+    thread->Self = this;
+    thread->StopFlag = false;
+    thread->Mutex = vtkMutexLockPointer::New();
+    thread->EpollDescriptor = epoll_create1(0);
+    thread->WakeupDescriptor = eventfd(0, EFD_NONBLOCK);
+    if (thread->EpollDescriptor < 0 || thread->WakeupDescriptor < 0)
+      {
+      vtkErrorMacro("Failed to create epoll instance: " << strerror(errno));
+      if (thread->EpollDescriptor >= 0)
+        close(thread->EpollDescriptor);
+      if (thread->WakeupDescriptor >= 0)
+        close(thread->WakeupDescriptor);
+      delete thread;
+      this->Stop();
+      return 0;
+      }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL; // NULL marks the wakeup descriptor
+    epoll_ctl(thread->EpollDescriptor, EPOLL_CTL_ADD, thread->WakeupDescriptor, &ev);
+
+    this->Threads.push_back(thread);
+    thread->ThreadID = this->Threader->SpawnThread((vtkThreadFunctionType) &Reactor::ThreadFunction, thread);
+    }
+  return 1;
+#else
+  vtkErrorMacro("The I/O reactor is not supported on this platform.");
+  return 0;
+#endif
+}
+
+//---------------------------------------------------------------------------
+int Reactor::Stop()
+{
+  if (!this->IsRunning())
+    return 0;
+
+#ifdef IGTLIO_USE_EPOLL
+  for (unsigned i=0; i<this->Threads.size(); ++i)
+    {
+    IOThread* thread = this->Threads[i];
+    thread->StopFlag = true;
+    uint64_t one = 1;
+    if (write(thread->WakeupDescriptor, &one, sizeof(one)) < 0)
+      {
+      vtkWarningMacro("Failed to wake up I/O thread " << i);
+      }
+    }
+  for (unsigned i=0; i<this->Threads.size(); ++i)
+    {
+    IOThread* thread = this->Threads[i];
+    this->Threader->TerminateThread(thread->ThreadID);
+    close(thread->EpollDescriptor);
+    close(thread->WakeupDescriptor);
+    delete thread;
+    }
+#endif
+  this->Threads.clear();
+
+  this->ConnectorThreadsMutex->Lock();
+  this->ConnectorThreads.clear();
+  this->ConnectorThreadsMutex->Unlock();
+  return 1;
+}
+
+//---------------------------------------------------------------------------
+void Reactor::AddConnector(Connector* connector)
+{
+  if (!this->IsRunning())
+    return;
+
+  IOThread* thread = this->Threads[0];
+  for (unsigned i=1; i<this->Threads.size(); ++i)
+    {
+    if (this->Threads[i]->Connectors.size() < thread->Connectors.size())
+      thread = this->Threads[i];
+    }
+
+  this->ConnectorThreadsMutex->Lock();
+  this->ConnectorThreads[connector] = thread;
+  this->ConnectorThreadsMutex->Unlock();
+
+  thread->Mutex->Lock();
+  thread->Connectors.push_back(connector);
+  thread->Mutex->Unlock();
+}
+
+//---------------------------------------------------------------------------
+void Reactor::RemoveConnector(Connector* connector)
+{
+  IOThread* thread = this->GetThread(connector);
+  if (!thread)
+    return;
+
+  this->ConnectorThreadsMutex->Lock();
+  this->ConnectorThreads.erase(connector);
+  this->ConnectorThreadsMutex->Unlock();
+
+  thread->Mutex->Lock();
+  thread->Connectors.erase(std::remove(thread->Connectors.begin(), thread->Connectors.end(), connector),
+                           thread->Connectors.end());
+  thread->Mutex->Unlock();
+}
+
+//---------------------------------------------------------------------------
+Reactor::IOThread* Reactor::GetThread(Connector* connector)
+{
+  IOThread* thread = NULL;
+  this->ConnectorThreadsMutex->Lock();
+  std::map<Connector*, IOThread*>::iterator iter = this->ConnectorThreads.find(connector);
+  if (iter != this->ConnectorThreads.end())
+    thread = iter->second;
+  this->ConnectorThreadsMutex->Unlock();
+  return thread;
+}
+
+//---------------------------------------------------------------------------
+int Reactor::Watch(Connector* connector, int descriptor, int events)
+{
+#ifdef IGTLIO_USE_EPOLL
+  IOThread* thread = this->GetThread(connector);
+  if (!thread || descriptor < 0)
+    return 0;
+
+  struct epoll_event ev;
+  ev.events = 0;
+  if (events & ReadEvent)
+    ev.events |= EPOLLIN;
+  if (events & WriteEvent)
+    ev.events |= EPOLLOUT;
+  ev.data.ptr = connector;
+
+  if (epoll_ctl(thread->EpollDescriptor, EPOLL_CTL_ADD, descriptor, &ev) < 0)
+    {
+    if (errno != EEXIST || epoll_ctl(thread->EpollDescriptor, EPOLL_CTL_MOD, descriptor, &ev) < 0)
+      {
+      vtkErrorMacro("Failed to watch socket: " << strerror(errno));
+      return 0;
+      }
+    }
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+//---------------------------------------------------------------------------
+int Reactor::Unwatch(Connector* connector, int descriptor)
+{
+#ifdef IGTLIO_USE_EPOLL
+  IOThread* thread = this->GetThread(connector);
+  if (!thread || descriptor < 0)
+    return 0;
+
+  struct epoll_event ev; // ignored, but must be non-NULL on old kernels
+  return epoll_ctl(thread->EpollDescriptor, EPOLL_CTL_DEL, descriptor, &ev) == 0;
+#else
+  return 0;
+#endif
+}
+
+//---------------------------------------------------------------------------
+void Reactor::Wakeup(Connector* connector)
+{
+#ifdef IGTLIO_USE_EPOLL
+  IOThread* thread = this->GetThread(connector);
+  if (!thread)
+    return;
+
+  uint64_t one = 1;
+  if (write(thread->WakeupDescriptor, &one, sizeof(one)) < 0)
+    {
+    vtkWarningMacro("Failed to wake up I/O thread: " << strerror(errno));
+    }
+#endif
+}
+
+//---------------------------------------------------------------------------
+void* Reactor::ThreadFunction(void* ptr)
+{
+  vtkMultiThreader::ThreadInfo* vinfo =
+    static_cast<vtkMultiThreader::ThreadInfo*>(ptr);
+  IOThread* thread = static_cast<IOThread*>(vinfo->UserData);
+  thread->Self->Run(thread);
+  return NULL;
+}
+
+//---------------------------------------------------------------------------
+void Reactor::Run(IOThread* thread)
+{
+#ifdef IGTLIO_USE_EPOLL
+  struct epoll_event events[IGTLIO_REACTOR_MAX_EVENTS];
+
+  while (!thread->StopFlag)
+    {
+    int n = epoll_wait(thread->EpollDescriptor, events, IGTLIO_REACTOR_MAX_EVENTS, IGTLIO_REACTOR_TIMEOUT_MS);
+    if (n < 0 && errno != EINTR)
+      {
+      vtkErrorMacro("epoll_wait failed: " << strerror(errno));
+      break;
+      }
+
+    thread->Mutex->Lock();
+    for (int i=0; i<n; ++i)
+      {
+      Connector* connector = static_cast<Connector*>(events[i].data.ptr);
+      if (!connector)
+        {
+        uint64_t count;
+        while (read(thread->WakeupDescriptor, &count, sizeof(count)) > 0) {}
+        continue;
+        }
+      // The connector may have been removed after epoll_wait returned.
+      if (std::find(thread->Connectors.begin(), thread->Connectors.end(), connector) == thread->Connectors.end())
+        continue;
+
+      int ready = 0;
+      if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        ready |= ReadEvent;
+      if (events[i].events & (EPOLLOUT | EPOLLERR))
+        ready |= WriteEvent;
+      connector->HandleReactorEvent(ready);
+      }
+
+    for (unsigned i=0; i<thread->Connectors.size(); ++i)
+      {
+      thread->Connectors[i]->HandleReactorTimer();
+      }
+    thread->Mutex->Unlock();
+    }
+#endif
+}
+
+} // namespace igtlio
@@ -0,0 +1,104 @@
+#ifndef IGTLIOREACTOR_H
+#define IGTLIOREACTOR_H
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// IGTLIO includes
+#include "igtlioLogicExport.h"
+
+// STD includes
+#include <map>
+#include <vector>
+
+typedef vtkSmartPointer<class vtkMutexLock> vtkMutexLockPointer;
+typedef vtkSmartPointer<class vtkMultiThreader> vtkMultiThreaderPointer;
+
+namespace igtlio
+{
+typedef vtkSmartPointer<class Reactor> ReactorPointer;
+class Connector;
+
+/// A small pool of I/O threads multiplexing the sockets of many Connectors.
+///
+/// By default each Connector runs its own blocking receive thread. When a
+/// Connector is given a running Reactor, it is instead pinned to one of
+/// the reactor threads, which waits for all its sockets with epoll and
+/// performs non-blocking reads, accepts and connects. Complete messages
+/// are pushed to the same circular buffers as in the threaded mode.
+///
+/// The reactor is only available on Linux, Start() fails elsewhere and
+/// Connectors then fall back to one thread per connection.
+///
+class OPENIGTLINKIO_LOGIC_EXPORT Reactor : public vtkObject
+{
+public:
+  static Reactor *New();
+  vtkTypeMacro(Reactor, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Number of I/O threads. Can only be changed while stopped.
+  void SetNumberOfThreads(int n);
+  vtkGetMacro(NumberOfThreads, int);
+
+  int Start();
+  int Stop();
+  bool IsRunning() const { return !this->Threads.empty(); }
+
+  /// Pin the connector to the least loaded thread.
+  /// Called by Connector::Start()/Stop().
+  void AddConnector(Connector* connector);
+  void RemoveConnector(Connector* connector);
+
+  /// Watch the descriptor for the connector, replacing any previous watch.
+  /// Only one descriptor is watched per connector at a time.
+  /// events is a combination of ReadEvent and WriteEvent.
+  int Watch(Connector* connector, int descriptor, int events);
+  int Unwatch(Connector* connector, int descriptor);
+
+  /// Make the thread of the connector call its HandleReactorTimer() now
+  /// instead of at the next timeout. From any thread.
+  void Wakeup(Connector* connector);
+
+  enum {
+    ReadEvent  = 0x01,
+    WriteEvent = 0x02
+  };
+
+protected:
+  Reactor();
+  virtual ~Reactor();
+
+private:
+  Reactor(const Reactor&); // Not implemented
+  void operator=(const Reactor&); // Not implemented
+
+  struct IOThread
+  {
+    Reactor* Self;
+    int ThreadID;
+    int EpollDescriptor;
+    int WakeupDescriptor;
+    bool StopFlag;
+    // Held while dispatching events, so that RemoveConnector() returns only
+    // when the connector is no longer in use by this thread.
+    vtkMutexLockPointer Mutex;
+    std::vector<Connector*> Connectors;
+  };
+
+  static void* ThreadFunction(void* ptr);
+  void Run(IOThread* thread);
+  IOThread* GetThread(Connector* connector);
+
+  int NumberOfThreads;
+  vtkMultiThreaderPointer Threader;
+  std::vector<IOThread*> Threads;
+
+  std::map<Connector*, IOThread*> ConnectorThreads;
+  vtkMutexLockPointer ConnectorThreadsMutex;
+};
+
+} // namespace igtlio
+
+#endif // IGTLIOREACTOR_H
@@ -0,0 +1,642 @@
+#include "igtlioSendQueue.h"
+#include "igtlioSocketUtilities.h"
+#include "igtlioImageCompressor.h"
+
+// OpenIGTLink includes
+#include <igtlOSUtil.h>
+#include <igtl_header.h>
+
+// VTK includes
+#include <vtkConditionVariable.h>
+#include <vtkMultiThreader.h>
+#include <vtkMutexLock.h>
+#include <vtkObjectFactory.h>
+#include <vtkTimerLog.h>
+
+// STD includes
+#include <vector>
+
+namespace igtlio
+{
+
+namespace
+{
+//---------------------------------------------------------------------------
+// Payloads larger than what SendVector() takes in one buffer are split.
+void AppendPayload(const void* payload, long long size,
+                   std::vector<const void*>* buffers, std::vector<int>* lengths)
+{
+  const long long maximum = 1 << 30;
+  const char* data = static_cast<const char*>(payload);
+  while (data && size > 0)
+    {
+    int length = static_cast<int>(size < maximum ? size : maximum);
+    buffers->push_back(data);
+    lengths->push_back(length);
+    data += length;
+    size -= length;
+    }
+}
+}
+
+//---------------------------------------------------------------------------
+vtkStandardNewMacro(SendQueue);
+
+//---------------------------------------------------------------------------
+SendQueue::SendQueue()
+{
+  this->NumberOfBytes = 0;
+  this->MaximumNumberOfMessages = 100;
+  this->MaximumNumberOfBytes = 0;
+  this->OverflowPolicy = OVERFLOW_DROP_OLDEST;
+  this->CoalesceWrites = false;
+  this->FlushWindow = 0.005;
+  this->FlushRequested = false;
+  this->FirstItemTime = 0;
+  this->NumberOfSentMessages = 0;
+  this->NumberOfDroppedMessages = 0;
+  this->NumberOfCoalescedMessages = 0;
+  this->NumberOfRejectedMessages = 0;
+  this->NumberOfFlushes = 0;
+  this->NumberOfFlushedMessages = 0;
+  this->NumberOfFlushedBytes = 0;
+  this->MaximumMessagesPerFlush = 0;
+  this->MaximumBytesPerFlush = 0;
+  this->ImageCompression = ImageCompressor::CODEC_NONE;
+  this->NumberOfCompressedImages = 0;
+  this->NumberOfUncompressedImageBytes = 0;
+  this->NumberOfCompressedImageBytes = 0;
+  this->PeerCapabilitiesRequested = false;
+  this->PeerAcceptsImageDelta = false;
+  this->Running = false;
+  this->Failed = false;
+  this->StopFlag = false;
+  this->Mutex = vtkMutexLockPointer::New();
+  this->SendMutex = vtkMutexLockPointer::New();
+  this->Condition = vtkConditionVariablePointer::New();
+  this->Thread = vtkMultiThreaderPointer::New();
+  this->ThreadID = -1;
+}
+
+//---------------------------------------------------------------------------
+SendQueue::~SendQueue()
+{
+  this->Stop();
+}
+
+//---------------------------------------------------------------------------
+void SendQueue::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->vtkObject::PrintSelf(os, indent);
+  os << indent << "Number of messages: " << this->GetNumberOfMessages() << "\n";
+  os << indent << "Number of bytes: " << this->GetNumberOfBytes() << "\n";
+  os << indent << "Maximum number of messages: " << this->MaximumNumberOfMessages << "\n";
+  os << indent << "Maximum number of bytes: " << this->MaximumNumberOfBytes << "\n";
+  os << indent << "Overflow policy: " << this->OverflowPolicy << "\n";
+  os << indent << "Number of sent messages: " << this->NumberOfSentMessages << "\n";
+  os << indent << "Number of dropped messages: " << this->NumberOfDroppedMessages << "\n";
+  os << indent << "Number of coalesced messages: " << this->NumberOfCoalescedMessages << "\n";
+  os << indent << "Number of rejected messages: " << this->NumberOfRejectedMessages << "\n";
+  os << indent << "Coalesce writes: " << this->CoalesceWrites << "\n";
+  os << indent << "Flush window: " << this->FlushWindow << "\n";
+  os << indent << "Number of flushes: " << this->NumberOfFlushes << "\n";
+  os << indent << "Average messages per flush: " << this->GetAverageMessagesPerFlush() << "\n";
+  os << indent << "Average bytes per flush: " << this->GetAverageBytesPerFlush() << "\n";
+  os << indent << "Image compression: " << ImageCompressor::GetCodecName(this->GetImageCompression()) << "\n";
+  os << indent << "Number of compressed images: " << this->NumberOfCompressedImages << "\n";
+  os << indent << "Image compression ratio: " << this->GetImageCompressionRatio() << "\n";
+  os << indent << "Peer accepts image deltas: " << this->GetPeerAcceptsImageDelta() << "\n";
+  os << indent << "Failed: " << this->Failed << "\n";
+}
+
+//---------------------------------------------------------------------------
+void SendQueue::CopySettings(SendQueue* other)
+{
+  if (!other)
+    return;
+  this->MaximumNumberOfMessages = other->MaximumNumberOfMessages;
+  this->MaximumNumberOfBytes = other->MaximumNumberOfBytes;
+  this->OverflowPolicy = other->OverflowPolicy;
+  this->CoalesceWrites = other->CoalesceWrites;
+  this->FlushWindow = other->FlushWindow;
+}
+
+//---------------------------------------------------------------------------
+void SendQueue::Flush()
+{
+  this->Mutex->Lock();
+  if (!this->Items.empty())
+    {
+    this->FlushRequested = true;
+    }
+  this->Mutex->Unlock();
+}
+
+//---------------------------------------------------------------------------
+double SendQueue::GetAverageMessagesPerFlush()
+{
+  this->Mutex->Lock();
+  double average = this->NumberOfFlushes ? double(this->NumberOfFlushedMessages) / this->NumberOfFlushes : 0;
+  this->Mutex->Unlock();
+  return average;
+}
+
+//---------------------------------------------------------------------------
+double SendQueue::GetAverageBytesPerFlush()
+{
+  this->Mutex->Lock();
+  double average = this->NumberOfFlushes ? double(this->NumberOfFlushedBytes) / this->NumberOfFlushes : 0;
+  this->Mutex->Unlock();
+  return average;
+}
+
+//---------------------------------------------------------------------------
+void SendQueue::ResetFlushStatistics()
+{
+  this->Mutex->Lock();
+  this->NumberOfFlushes = 0;
+  this->NumberOfFlushedMessages = 0;
+  this->NumberOfFlushedBytes = 0;
+  this->MaximumMessagesPerFlush = 0;
+  this->MaximumBytesPerFlush = 0;
+  this->Mutex->Unlock();
+}
+
+//---------------------------------------------------------------------------
+void SendQueue::SetImageCompression(int codec)
+{
+  if (!ImageCompressor::IsCodecSupported(codec) || codec == ImageCompressor::CODEC_AUTO)
+    {
+    vtkErrorMacro("Unsupported image compression " << ImageCompressor::GetCodecName(codec));
+    return;
+    }
+  this->Mutex->Lock();
+  this->ImageCompression = codec;
+  this->Mutex->Unlock();
+}
+
+//---------------------------------------------------------------------------
+int SendQueue::GetImageCompression()
+{
+  this->Mutex->Lock();
+  int codec = this->ImageCompression;
+  this->Mutex->Unlock();
+  return codec;
+}
+
+//---------------------------------------------------------------------------
+double SendQueue::GetImageCompressionRatio()
+{
+  this->Mutex->Lock();
+  double ratio = this->NumberOfCompressedImageBytes
+    ? double(this->NumberOfUncompressedImageBytes) / this->NumberOfCompressedImageBytes : 0;
+  this->Mutex->Unlock();
+  return ratio;
+}
+
+//---------------------------------------------------------------------------
+void SendQueue::SetPeerCapabilitiesRequested(bool requested)
+{
+  this->Mutex->Lock();
+  this->PeerCapabilitiesRequested = requested;
+  this->Mutex->Unlock();
+}
+
+//---------------------------------------------------------------------------
+bool SendQueue::GetPeerCapabilitiesRequested()
+{
+  this->Mutex->Lock();
+  bool requested = this->PeerCapabilitiesRequested;
+  this->Mutex->Unlock();
+  return requested;
+}
+
+//---------------------------------------------------------------------------
+void SendQueue::SetPeerAcceptsImageDelta(bool accepts)
+{
+  this->Mutex->Lock();
+  this->PeerAcceptsImageDelta = accepts;
+  this->Mutex->Unlock();
+}
+
+//---------------------------------------------------------------------------
+bool SendQueue::GetPeerAcceptsImageDelta()
+{
+  this->Mutex->Lock();
+  bool accepts = this->PeerAcceptsImageDelta;
+  this->Mutex->Unlock();
+  return accepts;
+}
+
+//---------------------------------------------------------------------------
+int SendQueue::Start(igtl::Socket::Pointer socket)
+{
+  this->Mutex->Lock();
+  if (this->Running)
+    {
+    this->Mutex->Unlock();
+    return 0;
+    }
+  this->Socket = socket;
+  this->ImageCompression = ImageCompressor::CODEC_NONE;
+  this->PeerCapabilitiesRequested = false;
+  this->PeerAcceptsImageDelta = false;
+  this->Running = true;
+  this->Failed = false;
+  this->StopFlag = false;
+  this->Mutex->Unlock();
+  return 1;
+}
+
+//---------------------------------------------------------------------------
+void SendQueue::Stop()
+{
+  ItemListType dropped;
+
+  this->Mutex->Lock();
+  this->Running = false;
+  this->StopFlag = true;
+  dropped.swap(this->Items);
+  this->NumberOfBytes = 0;
+  this->NumberOfDroppedMessages += dropped.size();
+  this->Condition->Signal();
+  this->Mutex->Unlock();
+
+  if (this->ThreadID >= 0)
+    {
+    this->Thread->TerminateThread(this->ThreadID);
+    this->ThreadID = -1;
+    }
+
+  this->Mutex->Lock();
+  this->Socket = NULL;
+  this->Mutex->Unlock();
+
+  this->Notify(dropped, MessageDroppedEvent);
+}
+
+//---------------------------------------------------------------------------
+bool SendQueue::IsRunning()
+{
+  this->Mutex->Lock();
+  bool running = this->Running && !this->Failed;
+  this->Mutex->Unlock();
+  return running;
+}
+
+//---------------------------------------------------------------------------
+int SendQueue::Push(igtl::MessageBase::Pointer message, const std::string& coalesceKey, vtkCommand* callback)
+{
+  if (message.IsNull())
+    return 0;
+
+  Item item;
+  item.Message = message;
+  item.CoalesceKey = coalesceKey;
+  item.Callback = callback;
+  item.Payload = NULL;
+  item.PayloadSize = 0;
+  return this->PushItem(item);
+}
+
+//---------------------------------------------------------------------------
+int SendQueue::PushGather(igtl::MessageBase::Pointer message, const void* payload, long long payloadSize,
+                          vtkObject* owner, const std::string& coalesceKey, vtkCommand* callback)
+{
+  if (message.IsNull())
+    return 0;
+
+  Item item;
+  item.Message = message;
+  item.CoalesceKey = coalesceKey;
+  item.Callback = callback;
+  item.Payload = payload;
+  item.PayloadSize = payloadSize;
+  item.PayloadOwner = owner;
+  return this->PushItem(item);
+}
+
+//---------------------------------------------------------------------------
+int SendQueue::PushItem(const Item& item)
+{
+  const std::string& coalesceKey = item.CoalesceKey;
+  long long size = item.GetSize();
+
+  ItemListType dropped;
+
+  this->Mutex->Lock();
+  if (!this->Running || this->StopFlag || this->Failed)
+    {
+    ++this->NumberOfRejectedMessages;
+    this->Mutex->Unlock();
+    dropped.push_back(item);
+    this->Notify(dropped, MessageDroppedEvent);
+    return 0;
+    }
+
+  // Replace a queued message with the same key, keeping its position.
+  if (!coalesceKey.empty())
+    {
+    for (ItemListType::iterator iter = this->Items.begin(); iter != this->Items.end(); ++iter)
+      {
+      if (iter->CoalesceKey != coalesceKey)
+        continue;
+      this->NumberOfBytes += size - iter->GetSize();
+      dropped.push_back(*iter);
+      *iter = item;
+      ++this->NumberOfCoalescedMessages;
+      this->Mutex->Unlock();
+      this->Notify(dropped, MessageDroppedEvent);
+      return 1;
+      }
+    }
+
+  while (!this->Items.empty()
+         && ((this->MaximumNumberOfMessages > 0
+              && static_cast<int>(this->Items.size()) >= this->MaximumNumberOfMessages)
+             || (this->MaximumNumberOfBytes > 0
+                 && this->NumberOfBytes + size > this->MaximumNumberOfBytes)))
+    {
+    if (this->OverflowPolicy == OVERFLOW_REJECT)
+      {
+      ++this->NumberOfRejectedMessages;
+      this->Mutex->Unlock();
+      dropped.push_back(item);
+      this->Notify(dropped, MessageDroppedEvent);
+      return 0;
+      }
+    this->NumberOfBytes -= this->Items.front().GetSize();
+    dropped.push_back(this->Items.front());
+    this->Items.pop_front();
+    ++this->NumberOfDroppedMessages;
+    }
+
+  if (this->Items.empty())
+    {
+    this->FirstItemTime = vtkTimerLog::GetUniversalTime();
+    }
+  this->Items.push_back(item);
+  this->NumberOfBytes += size;
+
+  if (this->ThreadID < 0)
+    {
+    this->ThreadID = this->Thread->SpawnThread((vtkThreadFunctionType) &SendQueue::ThreadFunction, this);
+    }
+  this->Condition->Signal();
+  this->Mutex->Unlock();
+
+  this->Notify(dropped, MessageDroppedEvent);
+  return 1;
+}
+
+//---------------------------------------------------------------------------
+int SendQueue::Send(const void* data, int size)
+{
+  this->Mutex->Lock();
+  igtl::Socket::Pointer socket = this->Socket;
+  bool usable = this->Running && !this->Failed;
+  this->Mutex->Unlock();
+
+  if (!usable || socket.IsNull())
+    return 0;
+
+  igtl::MessageBase::Pointer compressed = this->CompressImage(data, size, NULL, 0);
+  if (compressed)
+    {
+    data = compressed->GetPackPointer();
+    size = compressed->GetPackSize();
+    }
+
+  this->SendMutex->Lock();
+  int r = socket->Send(data, size);
+  this->SendMutex->Unlock();
+
+  if (!r)
+    {
+    this->Mutex->Lock();
+    this->Failed = true;
+    this->Mutex->Unlock();
+    }
+  return r;
+}
+
+//---------------------------------------------------------------------------
+int SendQueue::SendGather(const void* data, int size, const void* payload, long long payloadSize)
+{
+  this->Mutex->Lock();
+  igtl::Socket::Pointer socket = this->Socket;
+  bool usable = this->Running && !this->Failed;
+  this->Mutex->Unlock();
+
+  if (!usable || socket.IsNull())
+    return 0;
+
+  igtl::MessageBase::Pointer compressed = this->CompressImage(data, size, payload, payloadSize);
+  if (compressed)
+    {
+    data = compressed->GetPackPointer();
+    size = compressed->GetPackSize();
+    payload = NULL;
+    }
+
+  std::vector<const void*> buffers(1, data);
+  std::vector<int> lengths(1, size);
+  AppendPayload(payload, payloadSize, &buffers, &lengths);
+
+  this->SendMutex->Lock();
+  int r = SendVector(socket, &buffers[0], &lengths[0], static_cast<int>(buffers.size()));
+  this->SendMutex->Unlock();
+
+  if (!r)
+    {
+    this->Mutex->Lock();
+    this->Failed = true;
+    this->Mutex->Unlock();
+    }
+  return r;
+}
+
+//---------------------------------------------------------------------------
+int SendQueue::GetNumberOfMessages()
+{
+  this->Mutex->Lock();
+  int n = static_cast<int>(this->Items.size());
+  this->Mutex->Unlock();
+  return n;
+}
+
+//---------------------------------------------------------------------------
+long long SendQueue::GetNumberOfBytes()
+{
+  this->Mutex->Lock();
+  long long n = this->NumberOfBytes;
+  this->Mutex->Unlock();
+  return n;
+}
+
+//---------------------------------------------------------------------------
+void SendQueue::Notify(const ItemListType& items, unsigned long event)
+{
+  for (ItemListType::const_iterator iter = items.begin(); iter != items.end(); ++iter)
+    {
+    if (iter->Callback)
+      {
+      iter->Callback->Execute(this, event, iter->Message.GetPointer());
+      }
+    }
+}
+
+//---------------------------------------------------------------------------
+void* SendQueue::ThreadFunction(void* ptr)
+{
+  vtkMultiThreader::ThreadInfo* vinfo =
+    static_cast<vtkMultiThreader::ThreadInfo*>(ptr);
+  SendQueue* self = static_cast<SendQueue*>(vinfo->UserData);
+  self->Run();
+  return NULL;
+}
+
+//---------------------------------------------------------------------------
+int SendQueue::Write(igtl::Socket* socket, const ItemListType& items, long long* bytes)
+{
+  *bytes = 0;
+  if (items.size() == 1 && (items.front().Compressed || !items.front().Payload))
+    {
+    igtl::MessageBase* message = items.front().Compressed ? items.front().Compressed : items.front().Message;
+    *bytes = message->GetPackSize();
+    return socket->Send(message->GetPackPointer(), message->GetPackSize());
+    }
+
+  std::vector<const void*> buffers;
+  std::vector<int> lengths;
+  buffers.reserve(items.size());
+  lengths.reserve(items.size());
+  for (unsigned i=0; i<items.size(); ++i)
+    {
+    if (items[i].Compressed)
+      {
+      buffers.push_back(items[i].Compressed->GetPackPointer());
+      lengths.push_back(items[i].Compressed->GetPackSize());
+      *bytes += items[i].Compressed->GetPackSize();
+      continue;
+      }
+    buffers.push_back(items[i].Message->GetPackPointer());
+    lengths.push_back(items[i].Message->GetPackSize());
+    AppendPayload(items[i].Payload, items[i].PayloadSize, &buffers, &lengths);
+    *bytes += items[i].GetSize();
+    }
+  return SendVector(socket, &buffers[0], &lengths[0], static_cast<int>(buffers.size()));
+}
+
+//---------------------------------------------------------------------------
+igtl::MessageBase::Pointer SendQueue::CompressImage(const void* data, long long size,
+                                                    const void* payload, long long payloadSize)
+{
+  this->Mutex->Lock();
+  int codec = this->ImageCompression;
+  this->Mutex->Unlock();
+
+  if (codec == ImageCompressor::CODEC_NONE || size < IGTL_HEADER_SIZE || !ImageCompressor::IsImageMessage(data))
+    {
+    return NULL;
+    }
+  // Sent uncompressed if it fails.
+  igtl::MessageBase::Pointer compressed = ImageCompressor::Compress(codec, data, size, payload, payload ? payloadSize : 0);
+  if (compressed)
+    {
+    this->Mutex->Lock();
+    ++this->NumberOfCompressedImages;
+    this->NumberOfUncompressedImageBytes += size + (payload ? payloadSize : 0);
+    this->NumberOfCompressedImageBytes += compressed->GetPackSize();
+    this->Mutex->Unlock();
+    }
+  return compressed;
+}
+
+//---------------------------------------------------------------------------
+void SendQueue::Run()
+{
+  while (true)
+    {
+    this->Mutex->Lock();
+    while (!this->StopFlag && this->Items.empty())
+      {
+      this->Condition->Wait(this->Mutex);
+      }
+
+    // Let more messages gather, until the window ends or a flush is requested.
+    if (this->CoalesceWrites)
+      {
+      double deadline = this->FirstItemTime + this->FlushWindow;
+      while (!this->StopFlag && !this->FlushRequested
+             && vtkTimerLog::GetUniversalTime() < deadline)
+        {
+        this->Mutex->Unlock();
+        igtl::Sleep(1);
+        this->Mutex->Lock();
+        }
+      }
+
+    if (this->StopFlag)
+      {
+      this->Mutex->Unlock();
+      break;
+      }
+
+    ItemListType current;
+    if (this->CoalesceWrites)
+      {
+      current.swap(this->Items);
+      this->NumberOfBytes = 0;
+      this->FlushRequested = false;
+      }
+    else
+      {
+      current.push_back(this->Items.front());
+      this->Items.pop_front();
+      this->NumberOfBytes -= current.front().GetSize();
+      }
+    igtl::Socket::Pointer socket = this->Socket;
+    this->Mutex->Unlock();
+
+    // Compressed here rather than by the pushing thread.
+    for (ItemListType::iterator iter = current.begin(); iter != current.end(); ++iter)
+      {
+      iter->Compressed = this->CompressImage(iter->Message->GetPackPointer(), iter->Message->GetPackSize(),
+                                             iter->Payload, iter->PayloadSize);
+      }
+
+    long long bytes = 0;
+    this->SendMutex->Lock();
+    int r = this->Write(socket, current, &bytes);
+    this->SendMutex->Unlock();
+
+    if (!r)
+      {
+      this->Mutex->Lock();
+      this->Failed = true;
+      current.insert(current.end(), this->Items.begin(), this->Items.end());
+      this->Items.clear();
+      this->NumberOfBytes = 0;
+      this->NumberOfDroppedMessages += current.size();
+      this->Mutex->Unlock();
+      this->Notify(current, MessageDroppedEvent);
+      break;
+      }
+
+    int count = static_cast<int>(current.size());
+    this->Mutex->Lock();
+    this->NumberOfSentMessages += count;
+    ++this->NumberOfFlushes;
+    this->NumberOfFlushedMessages += count;
+    this->NumberOfFlushedBytes += bytes;
+    if (count > this->MaximumMessagesPerFlush)
+      this->MaximumMessagesPerFlush = count;
+    if (bytes > this->MaximumBytesPerFlush)
+      this->MaximumBytesPerFlush = bytes;
+    this->Mutex->Unlock();
+    this->Notify(current, MessageSentEvent);
+    }
+}
+
+} // namespace igtlio
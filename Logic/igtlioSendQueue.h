@@ -0,0 +1,236 @@
+#ifndef IGTLIOSENDQUEUE_H
+#define IGTLIOSENDQUEUE_H
+
+// OpenIGTLink includes
+#include <igtlMessageBase.h>
+#include <igtlSocket.h>
+
+// VTK includes
+#include <vtkCommand.h>
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// IGTLIO includes
+#include "igtlioLogicExport.h"
+
+// STD includes
+#include <deque>
+#include <string>
+
+typedef vtkSmartPointer<class vtkMutexLock> vtkMutexLockPointer;
+typedef vtkSmartPointer<class vtkMultiThreader> vtkMultiThreaderPointer;
+typedef vtkSmartPointer<class vtkConditionVariable> vtkConditionVariablePointer;
+
+namespace igtlio
+{
+typedef vtkSmartPointer<class SendQueue> SendQueuePointer;
+
+/// Queue of packed messages sent to one socket by a dedicated writer thread.
+///
+/// Push() can be called from any thread and never blocks on the network,
+/// so that a slow peer does not stall the producer. The queue is bounded
+/// in messages and bytes. When full, either the oldest message is dropped
+/// or the new one is rejected, which gives the producer backpressure.
+///
+/// Messages pushed with the same coalescing key replace each other while
+/// waiting in the queue, so only the latest one is sent.
+///
+/// Messages are sent as they are, they must not be modified until they are
+/// reported as sent or dropped through the optional callback. The callback
+/// is executed from the writer thread (or the pushing thread for dropped
+/// messages) with MessageSentEvent or MessageDroppedEvent, and the
+/// igtl::MessageBase* as call data.
+///
+/// The writer thread is only spawned by the first Push(). Send() writes
+/// from the calling thread, serialized with the writer thread.
+///
+/// PushGather() queues a message followed by a payload sent from where it
+/// is, e.g. the pixels of an image. The payload is gathered with the pack
+/// of the message into one write, and must not be modified until the
+/// message is reported as sent or dropped.
+///
+/// With CoalesceWrites, the writer gathers the messages queued within
+/// FlushWindow, or until Flush() is called, and sends them with a single
+/// vectored write. This saves system calls and small packets when many
+/// small messages are sent at a high rate.
+///
+/// With an ImageCompression codec, IMAGE messages are sent as ZIMAGE
+/// messages (see ImageCompressor), compressed by the writer thread, or by
+/// the calling thread for Send() and SendGather(). The codec must have
+/// been negotiated with the peer, see Connector::SetImageCompression().
+///
+class OPENIGTLINKIO_LOGIC_EXPORT SendQueue : public vtkObject
+{
+public:
+  static SendQueue *New();
+  vtkTypeMacro(SendQueue, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  enum {
+    MessageSentEvent    = vtkCommand::UserEvent + 200,
+    MessageDroppedEvent = vtkCommand::UserEvent + 201
+  };
+
+  enum {
+    OVERFLOW_DROP_OLDEST, // make room by dropping the oldest queued message
+    OVERFLOW_REJECT       // refuse the new message
+  };
+
+  /// Start accepting messages for the socket.
+  int Start(igtl::Socket::Pointer socket);
+  /// Stop the writer thread and drop queued messages.
+  /// If the writer may be blocked in a send, shut the socket down first.
+  void Stop();
+  bool IsRunning();
+
+  /// Queue a packed message. Returns 0 if it was rejected because the queue
+  /// is full, not running or the connection failed.
+  int Push(igtl::MessageBase::Pointer message, const std::string& coalesceKey="", vtkCommand* callback=NULL);
+
+  /// Queue a packed message followed by payloadSize bytes at payload,
+  /// which owner keeps alive until the message is sent or dropped.
+  int PushGather(igtl::MessageBase::Pointer message, const void* payload, long long payloadSize,
+                 vtkObject* owner, const std::string& coalesceKey="", vtkCommand* callback=NULL);
+
+  /// Send immediately from the calling thread, without queuing.
+  int Send(const void* data, int size);
+  /// Send data followed by the payload, with one gathered write.
+  int SendGather(const void* data, int size, const void* payload, long long payloadSize);
+
+  /// Queue depth
+  int GetNumberOfMessages();
+  long long GetNumberOfBytes();
+
+  vtkSetMacro(MaximumNumberOfMessages, int);
+  vtkGetMacro(MaximumNumberOfMessages, int);
+  vtkSetMacro(MaximumNumberOfBytes, long long);
+  vtkGetMacro(MaximumNumberOfBytes, long long);
+  vtkSetMacro(OverflowPolicy, int);
+  vtkGetMacro(OverflowPolicy, int);
+
+  /// Gather messages and send them together (off by default).
+  vtkSetMacro(CoalesceWrites, bool);
+  vtkGetMacro(CoalesceWrites, bool);
+  vtkBooleanMacro(CoalesceWrites, bool);
+  /// Longest time a message waits for others, in seconds (default 0.005).
+  vtkSetMacro(FlushWindow, double);
+  vtkGetMacro(FlushWindow, double);
+
+  /// Send the gathered messages without waiting for the end of the window.
+  void Flush();
+
+  /// Flush statistics. A flush is one write of one or more messages.
+  vtkGetMacro(NumberOfFlushes, unsigned long);
+  vtkGetMacro(MaximumMessagesPerFlush, int);
+  vtkGetMacro(MaximumBytesPerFlush, long long);
+  double GetAverageMessagesPerFlush();
+  double GetAverageBytesPerFlush();
+  void ResetFlushStatistics();
+
+  /// Codec of the IMAGE messages (ImageCompressor::CODEC_NONE by default).
+  /// Reset to CODEC_NONE by Start(), as a new peer must negotiate it again.
+  void SetImageCompression(int codec);
+  int GetImageCompression();
+
+  /// Compression statistics
+  vtkGetMacro(NumberOfCompressedImages, unsigned long);
+  /// Bytes of the IMAGE messages over bytes of the ZIMAGE messages sent.
+  double GetImageCompressionRatio();
+
+  /// Whether the capabilities of the peer were asked for, and whether it
+  /// listed DLT_IMAGE (see ImageDelta). Both reset by Start().
+  void SetPeerCapabilitiesRequested(bool requested);
+  bool GetPeerCapabilitiesRequested();
+  void SetPeerAcceptsImageDelta(bool accepts);
+  bool GetPeerAcceptsImageDelta();
+
+  /// Copy the limits and policies of another queue.
+  void CopySettings(SendQueue* other);
+
+  /// Statistics
+  vtkGetMacro(NumberOfSentMessages, unsigned long);
+  vtkGetMacro(NumberOfDroppedMessages, unsigned long);
+  vtkGetMacro(NumberOfCoalescedMessages, unsigned long);
+  vtkGetMacro(NumberOfRejectedMessages, unsigned long);
+
+  /// True once a send failed, i.e. the peer is gone.
+  vtkGetMacro(Failed, bool);
+
+protected:
+  SendQueue();
+  virtual ~SendQueue();
+
+private:
+  SendQueue(const SendQueue&); // Not implemented
+  void operator=(const SendQueue&); // Not implemented
+
+  struct Item
+  {
+    igtl::MessageBase::Pointer Message;
+    std::string CoalesceKey;
+    vtkSmartPointer<vtkCommand> Callback;
+    // Sent after the pack of Message, without copy.
+    const void* Payload;
+    long long PayloadSize;
+    vtkSmartPointer<vtkObject> PayloadOwner;
+    // Sent instead of Message and Payload if the image was compressed.
+    igtl::MessageBase::Pointer Compressed;
+
+    long long GetSize() const
+    {
+      return this->Message->GetPackSize() + this->PayloadSize;
+    }
+  };
+  typedef std::deque<Item> ItemListType;
+
+  int PushItem(const Item& item);
+  static void* ThreadFunction(void* ptr);
+  void Run();
+  void Notify(const ItemListType& items, unsigned long event);
+  int Write(igtl::Socket* socket, const ItemListType& items, long long* bytes);
+  igtl::MessageBase::Pointer CompressImage(const void* data, long long size,
+                                           const void* payload, long long payloadSize);
+
+  igtl::Socket::Pointer Socket;
+  ItemListType Items;
+  long long NumberOfBytes;
+  int MaximumNumberOfMessages;
+  long long MaximumNumberOfBytes;
+  int OverflowPolicy;
+  bool CoalesceWrites;
+  double FlushWindow;
+  bool FlushRequested;
+  double FirstItemTime; // time the oldest queued message was pushed
+
+  unsigned long NumberOfSentMessages;
+  unsigned long NumberOfDroppedMessages;
+  unsigned long NumberOfCoalescedMessages;
+  unsigned long NumberOfRejectedMessages;
+
+  unsigned long NumberOfFlushes;
+  unsigned long NumberOfFlushedMessages;
+  long long NumberOfFlushedBytes;
+  int MaximumMessagesPerFlush;
+  long long MaximumBytesPerFlush;
+
+  int ImageCompression;
+  unsigned long NumberOfCompressedImages;
+  long long NumberOfUncompressedImageBytes;
+  long long NumberOfCompressedImageBytes;
+  bool PeerCapabilitiesRequested;
+  bool PeerAcceptsImageDelta;
+
+  bool Running;
+  bool Failed;
+  bool StopFlag;
+
+  vtkMutexLockPointer Mutex;     // protects the items and flags
+  vtkMutexLockPointer SendMutex; // held while writing to the socket
+  vtkConditionVariablePointer Condition;
+  vtkMultiThreaderPointer Thread;
+  int ThreadID;
+};
+
+} // namespace igtlio
+
+#endif // IGTLIOSENDQUEUE_H
@@ -35,7 +35,7 @@ DevicePointer vtkIGTLIOSession::AddDeviceIfNotPresent(DeviceKeyType key)
 
   if (!device)
   {
-    device = Connector->GetDeviceFactory()->create(key.type, key.name);
+    device = Connector->GetDeviceFactory()->create(key.GetType(), key.GetName());
     Connector->AddDevice(device);
   }
 
@@ -66,10 +66,12 @@ CommandDevicePointer vtkIGTLIOSession::SendCommandQuery(std::string device_id,
   if (synchronized==igtlio::BLOCKING)
   {
     double starttime = vtkTimerLog::GetUniversalTime();
-    while (vtkTimerLog::GetUniversalTime() - starttime < timeout_s)
+    double elapsed = 0;
+    while (elapsed < timeout_s)
     {
+      // Sleep until something is received, instead of polling.
+      Connector->GetWaitHandle()->Wait(timeout_s - elapsed);
       Connector->PeriodicProcess();
-      vtksys::SystemTools::Delay(5);
 
       CommandDevicePointer response = device->GetResponseFromCommandID(contentdata.id);
 
@@ -77,6 +79,7 @@ CommandDevicePointer vtkIGTLIOSession::SendCommandQuery(std::string device_id,
       {
         return response;
       }
+      elapsed = vtkTimerLog::GetUniversalTime() - starttime;
     }
   }
   else
@@ -108,7 +111,8 @@ CommandDevicePointer vtkIGTLIOSession::SendCommandResponse(std::string device_id
   return device;
 }
 
-ImageDevicePointer vtkIGTLIOSession::SendImage(std::string device_id, vtkSmartPointer<vtkImageData> image, vtkSmartPointer<vtkMatrix4x4> transform)
+ImageDevicePointer vtkIGTLIOSession::SendImage(std::string device_id, vtkSmartPointer<vtkImageData> image, vtkSmartPointer<vtkMatrix4x4> transform,
+                                               const int* modifiedExtent)
 {
   ImageDevicePointer device;
   DeviceKeyType key(igtlio::ImageConverter::GetIGTLTypeName(), device_id);
@@ -118,6 +122,10 @@ ImageDevicePointer vtkIGTLIOSession::SendImage(std::string device_id, vtkSmartPo
   contentdata.image = image;
   contentdata.transform = transform;
   device->SetContent(contentdata);
+  if (modifiedExtent)
+    {
+    device->AddModifiedExtent(modifiedExtent);
+    }
 
   Connector->SendMessage(CreateDeviceKey(device));
 
@@ -186,16 +194,19 @@ void vtkIGTLIOSession::ConnectToServer(std::string serverHost, int serverPort, i
 bool vtkIGTLIOSession::waitForConnection(double timeout_s)
 {
   double starttime = vtkTimerLog::GetUniversalTime();
+  double elapsed = 0;
 
-  while (vtkTimerLog::GetUniversalTime() - starttime < timeout_s)
+  while (elapsed < timeout_s)
   {
     Connector->PeriodicProcess();
-    vtksys::SystemTools::Delay(5);
+    // Connection changes are signaled along with their events.
+    Connector->GetWaitHandle()->Wait(timeout_s - elapsed);
 
     if (Connector->GetState() != Connector::STATE_WAIT_CONNECTION)
     {
       break;
     }
+    elapsed = vtkTimerLog::GetUniversalTime() - starttime;
   }
 
   return Connector->GetState() == Connector::STATE_CONNECTED;
@@ -218,4 +229,46 @@ TransformDevicePointer vtkIGTLIOSession::SendTransform(std::string device_id, vt
   return device;
 }
 
+//---------------------------------------------------------------------------
+int vtkIGTLIOSession::SendImageAsync(std::string device_id, vtkSmartPointer<vtkImageData> image, vtkSmartPointer<vtkMatrix4x4> transform)
+{
+  igtlio::BaseConverter::HeaderData header;
+  header.deviceName = device_id;
+  header.timestamp = vtkTimerLog::GetUniversalTime();
+
+  igtlio::ImageConverter::ContentData contentdata;
+  contentdata.image = image;
+  contentdata.transform = transform;
+
+  igtl::ImageMessage::Pointer msg;
+  if (!igtlio::ImageConverter::toIGTL(header, contentdata, &msg))
+    return 0;
+
+  std::string coalesceKey;
+  if (Connector->GetSendPolicy() == igtlio::Connector::SEND_LATEST)
+    coalesceKey = std::string(igtlio::ImageConverter::GetIGTLTypeName()) + "_" + device_id;
+  return Connector->SendMessageAsync(dynamic_pointer_cast<igtl::MessageBase>(msg), coalesceKey);
+}
+
+//---------------------------------------------------------------------------
+int vtkIGTLIOSession::SendTransformAsync(std::string device_id, vtkSmartPointer<vtkMatrix4x4> transform)
+{
+  igtlio::BaseConverter::HeaderData header;
+  header.deviceName = device_id;
+  header.timestamp = vtkTimerLog::GetUniversalTime();
+
+  igtlio::TransformConverter::ContentData contentdata;
+  contentdata.deviceName = device_id;
+  contentdata.transform = transform;
+
+  igtl::TransformMessage::Pointer msg;
+  if (!igtlio::TransformConverter::toIGTL(header, contentdata, &msg))
+    return 0;
+
+  std::string coalesceKey;
+  if (Connector->GetSendPolicy() == igtlio::Connector::SEND_LATEST)
+    coalesceKey = std::string(igtlio::TransformConverter::GetIGTLTypeName()) + "_" + device_id;
+  return Connector->SendMessageAsync(dynamic_pointer_cast<igtl::MessageBase>(msg), coalesceKey);
+}
+
 } //namespace igtlio
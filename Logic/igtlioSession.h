@@ -60,14 +60,30 @@ public:
 
   ///
   ///  Send the given image from the given device. Asynchronous.
+  /// If modifiedExtent is given, only this part of the image changed since
+  /// the last send, see ImageDevice::AddModifiedExtent().
   ImageDevicePointer SendImage(std::string device_id,
                                         vtkSmartPointer<vtkImageData> image,
-                                        vtkSmartPointer<vtkMatrix4x4> transform);
+                                        vtkSmartPointer<vtkMatrix4x4> transform,
+                                        const int* modifiedExtent=NULL);
 
   /// Send the given image from the given device. Asynchronous.
   TransformDevicePointer SendTransform(std::string device_id,
                                                 vtkSmartPointer<vtkMatrix4x4> transform);
 
+  /// Send the given image without using a device, from any thread.
+  /// The message is queued following the connector send policy.
+  /// Return 0 if the message was rejected.
+  int SendImageAsync(std::string device_id,
+                     vtkSmartPointer<vtkImageData> image,
+                     vtkSmartPointer<vtkMatrix4x4> transform);
+
+  /// Send the given transform without using a device, from any thread.
+  /// The message is queued following the connector send policy.
+  /// Return 0 if the message was rejected.
+  int SendTransformAsync(std::string device_id,
+                         vtkSmartPointer<vtkMatrix4x4> transform);
+
     /// TODO: add more convenience methods here.
 
 
@@ -0,0 +1,257 @@
+#include "igtlioSocketUtilities.h"
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include <vector>
+
+namespace igtlio
+{
+
+namespace
+{
+/// Gives access to the protected descriptor of igtl::Socket.
+/// The member pointer is taken through a subclass, but applies to any igtl::Socket.
+struct SocketDescriptorAccess : public igtl::Socket
+{
+  static int& Descriptor(igtl::Socket* socket)
+  {
+    return socket->*(&SocketDescriptorAccess::m_SocketDescriptor);
+  }
+};
+}
+
+//---------------------------------------------------------------------------
+int GetSocketDescriptor(igtl::Socket* socket)
+{
+  if (!socket)
+    return -1;
+  return SocketDescriptorAccess::Descriptor(socket);
+}
+
+//---------------------------------------------------------------------------
+void SetSocketDescriptor(igtl::Socket* socket, int descriptor)
+{
+  if (!socket)
+    return;
+  SocketDescriptorAccess::Descriptor(socket) = descriptor;
+}
+
+//---------------------------------------------------------------------------
+void ShutdownSocket(igtl::Socket* socket)
+{
+  int descriptor = GetSocketDescriptor(socket);
+  if (descriptor < 0)
+    return;
+#if defined(_WIN32)
+  shutdown(descriptor, SD_BOTH);
+#else
+  shutdown(descriptor, SHUT_RDWR);
+#endif
+}
+
+#if !defined(_WIN32)
+
+//---------------------------------------------------------------------------
+int SendVector(igtl::Socket* socket, const void* const* buffers, const int* lengths, int count)
+{
+  int descriptor = GetSocketDescriptor(socket);
+  if (descriptor < 0)
+    return 0;
+
+#if defined(IOV_MAX)
+  const int maximumVectors = IOV_MAX < 1024 ? IOV_MAX : 1024;
+#else
+  const int maximumVectors = 16;
+#endif
+#if defined(MSG_NOSIGNAL)
+  const int flags = MSG_NOSIGNAL;
+#else
+  const int flags = 0;
+#endif
+
+  std::vector<struct iovec> vectors(count);
+  for (int i=0; i<count; ++i)
+    {
+    vectors[i].iov_base = const_cast<void*>(buffers[i]);
+    vectors[i].iov_len = lengths[i];
+    }
+
+  int first = 0;
+  while (first < count)
+    {
+    if (vectors[first].iov_len == 0)
+      {
+      ++first;
+      continue;
+      }
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &vectors[first];
+    message.msg_iovlen = count - first < maximumVectors ? count - first : maximumVectors;
+
+    ssize_t n = sendmsg(descriptor, &message, flags);
+    if (n < 0)
+      {
+      if (errno == EINTR)
+        continue;
+      return 0;
+      }
+
+    // Skip what was written, the last vector may be partially sent.
+    while (n > 0 && first < count)
+      {
+      size_t len = vectors[first].iov_len;
+      if (static_cast<size_t>(n) >= len)
+        {
+        n -= len;
+        vectors[first].iov_len = 0;
+        ++first;
+        }
+      else
+        {
+        vectors[first].iov_base = static_cast<char*>(vectors[first].iov_base) + n;
+        vectors[first].iov_len -= n;
+        n = 0;
+        }
+      }
+    }
+  return 1;
+}
+
+//---------------------------------------------------------------------------
+int ReceiveNonBlocking(int descriptor, void* data, int length)
+{
+  if (length <= 0)
+    return 0;
+
+  while (true)
+    {
+    ssize_t n = recv(descriptor, data, length, MSG_DONTWAIT);
+    if (n > 0)
+      return static_cast<int>(n);
+    if (n == 0)
+      return -1; // closed by peer
+    if (errno == EINTR)
+      continue;
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return 0;
+    return -1;
+    }
+}
+
+//---------------------------------------------------------------------------
+int StartConnect(const std::string& hostname, int port)
+{
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+
+  struct addrinfo* result = NULL;
+  if (getaddrinfo(hostname.c_str(), NULL, &hints, &result) != 0 || !result)
+    return -1;
+
+  struct sockaddr_in address;
+  memcpy(&address, result->ai_addr, sizeof(address));
+  address.sin_port = htons(port);
+  freeaddrinfo(result);
+
+  int descriptor = socket(AF_INET, SOCK_STREAM, 0);
+  if (descriptor < 0)
+    return -1;
+
+  // Same options as igtl::Socket::CreateSocket()
+  int on = 1;
+  setsockopt(descriptor, SOL_SOCKET, SO_REUSEADDR, (char*)&on, sizeof(on));
+  setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, (char*)&on, sizeof(on));
+
+  int flags = fcntl(descriptor, F_GETFL, 0);
+  fcntl(descriptor, F_SETFL, flags | O_NONBLOCK);
+
+  if (connect(descriptor, (struct sockaddr*)&address, sizeof(address)) < 0 && errno != EINPROGRESS)
+    {
+    close(descriptor);
+    return -1;
+    }
+  return descriptor;
+}
+
+//---------------------------------------------------------------------------
+int FinishConnect(int descriptor)
+{
+  int error = 0;
+  socklen_t length = sizeof(error);
+  if (getsockopt(descriptor, SOL_SOCKET, SO_ERROR, &error, &length) < 0)
+    return -1;
+  if (error == EINPROGRESS || error == EALREADY)
+    return 0;
+  if (error != 0)
+    return -1;
+
+  // igtl::Socket sends with blocking calls
+  int flags = fcntl(descriptor, F_GETFL, 0);
+  fcntl(descriptor, F_SETFL, flags & ~O_NONBLOCK);
+  return 1;
+}
+
+//---------------------------------------------------------------------------
+void CloseSocketDescriptor(int descriptor)
+{
+  if (descriptor >= 0)
+    close(descriptor);
+}
+
+#else
+
+//---------------------------------------------------------------------------
+int SendVector(igtl::Socket* socket, const void* const* buffers, const int* lengths, int count)
+{
+  for (int i=0; i<count; ++i)
+    {
+    if (!socket->Send(buffers[i], lengths[i]))
+      return 0;
+    }
+  return 1;
+}
+
+//---------------------------------------------------------------------------
+int ReceiveNonBlocking(int, void*, int)
+{
+  return -1;
+}
+
+//---------------------------------------------------------------------------
+int StartConnect(const std::string&, int)
+{
+  return -1;
+}
+
+//---------------------------------------------------------------------------
+int FinishConnect(int)
+{
+  return -1;
+}
+
+//---------------------------------------------------------------------------
+void CloseSocketDescriptor(int)
+{
+}
+
+#endif
+
+} // namespace igtlio
@@ -0,0 +1,58 @@
+#ifndef IGTLIOSOCKETUTILITIES_H
+#define IGTLIOSOCKETUTILITIES_H
+
+#include "igtlioLogicExport.h"
+
+// OpenIGTLink includes
+#include <igtlSocket.h>
+
+// STD includes
+#include <string>
+
+namespace igtlio
+{
+
+/// Low-level socket helpers for the non-blocking I/O paths (Reactor).
+///
+/// igtl::Socket only offers blocking calls and keeps its descriptor
+/// protected, these functions give access to the native descriptor
+/// so that it can be multiplexed.
+/// Non-blocking operations are only implemented on POSIX systems,
+/// elsewhere they report an error.
+
+/// Return the native descriptor of the socket, or -1 if not open.
+OPENIGTLINKIO_LOGIC_EXPORT int GetSocketDescriptor(igtl::Socket* socket);
+
+/// Let the socket take ownership of an already connected descriptor.
+OPENIGTLINKIO_LOGIC_EXPORT void SetSocketDescriptor(igtl::Socket* socket, int descriptor);
+
+/// Read at most length bytes without blocking.
+/// Return the number of bytes read, 0 if no data is available yet,
+/// or -1 if the peer closed the connection or an error occurred.
+OPENIGTLINKIO_LOGIC_EXPORT int ReceiveNonBlocking(int descriptor, void* data, int length);
+
+/// Start a non-blocking connect to hostname:port.
+/// Return the descriptor of the connecting socket, or -1 on failure.
+/// Wait for the descriptor to become writable, then call FinishConnect().
+OPENIGTLINKIO_LOGIC_EXPORT int StartConnect(const std::string& hostname, int port);
+
+/// Complete a connect started with StartConnect().
+/// Return 1 if connected (the descriptor is switched back to blocking mode),
+/// 0 if still in progress, or -1 if the connection failed.
+OPENIGTLINKIO_LOGIC_EXPORT int FinishConnect(int descriptor);
+
+/// Send several buffers in order with as few system calls as possible
+/// (gathered writes). Blocks until everything is sent.
+/// Return 1 on success, 0 on failure.
+OPENIGTLINKIO_LOGIC_EXPORT int SendVector(igtl::Socket* socket, const void* const* buffers, const int* lengths, int count);
+
+/// Interrupt any send or receive blocked on the socket, from another thread.
+/// The descriptor stays valid until the socket is closed.
+OPENIGTLINKIO_LOGIC_EXPORT void ShutdownSocket(igtl::Socket* socket);
+
+/// Close a descriptor not owned by an igtl::Socket.
+OPENIGTLINKIO_LOGIC_EXPORT void CloseSocketDescriptor(int descriptor);
+
+} // namespace igtlio
+
+#endif // IGTLIOSOCKETUTILITIES_H
@@ -0,0 +1,133 @@
+#include "igtlioStreamReader.h"
+
+// STD includes
+#include <algorithm>
+#include <string.h>
+
+namespace igtlio
+{
+
+//---------------------------------------------------------------------------
+StreamReader::StreamReader(int capacity)
+  : Socket(NULL),
+    Buffer(capacity),
+    Begin(0),
+    End(0),
+    DirectReadSize(capacity/2),
+    NumberOfReceiveCalls(0),
+    NumberOfDirectReads(0)
+{
+}
+
+//---------------------------------------------------------------------------
+void StreamReader::SetSocket(igtl::Socket* socket)
+{
+  this->Socket = socket;
+  this->Begin = 0;
+  this->End = 0;
+}
+
+//---------------------------------------------------------------------------
+int StreamReader::GetNumberOfBufferedBytes() const
+{
+  return this->End - this->Begin;
+}
+
+//---------------------------------------------------------------------------
+void StreamReader::SetDirectReadSize(int size)
+{
+  this->DirectReadSize = size;
+}
+
+//---------------------------------------------------------------------------
+int StreamReader::GetDirectReadSize() const
+{
+  return this->DirectReadSize;
+}
+
+//---------------------------------------------------------------------------
+unsigned long StreamReader::GetNumberOfReceiveCalls() const
+{
+  return this->NumberOfReceiveCalls;
+}
+
+//---------------------------------------------------------------------------
+unsigned long StreamReader::GetNumberOfDirectReads() const
+{
+  return this->NumberOfDirectReads;
+}
+
+//---------------------------------------------------------------------------
+int StreamReader::Fill()
+{
+  // Only called once the buffer is consumed.
+  this->Begin = 0;
+  this->End = 0;
+  if (!this->Socket || this->Buffer.empty())
+    return 0;
+
+  ++this->NumberOfReceiveCalls;
+  int n = static_cast<int>(this->Socket->Receive(&this->Buffer[0], this->Buffer.size(), 0));
+  if (n <= 0)
+    return 0;
+  this->End = n;
+  return n;
+}
+
+//---------------------------------------------------------------------------
+int StreamReader::Read(void* data, int length)
+{
+  unsigned char* dest = static_cast<unsigned char*>(data);
+  int done = 0;
+
+  while (done < length)
+    {
+    int buffered = this->End - this->Begin;
+    if (buffered > 0)
+      {
+      int n = std::min(buffered, length - done);
+      memcpy(dest + done, &this->Buffer[this->Begin], n);
+      this->Begin += n;
+      done += n;
+      continue;
+      }
+
+    // Large remainder: receive in place, saving a copy.
+    if (length - done >= this->DirectReadSize)
+      {
+      ++this->NumberOfReceiveCalls;
+      ++this->NumberOfDirectReads;
+      int n = static_cast<int>(this->Socket->Receive(dest + done, length - done, 1));
+      if (n <= 0)
+        break;
+      done += n;
+      continue;
+      }
+
+    if (this->Fill() <= 0)
+      break;
+    }
+  return done;
+}
+
+//---------------------------------------------------------------------------
+igtlUint64 StreamReader::Skip(igtlUint64 length)
+{
+  igtlUint64 done = 0;
+  while (done < length)
+    {
+    int buffered = this->End - this->Begin;
+    if (buffered == 0)
+      {
+      if (this->Fill() <= 0)
+        break;
+      continue;
+      }
+    int n = static_cast<int>(std::min<igtlUint64>(buffered, length - done));
+    this->Begin += n;
+    done += n;
+    }
+  return done;
+}
+
+} // namespace igtlio
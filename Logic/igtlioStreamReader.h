@@ -0,0 +1,66 @@
+#ifndef IGTLIOSTREAMREADER_H
+#define IGTLIOSTREAMREADER_H
+
+#include "igtlioLogicExport.h"
+
+// OpenIGTLink includes
+#include <igtlSocket.h>
+
+// STD includes
+#include <vector>
+
+namespace igtlio
+{
+
+/// Blocking reader with a read-ahead buffer, for one connection.
+///
+/// Each receive asks the socket for as much as fits in the buffer, so that
+/// many small messages (TRANSFORM, STATUS, ...) are framed out of a single
+/// system call. Reads of at least DirectReadSize bytes, typically image
+/// bodies, bypass the buffer and are received directly into their
+/// destination once the buffered bytes are consumed.
+///
+/// A short read means the connection was closed: the stream cannot be
+/// resynchronised after losing bytes, the caller must drop the connection.
+class OPENIGTLINKIO_LOGIC_EXPORT StreamReader
+{
+public:
+  StreamReader(int capacity=65536);
+
+  /// Read from the given socket, discarding any buffered data.
+  void SetSocket(igtl::Socket* socket);
+
+  /// Read exactly length bytes.
+  /// Return length, or less if the connection was closed.
+  int Read(void* data, int length);
+
+  /// Discard exactly length bytes.
+  /// Return length, or less if the connection was closed.
+  igtlUint64 Skip(igtlUint64 length);
+
+  /// Number of received bytes not read yet.
+  int GetNumberOfBufferedBytes() const;
+
+  void SetDirectReadSize(int size);
+  int GetDirectReadSize() const;
+
+  /// Statistics
+  unsigned long GetNumberOfReceiveCalls() const;
+  unsigned long GetNumberOfDirectReads() const;
+
+private:
+  int Fill();
+
+  igtl::Socket* Socket;
+  std::vector<unsigned char> Buffer;
+  int Begin; // first unread byte
+  int End;   // end of the received bytes
+  int DirectReadSize;
+
+  unsigned long NumberOfReceiveCalls;
+  unsigned long NumberOfDirectReads;
+};
+
+} // namespace igtlio
+
+#endif // IGTLIOSTREAMREADER_H
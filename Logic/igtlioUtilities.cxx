@@ -1,6 +1,245 @@
 #include "igtlioUtilities.h"
+#include "igtlioDevice.h"
+
+// VTK includes
+#include <vtkAtomic.h>
+#include <vtkMutexLock.h>
+
+// STD includes
+#include <map>
+#include <string.h>
 
 namespace igtlio
 {
 
+//---------------------------------------------------------------------------
+struct DeviceKeyType::Entry
+{
+  std::string Type;
+  std::string Name;
+  std::string BaseTypeName;
+  unsigned int Id;
+  unsigned int Hash;
+};
+
+namespace
+{
+
+//---------------------------------------------------------------------------
+// FNV-1a over type and name, separated by a NUL.
+unsigned int HashKey(const char* type, const char* name)
+{
+  unsigned int hash = 2166136261u;
+  for (const char* c = type; *c; ++c)
+    {
+    hash = (hash ^ static_cast<unsigned char>(*c)) * 16777619u;
+    }
+  hash *= 16777619u;
+  for (const char* c = name; *c; ++c)
+    {
+    hash = (hash ^ static_cast<unsigned char>(*c)) * 16777619u;
+    }
+  return hash;
+}
+
+//---------------------------------------------------------------------------
+// Lookups of existing keys do not lock: a node is fully initialized before
+// it is published as a bucket head, and is never modified afterwards.
+// Rehashing builds new nodes into a new bucket array, so a reader still
+// walking the previous array sees a consistent, possibly stale, table and
+// falls back to the locked path on a miss. Entries, nodes and bucket arrays
+// are never freed: keys may outlive any connector, and the arrays only
+// double, so the nodes left behind are bounded by the number of entries.
+class DeviceKeyTable
+{
+public:
+  DeviceKeyTable() : NumberOfEntries(0), NumberOfIds(1)
+  {
+    this->Buckets = new BucketArray(64);
+  }
+
+  const DeviceKeyType::Entry* Intern(const char* type, const char* name)
+  {
+    unsigned int hash = HashKey(type, name);
+
+    const DeviceKeyType::Entry* entry = Find(this->Buckets.Load(), type, name, hash);
+    if (entry)
+      {
+      return entry;
+      }
+
+    this->Mutex.Lock();
+    entry = Find(this->Buckets.Load(), type, name, hash);
+    if (!entry)
+      {
+      entry = this->Insert(type, name, hash);
+      }
+    this->Mutex.Unlock();
+    return entry;
+  }
+
+  unsigned int GetNumberOfIds()
+  {
+    return this->NumberOfIds.Load();
+  }
+
+private:
+  struct Node
+  {
+    DeviceKeyType::Entry* Entry;
+    Node* Next; // in the same bucket
+  };
+
+  struct BucketArray
+  {
+    BucketArray(size_t size) : Size(size), Heads(new vtkAtomic<Node*>[size]) {}
+    size_t Size;
+    vtkAtomic<Node*>* Heads;
+  };
+
+  static const DeviceKeyType::Entry* Find(const BucketArray* buckets, const char* type, const char* name, unsigned int hash)
+  {
+    const Node* node = buckets->Heads[hash & (buckets->Size-1)].Load();
+    while (node && (node->Entry->Hash != hash || node->Entry->Type != type || node->Entry->Name != name))
+      {
+      node = node->Next;
+      }
+    return node ? node->Entry : NULL;
+  }
+
+  static void Link(BucketArray* buckets, DeviceKeyType::Entry* entry)
+  {
+    vtkAtomic<Node*>& head = buckets->Heads[entry->Hash & (buckets->Size-1)];
+    Node* node = new Node;
+    node->Entry = entry;
+    node->Next = head.Load();
+    head.Store(node);
+  }
+
+  DeviceKeyType::Entry* Insert(const char* type, const char* name, unsigned int hash)
+  {
+    DeviceKeyType::Entry* entry = new DeviceKeyType::Entry;
+    entry->Type = type;
+    entry->Name = name;
+    std::string::size_type pos = entry->Type.find("_");
+    entry->BaseTypeName = (pos != std::string::npos) ? entry->Type.substr(pos+1) : entry->Type;
+    entry->Hash = hash;
+
+    // Keys differing only by their prefix share the id.
+    std::pair<std::string, std::string> base(entry->BaseTypeName, entry->Name);
+    std::map<std::pair<std::string, std::string>, unsigned int>::iterator iter = this->Ids.find(base);
+    if (iter == this->Ids.end())
+      {
+      unsigned int id = this->NumberOfIds.Load();
+      iter = this->Ids.insert(std::make_pair(base, id)).first;
+      this->NumberOfIds.Store(id+1);
+      }
+    entry->Id = iter->second;
+
+    BucketArray* buckets = this->Buckets.Load();
+    if (++this->NumberOfEntries > buckets->Size)
+      {
+      buckets = this->Rehash(buckets, 2*buckets->Size);
+      }
+    Link(buckets, entry);
+    return entry;
+  }
+
+  BucketArray* Rehash(const BucketArray* buckets, size_t size)
+  {
+    BucketArray* rehashed = new BucketArray(size);
+    for (size_t i=0; i<buckets->Size; ++i)
+      {
+      for (const Node* node = buckets->Heads[i].Load(); node; node = node->Next)
+        {
+        Link(rehashed, node->Entry);
+        }
+      }
+    this->Buckets.Store(rehashed);
+    return rehashed;
+  }
+
+  vtkSimpleMutexLock Mutex; // serializes insertions
+  vtkAtomic<BucketArray*> Buckets;
+  size_t NumberOfEntries;
+  std::map<std::pair<std::string, std::string>, unsigned int> Ids;
+  vtkAtomic<unsigned int> NumberOfIds;
+};
+
+DeviceKeyTable Table;
+const std::string EmptyString;
+
+} // namespace
+
+//---------------------------------------------------------------------------
+DeviceKeyType::DeviceKeyType() : Key(NULL)
+{
+}
+
+//---------------------------------------------------------------------------
+DeviceKeyType::DeviceKeyType(const std::string& type, const std::string& name) : Key(NULL)
+{
+  if (!type.empty() || !name.empty())
+    {
+    this->Key = Table.Intern(type.c_str(), name.c_str());
+    }
+}
+
+//---------------------------------------------------------------------------
+DeviceKeyType::DeviceKeyType(const char* type, const char* name) : Key(NULL)
+{
+  type = type ? type : "";
+  name = name ? name : "";
+  if (*type || *name)
+    {
+    this->Key = Table.Intern(type, name);
+    }
+}
+
+//---------------------------------------------------------------------------
+const std::string& DeviceKeyType::GetType() const
+{
+  return this->Key ? this->Key->Type : EmptyString;
+}
+
+//---------------------------------------------------------------------------
+const std::string& DeviceKeyType::GetName() const
+{
+  return this->Key ? this->Key->Name : EmptyString;
+}
+
+//---------------------------------------------------------------------------
+const std::string& DeviceKeyType::GetBaseTypeName() const
+{
+  return this->Key ? this->Key->BaseTypeName : EmptyString;
+}
+
+//---------------------------------------------------------------------------
+unsigned int DeviceKeyType::GetId() const
+{
+  return this->Key ? this->Key->Id : 0;
+}
+
+//---------------------------------------------------------------------------
+unsigned int DeviceKeyType::GetNumberOfIds()
+{
+  return Table.GetNumberOfIds();
+}
+
+//---------------------------------------------------------------------------
+DeviceKeyType CreateDeviceKey(igtl::MessageBase::Pointer message)
+{
+  if (!message)
+    return DeviceKeyType();
+  return DeviceKeyType(message->GetDeviceType(), message->GetDeviceName());
+}
+
+//---------------------------------------------------------------------------
+DeviceKeyType CreateDeviceKey(DevicePointer device)
+{
+  if (!device)
+    return DeviceKeyType();
+  return DeviceKeyType(device->GetDeviceType(), device->GetDeviceName());
+}
+
 } // namespace igtlio
@@ -21,22 +21,41 @@ enum OPENIGTLINKIO_LOGIC_EXPORT SYNCHRONIZATION_TYPE
 /// This enables broadcast Devices (with empty name) of different types
 /// to be stored in the same structures.
 ///
-struct OPENIGTLINKIO_LOGIC_EXPORT DeviceKeyType
+/// Keys are interned: the strings are stored once in a global table and a
+/// key only refers to its entry, so that copying, comparing and hashing keys
+/// do no string work. Keys that only differ by a message prefix, such as
+/// GET_IMAGE and IMAGE, are equal and share the same id.
+///
+class OPENIGTLINKIO_LOGIC_EXPORT DeviceKeyType
 {
-  explicit DeviceKeyType() {}
-  explicit DeviceKeyType(const std::string& type_, const std::string& name_) :
-    type(type_), name(name_) {}
-  std::string type;
-  std::string name;
-
 public:
-  std::string GetBaseTypeName() const;
+  DeviceKeyType();
+  explicit DeviceKeyType(const std::string& type, const std::string& name);
+  /// Look up the key without allocating, unless it is new.
+  explicit DeviceKeyType(const char* type, const char* name);
+
+  const std::string& GetType() const;
+  const std::string& GetName() const;
+  /// The type without message prefix, e.g. COMMAND for RTS_COMMAND.
+  const std::string& GetBaseTypeName() const;
+
+  /// Small integer, identical for equal keys. The empty key has id 0,
+  /// the others are numbered from 1 in order of first use.
+  unsigned int GetId() const;
+  /// Upper bound of the ids handed out so far, for tables indexed by id.
+  static unsigned int GetNumberOfIds();
+
+  struct Entry;
+
+private:
+  const Entry* Key;
 };
-//typedef std::pair<std::string, std::string> DeviceKeyType;
+
 OPENIGTLINKIO_LOGIC_EXPORT DeviceKeyType CreateDeviceKey(igtl::MessageBase::Pointer message);
 OPENIGTLINKIO_LOGIC_EXPORT DeviceKeyType CreateDeviceKey(DevicePointer device);
-bool operator==(const DeviceKeyType& lhs, const DeviceKeyType& rhs);
-bool operator<(const DeviceKeyType& lhs, const DeviceKeyType& rhs);
+inline bool operator==(const DeviceKeyType& lhs, const DeviceKeyType& rhs) { return lhs.GetId() == rhs.GetId(); }
+inline bool operator!=(const DeviceKeyType& lhs, const DeviceKeyType& rhs) { return lhs.GetId() != rhs.GetId(); }
+inline bool operator<(const DeviceKeyType& lhs, const DeviceKeyType& rhs) { return lhs.GetId() < rhs.GetId(); }
 
 } // namespace igtlio
 
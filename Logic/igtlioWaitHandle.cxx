@@ -0,0 +1,164 @@
+#include "igtlioWaitHandle.h"
+#include "igtlioLockFree.h"
+
+// OpenIGTLink includes
+#include <igtlOSUtil.h>
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkTimerLog.h>
+
+#if defined(__linux__)
+#define IGTLIO_USE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#endif
+
+namespace igtlio
+{
+
+//---------------------------------------------------------------------------
+vtkStandardNewMacro(WaitHandle);
+
+//---------------------------------------------------------------------------
+WaitHandle::WaitHandle()
+{
+  this->Signaled = 0;
+  this->ReadDescriptor = -1;
+  this->WriteDescriptor = -1;
+
+#if defined(IGTLIO_USE_EVENTFD)
+  this->ReadDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  this->WriteDescriptor = this->ReadDescriptor;
+  if (this->ReadDescriptor < 0)
+    {
+    vtkErrorMacro("Failed to create eventfd: " << strerror(errno));
+    }
+#elif !defined(_WIN32)
+  int descriptors[2];
+  if (pipe(descriptors) == 0)
+    {
+    for (int i=0; i<2; ++i)
+      {
+      fcntl(descriptors[i], F_SETFL, fcntl(descriptors[i], F_GETFL, 0) | O_NONBLOCK);
+      fcntl(descriptors[i], F_SETFD, FD_CLOEXEC);
+      }
+    this->ReadDescriptor = descriptors[0];
+    this->WriteDescriptor = descriptors[1];
+    }
+  else
+    {
+    vtkErrorMacro("Failed to create pipe: " << strerror(errno));
+    }
+#endif
+}
+
+//---------------------------------------------------------------------------
+WaitHandle::~WaitHandle()
+{
+#if !defined(_WIN32)
+  if (this->ReadDescriptor >= 0)
+    close(this->ReadDescriptor);
+  if (this->WriteDescriptor >= 0 && this->WriteDescriptor != this->ReadDescriptor)
+    close(this->WriteDescriptor);
+#endif
+}
+
+//---------------------------------------------------------------------------
+void WaitHandle::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "Descriptor: " << this->ReadDescriptor << "\n";
+  os << indent << "Signaled: " << this->Signaled << "\n";
+}
+
+//---------------------------------------------------------------------------
+void WaitHandle::SetParent(WaitHandle* parent)
+{
+  this->Parent = parent;
+}
+
+//---------------------------------------------------------------------------
+void WaitHandle::Signal()
+{
+  if (AtomicExchange(&this->Signaled, 1) == 0)
+    {
+#if !defined(_WIN32)
+    if (this->WriteDescriptor >= 0)
+      {
+      // Fails only if the pipe is full, which is readable anyway.
+      uint64_t one = 1;
+      ssize_t written = write(this->WriteDescriptor, &one, this->WriteDescriptor == this->ReadDescriptor ? sizeof(one) : 1);
+      (void)written;
+      }
+#endif
+    }
+
+  if (this->Parent)
+    {
+    this->Parent->Signal();
+    }
+}
+
+//---------------------------------------------------------------------------
+void WaitHandle::Clear()
+{
+#if !defined(_WIN32)
+  // Drain before lowering the flag. A Signal() landing in between finds
+  // the flag raised and writes nothing, and its work is processed by the
+  // caller after Clear(). The other way around, the drain could eat the
+  // byte of a Signal() that raised the flag again, leaving it raised with
+  // nothing to read, so that later Signal()s would not write either.
+  if (this->ReadDescriptor >= 0)
+    {
+    char buffer[64];
+    while (read(this->ReadDescriptor, buffer, sizeof(buffer)) > 0 && this->WriteDescriptor != this->ReadDescriptor)
+      {
+      }
+    }
+#endif
+
+  AtomicExchange(&this->Signaled, 0);
+}
+
+//---------------------------------------------------------------------------
+int WaitHandle::Wait(double timeout)
+{
+  if (this->Signaled)
+    {
+    return 1;
+    }
+
+#if !defined(_WIN32)
+  if (this->ReadDescriptor >= 0)
+    {
+    struct pollfd fd;
+    fd.fd = this->ReadDescriptor;
+    fd.events = POLLIN;
+    fd.revents = 0;
+    int timeoutMs = timeout > 0 ? static_cast<int>(timeout*1000.0 + 0.5) : 0;
+    if (poll(&fd, 1, timeoutMs) > 0)
+      {
+      return 1;
+      }
+    return this->Signaled != 0;
+    }
+#endif
+
+  double deadline = vtkTimerLog::GetUniversalTime() + timeout;
+  while (!this->Signaled && vtkTimerLog::GetUniversalTime() < deadline)
+    {
+    igtl::Sleep(1);
+    }
+  return this->Signaled != 0;
+}
+
+} // namespace igtlio
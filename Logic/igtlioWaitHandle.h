@@ -0,0 +1,74 @@
+#ifndef IGTLIOWAITHANDLE_H
+#define IGTLIOWAITHANDLE_H
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// IGTLIO includes
+#include "igtlioLogicExport.h"
+
+namespace igtlio
+{
+typedef vtkSmartPointer<class WaitHandle> WaitHandlePointer;
+
+/// A flag raised by the I/O threads when the main thread has work to do,
+/// exposed as a descriptor that can be watched by an event loop.
+///
+/// The descriptor becomes readable when Signal() is called, and stays
+/// readable until Clear(). Applications watch it (e.g. with a
+/// QSocketNotifier, poll or select) and call PeriodicProcess() when it
+/// is readable, instead of polling on a short timer.
+///
+/// The descriptor is an eventfd on Linux and a pipe on other POSIX
+/// systems. It is not available on Windows (GetDescriptor() returns -1),
+/// where Wait() falls back to sleeping in short steps.
+///
+class OPENIGTLINKIO_LOGIC_EXPORT WaitHandle : public vtkObject
+{
+public:
+  static WaitHandle *New();
+  vtkTypeMacro(WaitHandle, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Descriptor to watch for reading, -1 if not available.
+  int GetDescriptor() const { return this->ReadDescriptor; }
+
+  /// Raise the flag, and the flag of the parent. Thread safe, does not
+  /// block, and only makes a system call if the flag was not raised yet.
+  void Signal();
+
+  /// Lower the flag. Called by the waiting thread before it processes
+  /// the pending work, so that work arriving meanwhile raises it again.
+  void Clear();
+
+  /// Non-zero if the flag is raised.
+  int IsSignaled() const { return this->Signaled != 0; }
+
+  /// Block until the flag is raised, or timeout seconds have elapsed.
+  /// Returns 1 if raised. The flag is not lowered.
+  int Wait(double timeout);
+
+  /// Handle also signaled by this one, e.g. the handle of the Logic
+  /// gathering all its connectors. Set it before the I/O threads start,
+  /// it may be used by them until this handle is destroyed.
+  void SetParent(WaitHandle* parent);
+  WaitHandle* GetParent() { return this->Parent; }
+
+protected:
+  WaitHandle();
+  virtual ~WaitHandle();
+
+private:
+  WaitHandle(const WaitHandle&); // Not implemented
+  void operator=(const WaitHandle&); // Not implemented
+
+  volatile int Signaled;
+  int ReadDescriptor;
+  int WriteDescriptor; // same as ReadDescriptor for an eventfd
+  WaitHandlePointer Parent;
+};
+
+} // namespace igtlio
+
+#endif // IGTLIOWAITHANDLE_H
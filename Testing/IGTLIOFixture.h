@@ -2,6 +2,7 @@
 #define IGTLIOFIXTURE_H
 
 
+#include <iostream>
 #include <string>
 #include "igtlioLogic.h"
 #include "igtlioConnector.h"
@@ -12,6 +13,15 @@
 
 class vtkImageData;
 
+/// Fail the test, returning 1 from the calling function, if the condition
+/// does not hold.
+#define CHECK(condition)                                           \
+  if (!(condition))                                                \
+    {                                                              \
+    std::cout << "FAILURE: " #condition << std::endl;              \
+    return 1;                                                      \
+    }
+
 struct LogicFixture
 {
   LogicFixture();
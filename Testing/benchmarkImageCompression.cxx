@@ -0,0 +1,166 @@
+#include <cmath>
+#include <iostream>
+#include <string.h>
+#include "igtlioImageCompressor.h"
+#include "igtlioImageConverter.h"
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkTimerLog.h>
+
+// Compression ratio and throughput of the codecs on synthetic CT, MR and
+// US volumes, single threaded and with all threads.
+
+const int Repeat = 3;
+
+//---------------------------------------------------------------------------
+// Pseudo random, the same on every platform.
+struct Random
+{
+  Random() : Seed(1) {}
+  unsigned int Next(unsigned int range)
+  {
+    this->Seed = this->Seed*1103515245u + 12345u;
+    return (this->Seed >> 16) % range;
+  }
+  unsigned int Seed;
+};
+
+//---------------------------------------------------------------------------
+// 16 bit CT: air around a water body with a bone ring, noise of a few HU.
+vtkSmartPointer<vtkImageData> CreateCT()
+{
+  vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+  image->SetDimensions(512, 512, 64);
+  image->AllocateScalars(VTK_SHORT, 1);
+  short* ptr = static_cast<short*>(image->GetScalarPointer());
+  Random random;
+  for (int k=0; k<64; ++k)
+    for (int j=0; j<512; ++j)
+      for (int i=0; i<512; ++i, ++ptr)
+        {
+        double r = std::sqrt((i-256.0)*(i-256.0) + (j-256.0)*(j-256.0));
+        int value = r > 200 ? -1000 : (r > 180 ? 1200 : 40);
+        *ptr = static_cast<short>(value + static_cast<int>(random.Next(16)) - 8);
+        }
+  return image;
+}
+
+//---------------------------------------------------------------------------
+// Unsigned 16 bit MR: smooth tissue intensities, low background noise.
+vtkSmartPointer<vtkImageData> CreateMR()
+{
+  vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+  image->SetDimensions(256, 256, 64);
+  image->AllocateScalars(VTK_UNSIGNED_SHORT, 1);
+  unsigned short* ptr = static_cast<unsigned short*>(image->GetScalarPointer());
+  Random random;
+  for (int k=0; k<64; ++k)
+    for (int j=0; j<256; ++j)
+      for (int i=0; i<256; ++i, ++ptr)
+        {
+        double x = (i-128.0)/110;
+        double y = (j-128.0)/90;
+        double r2 = x*x + y*y;
+        int value = r2 > 1 ? 0 : static_cast<int>(600 + 400*std::cos(6*r2) + 3*k);
+        *ptr = static_cast<unsigned short>(value + random.Next(r2 > 1 ? 4 : 24));
+        }
+  return image;
+}
+
+//---------------------------------------------------------------------------
+// 8 bit US: speckle in a sector, black outside.
+vtkSmartPointer<vtkImageData> CreateUS()
+{
+  vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+  image->SetDimensions(640, 480, 32);
+  image->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  unsigned char* ptr = static_cast<unsigned char*>(image->GetScalarPointer());
+  Random random;
+  for (int k=0; k<32; ++k)
+    for (int j=0; j<480; ++j)
+      for (int i=0; i<640; ++i, ++ptr)
+        {
+        double dx = i - 320.0;
+        bool inside = j > 20 && std::fabs(dx) < 0.7*j;
+        int echo = 60 + static_cast<int>(40*std::sin(j/25.0));
+        *ptr = inside ? static_cast<unsigned char>(echo * random.Next(4) / 2) : 0;
+        }
+  return image;
+}
+
+//---------------------------------------------------------------------------
+int Benchmark(const char* name, vtkImageData* image)
+{
+  igtlio::ImageConverter::HeaderData header;
+  header.deviceName = name;
+  header.timestamp = 0;
+  igtlio::ImageConverter::ContentData content;
+  content.image = image;
+  content.transform = vtkSmartPointer<vtkMatrix4x4>::New();
+  igtl::ImageMessage::Pointer msg;
+  if (!igtlio::ImageConverter::toIGTL(header, content, &msg))
+    {
+    std::cout << "FAILURE: " << name << " not converted" << std::endl;
+    return 1;
+    }
+  double megabytes = msg->GetPackSize() / 1e6;
+  std::cout << name << ": " << megabytes << " MB" << std::endl;
+
+  int failures = 0;
+  for (int codec=igtlio::ImageCompressor::CODEC_ZLIB; codec<igtlio::ImageCompressor::CODEC_AUTO; ++codec)
+    {
+    if (!igtlio::ImageCompressor::IsCodecSupported(codec))
+      {
+      continue;
+      }
+    for (int threads=1; threads<=2; ++threads)
+      {
+      int numberOfThreads = threads == 1 ? 1 : 0; // single or automatic
+      igtl::MessageBase::Pointer compressed;
+      double start = vtkTimerLog::GetUniversalTime();
+      for (int r=0; r<Repeat; ++r)
+        {
+        compressed = igtlio::ImageCompressor::Compress(codec, msg->GetPackPointer(), msg->GetPackSize(),
+                                                       NULL, 0, numberOfThreads);
+        }
+      double compressTime = (vtkTimerLog::GetUniversalTime() - start)/Repeat;
+
+      igtl::MessageHeader::Pointer imageHeader = igtl::MessageHeader::New();
+      igtl::ImageMessage::Pointer received = igtl::ImageMessage::New();
+      bool ok = compressed.IsNotNull() && igtlio::ImageCompressor::GetImageHeader(compressed, imageHeader);
+      if (ok)
+        {
+        received->SetMessageHeader(imageHeader);
+        received->AllocatePack();
+        }
+      start = vtkTimerLog::GetUniversalTime();
+      for (int r=0; r<Repeat && ok; ++r)
+        {
+        ok = igtlio::ImageCompressor::Decompress(compressed, received->GetPackBodyPointer(),
+                                                 received->GetPackBodySize(), numberOfThreads) != 0;
+        }
+      double decompressTime = (vtkTimerLog::GetUniversalTime() - start)/Repeat;
+      if (!ok || memcmp(received->GetPackBodyPointer(), msg->GetPackBodyPointer(), msg->GetPackBodySize()) != 0)
+        {
+        std::cout << "FAILURE: " << name << " differs after " << igtlio::ImageCompressor::GetCodecName(codec) << std::endl;
+        ++failures;
+        continue;
+        }
+
+      std::cout << "  " << igtlio::ImageCompressor::GetCodecName(codec) << (threads == 1 ? ", 1 thread" : ", threads")
+                << ": ratio " << double(msg->GetPackSize())/compressed->GetPackSize()
+                << ", compression " << (compressTime > 0 ? megabytes/compressTime : 0) << " MB/s"
+                << ", decompression " << (decompressTime > 0 ? megabytes/decompressTime : 0) << " MB/s" << std::endl;
+      }
+    }
+  return failures;
+}
+
+int main(int argc, char **argv)
+{
+  int failures = 0;
+  failures += Benchmark("CT", CreateCT());
+  failures += Benchmark("MR", CreateMR());
+  failures += Benchmark("US", CreateUS());
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,119 @@
+#include <iostream>
+#include <string.h>
+#include <vector>
+#include "igtlioImageCopy.h"
+#include <igtl_util.h>
+#include <vtkTimerLog.h>
+
+// Compares the byte swap kernels on whole volumes and sub-volumes of
+// several sizes and scalar widths, with the per-scalar loop they replaced.
+
+const int Repeat = 5;
+
+//---------------------------------------------------------------------------
+// Previous implementation: one scalar per iteration, row by row.
+void SwapCopyRows(char* volume, const int size[3], const char* subVolume,
+                  const int svsize[3], const int svoffset[3], int scalarSize)
+{
+  const char* src = subVolume;
+  for (int k=svoffset[2]; k<svoffset[2]+svsize[2]; ++k)
+    {
+    for (int j=svoffset[1]; j<svoffset[1]+svsize[1]; ++j)
+      {
+      char* dst = &volume[((size_t)size[0]*size[1]*k + (size_t)size[0]*j + svoffset[0])*scalarSize];
+      for (int i=0; i<svsize[0]; ++i, dst+=scalarSize, src+=scalarSize)
+        {
+        if (scalarSize == 2)
+          *(igtlUint16*)dst = BYTE_SWAP_INT16(*(const igtlUint16*)src);
+        else if (scalarSize == 4)
+          *(igtlUint32*)dst = BYTE_SWAP_INT32(*(const igtlUint32*)src);
+        else
+          *(igtlUint64*)dst = BYTE_SWAP_INT64(*(const igtlUint64*)src);
+        }
+      }
+    }
+}
+
+//---------------------------------------------------------------------------
+void Report(const char* name, int scalarSize, const int svsize[3], double seconds)
+{
+  double bytes = (double)svsize[0]*svsize[1]*svsize[2]*scalarSize;
+  std::cout << "  " << name << " " << scalarSize*8 << " bit: " << seconds*1e3 << " ms, "
+            << (seconds > 0 ? bytes/seconds/1e9 : 0) << " GB/s" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  int failures = 0;
+  const int sizes[][3] = { {64, 64, 64}, {256, 256, 64}, {512, 512, 64} };
+
+  for (unsigned s=0; s<sizeof(sizes)/sizeof(sizes[0]); ++s)
+    {
+    for (int sub=0; sub<2; ++sub)
+      {
+      const int* size = sizes[s];
+      int svsize[3] = { size[0], size[1], size[2] };
+      int svoffset[3] = { 0, 0, 0 };
+      if (sub)
+        {
+        // Half of each dimension, in the middle
+        for (int d=0; d<3; ++d)
+          {
+          svsize[d] = size[d]/2;
+          svoffset[d] = size[d]/4;
+          }
+        }
+      std::cout << (sub ? "Sub-volume " : "Volume ") << svsize[0] << "x" << svsize[1] << "x" << svsize[2]
+                << " of " << size[0] << "x" << size[1] << "x" << size[2] << std::endl;
+
+      for (int scalarSize=2; scalarSize<=8; scalarSize*=2)
+        {
+        size_t volumeBytes = (size_t)size[0]*size[1]*size[2]*scalarSize;
+        size_t subBytes = (size_t)svsize[0]*svsize[1]*svsize[2]*scalarSize;
+        std::vector<char> src(subBytes);
+        for (size_t i=0; i<subBytes; ++i)
+          {
+          src[i] = (char)(i*7 + i/13);
+          }
+        std::vector<char> expected(volumeBytes, 0);
+        std::vector<char> volume(volumeBytes, 0);
+
+        double start = vtkTimerLog::GetUniversalTime();
+        for (int r=0; r<Repeat; ++r)
+          {
+          SwapCopyRows(&expected[0], size, &src[0], svsize, svoffset, scalarSize);
+          }
+        Report("per-scalar loop", scalarSize, svsize, (vtkTimerLog::GetUniversalTime() - start)/Repeat);
+
+        for (int kernel=igtlio::ImageCopy::KERNEL_SCALAR; kernel<=igtlio::ImageCopy::KERNEL_AVX2; ++kernel)
+          {
+          if (!igtlio::ImageCopy::SetKernel(kernel))
+            {
+            continue;
+            }
+          for (int threads=1; threads<=2; ++threads)
+            {
+            int numberOfThreads = threads == 1 ? 1 : 0; // single or automatic
+            memset(&volume[0], 0, volumeBytes);
+            start = vtkTimerLog::GetUniversalTime();
+            for (int r=0; r<Repeat; ++r)
+              {
+              igtlio::ImageCopy::CopySubVolume(&volume[0], size, &src[0], svsize, svoffset,
+                                               scalarSize, 1, true, numberOfThreads);
+              }
+            std::string name = igtlio::ImageCopy::GetKernelName(kernel);
+            name += threads == 1 ? ", 1 thread" : ", threads";
+            Report(name.c_str(), scalarSize, svsize, (vtkTimerLog::GetUniversalTime() - start)/Repeat);
+            if (volume != expected)
+              {
+              std::cout << "FAILURE: " << name << " differs from the per-scalar loop" << std::endl;
+              ++failures;
+              }
+            }
+          }
+        }
+      }
+    }
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,302 @@
+#include <iostream>
+#include <list>
+#include <string>
+#include <string.h>
+#include <igtlMessageHeader.h>
+#include "igtlioPolyDataConverter.h"
+#include <vtkCellArray.h>
+#include <vtkCellData.h>
+#include <vtkDoubleArray.h>
+#include <vtkFloatArray.h>
+#include <vtkIdList.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkPolygon.h>
+#include <vtkTimerLog.h>
+
+// Compares the conversion of triangle meshes of 1k to 1M cells with the
+// point by point conversion through the igtl::PolyDataMessage arrays it
+// replaced, and checks that both read what the other one writes.
+
+// Meshes larger than this are only converted by the bulk implementation.
+const int MaximumPreviousCells = 100000;
+
+//---------------------------------------------------------------------------
+// Grid of triangles, with point normals and a cell scalar.
+vtkSmartPointer<vtkPolyData> CreateMesh(int ncells)
+{
+  int nx = 1;
+  while (2*nx*nx < ncells)
+    ++nx;
+  int ny = (ncells/2 + nx - 1)/nx;
+
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  vtkSmartPointer<vtkFloatArray> normals = vtkSmartPointer<vtkFloatArray>::New();
+  normals->SetName("Normals");
+  normals->SetNumberOfComponents(3);
+  for (int j=0; j<=ny; ++j)
+    {
+    for (int i=0; i<=nx; ++i)
+      {
+      points->InsertNextPoint(0.5*i, 0.25*j, 0.01*(i%7) + 0.02*(j%5));
+      normals->InsertNextTuple3(0, 0.1*(i%3), 1);
+      }
+    }
+
+  vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+  vtkSmartPointer<vtkDoubleArray> scalars = vtkSmartPointer<vtkDoubleArray>::New();
+  scalars->SetName("Thickness");
+  for (int c=0; c<ncells; ++c)
+    {
+    int quad = c/2;
+    vtkIdType p0 = (quad/nx)*(nx+1) + quad%nx;
+    vtkIdType triangle[3] = { p0, p0+1, p0+nx+1 };
+    if (c%2)
+      {
+      triangle[0] = p0+nx+2;
+      }
+    polys->InsertNextCell(3, triangle);
+    scalars->InsertNextValue(0.125*(c%11));
+    }
+
+  vtkSmartPointer<vtkPolyData> poly = vtkSmartPointer<vtkPolyData>::New();
+  poly->SetPoints(points);
+  poly->SetPolys(polys);
+  poly->GetPointData()->AddArray(normals);
+  poly->GetCellData()->AddArray(scalars);
+  return poly;
+}
+
+//---------------------------------------------------------------------------
+// Previous implementation: point by point, and one std::list per cell.
+void PreviousVTKToIGTL(vtkPolyData* poly, igtl::PolyDataMessage::Pointer outMessage)
+{
+  outMessage->SetDeviceName("Mesh");
+  igtl::PolyDataPointArray::Pointer pointArray = igtl::PolyDataPointArray::New();
+  for (vtkIdType i = 0; i < poly->GetNumberOfPoints(); i ++)
+    {
+    double *p = poly->GetPoints()->GetPoint(i);
+    pointArray->AddPoint(static_cast<igtlFloat32>(p[0]), static_cast<igtlFloat32>(p[1]), static_cast<igtlFloat32>(p[2]));
+    }
+  outMessage->SetPoints(pointArray);
+
+  igtl::PolyDataCellArray::Pointer polygonsArray = igtl::PolyDataCellArray::New();
+  vtkSmartPointer<vtkIdList> idList = vtkSmartPointer<vtkIdList>::New();
+  vtkCellArray* polys = poly->GetPolys();
+  polys->InitTraversal();
+  while (polys->GetNextCell(idList))
+    {
+    std::list<igtlUint32> cell;
+    for (vtkIdType i = 0; i < idList->GetNumberOfIds(); i ++)
+      {
+      cell.push_back(idList->GetId(i));
+      }
+    polygonsArray->AddCell(cell);
+    }
+  outMessage->SetPolygons(polygonsArray);
+
+  vtkDataArray* arrays[2] = { poly->GetPointData()->GetArray(0), poly->GetCellData()->GetArray(0) };
+  int types[2] = { igtl::PolyDataAttribute::POINT_NORMAL, igtl::PolyDataAttribute::CELL_SCALAR };
+  for (int a=0; a<2; ++a)
+    {
+    igtl::PolyDataAttribute::Pointer attribute = igtl::PolyDataAttribute::New();
+    attribute->SetType(types[a]);
+    attribute->SetName(arrays[a]->GetName());
+    attribute->SetSize(arrays[a]->GetNumberOfTuples());
+    for (vtkIdType j = 0; j < arrays[a]->GetNumberOfTuples(); j ++)
+      {
+      double * tuple = arrays[a]->GetTuple(j);
+      igtlFloat32 data[9];
+      for (int k = 0; k < arrays[a]->GetNumberOfComponents(); k ++)
+        {
+        data[k] = static_cast<igtlFloat32>(tuple[k]);
+        }
+      attribute->SetNthData(j, data);
+      }
+    outMessage->AddAttribute(attribute);
+    }
+  outMessage->Pack();
+}
+
+//---------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> PreviousIGTLToVTK(igtl::MessageBase::Pointer source)
+{
+  igtl::PolyDataMessage::Pointer polyDataMsg = igtl::PolyDataMessage::New();
+  polyDataMsg->Copy(source);
+  polyDataMsg->Unpack(1);
+
+  vtkSmartPointer<vtkPolyData> poly = vtkSmartPointer<vtkPolyData>::New();
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  igtl::PolyDataPointArray::Pointer pointsArray = polyDataMsg->GetPoints();
+  for (int i = 0; i < pointsArray->GetNumberOfPoints(); i ++)
+    {
+    igtlFloat32 point[3];
+    pointsArray->GetPoint(i, point);
+    points->InsertNextPoint(point);
+    }
+  poly->SetPoints(points);
+
+  vtkSmartPointer<vtkCellArray> polygonCells = vtkSmartPointer<vtkCellArray>::New();
+  igtl::PolyDataCellArray::Pointer polygonsArray = polyDataMsg->GetPolygons();
+  for (unsigned int i = 0; i < polygonsArray->GetNumberOfCells(); i++)
+    {
+    vtkSmartPointer<vtkPolygon> polygon = vtkSmartPointer<vtkPolygon>::New();
+    std::list<igtlUint32> cell;
+    polygonsArray->GetCell(i, cell);
+    polygon->GetPointIds()->SetNumberOfIds(cell.size());
+    int j = 0;
+    for (std::list<igtlUint32>::iterator iter = cell.begin(); iter != cell.end(); iter ++)
+      {
+      polygon->GetPointIds()->SetId(j++, *iter);
+      }
+    polygonCells->InsertNextCell(polygon);
+    }
+  poly->SetPolys(polygonCells);
+
+  for (int i = 0; i < polyDataMsg->GetNumberOfAttributes(); i ++)
+    {
+    igtl::PolyDataAttribute::Pointer attribute = polyDataMsg->GetAttribute(i);
+    vtkSmartPointer<vtkFloatArray> data = vtkSmartPointer<vtkFloatArray>::New();
+    data->SetName(attribute->GetName());
+    data->SetNumberOfComponents(attribute->GetNumberOfComponents());
+    data->SetNumberOfTuples(attribute->GetSize());
+    attribute->GetData(static_cast<igtl_float32*>(data->GetPointer(0)));
+    if ((attribute->GetType() & 0xF0) == 0)
+      poly->GetPointData()->AddArray(data);
+    else
+      poly->GetCellData()->AddArray(data);
+    }
+  return poly;
+}
+
+//---------------------------------------------------------------------------
+// The message as received by the connector.
+igtl::MessageBase::Pointer Receive(igtl::MessageBase::Pointer sent)
+{
+  igtl::MessageHeader::Pointer headerMsg = igtl::MessageHeader::New();
+  headerMsg->InitPack();
+  memcpy(headerMsg->GetPackPointer(), sent->GetPackPointer(), IGTL_HEADER_SIZE);
+  headerMsg->Unpack();
+  igtl::MessageBase::Pointer msg = igtl::MessageBase::New();
+  msg->SetMessageHeader(headerMsg);
+  msg->AllocatePack();
+  memcpy(msg->GetPackPointer(), sent->GetPackPointer(), sent->GetPackSize());
+  return msg;
+}
+
+//---------------------------------------------------------------------------
+bool SameArray(vtkDataArray* array, vtkDataArray* expected)
+{
+  if (!array || !expected
+      || array->GetNumberOfTuples() != expected->GetNumberOfTuples()
+      || array->GetNumberOfComponents() != expected->GetNumberOfComponents()
+      || std::string(array->GetName() ? array->GetName() : "") != (expected->GetName() ? expected->GetName() : ""))
+    return false;
+  for (vtkIdType i=0; i<array->GetNumberOfTuples(); ++i)
+    for (int k=0; k<array->GetNumberOfComponents(); ++k)
+      if (array->GetComponent(i, k) != static_cast<float>(expected->GetComponent(i, k)))
+        return false;
+  return true;
+}
+
+bool SameMesh(vtkPolyData* poly, vtkPolyData* expected)
+{
+  if (!poly || !SameArray(poly->GetPoints()->GetData(), expected->GetPoints()->GetData())
+      || poly->GetPolys()->GetNumberOfCells() != expected->GetPolys()->GetNumberOfCells()
+      || !SameArray(poly->GetPointData()->GetArray("Normals"), expected->GetPointData()->GetArray("Normals"))
+      || !SameArray(poly->GetCellData()->GetArray("Thickness"), expected->GetCellData()->GetArray("Thickness")))
+    return false;
+  vtkSmartPointer<vtkIdList> cell = vtkSmartPointer<vtkIdList>::New();
+  vtkSmartPointer<vtkIdList> expectedCell = vtkSmartPointer<vtkIdList>::New();
+  poly->GetPolys()->InitTraversal();
+  expected->GetPolys()->InitTraversal();
+  while (expected->GetPolys()->GetNextCell(expectedCell))
+    {
+    if (!poly->GetPolys()->GetNextCell(cell) || cell->GetNumberOfIds() != expectedCell->GetNumberOfIds())
+      return false;
+    for (vtkIdType i=0; i<cell->GetNumberOfIds(); ++i)
+      if (cell->GetId(i) != expectedCell->GetId(i))
+        return false;
+    }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+void Report(const char* name, double seconds, double previous)
+{
+  std::cout << "  " << name << ": " << seconds*1e3 << " ms";
+  if (previous > 0 && seconds > 0)
+    std::cout << ", " << previous/seconds << "x faster";
+  std::cout << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  int failures = 0;
+  const int sizes[] = { 1000, 10000, 100000, 1000000 };
+
+  for (unsigned s=0; s<sizeof(sizes)/sizeof(sizes[0]); ++s)
+    {
+    igtlio::PolyDataConverter::MessageContent content;
+    content.polydata = CreateMesh(sizes[s]);
+    content.deviceName = "Mesh";
+    std::cout << sizes[s] << " triangles, " << content.polydata->GetNumberOfPoints() << " points" << std::endl;
+
+    double previousSend = 0;
+    double previousReceive = 0;
+    igtl::PolyDataMessage::Pointer previousMsg = igtl::PolyDataMessage::New();
+    if (sizes[s] <= MaximumPreviousCells)
+      {
+      double start = vtkTimerLog::GetUniversalTime();
+      PreviousVTKToIGTL(content.polydata, previousMsg);
+      previousSend = vtkTimerLog::GetUniversalTime() - start;
+      Report("previous VTKToIGTL", previousSend, 0);
+
+      igtl::MessageBase::Pointer received = Receive(dynamic_pointer_cast<igtl::MessageBase>(previousMsg));
+      start = vtkTimerLog::GetUniversalTime();
+      vtkSmartPointer<vtkPolyData> poly = PreviousIGTLToVTK(received);
+      previousReceive = vtkTimerLog::GetUniversalTime() - start;
+      Report("previous IGTLToVTK", previousReceive, 0);
+      }
+
+    igtl::PolyDataMessage::Pointer msg;
+    double start = vtkTimerLog::GetUniversalTime();
+    if (!igtlio::PolyDataConverter::VTKToIGTL(content, &msg))
+      {
+      std::cout << "FAILURE: mesh not converted" << std::endl;
+      return 1;
+      }
+    Report("VTKToIGTL", vtkTimerLog::GetUniversalTime() - start, previousSend);
+
+    igtl::MessageBase::Pointer received = Receive(dynamic_pointer_cast<igtl::MessageBase>(msg));
+    igtlio::PolyDataConverter::MessageContent receivedContent;
+    start = vtkTimerLog::GetUniversalTime();
+    if (!igtlio::PolyDataConverter::IGTLToVTK(received, &receivedContent, true))
+      {
+      std::cout << "FAILURE: message not converted" << std::endl;
+      return 1;
+      }
+    Report("IGTLToVTK", vtkTimerLog::GetUniversalTime() - start, previousReceive);
+
+    if (!SameMesh(receivedContent.polydata, content.polydata) || receivedContent.deviceName != "Mesh")
+      {
+      std::cout << "FAILURE: mesh differs after the round trip" << std::endl;
+      ++failures;
+      }
+    if (sizes[s] <= MaximumPreviousCells)
+      {
+      // Read by igtl::PolyDataMessage, and reading its messages
+      igtlio::PolyDataConverter::MessageContent fromPrevious;
+      if (!igtlio::PolyDataConverter::IGTLToVTK(Receive(dynamic_pointer_cast<igtl::MessageBase>(previousMsg)), &fromPrevious, true)
+          || !SameMesh(fromPrevious.polydata, content.polydata)
+          || !SameMesh(PreviousIGTLToVTK(received), content.polydata))
+        {
+        std::cout << "FAILURE: message differs from igtl::PolyDataMessage" << std::endl;
+        ++failures;
+        }
+      }
+    }
+
+  return failures ? 1 : 0;
+}
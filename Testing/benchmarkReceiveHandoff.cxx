@@ -0,0 +1,243 @@
+#include <deque>
+#include <iostream>
+#include <list>
+#include "igtlioCircularBuffer.h"
+#include "igtlioLockFree.h"
+#include <igtlMessageBase.h>
+#include <vtkMultiThreader.h>
+#include <vtkMutexLock.h>
+#include <vtkSmartPointer.h>
+#include <vtkTimerLog.h>
+
+// Compares the wait-free handoff between a receiving thread and the main
+// thread with the mutex based one it replaced, for messages and events.
+
+const int NumberOfMessages = 200000;
+const int Depth = 64;
+
+//---------------------------------------------------------------------------
+// Mutex protected FIFO of preallocated slots, as before the SPSC rings.
+class MutexFifo
+{
+public:
+  MutexFifo()
+  {
+    this->Mutex = vtkSmartPointer<vtkMutexLock>::New();
+    for (int i=0; i<Depth+2; ++i)
+      {
+      this->Messages.push_back(igtl::MessageBase::New());
+      this->Free.push_back(i);
+      }
+    this->InPush = -1;
+    this->InUse = -1;
+  }
+  int StartPush()
+  {
+    while (true)
+      {
+      this->Mutex->Lock();
+      if (static_cast<int>(this->Published.size()) < Depth && !this->Free.empty())
+        {
+        this->InPush = this->Free.back();
+        this->Free.pop_back();
+        this->Mutex->Unlock();
+        return this->InPush;
+        }
+      this->Mutex->Unlock();
+      }
+  }
+  void EndPush()
+  {
+    this->Mutex->Lock();
+    this->Published.push_back(this->InPush);
+    this->Mutex->Unlock();
+  }
+  int StartPull()
+  {
+    this->Mutex->Lock();
+    this->InUse = -1;
+    if (!this->Published.empty())
+      {
+      this->InUse = this->Published.front();
+      this->Published.pop_front();
+      }
+    this->Mutex->Unlock();
+    return this->InUse;
+  }
+  void EndPull()
+  {
+    this->Mutex->Lock();
+    this->Free.push_back(this->InUse);
+    this->Mutex->Unlock();
+  }
+
+  vtkSmartPointer<vtkMutexLock> Mutex;
+  std::vector<igtl::MessageBase::Pointer> Messages;
+  std::vector<int> Free;
+  std::deque<int> Published;
+  int InPush;
+  int InUse;
+};
+
+//---------------------------------------------------------------------------
+// Mutex protected event list, as before the SPSC rings.
+struct MutexEvents
+{
+  vtkSmartPointer<vtkMutexLock> Mutex;
+  std::list<unsigned long> Events;
+};
+
+struct BenchmarkData
+{
+  vtkSmartPointer<igtlio::CircularBuffer> Buffer;
+  MutexFifo* Fifo;
+  igtlio::SPSCRing<unsigned long>* Ring;
+  MutexEvents* Events;
+};
+
+//---------------------------------------------------------------------------
+void* PushToCircularBuffer(void* ptr)
+{
+  BenchmarkData* data = static_cast<BenchmarkData*>(static_cast<vtkMultiThreader::ThreadInfo*>(ptr)->UserData);
+  for (int i=0; i<NumberOfMessages; ++i)
+    {
+    data->Buffer->StartPush();
+    data->Buffer->EndPush();
+    }
+  return NULL;
+}
+
+//---------------------------------------------------------------------------
+void* PushToMutexFifo(void* ptr)
+{
+  BenchmarkData* data = static_cast<BenchmarkData*>(static_cast<vtkMultiThreader::ThreadInfo*>(ptr)->UserData);
+  for (int i=0; i<NumberOfMessages; ++i)
+    {
+    data->Fifo->StartPush();
+    data->Fifo->EndPush();
+    }
+  return NULL;
+}
+
+//---------------------------------------------------------------------------
+void* PushToRing(void* ptr)
+{
+  BenchmarkData* data = static_cast<BenchmarkData*>(static_cast<vtkMultiThreader::ThreadInfo*>(ptr)->UserData);
+  for (int i=0; i<NumberOfMessages; ++i)
+    {
+    while (!data->Ring->Push(i))
+      {
+      }
+    }
+  return NULL;
+}
+
+//---------------------------------------------------------------------------
+void* PushToMutexEvents(void* ptr)
+{
+  BenchmarkData* data = static_cast<BenchmarkData*>(static_cast<vtkMultiThreader::ThreadInfo*>(ptr)->UserData);
+  for (int i=0; i<NumberOfMessages; ++i)
+    {
+    data->Events->Mutex->Lock();
+    data->Events->Events.push_back(i);
+    data->Events->Mutex->Unlock();
+    }
+  return NULL;
+}
+
+//---------------------------------------------------------------------------
+void Report(const char* name, double seconds)
+{
+  std::cout << name << ": " << seconds*1e3 << " ms, "
+            << (seconds > 0 ? NumberOfMessages/seconds : 0) << " items/s" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+  BenchmarkData data;
+  int received = 0;
+  double start = 0;
+  int failures = 0;
+
+  //---------------------------------------------------------------------------
+  // Messages, lossless FIFO
+  data.Buffer = vtkSmartPointer<igtlio::CircularBuffer>::New();
+  data.Buffer->SetDeliveryPolicy(igtlio::CircularBuffer::DELIVER_FIFO, Depth);
+  data.Buffer->SetMaximumPushWait(10);
+  start = vtkTimerLog::GetUniversalTime();
+  int threadID = threader->SpawnThread((vtkThreadFunctionType)&PushToCircularBuffer, &data);
+  for (received=0; received<NumberOfMessages; )
+    {
+    if (data.Buffer->StartPull() != -1)
+      {
+      ++received;
+      }
+    data.Buffer->EndPull();
+    }
+  threader->TerminateThread(threadID);
+  Report("CircularBuffer (SPSC rings)", vtkTimerLog::GetUniversalTime() - start);
+  if (data.Buffer->GetNumberOfDroppedMessages() != 0)
+    {
+    std::cout << "FAILURE: messages dropped" << std::endl;
+    ++failures;
+    }
+
+  MutexFifo fifo;
+  data.Fifo = &fifo;
+  start = vtkTimerLog::GetUniversalTime();
+  threadID = threader->SpawnThread((vtkThreadFunctionType)&PushToMutexFifo, &data);
+  for (received=0; received<NumberOfMessages; )
+    {
+    if (fifo.StartPull() != -1)
+      {
+      ++received;
+      fifo.EndPull();
+      }
+    }
+  threader->TerminateThread(threadID);
+  Report("Mutex FIFO", vtkTimerLog::GetUniversalTime() - start);
+
+  //---------------------------------------------------------------------------
+  // Events
+  igtlio::SPSCRing<unsigned long> ring(256);
+  data.Ring = &ring;
+  start = vtkTimerLog::GetUniversalTime();
+  threadID = threader->SpawnThread((vtkThreadFunctionType)&PushToRing, &data);
+  unsigned long expected = 0;
+  unsigned long eventId = 0;
+  while (expected < static_cast<unsigned long>(NumberOfMessages))
+    {
+    if (ring.Pop(eventId))
+      {
+      if (eventId != expected && !failures)
+        {
+        std::cout << "FAILURE: event " << eventId << " received instead of " << expected << std::endl;
+        ++failures;
+        }
+      ++expected;
+      }
+    }
+  threader->TerminateThread(threadID);
+  Report("Event ring (SPSC)", vtkTimerLog::GetUniversalTime() - start);
+
+  MutexEvents events;
+  events.Mutex = vtkSmartPointer<vtkMutexLock>::New();
+  data.Events = &events;
+  start = vtkTimerLog::GetUniversalTime();
+  threadID = threader->SpawnThread((vtkThreadFunctionType)&PushToMutexEvents, &data);
+  for (received=0; received<NumberOfMessages; )
+    {
+    events.Mutex->Lock();
+    if (!events.Events.empty())
+      {
+      events.Events.pop_front();
+      ++received;
+      }
+    events.Mutex->Unlock();
+    }
+  threader->TerminateThread(threadID);
+  Report("Event list (mutex)", vtkTimerLog::GetUniversalTime() - start);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,170 @@
+#include <sstream>
+#include <string>
+#include "igtlioLogic.h"
+#include "igtlioConnector.h"
+#include "igtlioSendQueue.h"
+#include "igtlioSession.h"
+#include "igtlioTransformConverter.h"
+#include "vtkTimerLog.h"
+#include "vtkMatrix4x4.h"
+#include <vtkCallbackCommand.h>
+#include <vtkMultiThreader.h>
+#include <vtkMutexLock.h>
+#include <vtksys/SystemTools.hxx>
+#include "IGTLIOFixture.h"
+
+const int NumberOfMessages = 200;
+
+struct SendCounter
+{
+  vtkSmartPointer<vtkMutexLock> Mutex;
+  int Sent;
+  int Dropped;
+};
+
+struct WorkerData
+{
+  igtlio::ConnectorPointer Connector;
+  vtkSmartPointer<vtkCallbackCommand> Callback;
+  int Accepted;
+};
+
+//---------------------------------------------------------------------------
+// Called from the writer thread, or the sending thread for dropped messages.
+void OnMessageDone(vtkObject* caller, unsigned long eventId, void* clientData, void* callData)
+{
+  SendCounter* counter = static_cast<SendCounter*>(clientData);
+  counter->Mutex->Lock();
+  if (eventId == igtlio::SendQueue::MessageSentEvent)
+    ++counter->Sent;
+  if (eventId == igtlio::SendQueue::MessageDroppedEvent)
+    ++counter->Dropped;
+  counter->Mutex->Unlock();
+}
+
+//---------------------------------------------------------------------------
+// Producer thread, sending without touching any device.
+void* SendTransforms(void* ptr)
+{
+  vtkMultiThreader::ThreadInfo* vinfo = static_cast<vtkMultiThreader::ThreadInfo*>(ptr);
+  WorkerData* data = static_cast<WorkerData*>(vinfo->UserData);
+
+  for (int i=0; i<NumberOfMessages; ++i)
+    {
+    igtlio::BaseConverter::HeaderData header;
+    header.deviceName = "AsyncDevice";
+    header.timestamp = vtkTimerLog::GetUniversalTime();
+    igtlio::TransformConverter::ContentData content;
+    content.deviceName = "AsyncDevice";
+    content.transform = vtkSmartPointer<vtkMatrix4x4>::New();
+    content.transform->SetElement(0, 3, i);
+
+    igtl::TransformMessage::Pointer msg;
+    igtlio::TransformConverter::toIGTL(header, content, &msg);
+    if (data->Connector->SendMessageAsync(dynamic_pointer_cast<igtl::MessageBase>(msg), "TRANSFORM_AsyncDevice", data->Callback))
+      ++data->Accepted;
+    }
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  ClientServerFixture fixture;
+
+  if (!fixture.ConnectClientToServer())
+    return 1;
+
+  SendCounter counter;
+  counter.Mutex = vtkSmartPointer<vtkMutexLock>::New();
+  counter.Sent = 0;
+  counter.Dropped = 0;
+
+  WorkerData data;
+  data.Connector = fixture.Server.Connector;
+  data.Callback = vtkSmartPointer<vtkCallbackCommand>::New();
+  data.Callback->SetCallback(OnMessageDone);
+  data.Callback->SetClientData(&counter);
+  data.Accepted = 0;
+
+  //---------------------------------------------------------------------------
+  // Send from a worker thread, keeping only the latest queued transform.
+  fixture.Server.Connector->SetSendPolicy(igtlio::Connector::SEND_LATEST);
+
+  vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+  int threadID = threader->SpawnThread((vtkThreadFunctionType)&SendTransforms, &data);
+  threader->TerminateThread(threadID);
+
+  if (data.Accepted != NumberOfMessages)
+    {
+    std::cout << "FAILURE: only " << data.Accepted << " of " << NumberOfMessages << " messages accepted" << std::endl;
+    return 1;
+    }
+
+  // Every message is reported once, either sent or replaced by a later one.
+  double starttime = vtkTimerLog::GetUniversalTime();
+  int done = 0;
+  while (vtkTimerLog::GetUniversalTime() - starttime < 2)
+    {
+    fixture.Server.Logic->PeriodicProcess();
+    fixture.Client.Logic->PeriodicProcess();
+    counter.Mutex->Lock();
+    done = counter.Sent + counter.Dropped;
+    counter.Mutex->Unlock();
+    if (done == NumberOfMessages && fixture.Client.Logic->GetNumberOfDevices() == 1)
+      break;
+    vtksys::SystemTools::Delay(5);
+    }
+
+  std::cout << "sent=" << counter.Sent << " dropped=" << counter.Dropped
+            << " coalesced=" << fixture.Server.Connector->GetSendQueue()->GetNumberOfCoalescedMessages() << std::endl;
+  if (done != NumberOfMessages || counter.Sent < 1)
+    {
+    std::cout << "FAILURE: " << done << " of " << NumberOfMessages << " messages reported" << std::endl;
+    return 1;
+    }
+  if (fixture.Client.Logic->GetNumberOfDevices() != 1)
+    {
+    std::cout << "FAILURE: transform not received" << std::endl;
+    return 1;
+    }
+  if (counter.Dropped != static_cast<int>(fixture.Server.Connector->GetSendQueue()->GetNumberOfCoalescedMessages()))
+    {
+    std::cout << "FAILURE: dropped messages were not replaced by later ones" << std::endl;
+    return 1;
+    }
+
+  //---------------------------------------------------------------------------
+  // Device messages are queued as copies in asynchronous mode.
+  fixture.Server.Connector->AsynchronousSendOn();
+  fixture.Server.Session->SendTransform("DeviceTransform", vtkSmartPointer<vtkMatrix4x4>::New());
+  if (!fixture.LoopUntilEventDetected(&fixture.Client, igtlio::Logic::NewDeviceEvent, 2))
+    return 1;
+
+  //---------------------------------------------------------------------------
+  // Messages sent during one tick are gathered into one write.
+  igtlio::SendQueuePointer queue = fixture.Server.Connector->GetSendQueue();
+  queue->CoalesceWritesOn();
+  queue->SetFlushWindow(1.0); // only flushed by PeriodicProcess()
+  queue->ResetFlushStatistics();
+  const int numberOfTools = 12;
+  for (int i=0; i<numberOfTools; ++i)
+    {
+    std::stringstream name;
+    name << "Tool" << i;
+    fixture.Server.Session->SendTransform(name.str(), vtkSmartPointer<vtkMatrix4x4>::New());
+    }
+  if (!fixture.LoopUntilEventDetected(&fixture.Client, igtlio::Logic::NewDeviceEvent, 2+numberOfTools))
+    return 1;
+
+  std::cout << "flushes=" << queue->GetNumberOfFlushes()
+            << " messages/flush=" << queue->GetAverageMessagesPerFlush()
+            << " bytes/flush=" << queue->GetAverageBytesPerFlush() << std::endl;
+  if (queue->GetMaximumMessagesPerFlush() != numberOfTools)
+    {
+    std::cout << "FAILURE: expected " << numberOfTools << " messages in one flush" << std::endl;
+    return 1;
+    }
+
+  std::cout << "*** Asynchronous send test successful" << std::endl;
+  return 0;
+}
@@ -0,0 +1,95 @@
+#include <iostream>
+#include <string.h>
+#include "igtlioBufferPool.h"
+#include <igtl_header.h>
+#include <igtlMessageBase.h>
+#include <igtlMessageHeader.h>
+#include "IGTLIOFixture.h"
+
+//---------------------------------------------------------------------------
+igtl::MessageBase::Pointer CreateReceiveMessage(int bodySize)
+{
+  igtl::MessageHeader::Pointer header = igtl::MessageHeader::New();
+  header->SetDeviceName("Pooled");
+  header->Pack();
+  // Body size as received from the peer.
+  igtl_header* raw = static_cast<igtl_header*>(header->GetPackPointer());
+  raw->body_size = bodySize;
+  igtl_header_convert_byte_order(raw);
+  header->Unpack();
+
+  igtl::MessageBase::Pointer message = igtl::MessageBase::New();
+  message->SetMessageHeader(header);
+  return message;
+}
+
+int main(int argc, char **argv)
+{
+  //---------------------------------------------------------------------------
+  // Size classes
+  CHECK(igtlio::BufferPool::GetSizeClass(1024*1024) == 1024*1024);
+  CHECK(igtlio::BufferPool::GetSizeClass(1024*1024+1) == 1024*1024+256*1024);
+  for (size_t size=1; size<10*1024*1024; size=size*3+7)
+    {
+    size_t sizeClass = igtlio::BufferPool::GetSizeClass(size);
+    CHECK(sizeClass >= size && sizeClass <= size + size/4 + 1);
+    }
+
+  igtlio::BufferPoolPointer pool = igtlio::BufferPoolPointer::New();
+  const int bodySize = 1024*1024;
+
+  //---------------------------------------------------------------------------
+  // Receiving again into the same message reuses its buffer.
+  igtl::MessageBase::Pointer message = CreateReceiveMessage(bodySize);
+  pool->AllocatePack(message);
+  CHECK(message->GetPackSize() == IGTL_HEADER_SIZE + bodySize);
+  CHECK(message->GetPackBodySize() == bodySize);
+  unsigned char* body = static_cast<unsigned char*>(message->GetPackBodyPointer());
+  memset(body, 1, bodySize);
+  CHECK(pool->GetNumberOfMisses() == 1 && pool->GetNumberOfHits() == 0);
+
+  message->SetMessageHeader(CreateReceiveMessage(bodySize - 1000));
+  pool->AllocatePack(message);
+  CHECK(message->GetPackBodyPointer() == body);
+  CHECK(message->GetPackBodySize() == bodySize - 1000);
+  CHECK(pool->GetNumberOfHits() == 1);
+
+  //---------------------------------------------------------------------------
+  // Buffers of released messages go back to the pool.
+  vtkTypeInt64 resident = pool->GetResidentBytes();
+  pool->Trim();
+  CHECK(pool->GetIdleBytes() == 0);
+  message = NULL;
+  pool->Trim();
+  CHECK(pool->GetIdleBytes() == resident);
+
+  igtl::MessageBase::Pointer next = CreateReceiveMessage(bodySize);
+  pool->AllocatePack(next);
+  CHECK(next->GetPackBodyPointer() == body);
+  CHECK(pool->GetIdleBytes() == 0 && pool->GetResidentBytes() == resident);
+  CHECK(pool->GetNumberOfHits() == 2 && pool->GetNumberOfMisses() == 1);
+
+  //---------------------------------------------------------------------------
+  // Queued copies of outgoing messages.
+  igtl::MessageBase::Pointer copy = igtl::MessageBase::New();
+  pool->AllocatePack(copy, next->GetPackBodySize());
+  copy->Copy(next);
+  CHECK(copy->GetPackSize() == next->GetPackSize());
+  CHECK(memcmp(copy->GetPackBodyPointer(), next->GetPackBodyPointer(), bodySize) == 0);
+  CHECK(pool->GetNumberOfMisses() == 2);
+
+  //---------------------------------------------------------------------------
+  // Small packs are left to igtl, idle bytes are bounded.
+  igtl::MessageBase::Pointer small = CreateReceiveMessage(100);
+  pool->AllocatePack(small);
+  CHECK(small->GetPackBodySize() == 100 && pool->GetNumberOfMisses() == 2);
+
+  pool->SetMaximumIdleBytes(0);
+  next = NULL;
+  copy = NULL;
+  pool->Trim();
+  CHECK(pool->GetIdleBytes() == 0 && pool->GetResidentBytes() == 0);
+
+  std::cout << "*** Buffer pool test successful" << std::endl;
+  return 0;
+}
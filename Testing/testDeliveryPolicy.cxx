@@ -0,0 +1,126 @@
+#include <iostream>
+#include <string>
+#include "igtlioLogic.h"
+#include "igtlioConnector.h"
+#include "igtlioCircularBuffer.h"
+#include "igtlioSession.h"
+#include "vtkTimerLog.h"
+#include "vtkMatrix4x4.h"
+#include <vtkCallbackCommand.h>
+#include <vtksys/SystemTools.hxx>
+#include "IGTLIOFixture.h"
+
+//---------------------------------------------------------------------------
+// Push messages numbered from first, by their device name.
+void PushMessages(igtlio::CircularBuffer* buffer, int first, int count)
+{
+  for (int i=first; i<first+count; ++i)
+    {
+    buffer->StartPush();
+    igtl::MessageBase::Pointer msg = buffer->GetPushBuffer();
+    msg->SetDeviceName(std::string(1, 'a'+i).c_str());
+    buffer->EndPush();
+    }
+}
+
+//---------------------------------------------------------------------------
+// Pull all pending messages, and return their names.
+std::string PullMessages(igtlio::CircularBuffer* buffer)
+{
+  std::string names;
+  while (buffer->StartPull() != -1)
+    {
+    names += buffer->GetPullBuffer()->GetDeviceName();
+    }
+  buffer->EndPull();
+  return names;
+}
+
+void OnDeviceModified(vtkObject* caller, unsigned long eventId, void* clientData, void* callData)
+{
+  ++(*static_cast<int*>(clientData));
+}
+
+int main(int argc, char **argv)
+{
+  //---------------------------------------------------------------------------
+  // Latest only: a burst is reduced to its last message.
+  igtlio::CircularBufferPointer latest = igtlio::CircularBufferPointer::New();
+  PushMessages(latest, 0, 5);
+  CHECK(PullMessages(latest) == "e");
+  CHECK(latest->GetNumberOfOverwrittenMessages() == 4);
+  CHECK(latest->GetNumberOfDroppedMessages() == 0);
+
+  //---------------------------------------------------------------------------
+  // FIFO: every message is delivered in order.
+  igtlio::CircularBufferPointer fifo = igtlio::CircularBufferPointer::New();
+  fifo->SetDeliveryPolicy(igtlio::CircularBuffer::DELIVER_FIFO, 10);
+  PushMessages(fifo, 0, 10);
+  CHECK(fifo->GetNumberOfPendingMessages() == 10);
+  CHECK(PullMessages(fifo) == "abcdefghij");
+  CHECK(fifo->GetNumberOfDroppedMessages() == 0);
+  CHECK(fifo->GetNumberOfBlockedPushes() == 0);
+
+  // A full FIFO waits for the consumer, then drops the new message.
+  fifo->SetMaximumPushWait(0.01);
+  PushMessages(fifo, 0, 11);
+  CHECK(fifo->GetNumberOfBlockedPushes() == 1);
+  CHECK(fifo->GetNumberOfDroppedMessages() == 1);
+  CHECK(PullMessages(fifo) == "abcdefghij");
+
+  //---------------------------------------------------------------------------
+  // Drop oldest: the most recent messages are kept, without waiting.
+  igtlio::CircularBufferPointer dropOldest = igtlio::CircularBufferPointer::New();
+  dropOldest->SetDeliveryPolicy(igtlio::CircularBuffer::DELIVER_DROP_OLDEST, 3);
+  PushMessages(dropOldest, 0, 8);
+  CHECK(dropOldest->GetNumberOfBlockedPushes() == 0);
+  CHECK(dropOldest->GetNumberOfDroppedMessages() == 5);
+  CHECK(PullMessages(dropOldest) == "fgh");
+
+  // Still the most recent ones when more are pushed than there are slots.
+  dropOldest->SetDeliveryPolicy(igtlio::CircularBuffer::DELIVER_DROP_OLDEST, 3);
+  PushMessages(dropOldest, 0, 20);
+  CHECK(dropOldest->GetNumberOfBlockedPushes() == 0);
+  CHECK(dropOldest->GetNumberOfDroppedMessages() == 5 + 17);
+  CHECK(PullMessages(dropOldest) == "rst");
+
+  //---------------------------------------------------------------------------
+  // The ready flag lists a buffer once, until it is cleared for pulling.
+  CHECK(dropOldest->MarkReady() == 1);
+  CHECK(dropOldest->MarkReady() == 0);
+  dropOldest->ClearReady();
+  CHECK(dropOldest->MarkReady() == 1);
+
+  //---------------------------------------------------------------------------
+  // A burst of transforms between two imports is delivered losslessly.
+  ClientServerFixture fixture;
+  if (!fixture.ConnectClientToServer())
+    return 1;
+
+  fixture.Client.Connector->SetDeliveryPolicy(std::string("TRANSFORM"), igtlio::CircularBuffer::DELIVER_FIFO, 100);
+
+  int modified = 0;
+  vtkSmartPointer<vtkCallbackCommand> callback = vtkSmartPointer<vtkCallbackCommand>::New();
+  callback->SetCallback(OnDeviceModified);
+  callback->SetClientData(&modified);
+  fixture.Client.Connector->AddObserver(igtlio::Connector::DeviceModifiedEvent, callback);
+
+  const int numberOfMessages = 50;
+  for (int i=0; i<numberOfMessages; ++i)
+    {
+    fixture.Server.Session->SendTransform("Tool", vtkSmartPointer<vtkMatrix4x4>::New());
+    }
+
+  double starttime = vtkTimerLog::GetUniversalTime();
+  while (modified < numberOfMessages && vtkTimerLog::GetUniversalTime() - starttime < 2)
+    {
+    vtksys::SystemTools::Delay(50); // let the messages accumulate
+    fixture.Server.Logic->PeriodicProcess();
+    fixture.Client.Logic->PeriodicProcess();
+    }
+  std::cout << "received " << modified << " of " << numberOfMessages << std::endl;
+  CHECK(modified == numberOfMessages);
+
+  std::cout << "*** Delivery policy test successful" << std::endl;
+  return 0;
+}
@@ -0,0 +1,74 @@
+#include <iostream>
+#include <map>
+#include <sstream>
+#include "igtlioUtilities.h"
+#include "igtlioConnector.h"
+#include <igtlTransformMessage.h>
+
+///
+/// Check the interned device keys: equality ignores the message prefix,
+/// ids are stable, and keys built from messages find the same devices.
+///
+
+int main(int argc, char **argv)
+{
+  igtlio::DeviceKeyType empty;
+  if (empty.GetId() != 0 || !(empty == igtlio::DeviceKeyType("", "")) || !empty.GetType().empty())
+    {
+    std::cout << "FAILURE: empty key" << std::endl;
+    return 1;
+    }
+
+  igtlio::DeviceKeyType image(std::string("IMAGE"), std::string("probe"));
+  igtlio::DeviceKeyType getImage("GET_IMAGE", "probe");
+  igtlio::DeviceKeyType other("IMAGE", "pointer");
+  if (!(image == getImage) || image.GetId() != getImage.GetId()
+      || getImage.GetType() != "GET_IMAGE" || getImage.GetBaseTypeName() != "IMAGE"
+      || getImage.GetName() != "probe")
+    {
+    std::cout << "FAILURE: prefixed key does not match its base key" << std::endl;
+    return 1;
+    }
+  if (image == other || image.GetId() == 0 || other.GetId() >= igtlio::DeviceKeyType::GetNumberOfIds())
+    {
+    std::cout << "FAILURE: distinct keys are equal or ids out of range" << std::endl;
+    return 1;
+    }
+
+  // Many keys: ids are dense and found again after the table grows.
+  std::map<igtlio::DeviceKeyType, int> keys;
+  for (int i=0; i<1000; ++i)
+    {
+    std::stringstream name;
+    name << "tool" << i;
+    keys[igtlio::DeviceKeyType("TRANSFORM", name.str())] = i;
+    }
+  for (int i=0; i<1000; ++i)
+    {
+    std::stringstream name;
+    name << "tool" << i;
+    std::map<igtlio::DeviceKeyType, int>::iterator iter = keys.find(igtlio::DeviceKeyType(std::string("TRANSFORM"), name.str()));
+    if (iter == keys.end() || iter->second != i)
+      {
+      std::cout << "FAILURE: key " << name.str() << " not found" << std::endl;
+      return 1;
+      }
+    }
+
+  // Keys built from messages and devices find the connector devices.
+  igtlio::ConnectorPointer connector = igtlio::ConnectorPointer::New();
+  igtlio::DevicePointer device = connector->GetDeviceFactory()->create("TRANSFORM", "tool7");
+  connector->AddDevice(device);
+  igtl::TransformMessage::Pointer msg = igtl::TransformMessage::New();
+  msg->SetDeviceName("tool7");
+  igtlio::DeviceKeyType key = igtlio::CreateDeviceKey(dynamic_pointer_cast<igtl::MessageBase>(msg));
+  if (key.GetId() != keys.find(key)->first.GetId() || connector->GetDevice(key) != device
+      || !(igtlio::CreateDeviceKey(device) == key))
+    {
+    std::cout << "FAILURE: device not found from message key" << std::endl;
+    return 1;
+    }
+
+  std::cout << "*** Device key test successful" << std::endl;
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include <iostream>
+#include <sstream>
+#include "igtlioDeviceRegistry.h"
+#include "igtlioDeviceFactory.h"
+#include "igtlioDevice.h"
+#include <vtkMultiThreader.h>
+#include "IGTLIOFixture.h"
+
+///
+/// Look devices up from a thread while the main thread adds and
+/// removes them, as the receiving threads do with RestrictDeviceName.
+///
+
+const int NumberOfDevices = 50;
+const int NumberOfRounds = 200;
+
+struct ReaderData
+{
+  igtlio::DeviceRegistry* Registry;
+  igtlio::DeviceKeyType PermanentKey;
+  volatile bool Stop;
+  int Lookups;
+  int Failures;
+};
+
+//---------------------------------------------------------------------------
+void* LookupDevices(void* ptr)
+{
+  ReaderData* data = static_cast<ReaderData*>(static_cast<vtkMultiThreader::ThreadInfo*>(ptr)->UserData);
+  while (!data->Stop)
+    {
+    // Always present, whatever the version read.
+    if (!data->Registry->Contains(data->PermanentKey))
+      {
+      ++data->Failures;
+      }
+    data->Registry->Contains(igtlio::DeviceKeyType("TRANSFORM", "tool7"));
+    ++data->Lookups;
+    }
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  igtlio::DeviceFactoryPointer factory = igtlio::DeviceFactoryPointer::New();
+  igtlio::DeviceRegistry registry;
+
+  //---------------------------------------------------------------------------
+  // Indexing
+  igtlio::DevicePointer permanent = factory->create("STATUS", "permanent");
+  CHECK(registry.Add(permanent));
+  CHECK(!registry.Add(factory->create("STATUS", "permanent")));
+  std::vector<igtlio::DevicePointer> devices;
+  for (int i=0; i<NumberOfDevices; ++i)
+    {
+    std::stringstream name;
+    name << "tool" << i;
+    devices.push_back(factory->create("TRANSFORM", name.str()));
+    CHECK(registry.Add(devices.back()));
+    }
+  CHECK(registry.GetNumberOfDevices() == NumberOfDevices+1);
+  CHECK(registry.Find(igtlio::DeviceKeyType("TRANSFORM", "tool7")) == devices[7]);
+  CHECK(registry.Remove(igtlio::DeviceKeyType("TRANSFORM", "tool7")) == devices[7]);
+  CHECK(!registry.Find(igtlio::DeviceKeyType("TRANSFORM", "tool7")));
+  CHECK(registry.Find(igtlio::DeviceKeyType("TRANSFORM", "tool8")) == devices[8]);
+  CHECK(registry.GetDevice(8) == devices[8]); // shifted by the removal
+  CHECK(registry.RemoveAt(0) == permanent);
+  CHECK(registry.Add(permanent));
+  registry.Reclaim();
+
+  //---------------------------------------------------------------------------
+  // Concurrent lookups
+  ReaderData data;
+  data.Registry = &registry;
+  data.PermanentKey = igtlio::CreateDeviceKey(permanent);
+  data.Stop = false;
+  data.Lookups = 0;
+  data.Failures = 0;
+  vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+  int threadID = threader->SpawnThread((vtkThreadFunctionType)&LookupDevices, &data);
+
+  for (int round=0; round<NumberOfRounds; ++round)
+    {
+    registry.Add(devices[7]);
+    registry.Remove(igtlio::CreateDeviceKey(devices[7]));
+    registry.Reclaim();
+    }
+  data.Stop = true;
+  threader->TerminateThread(threadID);
+  registry.Reclaim();
+
+  std::cout << "lookups=" << data.Lookups << std::endl;
+  CHECK(data.Failures == 0);
+
+  std::cout << "*** Device registry test successful" << std::endl;
+  return 0;
+}
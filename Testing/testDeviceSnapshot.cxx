@@ -0,0 +1,153 @@
+#include <iostream>
+#include <string.h>
+
+#include <igtlMessageHeader.h>
+
+#include "igtlioImageDevice.h"
+#include "igtlioTransformDevice.h"
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMultiThreader.h>
+#include "IGTLIOFixture.h"
+
+///
+/// Read the content of an image device from a thread while the main
+/// thread receives frames into it.
+///
+
+const int Size = 64;
+const int NumberOfPixels = Size*Size*4;
+const int NumberOfFrames = 500;
+
+struct ReaderData
+{
+  igtlio::ImageDevice* Device;
+  volatile bool Stop;
+  int Reads;
+  int Failures;
+};
+
+//---------------------------------------------------------------------------
+// Frame i: all pixels at i%251, with timestamp i.
+igtl::MessageBase::Pointer CreateFrame(int i)
+{
+  igtlio::ImageConverter::HeaderData header;
+  header.deviceName = "US";
+  header.timestamp = i;
+  igtlio::ImageConverter::ContentData content;
+  content.image = vtkSmartPointer<vtkImageData>::New();
+  content.image->SetDimensions(Size, Size, 4);
+  content.image->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  memset(content.image->GetScalarPointer(), i%251, NumberOfPixels);
+  content.transform = vtkSmartPointer<vtkMatrix4x4>::New();
+  content.transform->Identity();
+  igtl::ImageMessage::Pointer imgMsg;
+  igtlio::ImageConverter::toIGTL(header, content, &imgMsg);
+
+  // Received as the connector does.
+  igtl::MessageHeader::Pointer headerMsg = igtl::MessageHeader::New();
+  headerMsg->InitPack();
+  memcpy(headerMsg->GetPackPointer(), imgMsg->GetPackPointer(), IGTL_HEADER_SIZE);
+  headerMsg->Unpack();
+  igtl::MessageBase::Pointer msg = igtl::MessageBase::New();
+  msg->SetMessageHeader(headerMsg);
+  msg->AllocatePack();
+  memcpy(msg->GetPackPointer(), imgMsg->GetPackPointer(), imgMsg->GetPackSize());
+  return msg;
+}
+
+//---------------------------------------------------------------------------
+bool IsConsistent(const igtlio::ImageDevice::Snapshot& snapshot)
+{
+  unsigned char expected = static_cast<int>(snapshot.GetHeader().timestamp)%251;
+  const unsigned char* pixels = static_cast<unsigned char*>(snapshot.GetContent().image->GetScalarPointer());
+  for (int i=0; i<NumberOfPixels; ++i)
+    if (pixels[i] != expected)
+      return false;
+  return true;
+}
+
+//---------------------------------------------------------------------------
+void* ReadFrames(void* ptr)
+{
+  ReaderData* data = static_cast<ReaderData*>(static_cast<vtkMultiThreader::ThreadInfo*>(ptr)->UserData);
+  vtkTypeInt64 last = 0;
+  while (!data->Stop)
+    {
+    igtlio::ImageDevice::Snapshot snapshot = data->Device->GetSnapshot();
+    if (!snapshot.IsValid())
+      continue;
+    if (snapshot.GetFrameNumber() < last || !IsConsistent(snapshot))
+      ++data->Failures;
+    last = snapshot.GetFrameNumber();
+    ++data->Reads;
+    }
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  //---------------------------------------------------------------------------
+  // Snapshots held while frames are received.
+  igtlio::ImageDevicePointer device = igtlio::ImageDevicePointer::New();
+  CHECK(device->ReceiveIGTLMessage(CreateFrame(1), true));
+  CHECK(!device->GetSnapshot().IsValid());
+  device->PublishSnapshotsOn();
+  igtlio::ImageDevice::Snapshot first = device->GetSnapshot();
+  CHECK(first.IsValid() && first.GetFrameNumber() == 1 && IsConsistent(first));
+  CHECK(first.GetContent().image.GetPointer() != device->GetContent().image.GetPointer());
+
+  std::vector<igtlio::ImageDevice::Snapshot> held;
+  for (int i=2; i<10; ++i)
+    {
+    CHECK(device->ReceiveIGTLMessage(CreateFrame(i), true));
+    CHECK(device->GetSnapshotFrameNumber() == i);
+    held.push_back(device->GetSnapshot());
+    }
+  CHECK(first.GetHeader().timestamp == 1 && IsConsistent(first));
+  for (unsigned i=0; i<held.size(); ++i)
+    {
+    CHECK(held[i].GetFrameNumber() == i+2 && held[i].GetHeader().timestamp == i+2 && IsConsistent(held[i]));
+    }
+  held.clear();
+  first.Release();
+
+  //---------------------------------------------------------------------------
+  // Concurrent reads
+  ReaderData data;
+  data.Device = device;
+  data.Stop = false;
+  data.Reads = 0;
+  data.Failures = 0;
+  vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+  int threadID = threader->SpawnThread((vtkThreadFunctionType)&ReadFrames, &data);
+  for (int i=10; i<NumberOfFrames; ++i)
+    {
+    CHECK(device->ReceiveIGTLMessage(CreateFrame(i), true));
+    }
+  data.Stop = true;
+  threader->TerminateThread(threadID);
+
+  std::cout << "reads=" << data.Reads << std::endl;
+  CHECK(data.Failures == 0);
+  igtlio::ImageDevice::Snapshot last = device->GetSnapshot();
+  CHECK(last.GetFrameNumber() == NumberOfFrames-1 && last.GetHeader().timestamp == NumberOfFrames-1);
+
+  //---------------------------------------------------------------------------
+  // Transforms
+  igtlio::TransformDevicePointer transformDevice = igtlio::TransformDevicePointer::New();
+  igtlio::TransformConverter::ContentData content;
+  content.transform = vtkSmartPointer<vtkMatrix4x4>::New();
+  content.transform->Identity();
+  content.transform->SetElement(0, 3, 1);
+  transformDevice->SetContent(content);
+  igtlio::TransformDevice::Snapshot transform = transformDevice->GetSnapshot();
+  content.transform->SetElement(0, 3, 2);
+  transformDevice->SetContent(content);
+  CHECK(transform.GetFrameNumber() == 1 && transform.GetContent().transform->GetElement(0, 3) == 1);
+  CHECK(transformDevice->GetSnapshot().GetContent().transform->GetElement(0, 3) == 2);
+  CHECK(transformDevice->GetSnapshotFrameNumber() == 2);
+
+  std::cout << "*** Device snapshot test successful" << std::endl;
+  return 0;
+}
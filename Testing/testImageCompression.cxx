@@ -0,0 +1,280 @@
+#include <iostream>
+#include <string.h>
+#include "igtlioConnector.h"
+#include "igtlioImageCompressor.h"
+#include "igtlioImageConverter.h"
+#include "igtlioImageDevice.h"
+#include "igtlioLogic.h"
+#include "igtlioSession.h"
+#include <igtlClientSocket.h>
+#include <igtlServerSocket.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtksys/SystemTools.hxx>
+#include "IGTLIOFixture.h"
+
+const int NumberOfVoxels = 128*100*10;
+
+//---------------------------------------------------------------------------
+// Smooth, as images are, with some noise.
+vtkSmartPointer<vtkImageData> CreateImage()
+{
+  vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+  image->SetSpacing(1.5, 1.2, 1);
+  image->SetExtent(0, 127, 0, 99, 0, 9);
+  image->AllocateScalars(VTK_SHORT, 1);
+  short* ptr = static_cast<short*>(image->GetScalarPointer());
+  unsigned int seed = 1;
+  for (int i=0; i<NumberOfVoxels; ++i)
+    {
+    seed = seed*1103515245u + 12345u;
+    ptr[i] = static_cast<short>((i % 128) * 8 + ((seed >> 16) & 7));
+    }
+  return image;
+}
+
+//---------------------------------------------------------------------------
+bool SamePixels(vtkImageData* image, vtkImageData* expected)
+{
+  return image && memcmp(image->GetScalarPointer(), expected->GetScalarPointer(), NumberOfVoxels*sizeof(short)) == 0;
+}
+
+//---------------------------------------------------------------------------
+// Compress the packed image, then restore it as the receiving connector does.
+bool RoundTrip(int codec, igtl::ImageMessage::Pointer msg, const igtlio::ImageConverter::GatherData& gather)
+{
+  const char* name = igtlio::ImageCompressor::GetCodecName(codec);
+  igtl::MessageBase::Pointer compressed = igtlio::ImageCompressor::Compress(codec, msg->GetPackPointer(), msg->GetPackSize());
+  igtl::MessageBase::Pointer gathered = igtlio::ImageCompressor::Compress(
+    codec, gather.header->GetPackPointer(), gather.header->GetPackSize(), gather.pixels, gather.pixelSize);
+  if (compressed.IsNull() || gathered.IsNull())
+    {
+    std::cout << "FAILURE: " << name << " compression failed" << std::endl;
+    return false;
+    }
+  if (compressed->GetPackSize() != gathered->GetPackSize()
+      || memcmp(compressed->GetPackPointer(), gathered->GetPackPointer(), compressed->GetPackSize()) != 0)
+    {
+    std::cout << "FAILURE: " << name << " compression of the gathered image differs" << std::endl;
+    return false;
+    }
+  if (compressed->GetPackSize() >= msg->GetPackSize())
+    {
+    std::cout << "FAILURE: " << name << " did not compress the image" << std::endl;
+    return false;
+    }
+  if (strcmp(compressed->GetDeviceType(), "ZIMAGE") != 0 || strcmp(compressed->GetDeviceName(), msg->GetDeviceName()) != 0)
+    {
+    std::cout << "FAILURE: " << name << " header not kept" << std::endl;
+    return false;
+    }
+
+  igtl::MessageHeader::Pointer imageHeader = igtl::MessageHeader::New();
+  if (!igtlio::ImageCompressor::GetImageHeader(compressed, imageHeader)
+      || memcmp(imageHeader->GetPackPointer(), msg->GetPackPointer(), imageHeader->GetPackSize()) != 0)
+    {
+    std::cout << "FAILURE: " << name << " IMAGE header not restored" << std::endl;
+    return false;
+    }
+  igtl::ImageMessage::Pointer received = igtl::ImageMessage::New();
+  received->SetMessageHeader(imageHeader);
+  received->AllocatePack();
+  if (!igtlio::ImageCompressor::Decompress(compressed, received->GetPackBodyPointer(), received->GetPackBodySize())
+      || memcmp(received->GetPackBodyPointer(), msg->GetPackBodyPointer(), msg->GetPackBodySize()) != 0
+      || !(received->Unpack(1) & igtl::MessageHeader::UNPACK_BODY))
+    {
+    std::cout << "FAILURE: " << name << " IMAGE body not restored" << std::endl;
+    return false;
+    }
+
+  // Sizes that add up to the body but not to the blocks are detected.
+  unsigned char* body = static_cast<unsigned char*>(compressed->GetPackBodyPointer());
+  unsigned char table[8];
+  memcpy(table, body+32, 8);
+  igtlUint32 first = (table[0]<<24 | table[1]<<16 | table[2]<<8 | table[3]) & 0x7FFFFFFFu;
+  igtlUint32 second = (table[4]<<24 | table[5]<<16 | table[6]<<8 | table[7]) & 0x7FFFFFFFu;
+  igtlUint32 merged = first + second;
+  unsigned char shifted[8] = { static_cast<unsigned char>(merged>>24), static_cast<unsigned char>(merged>>16),
+                               static_cast<unsigned char>(merged>>8), static_cast<unsigned char>(merged), 0, 0, 0, 0 };
+  memcpy(body+32, shifted, 8);
+  if (igtlio::ImageCompressor::GetImageHeader(compressed, imageHeader))
+    {
+    std::cout << "FAILURE: " << name << " block sizes not checked" << std::endl;
+    return false;
+    }
+  memcpy(body+32, table, 8);
+
+  // A corrupted block table is detected.
+  body[32+3] ^= 1;
+  if (igtlio::ImageCompressor::GetImageHeader(compressed, imageHeader))
+    {
+    std::cout << "FAILURE: " << name << " corrupted message accepted" << std::endl;
+    return false;
+    }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool WaitForNegotiation(ClientServerFixture& fixture, int expected)
+{
+  double starttime = vtkTimerLog::GetUniversalTime();
+  while (fixture.Server.Connector->GetNegotiatedImageCompression() != expected
+         && vtkTimerLog::GetUniversalTime() - starttime < 2)
+    {
+    fixture.Server.Logic->PeriodicProcess();
+    fixture.Client.Logic->PeriodicProcess();
+    vtksys::SystemTools::Delay(5);
+    }
+  if (fixture.Server.Connector->GetNegotiatedImageCompression() != expected)
+    {
+    std::cout << "FAILURE: negotiated " << igtlio::ImageCompressor::GetCodecName(fixture.Server.Connector->GetNegotiatedImageCompression())
+              << " instead of " << igtlio::ImageCompressor::GetCodecName(expected) << std::endl;
+    return false;
+    }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool WaitForPixels(ClientServerFixture& fixture, const std::string& name, vtkImageData* sent)
+{
+  double starttime = vtkTimerLog::GetUniversalTime();
+  igtlio::ImageDevicePointer device;
+  while (vtkTimerLog::GetUniversalTime() - starttime < 2)
+    {
+    fixture.Server.Logic->PeriodicProcess();
+    fixture.Client.Logic->PeriodicProcess();
+    device = igtlio::ImageDevice::SafeDownCast(fixture.Client.Logic->GetDevice(igtlio::DeviceKeyType("IMAGE", name)));
+    if (device && SamePixels(device->GetContent().image, sent))
+      return true;
+    vtksys::SystemTools::Delay(5);
+    }
+  std::cout << "FAILURE: image " << name << " not received" << std::endl;
+  return false;
+}
+
+int main(int argc, char **argv)
+{
+  igtlio::ImageConverter::HeaderData header;
+  header.deviceName = "Compressed";
+  header.timestamp = 0;
+  igtlio::ImageConverter::ContentData content;
+  content.image = CreateImage();
+  content.transform = vtkSmartPointer<vtkMatrix4x4>::New();
+  content.transform->Identity();
+
+  //---------------------------------------------------------------------------
+  // Codecs, with blocks straddling the headers and the pixels.
+  igtl::ImageMessage::Pointer msg;
+  igtlio::ImageConverter::GatherData gather;
+  if (!igtlio::ImageConverter::toIGTL(header, content, &msg)
+      || !igtlio::ImageConverter::toIGTLGather(header, content, &gather))
+    return 1;
+  igtlio::ImageCompressor::SetBlockSize(64*1024);
+  for (int codec=igtlio::ImageCompressor::CODEC_ZLIB; codec<igtlio::ImageCompressor::CODEC_AUTO; ++codec)
+    {
+    if (igtlio::ImageCompressor::IsCodecSupported(codec) && !RoundTrip(codec, msg, gather))
+      return 1;
+    }
+  igtlio::ImageCompressor::SetBlockSize(1024*1024);
+
+  // Negotiation
+  std::vector<std::string> plainPeer(1, "IMAGE");
+  std::vector<std::string> ioPeer = igtlio::ImageCompressor::GetCapabilityTypes();
+  int fastest = igtlio::ImageCompressor::IsCodecSupported(igtlio::ImageCompressor::CODEC_LZ4)
+    ? igtlio::ImageCompressor::CODEC_LZ4 : igtlio::ImageCompressor::CODEC_ZLIB;
+  if (igtlio::ImageCompressor::NegotiateCodec(igtlio::ImageCompressor::CODEC_AUTO, plainPeer) != igtlio::ImageCompressor::CODEC_NONE
+      || igtlio::ImageCompressor::NegotiateCodec(igtlio::ImageCompressor::CODEC_AUTO, ioPeer) != fastest
+      || igtlio::ImageCompressor::NegotiateCodec(igtlio::ImageCompressor::CODEC_ZLIB, ioPeer) != igtlio::ImageCompressor::CODEC_ZLIB)
+    {
+    std::cout << "FAILURE: wrong codec negotiated" << std::endl;
+    return 1;
+    }
+
+  //---------------------------------------------------------------------------
+  // Between OpenIGTLinkIO peers, negotiated on connection or later.
+  ClientServerFixture fixture;
+  if (!fixture.ConnectClientToServer())
+    return 1;
+  fixture.Server.Connector->SetImageCompression(igtlio::ImageCompressor::CODEC_AUTO);
+  if (!WaitForNegotiation(fixture, fastest))
+    return 1;
+
+  vtkSmartPointer<vtkImageData> image = CreateImage();
+  fixture.Server.Session->SendImage("Compressed", image, content.transform);
+  if (!WaitForPixels(fixture, "Compressed", image))
+    return 1;
+  if (fixture.Server.Connector->GetSendQueue()->GetNumberOfCompressedImages() != 1
+      || fixture.Server.Connector->GetSendQueue()->GetImageCompressionRatio() <= 1)
+    {
+    std::cout << "FAILURE: image not sent compressed" << std::endl;
+    return 1;
+    }
+
+  // Queued images are compressed by the writer thread.
+  fixture.Server.Connector->AsynchronousSendOn();
+  short* ptr = static_cast<short*>(image->GetScalarPointer());
+  ptr[0] += 1;
+  image->Modified();
+  fixture.Server.Session->SendImage("Compressed", image, content.transform);
+  if (!WaitForPixels(fixture, "Compressed", image))
+    return 1;
+  fixture.Server.Connector->AsynchronousSendOff();
+
+  fixture.Server.Connector->SetImageCompression(igtlio::ImageCompressor::CODEC_NONE);
+  if (!WaitForNegotiation(fixture, igtlio::ImageCompressor::CODEC_NONE))
+    return 1;
+
+  //---------------------------------------------------------------------------
+  // Plain IMAGE messages for peers not answering GET_CAPABIL.
+  const int port = 18955;
+  igtl::ServerSocket::Pointer server = igtl::ServerSocket::New();
+  if (server->CreateServer(port) == -1)
+    {
+    std::cout << "FAILURE: cannot create server" << std::endl;
+    return 1;
+    }
+  igtlio::ConnectorPointer connector = igtlio::ConnectorPointer::New();
+  connector->SetTypeClient("localhost", port);
+  connector->SetImageCompression(igtlio::ImageCompressor::CODEC_ZLIB);
+  connector->Start();
+  igtl::ClientSocket::Pointer socket = server->WaitForConnection(2000);
+  if (socket.IsNull())
+    {
+    std::cout << "FAILURE: no connection" << std::endl;
+    return 1;
+    }
+  igtl::MessageHeader::Pointer headerMsg = igtl::MessageHeader::New();
+  headerMsg->InitPack();
+  if (socket->Receive(headerMsg->GetPackPointer(), headerMsg->GetPackSize()) != headerMsg->GetPackSize()
+      || !(headerMsg->Unpack() & igtl::MessageHeader::UNPACK_HEADER)
+      || strcmp(headerMsg->GetDeviceType(), "GET_CAPABIL") != 0)
+    {
+    std::cout << "FAILURE: capabilities not requested" << std::endl;
+    return 1;
+    }
+
+  connector->SendImage(header, content);
+  headerMsg->InitPack();
+  if (socket->Receive(headerMsg->GetPackPointer(), headerMsg->GetPackSize()) != headerMsg->GetPackSize()
+      || !(headerMsg->Unpack() & igtl::MessageHeader::UNPACK_HEADER)
+      || strcmp(headerMsg->GetDeviceType(), "IMAGE") != 0)
+    {
+    std::cout << "FAILURE: plain IMAGE expected" << std::endl;
+    return 1;
+    }
+  igtl::ImageMessage::Pointer plain = igtl::ImageMessage::New();
+  plain->SetMessageHeader(headerMsg);
+  plain->AllocatePack();
+  if (socket->Receive(plain->GetPackBodyPointer(), plain->GetPackBodySize()) != plain->GetPackBodySize()
+      || !(plain->Unpack(1) & igtl::MessageHeader::UNPACK_BODY))
+    {
+    std::cout << "FAILURE: plain IMAGE body not received" << std::endl;
+    return 1;
+    }
+  connector->Stop();
+  socket->CloseSocket();
+  server->CloseSocket();
+
+  std::cout << "*** Image compression test successful" << std::endl;
+  return 0;
+}
@@ -0,0 +1,196 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include <igtlMessageHeader.h>
+
+#include "vtkImageData.h"
+#include "vtkMatrix4x4.h"
+#include "igtlioBufferPool.h"
+#include "igtlioImageConverter.h"
+#include "igtlioDeviceFactory.h"
+#include "igtlioPackBuffer.h"
+
+//---------------------------------------------------------------------------
+// Count the number of bytes allocated on the heap while decoding. The body
+// copy made before unpacking shows up as one allocation of the body size.
+static bool CountAllocations = false;
+static size_t AllocatedBytes = 0;
+
+#if __cplusplus >= 201103L
+# define THROW_BAD_ALLOC
+# define NO_THROW noexcept
+#else
+# define THROW_BAD_ALLOC throw(std::bad_alloc)
+# define NO_THROW throw()
+#endif
+
+void* operator new(size_t size) THROW_BAD_ALLOC
+{
+  if (CountAllocations)
+    AllocatedBytes += size;
+  void* p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size) THROW_BAD_ALLOC
+{
+  return operator new(size);
+}
+
+void operator delete(void* p) NO_THROW
+{
+  free(p);
+}
+
+void operator delete[](void* p) NO_THROW
+{
+  free(p);
+}
+
+//---------------------------------------------------------------------------
+igtl::ImageMessage::Pointer CreateImageMessage(int scalarType=VTK_UNSIGNED_CHAR)
+{
+  igtlio::ImageConverter::HeaderData header;
+  header.deviceName = "TestDevice_Image";
+  header.timestamp = 0;
+
+  igtlio::ImageConverter::ContentData content;
+  content.image = vtkSmartPointer<vtkImageData>::New();
+  content.image->SetSpacing(1.5, 1.2, 1);
+  content.image->SetExtent(0, 255, 0, 255, 0, 19);
+  content.image->AllocateScalars(scalarType, 1);
+  memset(content.image->GetScalarPointer(), 7, 256*256*20*content.image->GetScalarSize());
+  content.transform = vtkSmartPointer<vtkMatrix4x4>::New();
+  content.transform->Identity();
+
+  igtl::ImageMessage::Pointer msg;
+  igtlio::ImageConverter::toIGTL(header, content, &msg);
+  return msg;
+}
+
+//---------------------------------------------------------------------------
+// Simulate Connector::ReceiveController: unpack the header and receive the
+// body into the given buffer. Returns the number of bytes allocated by
+// ImageConverter::fromIGTL when decoding that buffer.
+size_t DecodeAllocatedBytes(igtl::ImageMessage::Pointer sent, igtl::MessageBase::Pointer buffer, igtl::MessageHeader::Pointer headerMsg,
+                            igtlio::BufferPool* pool=NULL, igtlio::ImageConverter::ContentData* decoded=NULL)
+{
+  buffer->SetMessageHeader(headerMsg);
+  if (pool)
+    pool->AllocatePack(buffer);
+  else
+    buffer->AllocatePack();
+  memcpy(buffer->GetPackBodyPointer(), sent->GetPackBodyPointer(), buffer->GetPackBodySize());
+
+  igtlio::ImageConverter::HeaderData header;
+  igtlio::ImageConverter::ContentData localContent;
+  igtlio::ImageConverter::ContentData& content = decoded ? *decoded : localContent;
+
+  AllocatedBytes = 0;
+  CountAllocations = true;
+  int r = igtlio::ImageConverter::fromIGTL(buffer, &header, &content, true);
+  CountAllocations = false;
+
+  if (!r || !content.image || content.image->GetDimensions()[2] != 20)
+    {
+    std::cout << "ERROR: failed to decode image" << std::endl;
+    exit(1);
+    }
+  return AllocatedBytes;
+}
+
+//---------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+  igtl::ImageMessage::Pointer sent = CreateImageMessage();
+
+  igtl::MessageHeader::Pointer headerMsg = igtl::MessageHeader::New();
+  headerMsg->InitPack();
+  memcpy(headerMsg->GetPackPointer(), sent->GetPackPointer(), headerMsg->GetPackSize());
+  headerMsg->Unpack();
+
+  // Old path: body received into an untyped MessageBase, copied before unpack.
+  size_t copied = DecodeAllocatedBytes(sent, igtl::MessageBase::New(), headerMsg);
+
+  // New path: body received into the message created by the device factory.
+  igtlio::DeviceFactoryPointer factory = igtlio::DeviceFactoryPointer::New();
+  igtl::MessageBase::Pointer typed = factory->CreateReceiveMessage(headerMsg);
+  size_t inPlace = DecodeAllocatedBytes(sent, typed, headerMsg);
+
+  std::cout << "body size:                         " << sent->GetPackBodySize() << std::endl;
+  std::cout << "bytes allocated per image (copy):  " << copied << std::endl;
+  std::cout << "bytes allocated per image (typed): " << inPlace << std::endl;
+
+  if (copied < inPlace + static_cast<size_t>(sent->GetPackBodySize()))
+    {
+    std::cout << "ERROR: decoding a typed receive buffer still copies the body" << std::endl;
+    return 1;
+    }
+
+  // The image adopts the pixels of the typed buffer instead of copying them.
+  if (inPlace >= static_cast<size_t>(sent->GetImageSize()))
+    {
+    std::cout << "ERROR: decoding a typed receive buffer still copies the pixels" << std::endl;
+    return 1;
+    }
+
+  // Adopted pixels go back to the pool of the connector with the image.
+  igtlio::BufferPoolPointer pool = igtlio::BufferPoolPointer::New();
+  pool->SetMinimumPooledSize(0);
+  igtlio::ImageConverter::ContentData content;
+  igtl::MessageBase::Pointer pooled = factory->CreateReceiveMessage(headerMsg);
+  DecodeAllocatedBytes(sent, pooled, headerMsg, pool, &content);
+  if (igtlio::PackBuffer::GetNumberOfAdoptedPacks() != 1 || pool->GetIdleBytes() != 0)
+    {
+    std::cout << "ERROR: pixels not adopted from the pool" << std::endl;
+    return 1;
+    }
+  unsigned char* pixels = static_cast<unsigned char*>(content.image->GetScalarPointer());
+  if (memcmp(pixels, sent->GetScalarPointer(), sent->GetImageSize()) != 0)
+    {
+    std::cout << "ERROR: adopted pixels differ" << std::endl;
+    return 1;
+    }
+  content.image = NULL;
+  if (igtlio::PackBuffer::GetNumberOfAdoptedPacks() != 0 || pool->GetIdleBytes() != pool->GetResidentBytes())
+    {
+    std::cout << "ERROR: adopted pixels not returned to the pool" << std::endl;
+    return 1;
+    }
+
+  // The next message received into the same buffer reuses them.
+  DecodeAllocatedBytes(sent, pooled, headerMsg, pool, &content);
+  if (static_cast<unsigned char*>(content.image->GetScalarPointer()) != pixels || pool->GetNumberOfMisses() != 1)
+    {
+    std::cout << "ERROR: pixels returned to the pool not reused" << std::endl;
+    return 1;
+    }
+  content.image = NULL;
+
+  // Pooled buffers are aligned for float volumes too.
+  igtl::ImageMessage::Pointer sentFloat = CreateImageMessage(VTK_FLOAT);
+  igtl::MessageHeader::Pointer floatHeaderMsg = igtl::MessageHeader::New();
+  floatHeaderMsg->InitPack();
+  memcpy(floatHeaderMsg->GetPackPointer(), sentFloat->GetPackPointer(), floatHeaderMsg->GetPackSize());
+  floatHeaderMsg->Unpack();
+  igtl::MessageBase::Pointer pooledFloat = factory->CreateReceiveMessage(floatHeaderMsg);
+  DecodeAllocatedBytes(sentFloat, pooledFloat, floatHeaderMsg, pool, &content);
+  if (igtlio::PackBuffer::GetNumberOfAdoptedPacks() != 1)
+    {
+    std::cout << "ERROR: float pixels not adopted from the pool" << std::endl;
+    return 1;
+    }
+  if (memcmp(content.image->GetScalarPointer(), sentFloat->GetScalarPointer(), sentFloat->GetImageSize()) != 0)
+    {
+    std::cout << "ERROR: adopted float pixels differ" << std::endl;
+    return 1;
+    }
+  content.image = NULL;
+
+  return 0;
+}
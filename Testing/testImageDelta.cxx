@@ -0,0 +1,272 @@
+#include <iostream>
+#include <string.h>
+#include "igtlioCircularBuffer.h"
+#include "igtlioConnector.h"
+#include "igtlioImageConverter.h"
+#include "igtlioImageDelta.h"
+#include "igtlioImageDevice.h"
+#include "igtlioLogic.h"
+#include "igtlioSession.h"
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtksys/SystemTools.hxx>
+#include "IGTLIOFixture.h"
+
+const int Width = 320;
+const int Height = 240;
+const int NumberOfPixels = Width*Height;
+
+//---------------------------------------------------------------------------
+// Pseudo random, the same on every platform.
+struct Random
+{
+  Random() : Seed(1) {}
+  unsigned int Next(unsigned int range)
+  {
+    this->Seed = this->Seed*1103515245u + 12345u;
+    return (this->Seed >> 16) % range;
+  }
+  unsigned int Seed;
+};
+
+//---------------------------------------------------------------------------
+// 8 bit speckle
+vtkSmartPointer<vtkImageData> CreateFrame()
+{
+  vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+  image->SetSpacing(0.2, 0.2, 1);
+  image->SetDimensions(Width, Height, 1);
+  image->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  unsigned char* ptr = static_cast<unsigned char*>(image->GetScalarPointer());
+  Random random;
+  for (int i=0; i<NumberOfPixels; ++i)
+    {
+    ptr[i] = static_cast<unsigned char>(random.Next(256));
+    }
+  return image;
+}
+
+//---------------------------------------------------------------------------
+// Next frame: a band of rows changes, as under a moving probe.
+void NextFrame(vtkImageData* image, Random& random)
+{
+  unsigned char* ptr = static_cast<unsigned char*>(image->GetScalarPointer());
+  int first = random.Next(Height-40);
+  for (int j=first; j<first+40; ++j)
+    {
+    for (int i=0; i<Width; ++i)
+      {
+      ptr[j*Width + i] = static_cast<unsigned char>(random.Next(256));
+      }
+    }
+  image->Modified();
+}
+
+//---------------------------------------------------------------------------
+bool SamePixels(vtkImageData* image, vtkImageData* expected)
+{
+  return image && memcmp(image->GetScalarPointer(), expected->GetScalarPointer(), NumberOfPixels) == 0;
+}
+
+//---------------------------------------------------------------------------
+// Receive a gathered message as the connector does.
+igtl::MessageBase::Pointer Receive(const igtlio::ImageConverter::GatherData& gather)
+{
+  igtl::MessageHeader::Pointer headerMsg = igtl::MessageHeader::New();
+  headerMsg->InitPack();
+  memcpy(headerMsg->GetPackPointer(), gather.header->GetPackPointer(), IGTL_HEADER_SIZE);
+  headerMsg->Unpack();
+  igtl::MessageBase::Pointer msg = igtl::MessageBase::New();
+  msg->SetMessageHeader(headerMsg);
+  msg->AllocatePack();
+  memcpy(msg->GetPackPointer(), gather.header->GetPackPointer(), gather.header->GetPackSize());
+  memcpy(static_cast<unsigned char*>(msg->GetPackPointer()) + gather.header->GetPackSize(), gather.pixels, gather.pixelSize);
+  return msg;
+}
+
+//---------------------------------------------------------------------------
+bool WaitFor(ClientServerFixture& fixture, igtlio::ImageDevicePointer* received, vtkImageData* sent)
+{
+  double starttime = vtkTimerLog::GetUniversalTime();
+  while (vtkTimerLog::GetUniversalTime() - starttime < 2)
+    {
+    fixture.Server.Logic->PeriodicProcess();
+    fixture.Client.Logic->PeriodicProcess();
+    *received = igtlio::ImageDevice::SafeDownCast(fixture.Client.Logic->GetDevice(igtlio::DeviceKeyType("IMAGE", "US")));
+    if (*received && SamePixels((*received)->GetContent().image, sent))
+      return true;
+    vtksys::SystemTools::Delay(5);
+    }
+  std::cout << "FAILURE: frame not received" << std::endl;
+  return false;
+}
+
+int main(int argc, char **argv)
+{
+  //---------------------------------------------------------------------------
+  // Delta codec
+  Random random;
+  vtkSmartPointer<vtkImageData> frame = CreateFrame();
+  std::vector<unsigned char> previous(static_cast<unsigned char*>(frame->GetScalarPointer()),
+                                      static_cast<unsigned char*>(frame->GetScalarPointer()) + NumberOfPixels);
+  std::vector<unsigned char> reconstructed = previous;
+  NextFrame(frame, random);
+  std::vector<unsigned char> delta(NumberOfPixels);
+  igtlUint64 deltaSize = 0;
+  if (!igtlio::ImageDelta::Encode(&previous[0], static_cast<unsigned char*>(frame->GetScalarPointer()), NumberOfPixels,
+                                  &delta[0], NumberOfPixels, &deltaSize)
+      || deltaSize > NumberOfPixels/4
+      || memcmp(&previous[0], frame->GetScalarPointer(), NumberOfPixels) != 0)
+    {
+    std::cout << "FAILURE: delta not encoded" << std::endl;
+    return 1;
+    }
+  if (!igtlio::ImageDelta::Apply(&delta[0], deltaSize, &reconstructed[0], NumberOfPixels)
+      || reconstructed != previous)
+    {
+    std::cout << "FAILURE: delta not applied" << std::endl;
+    return 1;
+    }
+  std::vector<unsigned char> untouched = reconstructed;
+  if (igtlio::ImageDelta::Apply(&delta[0], deltaSize, &reconstructed[0], NumberOfPixels/2)
+      || igtlio::ImageDelta::Apply(&delta[0], deltaSize-1, &reconstructed[0], NumberOfPixels)
+      || reconstructed != untouched)
+    {
+    std::cout << "FAILURE: malformed delta applied" << std::endl;
+    return 1;
+    }
+
+  //---------------------------------------------------------------------------
+  // Messages, received in place.
+  igtlio::ImageConverter::HeaderData header;
+  header.deviceName = "US";
+  header.timestamp = 0;
+  igtlio::ImageConverter::ContentData content;
+  content.image = frame;
+  content.transform = vtkSmartPointer<vtkMatrix4x4>::New();
+  content.transform->Identity();
+  content.transform->SetElement(0, 3, 12.5);
+
+  std::vector<unsigned char> last;
+  igtlio::ImageDelta::FrameInfo info;
+  info.frame = 1;
+  info.referenceFrame = 0;
+  info.keyframe = false;
+  igtlio::ImageConverter::GatherData gather;
+  if (!igtlio::ImageDelta::toIGTLGather(header, content, &last, &info, &gather) || !info.keyframe)
+    {
+    std::cout << "FAILURE: first frame is not a keyframe" << std::endl;
+    return 1;
+    }
+  // Same geometry as received from an IMAGE message
+  igtl::ImageMessage::Pointer imageMsg;
+  igtlio::ImageConverter::HeaderData receivedHeader;
+  igtlio::ImageConverter::ContentData expected;
+  igtlio::ImageConverter::toIGTL(header, content, &imageMsg);
+  igtlio::ImageConverter::fromIGTL(dynamic_pointer_cast<igtl::MessageBase>(imageMsg), &receivedHeader, &expected, true);
+  igtlio::ImageConverter::ContentData receivedContent;
+  bool sameTransform = true;
+  if (igtlio::ImageDelta::fromIGTL(Receive(gather), &receivedHeader, &receivedContent, true))
+    for (int i=0; i<4; ++i)
+      for (int j=0; j<4; ++j)
+        sameTransform = sameTransform && receivedContent.transform->GetElement(i, j) == expected.transform->GetElement(i, j);
+  if (!receivedContent.image || !SamePixels(receivedContent.image, frame) || receivedHeader.deviceName != "US" || !sameTransform)
+    {
+    std::cout << "FAILURE: keyframe not received" << std::endl;
+    return 1;
+    }
+  vtkImageData* receivedImage = receivedContent.image;
+  for (int i=2; i<10; ++i)
+    {
+    NextFrame(frame, random);
+    info.frame = i;
+    info.referenceFrame = i-1;
+    if (!igtlio::ImageDelta::toIGTLGather(header, content, &last, &info, &gather)
+        || info.keyframe || gather.pixelSize > NumberOfPixels/4)
+      {
+      std::cout << "FAILURE: frame " << i << " not sent as delta" << std::endl;
+      return 1;
+      }
+    igtl::MessageBase::Pointer msg = Receive(gather);
+    igtlio::ImageDelta::FrameInfo receivedInfo;
+    if (!igtlio::ImageDelta::GetFrameInfo(msg, &receivedInfo)
+        || receivedInfo.frame != info.frame || receivedInfo.referenceFrame != info.referenceFrame || receivedInfo.keyframe
+        || !igtlio::ImageDelta::fromIGTL(msg, &receivedHeader, &receivedContent, true)
+        || receivedContent.image.GetPointer() != receivedImage || !SamePixels(receivedImage, frame))
+      {
+      std::cout << "FAILURE: frame " << i << " not reconstructed in place" << std::endl;
+      return 1;
+      }
+    }
+
+  //---------------------------------------------------------------------------
+  // Between OpenIGTLinkIO peers, with recovery of a lost delta.
+  ClientServerFixture fixture;
+  if (!fixture.ConnectClientToServer())
+    return 1;
+  fixture.Client.Connector->SetDeliveryPolicy(std::string("IMAGE"), igtlio::CircularBuffer::DELIVER_FIFO, 100);
+
+  igtlio::ImageDevicePointer sender = fixture.Server.Session->SendImage("US", frame, content.transform);
+  sender->DeltaEncodingOn();
+  sender->SetKeyframeInterval(0); // keyframes only on request
+  igtlio::ImageDevicePointer received;
+  if (!WaitFor(fixture, &received, frame))
+    return 1;
+
+  // Sent as IMAGE until the peer answered GET_CAPABIL.
+  double starttime = vtkTimerLog::GetUniversalTime();
+  while (!fixture.Server.Connector->GetSendQueue()->GetPeerAcceptsImageDelta()
+         && vtkTimerLog::GetUniversalTime() - starttime < 2)
+    {
+    NextFrame(frame, random);
+    fixture.Server.Session->SendImage("US", frame, content.transform);
+    if (!WaitFor(fixture, &received, frame))
+      return 1;
+    }
+  if (!fixture.Server.Connector->GetSendQueue()->GetPeerAcceptsImageDelta())
+    {
+    std::cout << "FAILURE: peer does not accept deltas" << std::endl;
+    return 1;
+    }
+
+  for (int i=0; i<10; ++i)
+    {
+    NextFrame(frame, random);
+    fixture.Server.Session->SendImage("US", frame, content.transform);
+    if (!WaitFor(fixture, &received, frame))
+      return 1;
+    }
+
+  // A delta taken but never sent: the next one cannot be applied.
+  NextFrame(frame, random);
+  igtlio::ImageConverter::GatherData lost;
+  sender->GetDeltaGather(&lost);
+  NextFrame(frame, random);
+  fixture.Server.Session->SendImage("US", frame, content.transform);
+  starttime = vtkTimerLog::GetUniversalTime();
+  while (received->GetNumberOfSkippedDeltas() == 0 && vtkTimerLog::GetUniversalTime() - starttime < 2)
+    {
+    fixture.Client.Logic->PeriodicProcess();
+    vtksys::SystemTools::Delay(5);
+    }
+  if (received->GetNumberOfSkippedDeltas() != 1 || SamePixels(received->GetContent().image, frame))
+    {
+    std::cout << "FAILURE: delta of a lost frame applied" << std::endl;
+    return 1;
+    }
+
+  // The receiver asked for a keyframe with GET_IMAGE.
+  starttime = vtkTimerLog::GetUniversalTime();
+  while (vtkTimerLog::GetUniversalTime() - starttime < 0.2)
+    {
+    fixture.Server.Logic->PeriodicProcess();
+    vtksys::SystemTools::Delay(5);
+    }
+  NextFrame(frame, random);
+  fixture.Server.Session->SendImage("US", frame, content.transform);
+  if (!WaitFor(fixture, &received, frame))
+    return 1;
+
+  std::cout << "*** Image delta test successful" << std::endl;
+  return 0;
+}
@@ -0,0 +1,176 @@
+#include <iostream>
+#include <string.h>
+#include "igtlioConnector.h"
+#include "igtlioImageConverter.h"
+#include "igtlioImageDevice.h"
+#include "igtlioLogic.h"
+#include "igtlioSendQueue.h"
+#include "igtlioSession.h"
+#include <vtkCallbackCommand.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMutexLock.h>
+#include <vtksys/SystemTools.hxx>
+#include "IGTLIOFixture.h"
+
+struct SendCounter
+{
+  vtkSmartPointer<vtkMutexLock> Mutex;
+  int Sent;
+  int Dropped;
+
+  int GetSent()
+  {
+    this->Mutex->Lock();
+    int sent = this->Sent;
+    this->Mutex->Unlock();
+    return sent;
+  }
+};
+
+//---------------------------------------------------------------------------
+// Called from the writer thread for queued images.
+void OnImageDone(vtkObject* caller, unsigned long eventId, void* clientData, void* callData)
+{
+  SendCounter* counter = static_cast<SendCounter*>(clientData);
+  counter->Mutex->Lock();
+  if (eventId == igtlio::SendQueue::MessageSentEvent)
+    ++counter->Sent;
+  if (eventId == igtlio::SendQueue::MessageDroppedEvent)
+    ++counter->Dropped;
+  counter->Mutex->Unlock();
+}
+
+//---------------------------------------------------------------------------
+vtkSmartPointer<vtkImageData> CreateImage(int seed)
+{
+  vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+  image->SetSpacing(1.5, 1.2, 1);
+  image->SetExtent(0, 127, 0, 99, 0, 9);
+  image->AllocateScalars(VTK_SHORT, 1);
+  short* ptr = static_cast<short*>(image->GetScalarPointer());
+  for (int i=0; i<128*100*10; ++i)
+    {
+    ptr[i] = static_cast<short>(i*seed);
+    }
+  return image;
+}
+
+//---------------------------------------------------------------------------
+bool CheckReceived(ClientServerFixture& fixture, const std::string& name, vtkImageData* sent)
+{
+  igtlio::ImageDevicePointer device = igtlio::ImageDevice::SafeDownCast(
+    fixture.Client.Logic->GetDevice(igtlio::DeviceKeyType("IMAGE", name)));
+  if (!device || !device->GetContent().image)
+    {
+    std::cout << "FAILURE: image " << name << " not received" << std::endl;
+    return false;
+    }
+  vtkImageData* received = device->GetContent().image;
+  if (memcmp(received->GetScalarPointer(), sent->GetScalarPointer(), 128*100*10*sizeof(short)) != 0)
+    {
+    std::cout << "FAILURE: pixels of " << name << " differ" << std::endl;
+    return false;
+    }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  ClientServerFixture fixture;
+
+  igtlio::ImageConverter::HeaderData header;
+  header.deviceName = "GatheredImage";
+  header.timestamp = 0;
+  igtlio::ImageConverter::ContentData content;
+  content.image = CreateImage(3);
+  content.transform = vtkSmartPointer<vtkMatrix4x4>::New();
+  content.transform->Identity();
+  content.transform->SetElement(0, 3, 10);
+
+  //---------------------------------------------------------------------------
+  // Same bytes on the wire as the packed message.
+  igtl::ImageMessage::Pointer packed;
+  igtlio::ImageConverter::toIGTL(header, content, &packed);
+  igtlio::ImageConverter::GatherData gather;
+  if (!igtlio::ImageConverter::toIGTLGather(header, content, &gather))
+    {
+    std::cout << "FAILURE: toIGTLGather failed" << std::endl;
+    return 1;
+    }
+  int headerSize = gather.header->GetPackSize();
+  if (headerSize + gather.pixelSize != static_cast<igtlUint64>(packed->GetPackSize())
+      || memcmp(gather.header->GetPackPointer(), packed->GetPackPointer(), headerSize) != 0
+      || memcmp(gather.pixels, static_cast<char*>(packed->GetPackPointer()) + headerSize, gather.pixelSize) != 0)
+    {
+    std::cout << "FAILURE: gathered message differs from the packed one" << std::endl;
+    return 1;
+    }
+  if (gather.pixels != content.image->GetScalarPointer())
+    {
+    std::cout << "FAILURE: pixels copied" << std::endl;
+    return 1;
+    }
+
+  if (!fixture.ConnectClientToServer())
+    return 1;
+
+  SendCounter counter;
+  counter.Mutex = vtkSmartPointer<vtkMutexLock>::New();
+  counter.Sent = 0;
+  counter.Dropped = 0;
+  vtkSmartPointer<vtkCallbackCommand> callback = vtkSmartPointer<vtkCallbackCommand>::New();
+  callback->SetCallback(OnImageDone);
+  callback->SetClientData(&counter);
+
+  //---------------------------------------------------------------------------
+  // Synchronous: the image can be modified again on return.
+  if (!fixture.Server.Connector->SendImage(header, content, callback) || counter.GetSent() != 1)
+    {
+    std::cout << "FAILURE: synchronous send not reported as sent" << std::endl;
+    return 1;
+    }
+  if (!fixture.LoopUntilEventDetected(&fixture.Client, igtlio::Logic::NewDeviceEvent))
+    return 1;
+  if (!CheckReceived(fixture, "GatheredImage", content.image))
+    return 1;
+
+  //---------------------------------------------------------------------------
+  // Queued: the image is referenced until reported as sent.
+  fixture.Server.Connector->AsynchronousSendOn();
+  header.deviceName = "QueuedImage";
+  content.image = CreateImage(5);
+  if (!fixture.Server.Connector->SendImage(header, content, callback))
+    {
+    std::cout << "FAILURE: queued send rejected" << std::endl;
+    return 1;
+    }
+  content.image = NULL;
+  if (!fixture.LoopUntilEventDetected(&fixture.Client, igtlio::Logic::NewDeviceEvent, 2))
+    return 1;
+  double starttime = vtkTimerLog::GetUniversalTime();
+  while (counter.GetSent() != 2 && vtkTimerLog::GetUniversalTime() - starttime < 2)
+    {
+    vtksys::SystemTools::Delay(5);
+    }
+  if (counter.GetSent() != 2 || counter.Dropped != 0)
+    {
+    std::cout << "FAILURE: queued send not reported as sent" << std::endl;
+    return 1;
+    }
+  vtkSmartPointer<vtkImageData> expected = CreateImage(5);
+  if (!CheckReceived(fixture, "QueuedImage", expected))
+    return 1;
+
+  //---------------------------------------------------------------------------
+  // Image devices are sent the same way.
+  fixture.Server.Connector->AsynchronousSendOff();
+  fixture.Server.Session->SendImage("DeviceImage", CreateImage(7), content.transform);
+  if (!fixture.LoopUntilEventDetected(&fixture.Client, igtlio::Logic::NewDeviceEvent, 3))
+    return 1;
+  if (!CheckReceived(fixture, "DeviceImage", CreateImage(7)))
+    return 1;
+
+  std::cout << "*** Image gather test successful" << std::endl;
+  return 0;
+}
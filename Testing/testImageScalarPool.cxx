@@ -0,0 +1,150 @@
+#include <iostream>
+#include <string.h>
+
+#include <igtlImageMessage.h>
+#include <igtlMessageHeader.h>
+
+#include "igtlioImageDevice.h"
+#include "igtlioImageScalarPool.h"
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+
+//---------------------------------------------------------------------------
+// 16 bit frame in the other byte order, which the receiver copies: the
+// pixels of the message cannot be adopted.
+igtl::MessageBase::Pointer CreateSwappedMessage(int width, int height, short value)
+{
+  igtl::ImageMessage::Pointer imgMsg = igtl::ImageMessage::New();
+  imgMsg->SetDeviceName("US");
+  imgMsg->SetDimensions(width, height, 1);
+  imgMsg->SetSpacing(0.2f, 0.2f, 1.0f);
+  imgMsg->SetScalarType(igtl::ImageMessage::TYPE_INT16);
+  imgMsg->SetEndian(igtl_is_little_endian() ? igtl::ImageMessage::ENDIAN_BIG : igtl::ImageMessage::ENDIAN_LITTLE);
+  imgMsg->SetNumComponents(1);
+  int svsize[3] = { width, height, 1 };
+  int svoffset[3] = { 0, 0, 0 };
+  imgMsg->SetSubVolume(svsize, svoffset);
+  imgMsg->AllocateScalars();
+  short swapped = static_cast<short>(((value & 0xff) << 8) | ((value >> 8) & 0xff));
+  short* pixels = static_cast<short*>(imgMsg->GetScalarPointer());
+  for (int i=0; i<width*height; ++i)
+    {
+    pixels[i] = swapped;
+    }
+  imgMsg->Pack();
+
+  // Received as the connector does.
+  igtl::MessageHeader::Pointer headerMsg = igtl::MessageHeader::New();
+  headerMsg->InitPack();
+  memcpy(headerMsg->GetPackPointer(), imgMsg->GetPackPointer(), IGTL_HEADER_SIZE);
+  headerMsg->Unpack();
+  igtl::MessageBase::Pointer msg = igtl::MessageBase::New();
+  msg->SetMessageHeader(headerMsg);
+  msg->AllocatePack();
+  memcpy(msg->GetPackPointer(), imgMsg->GetPackPointer(), imgMsg->GetPackSize());
+  return msg;
+}
+
+//---------------------------------------------------------------------------
+bool HasValue(vtkImageData* image, int width, int height, short value)
+{
+  int dimensions[3];
+  image->GetDimensions(dimensions);
+  if (dimensions[0] != width || dimensions[1] != height || image->GetScalarType() != VTK_SHORT)
+    return false;
+  short* pixels = static_cast<short*>(image->GetScalarPointer());
+  for (int i=0; i<width*height; ++i)
+    if (pixels[i] != value)
+      return false;
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  //---------------------------------------------------------------------------
+  // Pool
+  igtlio::ImageScalarPoolPointer pool = igtlio::ImageScalarPoolPointer::New();
+  pool->SetMaximumNumberOfBuffers(2);
+  vtkSmartPointer<vtkDataArray> first = pool->GetScalars(VTK_FLOAT, 1, 1000);
+  void* firstData = first->GetVoidPointer(0);
+  vtkSmartPointer<vtkDataArray> second = pool->GetScalars(VTK_UNSIGNED_CHAR, 3, 1000);
+  if (pool->GetNumberOfAllocations() != 2 || pool->GetNumberOfReuses() != 0
+      || firstData == second->GetVoidPointer(0)
+      || first->GetNumberOfTuples() != 1000 || second->GetNumberOfComponents() != 3)
+    {
+    std::cout << "FAILURE: buffer in use reused" << std::endl;
+    return 1;
+    }
+
+  // Smaller, of another type, on the idle buffer.
+  first = NULL;
+  vtkSmartPointer<vtkDataArray> third = pool->GetScalars(VTK_SHORT, 1, 1500);
+  if (pool->GetNumberOfReuses() != 1 || third->GetVoidPointer(0) != firstData
+      || pool->GetAllocatedBytes() != 4000 + 3000)
+    {
+    std::cout << "FAILURE: idle buffer not reused" << std::endl;
+    return 1;
+    }
+
+  // Beyond the maximum, the idle buffers are freed.
+  vtkSmartPointer<vtkDataArray> fourth = pool->GetScalars(VTK_DOUBLE, 1, 1000);
+  if (pool->GetNumberOfAllocations() != 3 || pool->GetAllocatedBytes() != 4000 + 3000 + 8000)
+    {
+    std::cout << "FAILURE: buffers in use freed" << std::endl;
+    return 1;
+    }
+  second = NULL;
+  third = NULL;
+  vtkSmartPointer<vtkDataArray> fifth = pool->GetScalars(VTK_DOUBLE, 1, 100);
+  if (pool->GetNumberOfReuses() != 2 || pool->GetAllocatedBytes() > 4000 + 8000)
+    {
+    std::cout << "FAILURE: idle buffers not freed" << std::endl;
+    return 1;
+    }
+  fourth = NULL;
+  fifth = NULL;
+
+  //---------------------------------------------------------------------------
+  // Device receiving a stream of which the depth changes.
+  igtlio::ImageDevicePointer device = igtlio::ImageDevicePointer::New();
+  if (!device->ReceiveIGTLMessage(CreateSwappedMessage(128, 96, 1), true)
+      || !HasValue(device->GetContent().image, 128, 96, 1))
+    {
+    std::cout << "FAILURE: first frame not received" << std::endl;
+    return 1;
+    }
+  vtkImageData* image = device->GetContent().image;
+  for (int i=2; i<20; ++i)
+    {
+    int height = i%2 ? 96 : 64;
+    if (!device->ReceiveIGTLMessage(CreateSwappedMessage(128, height, i), true)
+        || device->GetContent().image.GetPointer() != image
+        || !HasValue(image, 128, height, i))
+      {
+      std::cout << "FAILURE: frame " << i << " not received in the same image" << std::endl;
+      return 1;
+      }
+    }
+  igtlio::ImageScalarPool* devicePool = device->GetScalarPool();
+  if (devicePool->GetNumberOfAllocations() != 1 || devicePool->GetNumberOfReuses() != 18)
+    {
+    std::cout << "FAILURE: scalars reallocated, " << devicePool->GetNumberOfAllocations() << " allocations, "
+              << devicePool->GetNumberOfReuses() << " reuses" << std::endl;
+    return 1;
+    }
+
+  // Scalars still used by a pipeline are left alone.
+  vtkSmartPointer<vtkDataArray> kept = image->GetPointData()->GetScalars();
+  if (!device->ReceiveIGTLMessage(CreateSwappedMessage(128, 64, 100), true)
+      || devicePool->GetNumberOfAllocations() != 2
+      || static_cast<short*>(kept->GetVoidPointer(0))[0] != 19
+      || !HasValue(image, 128, 64, 100))
+    {
+    std::cout << "FAILURE: scalars in use reused" << std::endl;
+    return 1;
+    }
+
+  std::cout << "*** Image scalar pool test successful" << std::endl;
+  return 0;
+}
@@ -0,0 +1,254 @@
+#include <iostream>
+#include <string.h>
+#include "igtlioConnector.h"
+#include "igtlioImageConverter.h"
+#include "igtlioImageDevice.h"
+#include "igtlioLogic.h"
+#include "igtlioSession.h"
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtksys/SystemTools.hxx>
+#include "IGTLIOFixture.h"
+
+const int Size[3] = {64, 48, 16};
+const int NumberOfVoxels = 64*48*16;
+
+//---------------------------------------------------------------------------
+vtkSmartPointer<vtkImageData> CreateImage(int firstI, int firstK)
+{
+  vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+  image->SetSpacing(1.5, 1.2, 1);
+  image->SetExtent(firstI, firstI+Size[0]-1, 0, Size[1]-1, firstK, firstK+Size[2]-1);
+  image->AllocateScalars(VTK_SHORT, 1);
+  short* ptr = static_cast<short*>(image->GetScalarPointer());
+  for (int i=0; i<NumberOfVoxels; ++i)
+    {
+    ptr[i] = static_cast<short>(i);
+    }
+  return image;
+}
+
+//---------------------------------------------------------------------------
+// Add value to the voxels of the extent, given from the first voxel.
+void ModifyVoxels(vtkImageData* image, const int extent[6], short value)
+{
+  short* ptr = static_cast<short*>(image->GetScalarPointer());
+  for (int k=extent[4]; k<=extent[5]; ++k)
+    for (int j=extent[2]; j<=extent[3]; ++j)
+      for (int i=extent[0]; i<=extent[1]; ++i)
+        ptr[(k*Size[1] + j)*Size[0] + i] += value;
+}
+
+//---------------------------------------------------------------------------
+bool SamePixels(vtkImageData* image, vtkImageData* expected)
+{
+  return image && memcmp(image->GetScalarPointer(), expected->GetScalarPointer(), NumberOfVoxels*sizeof(short)) == 0;
+}
+
+//---------------------------------------------------------------------------
+// Copy of the message, as received from the network.
+igtl::MessageBase::Pointer Transmit(igtl::ImageMessage::Pointer msg)
+{
+  igtl::MessageHeader::Pointer headerMsg = igtl::MessageHeader::New();
+  headerMsg->InitPack();
+  memcpy(headerMsg->GetPackPointer(), msg->GetPackPointer(), headerMsg->GetPackSize());
+  headerMsg->Unpack();
+
+  igtl::ImageMessage::Pointer received = igtl::ImageMessage::New();
+  received->SetMessageHeader(headerMsg);
+  received->AllocatePack();
+  memcpy(received->GetPackBodyPointer(), msg->GetPackBodyPointer(), received->GetPackBodySize());
+  return dynamic_pointer_cast<igtl::MessageBase>(received);
+}
+
+//---------------------------------------------------------------------------
+bool Receive(igtl::ImageMessage::Pointer msg, igtlio::ImageConverter::ContentData* content)
+{
+  igtlio::ImageConverter::HeaderData header;
+  return igtlio::ImageConverter::fromIGTL(Transmit(msg), &header, content, true) != 0;
+}
+
+//---------------------------------------------------------------------------
+bool CheckSubVolume(igtl::ImageMessage::Pointer msg, const int svsize[3], const int svoffset[3])
+{
+  int size[3];
+  int offset[3];
+  msg->GetSubVolume(size, offset);
+  for (int i=0; i<3; ++i)
+    {
+    if (size[i] != svsize[i] || offset[i] != svoffset[i])
+      {
+      std::cout << "FAILURE: sub-volume " << size[0] << "x" << size[1] << "x" << size[2]
+                << " at " << offset[0] << "," << offset[1] << "," << offset[2] << " instead of "
+                << svsize[0] << "x" << svsize[1] << "x" << svsize[2]
+                << " at " << svoffset[0] << "," << svoffset[1] << "," << svoffset[2] << std::endl;
+      return false;
+      }
+    }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+// Same bytes on the wire from the gathered and the packed message.
+bool CheckGather(const igtlio::ImageConverter::HeaderData& header, const igtlio::ImageConverter::ContentData& content,
+                 const int extent[6], bool contiguous)
+{
+  igtl::ImageMessage::Pointer packed;
+  igtlio::ImageConverter::GatherData gather;
+  if (!igtlio::ImageConverter::toIGTL(header, content, &packed, extent)
+      || !igtlio::ImageConverter::toIGTLGather(header, content, &gather, extent))
+    {
+    std::cout << "FAILURE: sub-volume conversion failed" << std::endl;
+    return false;
+    }
+  int headerSize = gather.header->GetPackSize();
+  if (headerSize + gather.pixelSize != static_cast<igtlUint64>(packed->GetPackSize())
+      || memcmp(gather.header->GetPackPointer(), packed->GetPackPointer(), headerSize) != 0
+      || memcmp(gather.pixels, static_cast<char*>(packed->GetPackPointer()) + headerSize, gather.pixelSize) != 0)
+    {
+    std::cout << "FAILURE: gathered sub-volume differs from the packed one" << std::endl;
+    return false;
+    }
+  if (contiguous != (gather.pixelOwner.GetPointer() == content.image.GetPointer()))
+    {
+    std::cout << "FAILURE: contiguous sub-volume expected " << (contiguous ? "in" : "out of") << " the image" << std::endl;
+    return false;
+    }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  igtlio::ImageConverter::HeaderData header;
+  header.deviceName = "SubVolume";
+  header.timestamp = 0;
+  igtlio::ImageConverter::ContentData content;
+  content.image = CreateImage(10, 5);
+  content.transform = vtkSmartPointer<vtkMatrix4x4>::New();
+  content.transform->Identity();
+
+  //---------------------------------------------------------------------------
+  // The receiving image is patched with the sub-volume.
+  igtl::ImageMessage::Pointer msg;
+  igtlio::ImageConverter::ContentData received;
+  if (!igtlio::ImageConverter::toIGTL(header, content, &msg) || !Receive(msg, &received))
+    {
+    std::cout << "FAILURE: whole image not received" << std::endl;
+    return 1;
+    }
+  int box[6] = {3, 40, 10, 20, 2, 6};
+  ModifyVoxels(content.image, box, 1000);
+  int boxExtent[6] = {13, 50, 10, 20, 7, 11}; // same box, in the image extent
+  if (!igtlio::ImageConverter::toIGTL(header, content, &msg, boxExtent))
+    return 1;
+  int boxSize[3] = {38, 11, 5};
+  int boxOffset[3] = {3, 10, 2};
+  if (!CheckSubVolume(msg, boxSize, boxOffset))
+    return 1;
+  if (!Receive(msg, &received) || !SamePixels(received.image, content.image))
+    {
+    std::cout << "FAILURE: image not patched by the sub-volume" << std::endl;
+    return 1;
+    }
+
+  // Clipped to the image
+  int outside[6] = {0, 100, 47, 60, 20, 30};
+  int outsideSize[3] = {64, 1, 1};
+  int outsideOffset[3] = {0, 47, 15};
+  if (!igtlio::ImageConverter::toIGTL(header, content, &msg, outside) || !CheckSubVolume(msg, outsideSize, outsideOffset))
+    return 1;
+
+  //---------------------------------------------------------------------------
+  // Contiguous sub-volumes are gathered from the image, others copied.
+  int slab[6] = {10, 73, 0, 47, 8, 12};
+  int rows[6] = {10, 73, 5, 9, 8, 8};
+  int row[6] = {20, 30, 5, 5, 8, 8};
+  if (!CheckGather(header, content, slab, true) || !CheckGather(header, content, rows, true)
+      || !CheckGather(header, content, row, true) || !CheckGather(header, content, boxExtent, false))
+    return 1;
+
+  //---------------------------------------------------------------------------
+  // Devices send the modified extent, with keyframes.
+  igtlio::ImageDevicePointer sender = igtlio::ImageDevicePointer::New();
+  sender->SetDeviceName("SubVolume");
+  sender->ComputeModifiedExtentOn();
+  sender->SetKeyframeInterval(4);
+  content.image = CreateImage(0, 0);
+  sender->SetContent(content);
+  igtlio::ImageDevicePointer receiver = igtlio::ImageDevicePointer::New();
+
+  int whole[3] = {64, 48, 16};
+  int origin[3] = {0, 0, 0};
+  for (int frame=0; frame<9; ++frame)
+    {
+    int slice[6] = {0, Size[0]-1, 0, Size[1]-1, frame, frame+1};
+    int patch[6] = {5, 9, 7, 7, frame, frame};
+    ModifyVoxels(content.image, slice, 1);
+    ModifyVoxels(content.image, patch, 1);
+    msg = dynamic_pointer_cast<igtl::ImageMessage>(sender->GetIGTLMessage());
+    bool keyframe = frame % 4 == 0;
+    int sliceSize[3] = {64, 48, 2};
+    int sliceOffset[3] = {0, 0, frame};
+    if (!CheckSubVolume(msg, keyframe ? whole : sliceSize, keyframe ? origin : sliceOffset))
+      {
+      std::cout << "FAILURE: wrong sub-volume for frame " << frame << std::endl;
+      return 1;
+      }
+    if (!receiver->ReceiveIGTLMessage(Transmit(msg), true)
+        || !SamePixels(receiver->GetContent().image, content.image))
+      {
+      std::cout << "FAILURE: frame " << frame << " not received" << std::endl;
+      return 1;
+      }
+    }
+
+  // Unmodified image: a single voxel keeps the header current.
+  int voxel[3] = {1, 1, 1};
+  msg = dynamic_pointer_cast<igtl::ImageMessage>(sender->GetIGTLMessage());
+  if (!CheckSubVolume(msg, voxel, origin))
+    return 1;
+
+  // Given extents, without comparison
+  sender->ComputeModifiedExtentOff();
+  sender->AddModifiedExtent(box);
+  msg = dynamic_pointer_cast<igtl::ImageMessage>(sender->GetIGTLMessage());
+  if (!CheckSubVolume(msg, boxSize, boxOffset))
+    return 1;
+  msg = dynamic_pointer_cast<igtl::ImageMessage>(sender->GetIGTLMessage());
+  if (!CheckSubVolume(msg, whole, origin))
+    {
+    std::cout << "FAILURE: whole image expected without modified extent" << std::endl;
+    return 1;
+    }
+
+  //---------------------------------------------------------------------------
+  // Through the session, from the pixels of the image.
+  ClientServerFixture fixture;
+  if (!fixture.ConnectClientToServer())
+    return 1;
+
+  vtkSmartPointer<vtkImageData> image = CreateImage(0, 0);
+  fixture.Server.Session->SendImage("StreamedImage", image, content.transform);
+  if (!fixture.LoopUntilEventDetected(&fixture.Client, igtlio::Logic::NewDeviceEvent))
+    return 1;
+  ModifyVoxels(image, box, 7);
+  fixture.Server.Session->SendImage("StreamedImage", image, content.transform, box);
+
+  igtlio::ImageDevicePointer device = igtlio::ImageDevice::SafeDownCast(
+    fixture.Client.Logic->GetDevice(igtlio::DeviceKeyType("IMAGE", "StreamedImage")));
+  double starttime = vtkTimerLog::GetUniversalTime();
+  while (!SamePixels(device->GetContent().image, image) && vtkTimerLog::GetUniversalTime() - starttime < 2)
+    {
+    fixture.Server.Logic->PeriodicProcess();
+    fixture.Client.Logic->PeriodicProcess();
+    vtksys::SystemTools::Delay(5);
+    }
+  if (!SamePixels(device->GetContent().image, image))
+    {
+    std::cout << "FAILURE: streamed sub-volume not received" << std::endl;
+    return 1;
+    }
+
+  std::cout << "*** Image sub-volume test successful" << std::endl;
+  return 0;
+}
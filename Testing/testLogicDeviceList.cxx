@@ -0,0 +1,52 @@
+#include <iostream>
+#include "igtlioLogic.h"
+#include "igtlioConnector.h"
+#include "igtlioDeviceFactory.h"
+#include "IGTLIOFixture.h"
+
+///
+/// The device list of Logic follows the devices added to and removed from
+/// its connectors, listing devices shared by several connectors once.
+///
+
+int main(int argc, char **argv)
+{
+  igtlio::LogicPointer logic = igtlio::LogicPointer::New();
+  igtlio::ConnectorPointer first = logic->CreateConnector();
+  igtlio::ConnectorPointer second = logic->CreateConnector();
+  igtlio::DeviceFactoryPointer factory = first->GetDeviceFactory();
+
+  igtlio::DevicePointer a = factory->create("TRANSFORM", "a");
+  igtlio::DevicePointer b = factory->create("IMAGE", "b");
+  igtlio::DevicePointer c = factory->create("STATUS", "c");
+  first->AddDevice(a);
+  first->AddDevice(b);
+  second->AddDevice(b); // shared
+  second->AddDevice(c);
+
+  CHECK(logic->GetNumberOfDevices() == 3);
+  CHECK(logic->GetDevice(0) == a && logic->GetDevice(1) == b && logic->GetDevice(2) == c);
+  CHECK(logic->GetDevices().size() == 3);
+  CHECK(logic->GetDevice(igtlio::DeviceKeyType("STATUS", "c")) == c);
+  CHECK(!logic->GetDevice(igtlio::DeviceKeyType("STATUS", "a")));
+
+  // Still held by the second connector.
+  first->RemoveDevice(b);
+  CHECK(logic->GetNumberOfDevices() == 3);
+
+  // Removed from every connector.
+  logic->RemoveDevice(0);
+  CHECK(logic->GetNumberOfDevices() == 2);
+  CHECK(first->GetNumberOfDevices() == 0);
+  CHECK(logic->GetDevice(0) == b && logic->GetDevice(1) == c);
+  CHECK(logic->GetDevice(igtlio::DeviceKeyType("IMAGE", "b")) == b);
+  CHECK(!logic->GetDevice(igtlio::DeviceKeyType("TRANSFORM", "a")));
+
+  // Devices of a removed connector disappear.
+  logic->RemoveConnector(1);
+  CHECK(logic->GetNumberOfDevices() == 0);
+  CHECK(!logic->GetDevice(igtlio::DeviceKeyType("STATUS", "c")));
+
+  std::cout << "*** Logic device list test successful" << std::endl;
+  return 0;
+}
@@ -0,0 +1,77 @@
+#include <string>
+#include "igtlioLogic.h"
+#include "igtlioConnector.h"
+#include "vtkTimerLog.h"
+#include "vtkMatrix4x4.h"
+#include <vtksys/SystemTools.hxx>
+#include "IGTLIOFixture.h"
+#include "igtlioSession.h"
+#include "igtlioTransformDevice.h"
+
+//---------------------------------------------------------------------------
+// Process all logics until the condition holds, or timeout.
+#define LOOP_UNTIL(condition)                                           \
+  {                                                                     \
+  double starttime = vtkTimerLog::GetUniversalTime();                   \
+  while (!(condition) && vtkTimerLog::GetUniversalTime() - starttime < 2) \
+    {                                                                   \
+    serverLogic->PeriodicProcess();                                     \
+    clientA.Logic->PeriodicProcess();                                   \
+    clientB.Logic->PeriodicProcess();                                   \
+    vtksys::SystemTools::Delay(5);                                      \
+    }                                                                   \
+  if (!(condition))                                                     \
+    {                                                                   \
+    std::cout << "FAILURE: timeout waiting for " #condition << std::endl; \
+    return 1;                                                           \
+    }                                                                   \
+  }
+
+int main(int argc, char **argv)
+{
+  igtlio::LogicPointer serverLogic = igtlio::LogicPointer::New();
+  igtlio::ConnectorPointer server = serverLogic->CreateConnector();
+  server->SetTypeServer(server->GetServerPort());
+  server->SetMaximumNumberOfClients(3);
+  server->Start();
+
+  igtlio::vtkIGTLIOSessionPointer serverSession = igtlio::vtkIGTLIOSessionPointer::New();
+  serverSession->SetConnector(server);
+
+  LogicFixture clientA;
+  LogicFixture clientB;
+  clientA.startClient();
+  clientB.startClient();
+
+  LOOP_UNTIL(server->GetNumberOfClients() == 2);
+  std::cout << "*** Two clients connected" << std::endl;
+
+  //---------------------------------------------------------------------------
+  // Server output is broadcast to all clients.
+  serverSession->SendTransform("TestDevice_Server", vtkSmartPointer<vtkMatrix4x4>::New());
+
+  LOOP_UNTIL(clientA.Logic->GetNumberOfDevices() == 1 && clientB.Logic->GetNumberOfDevices() == 1);
+  std::cout << "*** Broadcast received by both clients" << std::endl;
+
+  //---------------------------------------------------------------------------
+  // Messages from all clients are received.
+  clientA.Session->SendTransform("TestDevice_ClientA", vtkSmartPointer<vtkMatrix4x4>::New());
+  clientB.Session->SendTransform("TestDevice_ClientB", vtkSmartPointer<vtkMatrix4x4>::New());
+
+  LOOP_UNTIL(serverLogic->GetNumberOfDevices() == 3);
+  std::cout << "*** Server received from both clients" << std::endl;
+
+  //---------------------------------------------------------------------------
+  // A disconnecting client does not affect the others.
+  clientA.Connector->Stop();
+
+  LOOP_UNTIL(server->GetNumberOfClients() == 1);
+  if (server->GetState() != igtlio::Connector::STATE_CONNECTED)
+    {
+    std::cout << "FAILURE: server not connected to the remaining client" << std::endl;
+    return 1;
+    }
+
+  server->Stop();
+  return 0;
+}
@@ -0,0 +1,237 @@
+#include <iostream>
+#include <string.h>
+
+#include <igtlMessageHeader.h>
+
+#include "igtlioDeviceFactory.h"
+#include "igtlioPolyDataDevice.h"
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkIdList.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include "IGTLIOFixture.h"
+
+///
+/// Stream a deforming surface between two POLYDATA devices: the cells
+/// are only converted when the topology changes.
+///
+
+const int Size = 10;
+
+//---------------------------------------------------------------------------
+// Grid of Size x Size quads, displaced along z by frame, with point normals.
+vtkSmartPointer<vtkPolyData> CreateSurface()
+{
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  points->SetDataTypeToFloat();
+  vtkSmartPointer<vtkFloatArray> normals = vtkSmartPointer<vtkFloatArray>::New();
+  normals->SetName("Normals");
+  normals->SetNumberOfComponents(3);
+  for (int j=0; j<=Size; ++j)
+    {
+    for (int i=0; i<=Size; ++i)
+      {
+      points->InsertNextPoint(i, j, 0);
+      normals->InsertNextTuple3(0, 0, 1);
+      }
+    }
+  vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+  for (int j=0; j<Size; ++j)
+    {
+    for (int i=0; i<Size; ++i)
+      {
+      vtkIdType p0 = j*(Size+1) + i;
+      vtkIdType quad[4] = { p0, p0+1, p0+Size+2, p0+Size+1 };
+      polys->InsertNextCell(4, quad);
+      }
+    }
+  vtkSmartPointer<vtkPolyData> poly = vtkSmartPointer<vtkPolyData>::New();
+  poly->SetPoints(points);
+  poly->SetPolys(polys);
+  poly->GetPointData()->AddArray(normals);
+  return poly;
+}
+
+//---------------------------------------------------------------------------
+void Deform(vtkPolyData* poly, int frame)
+{
+  vtkPoints* points = poly->GetPoints();
+  for (vtkIdType i=0; i<points->GetNumberOfPoints(); ++i)
+    {
+    double p[3];
+    points->GetPoint(i, p);
+    points->SetPoint(i, p[0], p[1], 0.5*frame + 0.01*i);
+    }
+  points->Modified();
+}
+
+//---------------------------------------------------------------------------
+// Received as the connector does, in the message created by the factory.
+igtlio::DeviceFactoryPointer Factory;
+
+igtl::MessageBase::Pointer Receive(igtl::MessageBase::Pointer sent)
+{
+  igtl::MessageHeader::Pointer headerMsg = igtl::MessageHeader::New();
+  headerMsg->InitPack();
+  memcpy(headerMsg->GetPackPointer(), sent->GetPackPointer(), IGTL_HEADER_SIZE);
+  headerMsg->Unpack();
+  igtl::MessageBase::Pointer msg = Factory->CreateReceiveMessage(
+        dynamic_pointer_cast<igtl::MessageBase>(headerMsg));
+  msg->SetMessageHeader(headerMsg);
+  msg->AllocatePack();
+  memcpy(msg->GetPackPointer(), sent->GetPackPointer(), sent->GetPackSize());
+  return msg;
+}
+
+//---------------------------------------------------------------------------
+bool SameCells(vtkCellArray* a, vtkCellArray* b)
+{
+  if (a->GetNumberOfCells() != b->GetNumberOfCells())
+    return false;
+  vtkSmartPointer<vtkIdList> ids[2] = { vtkSmartPointer<vtkIdList>::New(), vtkSmartPointer<vtkIdList>::New() };
+  a->InitTraversal();
+  b->InitTraversal();
+  while (a->GetNextCell(ids[0]))
+    {
+    if (!b->GetNextCell(ids[1]) || ids[0]->GetNumberOfIds() != ids[1]->GetNumberOfIds())
+      return false;
+    for (vtkIdType i=0; i<ids[0]->GetNumberOfIds(); ++i)
+      if (ids[0]->GetId(i) != ids[1]->GetId(i))
+        return false;
+    }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool SamePoints(vtkPolyData* a, vtkPolyData* b)
+{
+  if (a->GetNumberOfPoints() != b->GetNumberOfPoints())
+    return false;
+  for (vtkIdType i=0; i<a->GetNumberOfPoints(); ++i)
+    {
+    double p[3], q[3];
+    a->GetPoints()->GetPoint(i, p);
+    b->GetPoints()->GetPoint(i, q);
+    if (p[0] != q[0] || p[1] != q[1] || p[2] != q[2])
+      return false;
+    }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+// A cell declaring more points than are left once the counts of the
+// following cells are reserved is rejected, instead of overflowing.
+int TestInflatedCell()
+{
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  for (int i=0; i<5; ++i)
+    {
+    points->InsertNextPoint(i, 0, 0);
+    }
+  vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+  vtkIdType quad[4] = { 0, 1, 2, 3 };
+  vtkIdType single[1] = { 4 };
+  polys->InsertNextCell(4, quad);
+  polys->InsertNextCell(1, single);
+  polys->InsertNextCell(1, single);
+  igtlio::PolyDataConverter::MessageContent content;
+  content.polydata = vtkSmartPointer<vtkPolyData>::New();
+  content.polydata->SetPoints(points);
+  content.polydata->SetPolys(polys);
+  content.deviceName = "Malformed";
+
+  igtlio::PolyDataDevicePointer sender = igtlio::PolyDataDevicePointer::New();
+  sender->SetContent(content);
+  sender->SetDeviceName("Malformed");
+  igtl::MessageBase::Pointer msg = Receive(sender->GetIGTLMessage());
+
+  // The first cell, as packed: its count then its ids.
+  const unsigned char cell[20] = { 0,0,0,4, 0,0,0,0, 0,0,0,1, 0,0,0,2, 0,0,0,3 };
+  unsigned char* pack = static_cast<unsigned char*>(msg->GetPackPointer());
+  unsigned char* found = NULL;
+  for (int i=IGTL_HEADER_SIZE; i+20<=msg->GetPackSize() && !found; ++i)
+    {
+    if (memcmp(pack + i, cell, 20) == 0)
+      found = pack + i;
+    }
+  CHECK(found != NULL);
+
+  // 7 points: within the section, but not within the 6 ids of the cells.
+  found[3] = 7;
+  igtlio::PolyDataConverter::MessageContent decoded;
+  CHECK(!igtlio::PolyDataConverter::IGTLToVTK(msg, &decoded, false));
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  Factory = igtlio::DeviceFactoryPointer::New();
+  igtlio::DevicePointer created = Factory->create("POLYDATA", "Liver");
+  CHECK(igtlio::PolyDataDevice::SafeDownCast(created) != NULL);
+
+  igtlio::PolyDataDevicePointer sender = igtlio::PolyDataDevicePointer::New();
+  igtlio::PolyDataDevicePointer receiver = igtlio::PolyDataDevicePointer::New();
+  igtlio::PolyDataConverter::MessageContent content;
+  content.polydata = CreateSurface();
+  content.deviceName = "Liver";
+  sender->SetContent(content);
+  sender->SetDeviceName("Liver");
+
+  //---------------------------------------------------------------------------
+  // First frame
+  CHECK(receiver->ReceiveIGTLMessage(Receive(sender->GetIGTLMessage()), true));
+  CHECK(sender->GetNumberOfCellsKept() == 0 && receiver->GetNumberOfCellsKept() == 0);
+  vtkPolyData* received = receiver->GetContent().polydata;
+  CHECK(received && receiver->GetDeviceName() == "Liver");
+  CHECK(SamePoints(received, content.polydata) && SameCells(received->GetPolys(), content.polydata->GetPolys()));
+  vtkCellArray* polys = received->GetPolys();
+  vtkPoints* points = received->GetPoints();
+  vtkDataArray* normals = received->GetPointData()->GetArray("Normals");
+  vtkMTimeType polysTime = polys->GetMTime();
+
+  //---------------------------------------------------------------------------
+  // Deforming surface: the points are updated in place.
+  for (int frame=1; frame<=5; ++frame)
+    {
+    Deform(content.polydata, frame);
+    vtkMTimeType pointsTime = points->GetMTime();
+    CHECK(receiver->ReceiveIGTLMessage(Receive(sender->GetIGTLMessage()), true));
+    CHECK(sender->GetNumberOfCellsKept() == frame && receiver->GetNumberOfCellsKept() == frame);
+    CHECK(receiver->GetContent().polydata.GetPointer() == received);
+    CHECK(received->GetPolys() == polys && polys->GetMTime() == polysTime);
+    CHECK(received->GetPoints() == points && points->GetMTime() > pointsTime);
+    CHECK(received->GetPointData()->GetArray("Normals") == normals);
+    CHECK(SamePoints(received, content.polydata) && SameCells(polys, content.polydata->GetPolys()));
+    }
+
+  // The cells kept in the sent message are the ones of the polydata.
+  igtlio::PolyDataConverter::MessageContent decoded;
+  CHECK(igtlio::PolyDataConverter::IGTLToVTK(Receive(sender->GetIGTLMessage()), &decoded, true));
+  CHECK(SamePoints(decoded.polydata, content.polydata) && SameCells(decoded.polydata->GetPolys(), polys));
+
+  //---------------------------------------------------------------------------
+  // Topology change
+  vtkIdType triangle[3] = { 0, 1, Size+1 };
+  content.polydata->GetPolys()->InsertNextCell(3, triangle);
+  content.polydata->GetPolys()->Modified();
+  int kept = sender->GetNumberOfCellsKept();
+  CHECK(receiver->ReceiveIGTLMessage(Receive(sender->GetIGTLMessage()), true));
+  CHECK(sender->GetNumberOfCellsKept() == kept && receiver->GetNumberOfCellsKept() == kept);
+  CHECK(receiver->GetContent().polydata.GetPointer() == received);
+  CHECK(received->GetNumberOfCells() == Size*Size + 1);
+  CHECK(SameCells(received->GetPolys(), content.polydata->GetPolys()));
+
+  // Then kept again.
+  Deform(content.polydata, 6);
+  CHECK(receiver->ReceiveIGTLMessage(Receive(sender->GetIGTLMessage()), true));
+  CHECK(sender->GetNumberOfCellsKept() == kept+1 && receiver->GetNumberOfCellsKept() == kept+1);
+  CHECK(SamePoints(received, content.polydata));
+
+  CHECK(TestInflatedCell() == 0);
+
+  Factory = NULL;
+  std::cout << "*** PolyData device test successful" << std::endl;
+  return 0;
+}
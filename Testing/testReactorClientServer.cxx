@@ -0,0 +1,112 @@
+#include <string>
+#include "igtlioLogic.h"
+#include "igtlioConnector.h"
+#include "vtkTimerLog.h"
+#include "vtkImageData.h"
+#include "vtkMatrix4x4.h"
+#include <vtksys/SystemTools.hxx>
+#include "IGTLIOFixture.h"
+#include "igtlioSession.h"
+#include "igtlioImageCompressor.h"
+#include "igtlioImageDevice.h"
+#include "igtlioTransformDevice.h"
+
+int main(int argc, char **argv)
+{
+  ClientServerFixture fixture;
+
+  // Both ends receive on a shared I/O thread instead of one thread per connector.
+  fixture.Server.Logic->SetNumberOfIOThreads(1);
+  fixture.Client.Logic->SetNumberOfIOThreads(2);
+
+  if (fixture.Client.Logic->GetNumberOfIOThreads() != 2)
+  {
+    std::cout << "Reactor not available on this platform, skipping." << std::endl;
+    return 0;
+  }
+
+  if (!fixture.ConnectClientToServer())
+    return 1;
+
+  std::cout << "*** Connection done" << std::endl;
+
+  //---------------------------------------------------------------------------
+  fixture.Server.Session->SendTransform("TestDevice_Transform", fixture.CreateTestTransform());
+  fixture.Server.Session->SendImage("TestDevice_Image",
+                                    fixture.CreateTestImage(),
+                                    fixture.CreateTestTransform());
+  std::cout << "*** Sent messages from Server to Client" << std::endl;
+
+  if (!fixture.LoopUntilEventDetected(&fixture.Client, igtlio::Logic::NewDeviceEvent, 2))
+  {
+    return 1;
+  }
+
+  if (fixture.Client.Logic->GetNumberOfDevices() != 2)
+  {
+    std::cout << "FAILURE: wrong number of devices in client: "
+              << fixture.Client.Logic->GetNumberOfDevices() << std::endl;
+    return 1;
+  }
+
+  //---------------------------------------------------------------------------
+  // Compressed images are decompressed by the main thread of the client,
+  // once the reactor thread queued the reply to GET_CAPABIL.
+  fixture.Server.Connector->SetImageCompression(igtlio::ImageCompressor::CODEC_ZLIB);
+  vtkSmartPointer<vtkImageData> compressedImage = fixture.CreateTestImage();
+  unsigned char* pixels = static_cast<unsigned char*>(compressedImage->GetScalarPointer());
+  pixels[0] = 42;
+  bool decompressed = false;
+  bool sent = false;
+  double sendtime = vtkTimerLog::GetUniversalTime();
+  while (!decompressed && vtkTimerLog::GetUniversalTime() - sendtime < 2)
+  {
+    fixture.Server.Logic->PeriodicProcess();
+    fixture.Client.Logic->PeriodicProcess();
+    if (!sent && fixture.Server.Connector->GetNegotiatedImageCompression() == igtlio::ImageCompressor::CODEC_ZLIB)
+    {
+      fixture.Server.Session->SendImage("TestDevice_Image", compressedImage, fixture.CreateTestTransform());
+      sent = true;
+    }
+    igtlio::ImageDevicePointer device = igtlio::ImageDevice::SafeDownCast(
+      fixture.Client.Logic->GetDevice(igtlio::DeviceKeyType("IMAGE", "TestDevice_Image")));
+    decompressed = device && static_cast<unsigned char*>(device->GetContent().image->GetScalarPointer())[0] == 42;
+    vtksys::SystemTools::Delay(5);
+  }
+
+  if (!decompressed || fixture.Server.Connector->GetSendQueue()->GetNumberOfCompressedImages() != 1)
+  {
+    std::cout << "FAILURE: compressed image not received by the reactor" << std::endl;
+    return 1;
+  }
+
+  //---------------------------------------------------------------------------
+  // The client reconnects after the server restarts.
+  fixture.Server.Connector->Stop();
+  fixture.Server.Connector->Start();
+
+  double starttime = vtkTimerLog::GetUniversalTime();
+  bool reconnected = false;
+  while (vtkTimerLog::GetUniversalTime() - starttime < 2)
+  {
+    fixture.Server.Logic->PeriodicProcess();
+    fixture.Client.Logic->PeriodicProcess();
+    vtksys::SystemTools::Delay(5);
+
+    if (fixture.Server.Connector->GetState() == igtlio::Connector::STATE_CONNECTED)
+    {
+      reconnected = true;
+      break;
+    }
+  }
+
+  if (!reconnected)
+  {
+    std::cout << "FAILURE: client did not reconnect" << std::endl;
+    return 1;
+  }
+
+  std::cout << "*** Reconnected" << std::endl;
+
+  return 0;
+}
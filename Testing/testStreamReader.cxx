@@ -0,0 +1,110 @@
+#include <iostream>
+#include <vector>
+#include "igtlioStreamReader.h"
+#include <igtlServerSocket.h>
+#include <igtlClientSocket.h>
+#include <igtlMessageHeader.h>
+#include <igtlTransformMessage.h>
+
+int main(int argc, char **argv)
+{
+  const int port = 18950;
+  igtl::ServerSocket::Pointer server = igtl::ServerSocket::New();
+  if (server->CreateServer(port) == -1)
+    {
+    std::cout << "FAILURE: cannot create server" << std::endl;
+    return 1;
+    }
+  igtl::ClientSocket::Pointer client = igtl::ClientSocket::New();
+  if (client->ConnectToServer("localhost", port) != 0)
+    {
+    std::cout << "FAILURE: cannot connect" << std::endl;
+    return 1;
+    }
+  igtl::ClientSocket::Pointer socket = server->WaitForConnection(1000);
+  if (socket.IsNull())
+    {
+    std::cout << "FAILURE: no connection" << std::endl;
+    return 1;
+    }
+
+  //---------------------------------------------------------------------------
+  // Many small messages sent at once are framed out of a few receives.
+  const int numberOfMessages = 100;
+  std::vector<unsigned char> stream;
+  for (int i=0; i<numberOfMessages; ++i)
+    {
+    igtl::TransformMessage::Pointer msg = igtl::TransformMessage::New();
+    msg->SetDeviceName("Tool");
+    msg->Pack();
+    unsigned char* ptr = static_cast<unsigned char*>(msg->GetPackPointer());
+    stream.insert(stream.end(), ptr, ptr + msg->GetPackSize());
+    }
+  client->Send(&stream[0], stream.size());
+
+  igtlio::StreamReader reader;
+  reader.SetSocket(socket);
+
+  igtl::MessageHeader::Pointer header = igtl::MessageHeader::New();
+  for (int i=0; i<numberOfMessages; ++i)
+    {
+    header->InitPack();
+    if (reader.Read(header->GetPackPointer(), header->GetPackSize()) != header->GetPackSize()
+        || !(header->Unpack() & igtl::MessageHeader::UNPACK_HEADER))
+      {
+      std::cout << "FAILURE: header " << i << " not received" << std::endl;
+      return 1;
+      }
+    igtl::TransformMessage::Pointer body = igtl::TransformMessage::New();
+    body->SetMessageHeader(header);
+    body->AllocatePack();
+    if (reader.Read(body->GetPackBodyPointer(), body->GetPackBodySize()) != body->GetPackBodySize()
+        || !(body->Unpack(1) & igtl::MessageHeader::UNPACK_BODY))
+      {
+      std::cout << "FAILURE: body " << i << " not received" << std::endl;
+      return 1;
+      }
+    }
+  std::cout << numberOfMessages << " messages in " << reader.GetNumberOfReceiveCalls() << " receives" << std::endl;
+  if (reader.GetNumberOfReceiveCalls() >= static_cast<unsigned long>(numberOfMessages))
+    {
+    std::cout << "FAILURE: messages were not read ahead" << std::endl;
+    return 1;
+    }
+
+  //---------------------------------------------------------------------------
+  // Large reads go directly to their destination.
+  std::vector<unsigned char> large(1 << 18); // fits in the socket buffers
+  for (size_t i=0; i<large.size(); ++i)
+    large[i] = static_cast<unsigned char>(i);
+  client->Send(&large[0], large.size());
+
+  std::vector<unsigned char> received(large.size());
+  if (reader.Read(&received[0], received.size()) != static_cast<int>(received.size())
+      || received != large)
+    {
+    std::cout << "FAILURE: large block not received" << std::endl;
+    return 1;
+    }
+  if (reader.GetNumberOfDirectReads() == 0)
+    {
+    std::cout << "FAILURE: large block was not read directly" << std::endl;
+    return 1;
+    }
+
+  //---------------------------------------------------------------------------
+  // A message cut by a closed connection is reported as a short read.
+  client->Send(&stream[0], 20);
+  client->CloseSocket();
+  header->InitPack();
+  if (reader.Read(header->GetPackPointer(), header->GetPackSize()) == header->GetPackSize())
+    {
+    std::cout << "FAILURE: truncated header not detected" << std::endl;
+    return 1;
+    }
+
+  socket->CloseSocket();
+  server->CloseSocket();
+  std::cout << "*** Stream reader test successful" << std::endl;
+  return 0;
+}
@@ -0,0 +1,145 @@
+#include <iostream>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <igtlMessageHeader.h>
+#include <igtlTransformMessage.h>
+
+#include "igtlioTransformDevice.h"
+#include <vtkMatrix4x4.h>
+#include "IGTLIOFixture.h"
+
+///
+/// Receive a stream of transforms into a device, counting the heap
+/// allocations: there must be none once the first ones were received.
+///
+
+#if __cplusplus >= 201103L
+# define THROW_BAD_ALLOC
+# define NO_THROW noexcept
+#else
+# define THROW_BAD_ALLOC throw(std::bad_alloc)
+# define NO_THROW throw()
+#endif
+
+//---------------------------------------------------------------------------
+// Allocations made with new, by this test and the libraries it uses.
+static long Allocations = 0;
+
+void* operator new(std::size_t size) THROW_BAD_ALLOC
+{
+  ++Allocations;
+  void* p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](std::size_t size) THROW_BAD_ALLOC
+{
+  return operator new(size);
+}
+
+void operator delete(void* p) NO_THROW
+{
+  free(p);
+}
+
+void operator delete[](void* p) NO_THROW
+{
+  free(p);
+}
+
+const int NumberOfMessages = 16;
+const int NumberOfFrames = 10000;
+
+//---------------------------------------------------------------------------
+// Received as the connector does, into a message of the concrete type or not.
+igtl::MessageBase::Pointer CreateMessage(int i, bool typed)
+{
+  igtl::TransformMessage::Pointer transformMsg = igtl::TransformMessage::New();
+  transformMsg->SetDeviceName("Stylus");
+  transformMsg->SetTimeStamp(100 + i, 0);
+  igtl::Matrix4x4 matrix;
+  igtl::IdentityMatrix(matrix);
+  matrix[0][3] = static_cast<float>(i);
+  matrix[1][3] = 2.0f*i;
+  matrix[0][1] = 0.5f;
+  transformMsg->SetMatrix(matrix);
+  transformMsg->Pack();
+
+  igtl::MessageHeader::Pointer headerMsg = igtl::MessageHeader::New();
+  headerMsg->InitPack();
+  memcpy(headerMsg->GetPackPointer(), transformMsg->GetPackPointer(), IGTL_HEADER_SIZE);
+  headerMsg->Unpack();
+  igtl::MessageBase::Pointer msg;
+  if (typed)
+    msg = dynamic_pointer_cast<igtl::MessageBase>(igtl::TransformMessage::New());
+  else
+    msg = igtl::MessageBase::New();
+  msg->SetMessageHeader(headerMsg);
+  msg->AllocatePack();
+  memcpy(msg->GetPackPointer(), transformMsg->GetPackPointer(), transformMsg->GetPackSize());
+  return msg;
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<igtl::MessageBase::Pointer> messages;
+  for (int i=0; i<NumberOfMessages; ++i)
+    {
+    messages.push_back(CreateMessage(i, i%2 == 0));
+    }
+
+  igtlio::TransformDevicePointer device = igtlio::TransformDevicePointer::New();
+  device->SetDeviceName("Stylus");
+
+  // The matrix of the caller is copied, not received into.
+  igtlio::TransformConverter::ContentData initial;
+  initial.deviceName = "Stylus";
+  initial.transform = vtkSmartPointer<vtkMatrix4x4>::New();
+  initial.transform->Identity();
+  device->SetContent(initial);
+  CHECK(device->GetContent().transform.GetPointer() != initial.transform.GetPointer());
+
+  // The matrices of the content and the snapshots are created first.
+  for (int i=0; i<NumberOfMessages; ++i)
+    {
+    CHECK(device->ReceiveIGTLMessage(messages[i], true));
+    }
+  vtkMatrix4x4* matrix = device->GetContent().transform;
+
+  long before = Allocations;
+  for (int frame=0; frame<NumberOfFrames; ++frame)
+    {
+    if (!device->ReceiveIGTLMessage(messages[frame%NumberOfMessages], true))
+      {
+      std::cout << "FAILURE: frame " << frame << " not received" << std::endl;
+      return 1;
+      }
+    }
+  long allocations = Allocations - before;
+  std::cout << "allocations for " << NumberOfFrames << " transforms: " << allocations << std::endl;
+  CHECK(allocations == 0);
+
+  // Last frame received, in the same matrix.
+  int last = (NumberOfFrames-1)%NumberOfMessages;
+  igtlio::TransformConverter::ContentData content = device->GetContent();
+  CHECK(content.transform.GetPointer() == matrix);
+  CHECK(initial.transform->GetElement(0, 3) == 0 && initial.transform->GetElement(0, 1) == 0);
+  CHECK(content.transform->GetElement(0, 3) == last && content.transform->GetElement(1, 3) == 2*last);
+  CHECK(content.transform->GetElement(0, 1) == 0.5 && content.transform->GetElement(1, 0) == 0);
+  CHECK(content.transform->GetElement(3, 3) == 1 && content.deviceName == "Stylus");
+  CHECK(device->GetHeader().timestamp == 100 + last);
+  CHECK(device->GetSnapshot().GetContent().transform->GetElement(0, 3) == last);
+
+  // Corrupted messages are rejected, leaving the content unchanged.
+  static_cast<unsigned char*>(messages[0]->GetPackBodyPointer())[0] ^= 0xff;
+  CHECK(!device->ReceiveIGTLMessage(messages[0], true));
+  CHECK(content.transform->GetElement(0, 3) == last);
+
+  std::cout << "*** Transform allocations test successful" << std::endl;
+  return 0;
+}
@@ -0,0 +1,59 @@
+#include <iostream>
+#include "igtlioLogic.h"
+#include "igtlioConnector.h"
+#include "igtlioSession.h"
+#include "igtlioWaitHandle.h"
+#include "vtkTimerLog.h"
+#include "vtkMatrix4x4.h"
+#include "IGTLIOFixture.h"
+
+///
+/// Wait on the handle of the client Logic instead of polling:
+/// it is signaled when a message is received, and cleared by
+/// PeriodicProcess().
+///
+
+int main(int argc, char **argv)
+{
+  //---------------------------------------------------------------------------
+  // Handle alone: signals reach the parent, and stay until cleared.
+  igtlio::WaitHandlePointer parent = igtlio::WaitHandlePointer::New();
+  igtlio::WaitHandlePointer handle = igtlio::WaitHandlePointer::New();
+  handle->SetParent(parent);
+  CHECK(handle->Wait(0.01) == 0);
+  handle->Signal();
+  handle->Signal();
+  CHECK(handle->Wait(0) == 1);
+  CHECK(parent->Wait(0) == 1);
+  handle->Clear();
+  CHECK(handle->Wait(0.01) == 0);
+  CHECK(parent->IsSignaled());
+
+  //---------------------------------------------------------------------------
+  // Logic: woken up by the received message.
+  ClientServerFixture fixture;
+  if (!fixture.ConnectClientToServer())
+    return 1;
+
+  igtlio::WaitHandlePointer logicHandle = fixture.Client.Logic->GetWaitHandle();
+#if !defined(_WIN32)
+  CHECK(logicHandle->GetDescriptor() >= 0);
+#endif
+  fixture.Server.Session->SendTransform("WakeUp", vtkSmartPointer<vtkMatrix4x4>::New());
+
+  // Other events may wake us up first, e.g. from the connection.
+  double starttime = vtkTimerLog::GetUniversalTime();
+  while (fixture.Client.Logic->GetNumberOfDevices() == 0
+         && vtkTimerLog::GetUniversalTime() - starttime < 2)
+    {
+    if (logicHandle->Wait(2))
+      {
+      fixture.Client.Logic->PeriodicProcess();
+      }
+    }
+  std::cout << "woken up after " << (vtkTimerLog::GetUniversalTime() - starttime)*1000 << " ms" << std::endl;
+  CHECK(fixture.Client.Logic->GetNumberOfDevices() == 1);
+
+  std::cout << "*** Wait handle test successful" << std::endl;
+  return 0;
+}